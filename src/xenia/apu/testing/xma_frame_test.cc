@@ -0,0 +1,144 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/apu/xma_helpers.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "third_party/catch/include/catch.hpp"
+
+#include "xenia/base/bit_stream.h"
+
+namespace xe {
+namespace apu {
+namespace test {
+
+constexpr uint32_t kBytesPerPacket = 2048;
+constexpr uint32_t kBytesPerPacketHeader = 4;
+constexpr uint32_t kBytesPerPacketData =
+    kBytesPerPacket - kBytesPerPacketHeader;
+constexpr uint32_t kBitsPerPacket = kBytesPerPacket * 8;
+constexpr uint32_t kBitsPerPacketHeader = 32;
+
+using FrameBuffer = std::array<uint8_t, 4096>;
+
+// Reference - staging the data of the packets in a buffer like XmaContextNew
+// did before copying frames directly from the packets.
+static uint32_t CopyFrameStaged(const uint8_t* packet,
+                                const uint8_t* next_packet,
+                                uint32_t frame_offset, uint32_t frame_size,
+                                uint8_t* frame_out) {
+  std::array<uint8_t, kBytesPerPacketData * 2> input_buffer = {};
+  if (next_packet) {
+    std::memcpy(input_buffer.data() + kBytesPerPacketData,
+                next_packet + kBytesPerPacketHeader, kBytesPerPacketData);
+  }
+  std::memcpy(input_buffer.data(), packet + kBytesPerPacketHeader,
+              kBytesPerPacketData);
+  BitStream stream(input_buffer.data(),
+                   (kBitsPerPacket - kBitsPerPacketHeader) * 2);
+  stream.SetOffset(frame_offset - kBitsPerPacketHeader);
+  return uint32_t(stream.Copy(frame_out, frame_size));
+}
+
+static std::vector<uint8_t> GeneratePackets(std::mt19937& random,
+                                            uint32_t packet_count) {
+  std::vector<uint8_t> packets(kBytesPerPacket * packet_count);
+  for (uint8_t& byte : packets) {
+    byte = uint8_t(random());
+  }
+  return packets;
+}
+
+TEST_CASE("XMA frame copy matches staged copy", "[xma]") {
+  std::mt19937 random(1);
+  std::vector<uint8_t> packets = GeneratePackets(random, 2);
+  const uint8_t* packet = packets.data();
+  const uint8_t* next_packet = packets.data() + kBytesPerPacket;
+  for (uint32_t i = 0; i < 20000; ++i) {
+    uint32_t frame_size = 15 + uint32_t(random() % 0x3000);
+    uint32_t frame_offset =
+        kBitsPerPacketHeader +
+        uint32_t(random() % (kBitsPerPacket - kBitsPerPacketHeader));
+    // Split frames continue in the next packet, others must fit in this one.
+    bool is_split = frame_offset + frame_size > kBitsPerPacket;
+    if (is_split && (i & 1)) {
+      frame_offset = kBitsPerPacket - frame_size;
+      is_split = false;
+    }
+    const uint8_t* frame_next_packet = is_split ? next_packet : nullptr;
+
+    FrameBuffer expected = {};
+    FrameBuffer actual = {};
+    uint32_t expected_padding = CopyFrameStaged(
+        packet, frame_next_packet, frame_offset, frame_size, expected.data());
+    uint32_t actual_padding = xma::CopyFrame(
+        packet, frame_next_packet, frame_offset, frame_size, actual.data());
+    REQUIRE(actual_padding == expected_padding);
+    REQUIRE(actual_padding == frame_offset % 8);
+    REQUIRE(actual == expected);
+  }
+}
+
+TEST_CASE("XMA frame copy benchmark", "[xma][.][benchmark]") {
+  // Frames of an average size for 128 kbps stereo at 48 kHz, packed into
+  // packets with one in four split between packets.
+  constexpr uint32_t kFrameCount = 200000;
+  constexpr uint32_t kFrameSize = 128000 * 512 / 48000;
+  std::mt19937 random(2);
+  std::vector<uint8_t> packets = GeneratePackets(random, 2);
+  std::vector<uint32_t> frame_offsets(kFrameCount);
+  for (uint32_t i = 0; i < kFrameCount; ++i) {
+    frame_offsets[i] = (i & 3) ? kBitsPerPacketHeader +
+                                     uint32_t(random() % (kBitsPerPacket -
+                                                          kBitsPerPacketHeader -
+                                                          kFrameSize))
+                               : kBitsPerPacket - kFrameSize / 2;
+  }
+
+  FrameBuffer frame;
+  uint64_t checksums[2] = {};
+  for (bool is_direct : {false, true}) {
+    uint64_t& checksum = checksums[is_direct];
+    auto start_time = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < kFrameCount; ++i) {
+      const uint8_t* next_packet =
+          frame_offsets[i] + kFrameSize > kBitsPerPacket
+              ? packets.data() + kBytesPerPacket
+              : nullptr;
+      // Cleared like in XmaContextNew::Decode.
+      if (is_direct) {
+        std::memset(frame.data(), 0, (7 + kFrameSize + 7) / 8 + 64);
+        xma::CopyFrame(packets.data(), next_packet, frame_offsets[i],
+                       kFrameSize, frame.data());
+      } else {
+        frame.fill(0);
+        CopyFrameStaged(packets.data(), next_packet, frame_offsets[i],
+                        kFrameSize, frame.data());
+      }
+      checksum = checksum * 31 + frame[i % (kFrameSize / 8)];
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start_time);
+    WARN((is_direct ? "Direct" : "Staged")
+         << " frame copy: " << elapsed.count() / 1000 << " ms, "
+         << double(elapsed.count()) * 1000.0 / kFrameCount
+         << " ns per frame");
+  }
+  REQUIRE(checksums[1] == checksums[0]);
+}
+
+}  // namespace test
+}  // namespace apu
+}  // namespace xe
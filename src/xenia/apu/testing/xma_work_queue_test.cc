@@ -0,0 +1,307 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/apu/xma_work_queue.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "third_party/catch/include/catch.hpp"
+
+#include "xenia/apu/xma_context.h"
+
+namespace xe {
+namespace apu {
+namespace test {
+
+// Context decoding a synthetic stream - a few sinusoids per channel
+// synthesized like an inverse transform of sparse coefficients and converted
+// to the guest output format, with the same locking as the real contexts.
+class SyntheticXmaContext : public XmaContext {
+ public:
+  static constexpr uint32_t kCoefficientCount = 16;
+
+  SyntheticXmaContext(uint32_t id, uint32_t frames_per_kick, bool is_stereo)
+      : frames_per_kick_(frames_per_kick), is_stereo_(is_stereo) {
+    id_ = id;
+    set_is_allocated(true);
+  }
+
+  bool Work() override {
+    ++visit_count_;
+    if (!is_enabled() || !is_allocated()) {
+      return false;
+    }
+    std::lock_guard<xe_mutex> lock(lock_);
+    set_is_enabled(false);
+    if (is_in_work_.exchange(true)) {
+      concurrent_work_detected_ = true;
+    }
+    for (uint32_t i = 0; i < frames_per_kick_; ++i) {
+      DecodeFrame();
+    }
+    ++work_count_;
+    is_in_work_ = false;
+    return true;
+  }
+
+  void Enable() override {
+    std::lock_guard<xe_mutex> lock(lock_);
+    set_is_enabled(true);
+  }
+
+  uint32_t work_count() const { return work_count_.load(); }
+  uint32_t visit_count() const { return visit_count_.load(); }
+  uint32_t decoded_frame_count() const { return decoded_frame_count_; }
+  bool concurrent_work_detected() const { return concurrent_work_detected_; }
+
+ private:
+  void DecodeFrame() {
+    const uint8_t* samples[2];
+    for (uint32_t channel = 0; channel <= uint32_t(is_stereo_); ++channel) {
+      float* channel_samples = samples_[channel].data();
+      for (uint32_t i = 0; i < kSamplesPerFrame; ++i) {
+        float sample = 0.0f;
+        for (uint32_t k = 0; k < kCoefficientCount; ++k) {
+          float frequency = float((id_ + channel) * 7 + k * 13 + 1);
+          sample += std::cos(frequency * float(decoded_frame_count_ *
+                                                   kSamplesPerFrame +
+                                               i) *
+                             (1.0f / 48000.0f)) *
+                    (1.0f / kCoefficientCount);
+        }
+        channel_samples[i] = sample;
+      }
+      samples[channel] = reinterpret_cast<const uint8_t*>(channel_samples);
+    }
+    ConvertFrame(samples, is_stereo_, output_.data());
+    ++decoded_frame_count_;
+  }
+
+  uint32_t frames_per_kick_;
+  bool is_stereo_;
+  std::array<std::array<float, kSamplesPerFrame>, 2> samples_;
+  std::array<uint8_t, kBytesPerFrameChannel * 2> output_;
+  std::atomic<uint32_t> work_count_ = {0};
+  std::atomic<uint32_t> visit_count_ = {0};
+  uint32_t decoded_frame_count_ = 0;
+  std::atomic<bool> is_in_work_ = {false};
+  bool concurrent_work_detected_ = false;
+};
+
+class SyntheticXmaContextSet {
+ public:
+  SyntheticXmaContextSet(uint32_t context_count, uint32_t frames_per_kick) {
+    for (uint32_t i = 0; i < context_count; ++i) {
+      contexts_.push_back(std::make_unique<SyntheticXmaContext>(
+          i, frames_per_kick, (i & 1) != 0));
+      context_ptrs_.push_back(contexts_.back().get());
+    }
+  }
+
+  XmaContext* const* contexts() const { return context_ptrs_.data(); }
+  uint32_t count() const { return uint32_t(contexts_.size()); }
+  SyntheticXmaContext& operator[](uint32_t i) { return *contexts_[i]; }
+
+ private:
+  std::vector<std::unique_ptr<SyntheticXmaContext>> contexts_;
+  std::vector<XmaContext*> context_ptrs_;
+};
+
+// Kicks all contexts the specified number of times, like the guest writing to
+// the kick registers, and waits for all the work to be done.
+static void KickAndDrain(XmaWorkQueue& queue, SyntheticXmaContextSet& contexts,
+                         uint32_t kick_count) {
+  std::vector<uint32_t> expected_work_counts(contexts.count());
+  for (uint32_t kick = 0; kick < kick_count; ++kick) {
+    for (uint32_t i = 0; i < contexts.count(); ++i) {
+      // Wait for the previous kick to be processed, like a game waiting for
+      // output space before kicking again.
+      while (contexts[i].work_count() < expected_work_counts[i]) {
+        std::this_thread::yield();
+      }
+      contexts[i].Enable();
+      queue.Enqueue(i);
+      ++expected_work_counts[i];
+    }
+  }
+  for (uint32_t i = 0; i < contexts.count(); ++i) {
+    while (contexts[i].work_count() < expected_work_counts[i]) {
+      std::this_thread::yield();
+    }
+  }
+}
+
+static std::vector<std::thread> StartWorkers(XmaWorkQueue& queue,
+                                             uint32_t worker_count) {
+  std::vector<std::thread> workers;
+  for (uint32_t i = 0; i < worker_count; ++i) {
+    workers.emplace_back([&queue]() { queue.RunWorker(); });
+  }
+  return workers;
+}
+
+static void StopWorkers(XmaWorkQueue& queue,
+                        std::vector<std::thread>& workers) {
+  queue.Shutdown();
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+}
+
+TEST_CASE("XMA work queue decodes every kick", "[xma]") {
+  for (uint32_t worker_count : {1, 2, 4}) {
+    SyntheticXmaContextSet contexts(64, 1);
+    XmaWorkQueue queue(contexts.contexts(), contexts.count());
+    auto workers = StartWorkers(queue, worker_count);
+    KickAndDrain(queue, contexts, 8);
+    StopWorkers(queue, workers);
+    for (uint32_t i = 0; i < contexts.count(); ++i) {
+      REQUIRE(contexts[i].work_count() == 8);
+      REQUIRE(!contexts[i].concurrent_work_detected());
+    }
+  }
+}
+
+TEST_CASE("XMA work queue coalesces repeated kicks", "[xma]") {
+  SyntheticXmaContextSet contexts(1, 1);
+  XmaWorkQueue queue(contexts.contexts(), contexts.count());
+  // Kicks before any worker is running are queued once.
+  for (uint32_t i = 0; i < 4; ++i) {
+    contexts[0].Enable();
+    queue.Enqueue(0);
+  }
+  auto workers = StartWorkers(queue, 2);
+  while (!contexts[0].work_count()) {
+    std::this_thread::yield();
+  }
+  // A kick after the decoding has started is picked up again.
+  contexts[0].Enable();
+  queue.Enqueue(0);
+  while (contexts[0].work_count() < 2) {
+    std::this_thread::yield();
+  }
+  StopWorkers(queue, workers);
+  REQUIRE(contexts[0].work_count() == 2);
+  REQUIRE(!contexts[0].concurrent_work_detected());
+}
+
+TEST_CASE("XMA work queue only visits kicked contexts", "[xma]") {
+  SyntheticXmaContextSet contexts(320, 1);
+  XmaWorkQueue queue(contexts.contexts(), contexts.count());
+  auto workers = StartWorkers(queue, 2);
+  for (uint32_t kick = 1; kick <= 16; ++kick) {
+    for (uint32_t i : {5, 300}) {
+      contexts[i].Enable();
+      queue.Enqueue(i);
+    }
+    for (uint32_t i : {5, 300}) {
+      while (contexts[i].work_count() < kick) {
+        std::this_thread::yield();
+      }
+    }
+  }
+  StopWorkers(queue, workers);
+  for (uint32_t i = 0; i < contexts.count(); ++i) {
+    if (i == 5 || i == 300) {
+      REQUIRE(contexts[i].visit_count() == 16);
+    } else {
+      REQUIRE(contexts[i].visit_count() == 0);
+    }
+  }
+  XmaWorkQueue::LatencyStatistics latency = queue.GetLatencyStatistics();
+  REQUIRE(latency.decode_count == 32);
+  REQUIRE(latency.max_microseconds * latency.decode_count >=
+          latency.total_microseconds);
+  queue.ResetLatencyStatistics();
+  REQUIRE(queue.GetLatencyStatistics().decode_count == 0);
+}
+
+TEST_CASE("XMA work queue pause", "[xma]") {
+  SyntheticXmaContextSet contexts(16, 4);
+  XmaWorkQueue queue(contexts.contexts(), contexts.count());
+  auto workers = StartWorkers(queue, 4);
+  queue.Pause();
+  for (uint32_t i = 0; i < contexts.count(); ++i) {
+    contexts[i].Enable();
+    queue.Enqueue(i);
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  for (uint32_t i = 0; i < contexts.count(); ++i) {
+    REQUIRE(contexts[i].work_count() == 0);
+  }
+  queue.Resume();
+  for (uint32_t i = 0; i < contexts.count(); ++i) {
+    while (!contexts[i].work_count()) {
+      std::this_thread::yield();
+    }
+  }
+  StopWorkers(queue, workers);
+}
+
+TEST_CASE("XMA work queue scheduling benchmark", "[xma][.][benchmark]") {
+  // 48 voices playing at once, each kicked for 4 frames at a time. The
+  // synthetic contexts don't decode XMA, so this measures how the work queue
+  // spreads the kicks across the workers, not the throughput of the decoder.
+  constexpr uint32_t kStreamCount = 48;
+  constexpr uint32_t kFramesPerKick = 4;
+  constexpr uint32_t kKickCount = 64;
+  constexpr double kFramesPerSecondRealTime =
+      48000.0 / XmaContext::kSamplesPerFrame;
+
+  std::vector<uint32_t> worker_counts = {1};
+  for (uint32_t worker_count :
+       {uint32_t(2), uint32_t(4), XmaWorkQueue::GetDefaultWorkerCount()}) {
+    if (std::find(worker_counts.begin(), worker_counts.end(), worker_count) ==
+        worker_counts.end()) {
+      worker_counts.push_back(worker_count);
+    }
+  }
+
+  for (uint32_t worker_count : worker_counts) {
+    SyntheticXmaContextSet contexts(kStreamCount, kFramesPerKick);
+    XmaWorkQueue queue(contexts.contexts(), contexts.count());
+    auto workers = StartWorkers(queue, worker_count);
+    auto start_time = std::chrono::steady_clock::now();
+    KickAndDrain(queue, contexts, kKickCount);
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start_time);
+    StopWorkers(queue, workers);
+
+    uint64_t frame_count = 0;
+    for (uint32_t i = 0; i < contexts.count(); ++i) {
+      frame_count += contexts[i].decoded_frame_count();
+    }
+    REQUIRE(frame_count == uint64_t(kStreamCount) * kFramesPerKick *
+                               kKickCount);
+    double frames_per_second =
+        double(frame_count) * 1000000.0 /
+        std::max(double(elapsed.count()), 1.0);
+    XmaWorkQueue::LatencyStatistics latency = queue.GetLatencyStatistics();
+    WARN(worker_count << " worker(s): " << elapsed.count() / 1000 << " ms, "
+                      << frames_per_second << " synthetic frames/s ("
+                      << frames_per_second / kFramesPerSecondRealTime
+                      << " real-time synthetic streams), kick to output "
+                         "latency "
+                      << latency.total_microseconds /
+                             std::max(latency.decode_count, uint64_t(1))
+                      << " us average, " << latency.max_microseconds
+                      << " us max");
+  }
+}
+
+}  // namespace test
+}  // namespace apu
+}  // namespace xe
@@ -12,6 +12,7 @@
 
 #include <algorithm>
 
+#include "xenia/base/cvar.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/platform.h"
 #include "xenia/base/profiling.h"
@@ -30,6 +31,13 @@ extern "C" {
 // Credits for most of this code goes to:
 // https://github.com/koolkdev/libertyv/blob/master/libav_wrapper/xma2dec.c
 
+DEFINE_bool(xma_direct_frames, true,
+            "Copy XMA frames for decoding directly from the guest packets, and "
+            "write whole decoded frames directly to the guest output buffer, "
+            "instead of staging them in intermediate buffers. The output is "
+            "the same either way.",
+            "APU");
+
 namespace xe {
 namespace apu {
 
@@ -155,7 +163,7 @@ bool XmaContextNew::Work() {
         data.output_buffer_valid, data.subframe_decode_count,
         data.subframe_skip_count);
 
-    Decode(&data);
+    Decode(&data, &output_rb);
     Consume(&output_rb, &data);
 
     if (!data.IsAnyInputBufferValid() || data.error_status == 4) {
@@ -225,6 +233,7 @@ void XmaContextNew::Clear() {
   data.input_buffer_read_offset = kBitsPerPacketHeader;
 
   current_frame_remaining_subframes_ = 0;
+  current_frame_is_in_output_ = false;
   data.Store(context_ptr);
 }
 
@@ -268,6 +277,16 @@ void XmaContextNew::Consume(RingBuffer* output_rb, XMA_CONTEXT_DATA* data) {
       std::min((int8_t)current_frame_remaining_subframes_,
                (int8_t)data->subframe_decode_count);
 
+  if (current_frame_is_in_output_) {
+    // Already decoded to the output buffer, and written all at once.
+    assert_true(subframes_to_write == current_frame_remaining_subframes_);
+    output_rb->AdvanceWrite(subframes_to_write * kOutputBytesPerBlock);
+    remaining_subframe_blocks_in_output_buffer_ -= subframes_to_write;
+    current_frame_remaining_subframes_ = 0;
+    current_frame_is_in_output_ = false;
+    return;
+  }
+
   const int8_t raw_frame_read_offset =
       ((kBytesPerFrameChannel / kOutputBytesPerBlock) << data->is_stereo) -
       current_frame_remaining_subframes_;
@@ -285,7 +304,7 @@ void XmaContextNew::Consume(RingBuffer* output_rb, XMA_CONTEXT_DATA* data) {
            output_rb->write_offset(), current_frame_remaining_subframes_);
 }
 
-void XmaContextNew::Decode(XMA_CONTEXT_DATA* data) {
+void XmaContextNew::Decode(XMA_CONTEXT_DATA* data, RingBuffer* output_rb) {
   SCOPE_profile_cpu_f("apu");
 
   // No available data.
@@ -309,8 +328,6 @@ void XmaContextNew::Decode(XMA_CONTEXT_DATA* data) {
     return;
   }
 
-  input_buffer_.fill(0);
-
   UpdateLoopStatus(data);
 
   if (!data->output_buffer_block_count) {
@@ -366,35 +383,23 @@ void XmaContextNew::Decode(XMA_CONTEXT_DATA* data) {
     return;
   }
 
+  const uint8_t* split_next_packet = nullptr;
   if (packet_info.isLastFrameInPacket()) {
     // Frame is a splitted frame
     if (stream.BitsRemaining() < packet_info.current_frame_size_) {
-      const uint8_t* next_packet =
+      split_next_packet =
           GetNextPacket(data, next_packet_index, current_input_packet_count);
 
-      if (!next_packet) {
+      if (!split_next_packet) {
         // Error path
         // Decoder probably should return error here
         // Not sure what error code should be returned
         data->error_status = 4;
         return;
       }
-      // Copy next packet to buffer
-      std::memcpy(input_buffer_.data() + kBytesPerPacketData,
-                  next_packet + kBytesPerPacketHeader, kBytesPerPacketData);
     }
   }
 
-  // Copy current packet to buffer
-  std::memcpy(input_buffer_.data(), packet + kBytesPerPacketHeader,
-              kBytesPerPacketData);
-
-  stream = BitStream(input_buffer_.data(),
-                     (kBitsPerPacket - kBitsPerPacketHeader) * 2);
-  stream.SetOffset(relative_offset - kBitsPerPacketHeader);
-
-  xma_frame_.fill(0);
-
   XELOGAPU(
       "XmaContext {}: Reading Frame {}/{} (size: {}) From Packet "
       "{}/{}",
@@ -402,23 +407,69 @@ void XmaContextNew::Decode(XMA_CONTEXT_DATA* data) {
       packet_info.current_frame_size_, packet_index,
       current_input_packet_count);
 
-  const uint32_t padding_start = static_cast<uint8_t>(
-      stream.Copy(xma_frame_.data() + 1, packet_info.current_frame_size_));
+  uint32_t padding_start;
+  if (cvars::xma_direct_frames) {
+    // Only clear what the decoder may read - the frame with up to 7 bits
+    // before it, and the input padding FFmpeg requires.
+    std::memset(xma_frame_.data(), 0,
+                std::min(xma_frame_.size(),
+                         size_t(1 + (7 + packet_info.current_frame_size_ + 7) /
+                                        8 +
+                                AV_INPUT_BUFFER_PADDING_SIZE)));
+    padding_start =
+        xma::CopyFrame(packet, split_next_packet, relative_offset,
+                       packet_info.current_frame_size_, xma_frame_.data() + 1);
+  } else {
+    input_buffer_.fill(0);
+    if (split_next_packet) {
+      // Copy next packet to buffer
+      std::memcpy(input_buffer_.data() + kBytesPerPacketData,
+                  split_next_packet + kBytesPerPacketHeader,
+                  kBytesPerPacketData);
+    }
+
+    // Copy current packet to buffer
+    std::memcpy(input_buffer_.data(), packet + kBytesPerPacketHeader,
+                kBytesPerPacketData);
+
+    stream = BitStream(input_buffer_.data(),
+                       (kBitsPerPacket - kBitsPerPacketHeader) * 2);
+    stream.SetOffset(relative_offset - kBitsPerPacketHeader);
+
+    xma_frame_.fill(0);
+
+    padding_start = static_cast<uint8_t>(
+        stream.Copy(xma_frame_.data() + 1, packet_info.current_frame_size_));
+  }
+
+  // TODO: Write function to regenerate decoder
+  // TODO: Be aware of subframe_skips & loops subframes skips
+  current_frame_remaining_subframes_ = 4 << data->is_stereo;
 
-  raw_frame_.fill(0);
+  // If the whole frame will be consumed at once, decode it directly to the
+  // output buffer if it fits there without wrapping around.
+  const uint32_t frame_output_size =
+      current_frame_remaining_subframes_ * kOutputBytesPerBlock;
+  current_frame_is_in_output_ =
+      cvars::xma_direct_frames &&
+      data->subframe_decode_count >= current_frame_remaining_subframes_ &&
+      output_rb->write_count() >= frame_output_size &&
+      output_rb->capacity() - output_rb->write_offset() >= frame_output_size;
+  uint8_t* frame_output = current_frame_is_in_output_
+                              ? reinterpret_cast<uint8_t*>(
+                                    output_rb->write_ptr())
+                              : raw_frame_.data();
 
   PrepareDecoder(data->sample_rate, bool(data->is_stereo));
   PreparePacket(packet_info.current_frame_size_, padding_start);
   if (DecodePacket(av_context_, av_packet_, av_frame_)) {
     // dump_raw(av_frame_, id());
     ConvertFrame(reinterpret_cast<const uint8_t**>(&av_frame_->data),
-                 bool(data->is_stereo), raw_frame_.data());
+                 bool(data->is_stereo), frame_output);
+  } else {
+    std::memset(frame_output, 0, frame_output_size);
   }
 
-  // TODO: Write function to regenerate decoder
-  // TODO: Be aware of subframe_skips & loops subframes skips
-  current_frame_remaining_subframes_ = 4 << data->is_stereo;
-
   // Compute where to go next.
   if (!packet_info.isLastFrameInPacket()) {
     const uint32_t next_frame_offset =
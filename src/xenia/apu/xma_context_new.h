@@ -105,7 +105,7 @@ class XmaContextNew : public XmaContext {
 
   static uint32_t GetCurrentInputBufferSize(XMA_CONTEXT_DATA* data);
 
-  void Decode(XMA_CONTEXT_DATA* data);
+  void Decode(XMA_CONTEXT_DATA* data, RingBuffer* output_rb);
   void Consume(RingBuffer* output_rb, XMA_CONTEXT_DATA* data);
 
   void UpdateLoopStatus(XMA_CONTEXT_DATA* data);
@@ -128,6 +128,9 @@ class XmaContextNew : public XmaContext {
 
   int32_t remaining_subframe_blocks_in_output_buffer_ = 0;
   uint8_t current_frame_remaining_subframes_ = 0;
+  // Whether the current frame has been decoded directly to the output buffer
+  // rather than to raw_frame_.
+  bool current_frame_is_in_output_ = false;
 };
 
 }  // namespace apu
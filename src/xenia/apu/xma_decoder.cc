@@ -62,6 +62,12 @@ DEFINE_bool(use_dedicated_xma_thread, true,
             "better results, but decrease performance a bit.",
             "APU");
 
+DEFINE_int32(xma_decoder_threads, 0,
+             "Number of threads decoding XMA contexts in parallel if "
+             "use_dedicated_xma_thread is enabled. 0 to choose based on the "
+             "number of logical processors.",
+             "APU");
+
 namespace xe {
 namespace apu {
 
@@ -153,72 +159,61 @@ X_STATUS XmaDecoder::Setup(kernel::KernelState* kernel_state) {
   register_file_[XmaRegister::NextContextIndex] = 1;
   context_bitmap_.Resize(kContextCount);
 
-  worker_running_ = true;
-  work_event_ = xe::threading::Event::CreateAutoResetEvent(false);
-  assert_not_null(work_event_);
-  worker_thread_ =
-      kernel::object_ref<kernel::XHostThread>(new kernel::XHostThread(
-          kernel_state, 128 * 1024, 0,
-          [this]() {
-            if (cvars::use_dedicated_xma_thread) {
-              WorkerThreadMain();
-            }
-            return 0;
-          },
-          kernel_state
-              ->GetIdleProcess()));  // this one doesnt need any process
-                                     // actually. never calls any guest code
-  worker_thread_->set_name("XMA Decoder");
-  worker_thread_->set_can_debugger_suspend(true);
-  worker_thread_->Create();
-
-  return X_STATUS_SUCCESS;
-}
-
-void XmaDecoder::WorkerThreadMain() {
-  uint32_t idle_loop_count = 0;
-  while (worker_running_) {
-    // Okay, let's loop through XMA contexts to find ones we need to decode!
-    bool did_work = false;
-    for (uint32_t n = 0; n < kContextCount; n++) {
-      did_work = contexts_[n]->Work() || did_work;
-
-      // TODO: Need thread safety to do this.
-      // Probably not too important though.
-      // registers_.current_context = n;
-      // registers_.next_context = (n + 1) % kContextCount;
+  if (cvars::use_dedicated_xma_thread) {
+    work_queue_ = std::make_unique<XmaWorkQueue>(contexts_, kContextCount);
+    uint32_t worker_count =
+        cvars::xma_decoder_threads > 0
+            ? uint32_t(cvars::xma_decoder_threads)
+            : XmaWorkQueue::GetDefaultWorkerCount();
+    for (uint32_t i = 0; i < worker_count; ++i) {
+      auto worker_thread =
+          kernel::object_ref<kernel::XHostThread>(new kernel::XHostThread(
+              kernel_state, 128 * 1024, 0,
+              [this]() {
+                work_queue_->RunWorker();
+                return 0;
+              },
+              kernel_state
+                  ->GetIdleProcess()));  // this one doesnt need any process
+                                         // actually. never calls any guest code
+      worker_thread->set_name(worker_count > 1
+                                  ? fmt::format("XMA Decoder {}", i)
+                                  : std::string("XMA Decoder"));
+      worker_thread->set_can_debugger_suspend(true);
+      worker_thread->Create();
+      worker_threads_.push_back(std::move(worker_thread));
     }
-
-    if (paused_) {
-      pause_fence_.Signal();
-      resume_fence_.Wait();
-    }
-
-    if (!did_work) {
-      idle_loop_count++;
-    } else {
-      idle_loop_count = 0;
-    }
-    xe::threading::Wait(work_event_.get(), false);
   }
+
+  return X_STATUS_SUCCESS;
 }
 
 void XmaDecoder::Shutdown() {
-  worker_running_ = false;
-
-  if (work_event_) {
-    work_event_->Set();
-  }
-
   if (paused_) {
     Resume();
   }
 
-  if (worker_thread_) {
-    // Wait for work thread.
-    xe::threading::Wait(worker_thread_->thread(), false);
-    worker_thread_.reset();
+  if (work_queue_) {
+    work_queue_->Shutdown();
+  }
+  // Wait for work threads.
+  for (auto& worker_thread : worker_threads_) {
+    xe::threading::Wait(worker_thread->thread(), false);
   }
+  worker_threads_.clear();
+  if (work_queue_) {
+    XmaWorkQueue::LatencyStatistics latency =
+        work_queue_->GetLatencyStatistics();
+    if (latency.decode_count) {
+      XELOGI(
+          "XMA: {} context decoding passes, kick to output latency {} us "
+          "average, {} us max",
+          latency.decode_count,
+          latency.total_microseconds / latency.decode_count,
+          latency.max_microseconds);
+    }
+  }
+  work_queue_.reset();
 
   if (context_data_first_ptr_) {
     memory()->SystemHeapFree(context_data_first_ptr_);
@@ -328,13 +323,14 @@ void XmaDecoder::WriteRegister(uint32_t addr, uint32_t value) {
         uint32_t context_id = base_context_id + i;
         auto& context = *contexts_[context_id];
         context.Enable();
-        if (!cvars::use_dedicated_xma_thread) {
+        if (work_queue_) {
+          // Signal a decoder thread to start processing.
+          work_queue_->Enqueue(context_id);
+        } else {
           context.Work();
         }
       }
     }
-    // Signal the decoder thread to start processing.
-    work_event_->SetBoostPriority();
   } else if (r >= XmaRegister::Context0Lock && r <= XmaRegister::Context9Lock) {
     // Context lock command.
     // This requests a lock by flagging the context.
@@ -347,8 +343,6 @@ void XmaDecoder::WriteRegister(uint32_t addr, uint32_t value) {
         context.Disable();
       }
     }
-    // Signal the decoder thread to start processing.
-    // work_event_->Set();
   } else if (r >= XmaRegister::Context0Clear &&
              r <= XmaRegister::Context9Clear) {
     // Context clear command.
@@ -388,7 +382,9 @@ void XmaDecoder::Pause() {
   }
   paused_ = true;
 
-  pause_fence_.Wait();
+  if (work_queue_) {
+    work_queue_->Pause();
+  }
 }
 
 void XmaDecoder::Resume() {
@@ -397,7 +393,9 @@ void XmaDecoder::Resume() {
   }
   paused_ = false;
 
-  resume_fence_.Signal();
+  if (work_queue_) {
+    work_queue_->Resume();
+  }
 }
 
 }  // namespace apu
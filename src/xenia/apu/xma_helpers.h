@@ -14,6 +14,10 @@
 
 #include <stdint.h>
 
+#include <algorithm>
+
+#include "xenia/base/bit_stream.h"
+
 namespace xe {
 namespace apu {
 namespace xma {
@@ -45,6 +49,37 @@ static uint32_t GetPacketFrameOffset(const uint8_t* packet) {
   return val + 32;
 }
 
+// Copies the frame starting at the bit offset in the packet to the buffer,
+// continuing in the data of the next packet (if not null) if the frame is split
+// between packets. The first bit keeps its position within a byte, and the
+// number of the bits before it in the first byte is returned. Bits not copied
+// are left untouched, so the buffer should be zeroed.
+static uint32_t CopyFrame(const uint8_t* packet, const uint8_t* next_packet,
+                          uint32_t frame_offset, uint32_t frame_size,
+                          uint8_t* frame_out) {
+  constexpr uint32_t kBitsPerPacket = 2048 * 8;
+  constexpr uint32_t kBitsPerPacketHeader = 32;
+  if (frame_offset >= kBitsPerPacket) {
+    return 0;
+  }
+  uint32_t first_part_size =
+      std::min(frame_size, kBitsPerPacket - frame_offset);
+  BitStream stream(const_cast<uint8_t*>(packet), kBitsPerPacket);
+  stream.SetOffset(frame_offset);
+  uint32_t padding = uint32_t(stream.Copy(frame_out, first_part_size));
+  if (first_part_size < frame_size && next_packet) {
+    // The split ends at the end of the packet, so the rest of the frame starts
+    // at a byte boundary both in the next packet and in the buffer.
+    BitStream next_stream(const_cast<uint8_t*>(next_packet), kBitsPerPacket);
+    next_stream.SetOffset(kBitsPerPacketHeader);
+    next_stream.Copy(
+        frame_out + (padding + first_part_size) / 8,
+        std::min(frame_size - first_part_size,
+                 kBitsPerPacket - kBitsPerPacketHeader));
+  }
+  return padding;
+}
+
 }  // namespace xma
 }  // namespace apu
 }  // namespace xe
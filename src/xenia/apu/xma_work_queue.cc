@@ -0,0 +1,163 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/apu/xma_work_queue.h"
+
+#include <algorithm>
+
+#include "xenia/apu/xma_context.h"
+#include "xenia/base/assert.h"
+#include "xenia/base/clock.h"
+#include "xenia/base/math.h"
+#include "xenia/base/threading.h"
+
+namespace xe {
+namespace apu {
+
+XmaWorkQueue::XmaWorkQueue(XmaContext* const* contexts,
+                           uint32_t context_count)
+    : contexts_(contexts),
+      context_count_(context_count),
+      ready_contexts_(xe::round_up(context_count, 64)),
+      kick_host_ticks_(new std::atomic<uint64_t>[context_count]) {
+  ready_contexts_.AcquireAll();
+  for (uint32_t i = 0; i < context_count; ++i) {
+    kick_host_ticks_[i].store(0);
+  }
+}
+
+void XmaWorkQueue::Enqueue(uint32_t context_id) {
+  assert_true(context_id < context_count_);
+  // Keep the time of the earliest kick not picked up by a worker yet. Stored
+  // before publishing the context so the worker taking it sees the time.
+  uint64_t no_kick_host_ticks = 0;
+  kick_host_ticks_[context_id].compare_exchange_strong(
+      no_kick_host_ticks, Clock::QueryHostTickCount());
+  if (!ready_contexts_.TryRelease(context_id)) {
+    // Already waiting.
+    return;
+  }
+  ready_count_.fetch_add(1);
+  if (waiting_worker_count_.load()) {
+    // Lock so the notification isn't lost if the worker is between checking
+    // ready_count_ and starting to wait.
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+    }
+    work_cond_.notify_one();
+  }
+}
+
+void XmaWorkQueue::DrainReadyContexts() {
+  while (!is_paused_.load(std::memory_order_relaxed)) {
+    size_t context_id = ready_contexts_.Acquire();
+    if (context_id == size_t(-1)) {
+      break;
+    }
+    ready_count_.fetch_sub(1);
+    // Zero if the kick has happened while the previous pass was taking the
+    // context, and its time has been consumed by that pass.
+    uint64_t kick_host_ticks = kick_host_ticks_[context_id].exchange(0);
+
+    if (!contexts_[context_id]->Work() || !kick_host_ticks) {
+      continue;
+    }
+
+    uint64_t latency_host_ticks =
+        std::max(Clock::QueryHostTickCount(), kick_host_ticks) -
+        kick_host_ticks;
+    latency_decode_count_.fetch_add(1, std::memory_order_relaxed);
+    latency_total_host_ticks_.fetch_add(latency_host_ticks,
+                                        std::memory_order_relaxed);
+    uint64_t max_host_ticks =
+        latency_max_host_ticks_.load(std::memory_order_relaxed);
+    while (latency_host_ticks > max_host_ticks &&
+           !latency_max_host_ticks_.compare_exchange_weak(
+               max_host_ticks, latency_host_ticks,
+               std::memory_order_relaxed)) {
+    }
+  }
+}
+
+void XmaWorkQueue::RunWorker() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    waiting_worker_count_.fetch_add(1);
+    while (is_running_ && (is_paused_ || ready_count_.load() <= 0)) {
+      work_cond_.wait(lock);
+    }
+    waiting_worker_count_.fetch_sub(1);
+    if (!is_running_) {
+      break;
+    }
+    ++busy_worker_count_;
+    lock.unlock();
+
+    DrainReadyContexts();
+
+    lock.lock();
+    if (!--busy_worker_count_ && is_paused_) {
+      idle_cond_.notify_all();
+    }
+  }
+}
+
+void XmaWorkQueue::Shutdown() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    is_running_ = false;
+  }
+  work_cond_.notify_all();
+}
+
+void XmaWorkQueue::Pause() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  is_paused_ = true;
+  idle_cond_.wait(lock, [this]() { return !busy_worker_count_; });
+}
+
+void XmaWorkQueue::Resume() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    is_paused_ = false;
+  }
+  work_cond_.notify_all();
+}
+
+XmaWorkQueue::LatencyStatistics XmaWorkQueue::GetLatencyStatistics() const {
+  LatencyStatistics statistics;
+  statistics.decode_count =
+      latency_decode_count_.load(std::memory_order_relaxed);
+  uint64_t host_tick_frequency = Clock::QueryHostTickFrequency();
+  auto to_microseconds = [host_tick_frequency](uint64_t host_ticks) {
+    return uint64_t(double(host_ticks) * 1000000.0 /
+                    double(host_tick_frequency));
+  };
+  statistics.total_microseconds = to_microseconds(
+      latency_total_host_ticks_.load(std::memory_order_relaxed));
+  statistics.max_microseconds = to_microseconds(
+      latency_max_host_ticks_.load(std::memory_order_relaxed));
+  return statistics;
+}
+
+void XmaWorkQueue::ResetLatencyStatistics() {
+  latency_decode_count_.store(0, std::memory_order_relaxed);
+  latency_total_host_ticks_.store(0, std::memory_order_relaxed);
+  latency_max_host_ticks_.store(0, std::memory_order_relaxed);
+}
+
+uint32_t XmaWorkQueue::GetDefaultWorkerCount() {
+  // Leave most of the processors to the guest threads and the GPU, few games
+  // have enough voices playing at once to keep more than a few workers busy.
+  return std::clamp(xe::threading::logical_processor_count() / 4, uint32_t(1),
+                    uint32_t(4));
+}
+
+}  // namespace apu
+}  // namespace xe
@@ -0,0 +1,107 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_APU_XMA_WORK_QUEUE_H_
+#define XENIA_APU_XMA_WORK_QUEUE_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+#include "xenia/base/bit_map.h"
+
+namespace xe {
+namespace apu {
+
+class XmaContext;
+
+// Contexts kicked by the guest and waiting to be decoded, processed by any
+// number of worker threads calling RunWorker.
+//
+// The contexts waiting to be decoded are stored in a bit map, so workers only
+// visit the contexts that have been kicked, and a context is queued at most
+// once at a time. XmaContext::Work is serialized by the lock of the context, so
+// a context kicked again while it's being decoded is decoded again by the next
+// free worker once the current pass is done, while other contexts are decoded
+// in parallel. Workers only sleep when there's nothing to decode, and kicking
+// only locks the mutex to wake a worker up if some workers are sleeping.
+class XmaWorkQueue {
+ public:
+  // Time from the first kick of a context to the end of its decoding.
+  struct LatencyStatistics {
+    uint64_t decode_count;
+    uint64_t total_microseconds;
+    uint64_t max_microseconds;
+  };
+
+  XmaWorkQueue(XmaContext* const* contexts, uint32_t context_count);
+
+  // Queues the context for decoding unless it's already waiting. May be called
+  // from any thread.
+  void Enqueue(uint32_t context_id);
+
+  // Decodes the queued contexts until Shutdown is called.
+  void RunWorker();
+  // Makes all workers return from RunWorker.
+  void Shutdown();
+
+  // Stops taking contexts from the queue and waits for the contexts being
+  // decoded to be done.
+  void Pause();
+  void Resume();
+
+  LatencyStatistics GetLatencyStatistics() const;
+  void ResetLatencyStatistics();
+
+  // Number of worker threads to use by default, based on the number of logical
+  // processors.
+  static uint32_t GetDefaultWorkerCount();
+
+ private:
+  // Decodes the queued contexts until there are none left or the queue is
+  // paused.
+  void DrainReadyContexts();
+
+  XmaContext* const* contexts_;
+  uint32_t context_count_;
+
+  // Free entries are the contexts waiting to be decoded.
+  BitMap ready_contexts_;
+  // Number of the contexts in ready_contexts_, may temporarily be lower than
+  // the actual number (down to -1 per worker) while a context is being queued.
+  std::atomic<int32_t> ready_count_ = {0};
+  // Host tick count at the first kick of every queued context.
+  std::unique_ptr<std::atomic<uint64_t>[]> kick_host_ticks_;
+
+  std::mutex mutex_;
+  // Notified when contexts are queued while all workers are sleeping, or the
+  // state changes.
+  std::condition_variable work_cond_;
+  // Notified when the last busy worker finishes decoding.
+  std::condition_variable idle_cond_;
+  // Workers sleeping or about to sleep on work_cond_ - incremented with
+  // mutex_ locked before checking ready_count_, so either the worker sees the
+  // new context, or Enqueue sees the worker and wakes it up.
+  std::atomic<uint32_t> waiting_worker_count_ = {0};
+  uint32_t busy_worker_count_ = 0;
+  bool is_running_ = true;
+  // Also read without mutex_ by the busy workers.
+  std::atomic<bool> is_paused_ = {false};
+
+  std::atomic<uint64_t> latency_decode_count_ = {0};
+  std::atomic<uint64_t> latency_total_host_ticks_ = {0};
+  std::atomic<uint64_t> latency_max_host_ticks_ = {0};
+};
+
+}  // namespace apu
+}  // namespace xe
+
+#endif  // XENIA_APU_XMA_WORK_QUEUE_H_
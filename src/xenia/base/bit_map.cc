@@ -94,6 +94,23 @@ void BitMap::Release(size_t index) {
   } while (!atomic_cas(entry, new_entry, &data_[slot]));
 }
 
+bool BitMap::TryRelease(size_t index) {
+  auto slot = index / kDataSizeBits;
+  index -= slot * kDataSizeBits;
+
+  uint64_t bit = 1ull << (kDataSizeBits - index - 1);
+
+  uint64_t entry = 0;
+  do {
+    entry = data_[slot];
+    if (entry & bit) {
+      // Already free.
+      return false;
+    }
+  } while (!atomic_cas(entry, entry | bit, &data_[slot]));
+  return true;
+}
+
 void BitMap::Resize(size_t new_size_bits) {
   auto old_size = data_.size();
   assert_true(new_size_bits % kDataSizeBits == 0);
@@ -113,4 +130,10 @@ void BitMap::Reset() {
   }
 }
 
+void BitMap::AcquireAll() {
+  for (size_t i = 0; i < data_.size(); i++) {
+    data_[i] = 0;
+  }
+}
+
 }  // namespace xe
\ No newline at end of file
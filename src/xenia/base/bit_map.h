@@ -35,12 +35,17 @@ class BitMap {
   size_t AcquireFromBack();
   // (threadsafe) Releases an entry by an index.
   void Release(size_t index);
+  // (threadsafe) Releases an entry by an index if it's not free already.
+  // Returns whether the entry has been released by this call.
+  bool TryRelease(size_t index);
 
   // Resize the bitmap. Size is the number of entries, must be a multiple of 64.
   void Resize(size_t new_size_bits);
 
   // Sets all entries to free.
   void Reset();
+  // Sets all entries to used.
+  void AcquireAll();
 
   const std::vector<uint64_t> data() const { return data_; }
   std::vector<uint64_t>& data() { return data_; }
@@ -0,0 +1,359 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/base/crypto.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "xenia/base/math.h"
+#include "xenia/base/memory.h"
+#include "xenia/base/platform.h"
+
+#if XE_ARCH_AMD64
+#include <immintrin.h>
+#endif  // XE_ARCH_AMD64
+
+#include "third_party/crypto/rijndael-alg-fst.c"
+#include "third_party/crypto/rijndael-alg-fst.h"
+
+namespace xe {
+namespace crypto {
+
+bool IsAesHardwareAccelerated() {
+#if XE_ARCH_AMD64
+  return (amd64::GetFeatureFlags() & amd64::kX64EmitAESNI) != 0;
+#else
+  return false;
+#endif  // XE_ARCH_AMD64
+}
+
+bool IsSha1HardwareAccelerated() {
+#if XE_ARCH_AMD64
+  return (amd64::GetFeatureFlags() & amd64::kX64EmitSHA) != 0;
+#else
+  return false;
+#endif  // XE_ARCH_AMD64
+}
+
+#if XE_ARCH_AMD64
+
+// aeskeygenassist takes the round constant as an immediate.
+template <int RoundConstant>
+XE_TARGET_AES static __m128i Aes128ExpandKey(__m128i key) {
+  __m128i key_gen_assist = _mm_shuffle_epi32(
+      _mm_aeskeygenassist_si128(key, RoundConstant), _MM_SHUFFLE(3, 3, 3, 3));
+  key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+  key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+  key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+  return _mm_xor_si128(key, key_gen_assist);
+}
+
+// Writes the decryption round keys for the equivalent inverse cipher (in the
+// order they are used).
+XE_TARGET_AES static void Aes128SetupDecryptionKeysAESNI(
+    const uint8_t* key, __m128i* decryption_keys) {
+  __m128i encryption_keys[11];
+  encryption_keys[0] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(key));
+  encryption_keys[1] = Aes128ExpandKey<0x01>(encryption_keys[0]);
+  encryption_keys[2] = Aes128ExpandKey<0x02>(encryption_keys[1]);
+  encryption_keys[3] = Aes128ExpandKey<0x04>(encryption_keys[2]);
+  encryption_keys[4] = Aes128ExpandKey<0x08>(encryption_keys[3]);
+  encryption_keys[5] = Aes128ExpandKey<0x10>(encryption_keys[4]);
+  encryption_keys[6] = Aes128ExpandKey<0x20>(encryption_keys[5]);
+  encryption_keys[7] = Aes128ExpandKey<0x40>(encryption_keys[6]);
+  encryption_keys[8] = Aes128ExpandKey<0x80>(encryption_keys[7]);
+  encryption_keys[9] = Aes128ExpandKey<0x1B>(encryption_keys[8]);
+  encryption_keys[10] = Aes128ExpandKey<0x36>(encryption_keys[9]);
+  _mm_store_si128(decryption_keys, encryption_keys[10]);
+  for (uint32_t i = 1; i < 10; ++i) {
+    _mm_store_si128(decryption_keys + i,
+                    _mm_aesimc_si128(encryption_keys[10 - i]));
+  }
+  _mm_store_si128(decryption_keys + 10, encryption_keys[0]);
+}
+
+// Unlike encryption, CBC decryption of different blocks is independent, so
+// multiple blocks are decrypted at once to hide the latency of aesdec.
+XE_TARGET_AES static void Aes128CbcDecryptAESNI(
+    const __m128i* decryption_keys, uint8_t* iv, const uint8_t* input,
+    uint8_t* output, size_t block_count) {
+  constexpr size_t kParallelBlocks = 8;
+  __m128i keys[11];
+  for (uint32_t i = 0; i < 11; ++i) {
+    keys[i] = _mm_load_si128(decryption_keys + i);
+  }
+  __m128i previous = _mm_loadu_si128(reinterpret_cast<const __m128i*>(iv));
+  while (block_count >= kParallelBlocks) {
+    block_count -= kParallelBlocks;
+    __m128i ciphertext[kParallelBlocks], plaintext[kParallelBlocks];
+    for (size_t i = 0; i < kParallelBlocks; ++i) {
+      ciphertext[i] =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(input) + i);
+      plaintext[i] = _mm_xor_si128(ciphertext[i], keys[0]);
+    }
+    for (uint32_t round = 1; round < 10; ++round) {
+      for (size_t i = 0; i < kParallelBlocks; ++i) {
+        plaintext[i] = _mm_aesdec_si128(plaintext[i], keys[round]);
+      }
+    }
+    for (size_t i = 0; i < kParallelBlocks; ++i) {
+      plaintext[i] = _mm_aesdeclast_si128(plaintext[i], keys[10]);
+      plaintext[i] = _mm_xor_si128(plaintext[i], previous);
+      previous = ciphertext[i];
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(output) + i, plaintext[i]);
+    }
+    input += kParallelBlocks * Aes128CbcDecryptor::kBlockSize;
+    output += kParallelBlocks * Aes128CbcDecryptor::kBlockSize;
+  }
+  while (block_count--) {
+    __m128i ciphertext =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(input));
+    __m128i plaintext = _mm_xor_si128(ciphertext, keys[0]);
+    for (uint32_t round = 1; round < 10; ++round) {
+      plaintext = _mm_aesdec_si128(plaintext, keys[round]);
+    }
+    plaintext = _mm_aesdeclast_si128(plaintext, keys[10]);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(output),
+                     _mm_xor_si128(plaintext, previous));
+    previous = ciphertext;
+    input += Aes128CbcDecryptor::kBlockSize;
+    output += Aes128CbcDecryptor::kBlockSize;
+  }
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(iv), previous);
+}
+
+#endif  // XE_ARCH_AMD64
+
+Aes128CbcDecryptor::Aes128CbcDecryptor(const uint8_t* key,
+                                       bool allow_hardware) {
+  use_aes_ni_ = allow_hardware && IsAesHardwareAccelerated();
+#if XE_ARCH_AMD64
+  if (use_aes_ni_) {
+    rounds_ = 10;
+    Aes128SetupDecryptionKeysAESNI(key,
+                                   reinterpret_cast<__m128i*>(round_keys_));
+    return;
+  }
+#endif  // XE_ARCH_AMD64
+  static_assert(sizeof(round_keys_) >= sizeof(u32) * 4 * (MAXNR + 1),
+                "Round keys must fit the portable AES implementation");
+  rounds_ = rijndaelKeySetupDec(round_keys_, key, int(kKeySize * 8));
+}
+
+void Aes128CbcDecryptor::Decrypt(const void* input, void* output,
+                                 size_t size) {
+  auto input_bytes = static_cast<const uint8_t*>(input);
+  auto output_bytes = static_cast<uint8_t*>(output);
+  size_t block_count = size / kBlockSize;
+#if XE_ARCH_AMD64
+  if (use_aes_ni_) {
+    Aes128CbcDecryptAESNI(reinterpret_cast<const __m128i*>(round_keys_), iv_,
+                          input_bytes, output_bytes, block_count);
+  } else
+#endif  // XE_ARCH_AMD64
+  {
+    for (size_t i = 0; i < block_count; ++i) {
+      uint8_t ciphertext[kBlockSize];
+      std::memcpy(ciphertext, input_bytes + i * kBlockSize, kBlockSize);
+      uint8_t* plaintext = output_bytes + i * kBlockSize;
+      rijndaelDecrypt(round_keys_, rounds_, ciphertext, plaintext);
+      for (size_t j = 0; j < kBlockSize; ++j) {
+        plaintext[j] ^= iv_[j];
+      }
+      std::memcpy(iv_, ciphertext, kBlockSize);
+    }
+  }
+  size_t remainder = size - block_count * kBlockSize;
+  if (remainder) {
+    uint8_t block[kBlockSize] = {};
+    std::memcpy(block, input_bytes + block_count * kBlockSize, remainder);
+    Decrypt(block, block, kBlockSize);
+    std::memcpy(output_bytes + block_count * kBlockSize, block, remainder);
+  }
+}
+
+static void Sha1ProcessBlocksPortable(uint32_t* state, const uint8_t* blocks,
+                                      size_t block_count) {
+  for (; block_count; --block_count, blocks += 64) {
+    uint32_t w[80];
+    for (uint32_t i = 0; i < 16; ++i) {
+      w[i] = xe::load_and_swap<uint32_t>(blocks + i * sizeof(uint32_t));
+    }
+    for (uint32_t i = 16; i < 80; ++i) {
+      w[i] = xe::rotate_left<uint32_t>(
+          w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3],
+             e = state[4];
+    for (uint32_t i = 0; i < 80; ++i) {
+      uint32_t f, k;
+      if (i < 20) {
+        f = (b & c) | (~b & d);
+        k = 0x5A827999;
+      } else if (i < 40) {
+        f = b ^ c ^ d;
+        k = 0x6ED9EBA1;
+      } else if (i < 60) {
+        f = (b & c) | (b & d) | (c & d);
+        k = 0x8F1BBCDC;
+      } else {
+        f = b ^ c ^ d;
+        k = 0xCA62C1D6;
+      }
+      uint32_t temp = xe::rotate_left<uint32_t>(a, 5) + f + e + k + w[i];
+      e = d;
+      d = c;
+      c = xe::rotate_left<uint32_t>(b, 30);
+      b = a;
+      a = temp;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+  }
+}
+
+#if XE_ARCH_AMD64
+
+// One group of 4 rounds of SHA-1 with the SHA extensions, scheduling the
+// message for the next groups. The function for sha1rnds4 and the positions
+// of the message parts are compile-time constants derived from the group
+// index.
+template <int Group>
+XE_TARGET_SHA XE_FORCEINLINE static void Sha1RoundGroupSHA(
+    __m128i& abcd, __m128i* e, __m128i* message, const uint8_t* block,
+    __m128i byte_swap_shuffle) {
+  if constexpr (Group < 4) {
+    message[Group] = _mm_shuffle_epi8(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(block) + Group),
+        byte_swap_shuffle);
+  }
+  if constexpr (Group == 0) {
+    e[0] = _mm_add_epi32(e[0], message[0]);
+  } else {
+    e[Group & 1] = _mm_sha1nexte_epu32(e[Group & 1], message[Group & 3]);
+  }
+  e[(Group + 1) & 1] = abcd;
+  if constexpr (Group >= 3 && Group <= 18) {
+    message[(Group + 1) & 3] =
+        _mm_sha1msg2_epu32(message[(Group + 1) & 3], message[Group & 3]);
+  }
+  abcd = _mm_sha1rnds4_epu32(abcd, e[Group & 1], Group / 5);
+  if constexpr (Group >= 1 && Group <= 16) {
+    message[(Group + 3) & 3] =
+        _mm_sha1msg1_epu32(message[(Group + 3) & 3], message[Group & 3]);
+  }
+  if constexpr (Group >= 2 && Group <= 17) {
+    message[(Group + 2) & 3] =
+        _mm_xor_si128(message[(Group + 2) & 3], message[Group & 3]);
+  }
+  if constexpr (Group < 19) {
+    Sha1RoundGroupSHA<Group + 1>(abcd, e, message, block, byte_swap_shuffle);
+  }
+}
+
+XE_TARGET_SHA static void Sha1ProcessBlocksSHA(uint32_t* state,
+                                               const uint8_t* blocks,
+                                               size_t block_count) {
+  const __m128i byte_swap_shuffle =
+      _mm_set_epi64x(0x0001020304050607ll, 0x08090A0B0C0D0E0Fll);
+  __m128i abcd = _mm_shuffle_epi32(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(state)),
+      _MM_SHUFFLE(0, 1, 2, 3));
+  __m128i e0 = _mm_set_epi32(int32_t(state[4]), 0, 0, 0);
+  for (; block_count; --block_count, blocks += 64) {
+    __m128i abcd_saved = abcd;
+    __m128i e_saved = e0;
+    __m128i e[2] = {e0, _mm_setzero_si128()};
+    __m128i message[4];
+    Sha1RoundGroupSHA<0>(abcd, e, message, blocks, byte_swap_shuffle);
+    e0 = _mm_sha1nexte_epu32(e[0], e_saved);
+    abcd = _mm_add_epi32(abcd, abcd_saved);
+  }
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(state),
+                   _mm_shuffle_epi32(abcd, _MM_SHUFFLE(0, 1, 2, 3)));
+  state[4] = uint32_t(_mm_extract_epi32(e0, 3));
+}
+
+#endif  // XE_ARCH_AMD64
+
+Sha1::Sha1(bool allow_hardware) {
+  use_sha_ni_ = allow_hardware && IsSha1HardwareAccelerated();
+  Reset();
+}
+
+void Sha1::Reset() {
+  state_[0] = 0x67452301;
+  state_[1] = 0xEFCDAB89;
+  state_[2] = 0x98BADCFE;
+  state_[3] = 0x10325476;
+  state_[4] = 0xC3D2E1F0;
+  buffer_size_ = 0;
+  total_size_ = 0;
+}
+
+void Sha1::ProcessBlocks(const uint8_t* blocks, size_t block_count) {
+#if XE_ARCH_AMD64
+  if (use_sha_ni_) {
+    Sha1ProcessBlocksSHA(state_, blocks, block_count);
+    return;
+  }
+#endif  // XE_ARCH_AMD64
+  Sha1ProcessBlocksPortable(state_, blocks, block_count);
+}
+
+void Sha1::Update(const void* data, size_t size) {
+  auto bytes = static_cast<const uint8_t*>(data);
+  total_size_ += size;
+  if (buffer_size_) {
+    size_t buffer_append = std::min(sizeof(buffer_) - buffer_size_, size);
+    std::memcpy(buffer_ + buffer_size_, bytes, buffer_append);
+    buffer_size_ += buffer_append;
+    bytes += buffer_append;
+    size -= buffer_append;
+    if (buffer_size_ < sizeof(buffer_)) {
+      return;
+    }
+    ProcessBlocks(buffer_, 1);
+    buffer_size_ = 0;
+  }
+  size_t block_count = size / sizeof(buffer_);
+  if (block_count) {
+    ProcessBlocks(bytes, block_count);
+    bytes += block_count * sizeof(buffer_);
+    size -= block_count * sizeof(buffer_);
+  }
+  std::memcpy(buffer_, bytes, size);
+  buffer_size_ = size;
+}
+
+void Sha1::Finalize(uint8_t* digest_out) {
+  uint64_t bit_count = total_size_ * 8;
+  buffer_[buffer_size_++] = 0x80;
+  if (buffer_size_ > sizeof(buffer_) - sizeof(uint64_t)) {
+    std::memset(buffer_ + buffer_size_, 0, sizeof(buffer_) - buffer_size_);
+    ProcessBlocks(buffer_, 1);
+    buffer_size_ = 0;
+  }
+  std::memset(buffer_ + buffer_size_, 0,
+              sizeof(buffer_) - sizeof(uint64_t) - buffer_size_);
+  xe::store_and_swap<uint64_t>(buffer_ + sizeof(buffer_) - sizeof(uint64_t),
+                               bit_count);
+  ProcessBlocks(buffer_, 1);
+  buffer_size_ = 0;
+  for (uint32_t i = 0; i < 5; ++i) {
+    xe::store_and_swap<uint32_t>(digest_out + i * sizeof(uint32_t), state_[i]);
+  }
+}
+
+}  // namespace crypto
+}  // namespace xe
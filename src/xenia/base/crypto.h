@@ -0,0 +1,88 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_BASE_CRYPTO_H_
+#define XENIA_BASE_CRYPTO_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace xe {
+namespace crypto {
+
+// Whether the host supports the instructions used by the hardware paths below
+// (AES-NI and the SHA extensions on x86-64). On x86-64, requires
+// amd64::InitFeatureFlags to have been called.
+bool IsAesHardwareAccelerated();
+bool IsSha1HardwareAccelerated();
+
+// AES-128 decryption in the CBC mode with a zero initialization vector, as used
+// for XEX images, their session keys and patches.
+class Aes128CbcDecryptor {
+ public:
+  static constexpr size_t kKeySize = 16;
+  static constexpr size_t kBlockSize = 16;
+
+  // With allow_hardware false, the portable implementation is always used
+  // (for testing).
+  explicit Aes128CbcDecryptor(const uint8_t* key, bool allow_hardware = true);
+
+  bool is_hardware_accelerated() const { return use_aes_ni_; }
+
+  // Decrypts the data, continuing the chain of the previous calls. The input
+  // and the output may be the same buffer. If the size is not a multiple of
+  // the block size, the last block is decrypted as if it was padded with
+  // zeros, and this must be the last call.
+  void Decrypt(const void* input, void* output, size_t size);
+
+ private:
+  bool use_aes_ni_;
+  int rounds_;
+  // Decryption round keys - up to 4 * (14 + 1) words in the portable
+  // implementation, 11 128-bit keys with AES-NI.
+  alignas(16) uint32_t round_keys_[4 * 15];
+  alignas(16) uint8_t iv_[kBlockSize] = {};
+};
+
+// SHA-1 with the compression function using the SHA extensions when
+// available, and processing whole 64-byte blocks directly from the input.
+class Sha1 {
+ public:
+  static constexpr size_t kDigestSize = 20;
+
+  explicit Sha1(bool allow_hardware = true);
+
+  bool is_hardware_accelerated() const { return use_sha_ni_; }
+
+  void Reset();
+  void Update(const void* data, size_t size);
+  // The hash must be reset after this to be used again.
+  void Finalize(uint8_t* digest_out);
+
+  static void Digest(const void* data, size_t size, uint8_t* digest_out,
+                     bool allow_hardware = true) {
+    Sha1 sha1(allow_hardware);
+    sha1.Update(data, size);
+    sha1.Finalize(digest_out);
+  }
+
+ private:
+  void ProcessBlocks(const uint8_t* blocks, size_t block_count);
+
+  bool use_sha_ni_;
+  uint32_t state_[5];
+  uint8_t buffer_[64];
+  size_t buffer_size_;
+  uint64_t total_size_;
+};
+
+}  // namespace crypto
+}  // namespace xe
+
+#endif  // XENIA_BASE_CRYPTO_H_
@@ -145,6 +145,21 @@
 #define XE_MSVC_OPTIMIZE_REVERT()
 #endif
 
+// Instruction set extensions above the global build options for functions
+// selected at runtime based on amd64::GetFeatureFlags. MSVC allows using
+// intrinsics of any extension without this.
+#if XE_ARCH_AMD64 == 1 && XE_COMPILER_HAS_GNU_EXTENSIONS == 1
+#define XE_TARGET_AVX2 __attribute__((target("avx2")))
+#define XE_TARGET_AVX512BW __attribute__((target("avx2,avx512f,avx512bw")))
+#define XE_TARGET_AES __attribute__((target("aes")))
+#define XE_TARGET_SHA __attribute__((target("sha")))
+#else
+#define XE_TARGET_AVX2
+#define XE_TARGET_AVX512BW
+#define XE_TARGET_AES
+#define XE_TARGET_SHA
+#endif
+
 #if XE_COMPILER_HAS_GNU_EXTENSIONS == 1
 #define XE_LIKELY_IF(...) if (XE_LIKELY(__VA_ARGS__))
 #define XE_UNLIKELY_IF(...) if (XE_UNLIKELY(__VA_ARGS__))
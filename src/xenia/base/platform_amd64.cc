@@ -29,6 +29,8 @@ DEFINE_int64(x64_extension_mask, -1LL,
              " 1024 = AVX512BW\n"
              " 2048 = AVX512DQ\n"
              " 4096 = AVX512VBMI\n"
+             " 2097152 = AES-NI\n"
+             " 4194304 = SHA\n"
              "   -1 = Detect and utilize all possible processor features\n",
              "x64");
 namespace xe {
@@ -63,6 +65,7 @@ void InitFeatureFlags() {
     TEST_EMIT_FEATURE(kX64EmitAVX512DQ, Xbyak::util::Cpu::tAVX512DQ);
     TEST_EMIT_FEATURE(kX64EmitAVX512VBMI, Xbyak::util::Cpu::tAVX512VBMI);
     TEST_EMIT_FEATURE(kX64EmitPrefetchW, Xbyak::util::Cpu::tPREFETCHW);
+    TEST_EMIT_FEATURE(kX64EmitAESNI, Xbyak::util::Cpu::tAESNI);
 #undef TEST_EMIT_FEATURE
     /*
     fix for xbyak bug/omission, amd cpus are never checked for lzcnt. fixed in
@@ -127,6 +130,9 @@ void InitFeatureFlags() {
     if ((data[1] & (1 << 9)) && (cvars::x64_extension_mask & kX64FastRepMovs)) {
       feature_flags_ |= kX64FastRepMovs;
     }
+    if ((data[1] & (1 << 29)) && (cvars::x64_extension_mask & kX64EmitSHA)) {
+      feature_flags_ |= kX64EmitSHA;
+    }
   }
   g_feature_flags = feature_flags_;
   g_did_initialize_feature_flags = true;
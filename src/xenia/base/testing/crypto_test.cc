@@ -0,0 +1,265 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/base/crypto.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "xenia/base/platform.h"
+
+#include "third_party/catch/include/catch.hpp"
+#include "third_party/crypto/TinySHA1.hpp"
+#include "third_party/crypto/rijndael-alg-fst.h"
+
+namespace xe {
+namespace base {
+namespace test {
+
+using namespace xe::crypto;
+
+static void InitFeatureFlags() {
+#if XE_ARCH_AMD64
+  amd64::InitFeatureFlags();
+#endif  // XE_ARCH_AMD64
+}
+
+// The implementations available on the host, portable first.
+static std::vector<bool> GetAllowHardwareVariants(bool is_available) {
+  if (is_available) {
+    return {false, true};
+  }
+  return {false};
+}
+
+static std::vector<uint8_t> GenerateRandomBytes(std::mt19937& random,
+                                                size_t size) {
+  std::vector<uint8_t> bytes(size);
+  for (uint8_t& byte : bytes) {
+    byte = uint8_t(random());
+  }
+  return bytes;
+}
+
+TEST_CASE("AES-128 decryption known answer", "[crypto]") {
+  InitFeatureFlags();
+  // FIPS-197 appendix C.1 - with a zero IV, the first CBC block is the raw
+  // block cipher output.
+  static const uint8_t kKey[16] = {0x00, 0x01, 0x02, 0x03, 0x04, 0x05,
+                                   0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B,
+                                   0x0C, 0x0D, 0x0E, 0x0F};
+  static const uint8_t kCiphertext[16] = {0x69, 0xC4, 0xE0, 0xD8, 0x6A, 0x7B,
+                                          0x04, 0x30, 0xD8, 0xCD, 0xB7, 0x80,
+                                          0x70, 0xB4, 0xC5, 0x5A};
+  static const uint8_t kPlaintext[16] = {0x00, 0x11, 0x22, 0x33, 0x44, 0x55,
+                                         0x66, 0x77, 0x88, 0x99, 0xAA, 0xBB,
+                                         0xCC, 0xDD, 0xEE, 0xFF};
+  for (bool allow_hardware :
+       GetAllowHardwareVariants(IsAesHardwareAccelerated())) {
+    Aes128CbcDecryptor decryptor(kKey, allow_hardware);
+    REQUIRE(decryptor.is_hardware_accelerated() == allow_hardware);
+    uint8_t plaintext[16];
+    decryptor.Decrypt(kCiphertext, plaintext, sizeof(plaintext));
+    REQUIRE(!std::memcmp(plaintext, kPlaintext, sizeof(plaintext)));
+  }
+}
+
+TEST_CASE("AES-128 CBC decryption chaining", "[crypto]") {
+  InitFeatureFlags();
+  std::mt19937 random(1);
+  std::vector<bool> variants =
+      GetAllowHardwareVariants(IsAesHardwareAccelerated());
+  for (size_t size : {16, 32, 112, 128, 144, 4096, 65552, 65557}) {
+    std::vector<uint8_t> key = GenerateRandomBytes(random, 16);
+    std::vector<uint8_t> ciphertext = GenerateRandomBytes(random, size);
+
+    // Reference - the loop previously used for XEX images.
+    std::vector<uint8_t> expected(size);
+    {
+      uint32_t rk[4 * (MAXNR + 1)];
+      int32_t nr = rijndaelKeySetupDec(rk, key.data(), 128);
+      uint8_t ivec[16] = {};
+      for (size_t n = 0; n + 16 <= size; n += 16) {
+        rijndaelDecrypt(rk, nr, ciphertext.data() + n, expected.data() + n);
+        for (size_t i = 0; i < 16; ++i) {
+          expected[n + i] ^= ivec[i];
+          ivec[i] = ciphertext[n + i];
+        }
+      }
+      if (size % 16) {
+        uint8_t block[16] = {};
+        size_t tail = size - size % 16;
+        std::memcpy(block, ciphertext.data() + tail, size % 16);
+        rijndaelDecrypt(rk, nr, block, block);
+        for (size_t i = 0; i < size % 16; ++i) {
+          expected[tail + i] = block[i] ^ ivec[i];
+        }
+      }
+    }
+
+    for (bool allow_hardware : variants) {
+      // All at once.
+      std::vector<uint8_t> plaintext(size);
+      Aes128CbcDecryptor(key.data(), allow_hardware)
+          .Decrypt(ciphertext.data(), plaintext.data(), size);
+      REQUIRE(plaintext == expected);
+
+      // In place, in pieces of random sizes.
+      plaintext = ciphertext;
+      Aes128CbcDecryptor decryptor(key.data(), allow_hardware);
+      size_t offset = 0;
+      while (offset < size) {
+        size_t piece = std::min(size - offset, size_t(random() % 8 + 1) * 16);
+        decryptor.Decrypt(plaintext.data() + offset, plaintext.data() + offset,
+                          piece);
+        offset += piece;
+      }
+      REQUIRE(plaintext == expected);
+    }
+  }
+}
+
+static void RequireSha1Digest(const void* data, size_t size,
+                              const uint8_t* expected) {
+  for (bool allow_hardware :
+       GetAllowHardwareVariants(IsSha1HardwareAccelerated())) {
+    uint8_t digest[Sha1::kDigestSize];
+    Sha1::Digest(data, size, digest, allow_hardware);
+    REQUIRE(!std::memcmp(digest, expected, Sha1::kDigestSize));
+  }
+}
+
+TEST_CASE("SHA-1 known answer", "[crypto]") {
+  InitFeatureFlags();
+  // FIPS 180 examples.
+  static const uint8_t kEmptyDigest[20] = {
+      0xDA, 0x39, 0xA3, 0xEE, 0x5E, 0x6B, 0x4B, 0x0D, 0x32, 0x55,
+      0xBF, 0xEF, 0x95, 0x60, 0x18, 0x90, 0xAF, 0xD8, 0x07, 0x09};
+  RequireSha1Digest("", 0, kEmptyDigest);
+  static const uint8_t kAbcDigest[20] = {
+      0xA9, 0x99, 0x3E, 0x36, 0x47, 0x06, 0x81, 0x6A, 0xBA, 0x3E,
+      0x25, 0x71, 0x78, 0x50, 0xC2, 0x6C, 0x9C, 0xD0, 0xD8, 0x9D};
+  RequireSha1Digest("abc", 3, kAbcDigest);
+  static const char kTwoBlockMessage[] =
+      "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+  static const uint8_t kTwoBlockDigest[20] = {
+      0x84, 0x98, 0x3E, 0x44, 0x1C, 0x3B, 0xD2, 0x6E, 0xBA, 0xAE,
+      0x4A, 0xA1, 0xF9, 0x51, 0x29, 0xE5, 0xE5, 0x46, 0x70, 0xF1};
+  RequireSha1Digest(kTwoBlockMessage, sizeof(kTwoBlockMessage) - 1,
+                    kTwoBlockDigest);
+  std::vector<uint8_t> million_a(1000000, 'a');
+  static const uint8_t kMillionADigest[20] = {
+      0x34, 0xAA, 0x97, 0x3C, 0xD4, 0xC4, 0xDA, 0xA4, 0xF6, 0x1E,
+      0xEB, 0x2B, 0xDB, 0xAD, 0x27, 0x31, 0x65, 0x34, 0x01, 0x6F};
+  RequireSha1Digest(million_a.data(), million_a.size(), kMillionADigest);
+}
+
+TEST_CASE("SHA-1 incremental updates", "[crypto]") {
+  InitFeatureFlags();
+  std::mt19937 random(2);
+  std::vector<bool> variants =
+      GetAllowHardwareVariants(IsSha1HardwareAccelerated());
+  for (size_t size : {1, 55, 56, 63, 64, 65, 119, 120, 128, 1000, 65536}) {
+    std::vector<uint8_t> data = GenerateRandomBytes(random, size);
+    uint8_t expected[Sha1::kDigestSize];
+    sha1::SHA1 reference;
+    reference.processBytes(data.data(), size);
+    reference.finalize(expected);
+    for (bool allow_hardware : variants) {
+      Sha1 sha1(allow_hardware);
+      size_t offset = 0;
+      while (offset < size) {
+        size_t piece = std::min(size - offset, size_t(random() % 150));
+        sha1.Update(data.data() + offset, piece);
+        offset += piece;
+      }
+      uint8_t digest[Sha1::kDigestSize];
+      sha1.Finalize(digest);
+      REQUIRE(!std::memcmp(digest, expected, Sha1::kDigestSize));
+      // Reusable after resetting.
+      sha1.Reset();
+      sha1.Update(data.data(), size);
+      sha1.Finalize(digest);
+      REQUIRE(!std::memcmp(digest, expected, Sha1::kDigestSize));
+    }
+  }
+}
+
+TEST_CASE("XEX image crypto benchmark", "[crypto][.][benchmark]") {
+  // The cryptographic work done when loading a synthetic 64 MB XEX image with
+  // normal (LZX) compression - decryption of the whole file, hashing of every
+  // compressed block, and hashing of the code range for the precompiler.
+  InitFeatureFlags();
+  constexpr size_t kImageSize = 64 * 1024 * 1024;
+  constexpr size_t kCompressedBlockSize = 32 * 1024;
+  std::mt19937 random(3);
+  std::vector<uint8_t> key = GenerateRandomBytes(random, 16);
+  std::vector<uint8_t> image = GenerateRandomBytes(random, kImageSize);
+  std::vector<uint8_t> decrypted(kImageSize);
+  uint8_t digest[Sha1::kDigestSize];
+
+  auto report = [](const char* name, std::chrono::microseconds elapsed) {
+    WARN(name << ": " << elapsed.count() / 1000 << " ms ("
+              << double(kImageSize) /
+                     std::max(double(elapsed.count()), 1.0)
+              << " MB/s)");
+  };
+
+  // Previous implementation - byte-wise TinySHA1 and table-based AES.
+  {
+    auto start_time = std::chrono::steady_clock::now();
+    uint32_t rk[4 * (MAXNR + 1)];
+    int32_t nr = rijndaelKeySetupDec(rk, key.data(), 128);
+    uint8_t ivec[16] = {};
+    for (size_t n = 0; n < kImageSize; n += 16) {
+      rijndaelDecrypt(rk, nr, image.data() + n, decrypted.data() + n);
+      for (size_t i = 0; i < 16; ++i) {
+        decrypted[n + i] ^= ivec[i];
+        ivec[i] = image[n + i];
+      }
+    }
+    sha1::SHA1 block_sha1;
+    for (size_t n = 0; n < kImageSize; n += kCompressedBlockSize) {
+      block_sha1.reset();
+      block_sha1.processBytes(decrypted.data() + n, kCompressedBlockSize);
+      block_sha1.finalize(digest);
+    }
+    sha1::SHA1 image_sha1;
+    image_sha1.processBytes(decrypted.data(), kImageSize);
+    image_sha1.finalize(digest);
+    report("Previous XEX crypto",
+           std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now() - start_time));
+  }
+
+  for (bool allow_hardware :
+       GetAllowHardwareVariants(IsAesHardwareAccelerated() ||
+                                IsSha1HardwareAccelerated())) {
+    auto start_time = std::chrono::steady_clock::now();
+    Aes128CbcDecryptor(key.data(), allow_hardware)
+        .Decrypt(image.data(), decrypted.data(), kImageSize);
+    Sha1 sha1(allow_hardware);
+    for (size_t n = 0; n < kImageSize; n += kCompressedBlockSize) {
+      sha1.Reset();
+      sha1.Update(decrypted.data() + n, kCompressedBlockSize);
+      sha1.Finalize(digest);
+    }
+    Sha1::Digest(decrypted.data(), kImageSize, digest, allow_hardware);
+    report(allow_hardware ? "Hardware XEX crypto" : "Portable XEX crypto",
+           std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now() - start_time));
+  }
+}
+
+}  // namespace test
+}  // namespace base
+}  // namespace xe
@@ -41,6 +41,10 @@ class Assembler {
                         uint32_t debug_info_flags,
                         std::unique_ptr<FunctionDebugInfo> debug_info) = 0;
 
+  // Places code generated for the function during a previous run, if
+  // available, instead of assembling it again.
+  virtual bool AssembleStored(GuestFunction* function) { return false; }
+
  protected:
   Backend* backend_;
 };
@@ -10,7 +10,9 @@
 #ifndef XENIA_CPU_BACKEND_BACKEND_H_
 #define XENIA_CPU_BACKEND_BACKEND_H_
 
+#include <filesystem>
 #include <memory>
+#include <vector>
 
 #include "xenia/cpu/backend/machine_info.h"
 #include "xenia/cpu/thread_debug_info.h"
@@ -58,6 +60,17 @@ class Backend {
   virtual void CommitExecutableRange(uint32_t guest_low,
                                      uint32_t guest_high) = 0;
 
+  // Opens persistent storage for code generated for the guest address range,
+  // returning the addresses of the functions stored during previous runs.
+  virtual std::vector<uint32_t> InitializeCodeStorage(
+      const std::filesystem::path& storage_root, uint32_t guest_low,
+      uint32_t guest_high) {
+    return {};
+  }
+  // Closes the storage opened for the guest address range when the module is
+  // unloaded.
+  virtual void ShutdownCodeStorage(uint32_t guest_low, uint32_t guest_high) {}
+
   virtual std::unique_ptr<Assembler> CreateAssembler() = 0;
 
   virtual std::unique_ptr<GuestFunction> CreateGuestFunction(
@@ -95,6 +95,12 @@ bool X64Assembler::Assemble(GuestFunction* function, HIRBuilder* builder,
   static_cast<X64Function*>(function)->Setup(
       reinterpret_cast<uint8_t*>(machine_code), code_size);
 
+  X64CodeCacheStorage* code_storage = emitter_->code_storage();
+  if (code_storage) {
+    code_storage->StoreFunction(static_cast<X64Function*>(function),
+                                emitter_->func_info(), emitter_->relocations());
+  }
+
   // Install into indirection table.
   uint64_t host_address = reinterpret_cast<uint64_t>(machine_code);
   assert_true((host_address >> 32) == 0);
@@ -105,6 +111,24 @@ bool X64Assembler::Assemble(GuestFunction* function, HIRBuilder* builder,
   return true;
 }
 
+bool X64Assembler::AssembleStored(GuestFunction* function) {
+  std::shared_ptr<X64CodeCacheStorage> code_storage =
+      x64_backend_->LookupCodeStorage(function->address());
+  if (!code_storage ||
+      !code_storage->LoadFunction(static_cast<X64Function*>(function))) {
+    return false;
+  }
+
+  // Install into indirection table.
+  uint64_t host_address =
+      reinterpret_cast<uint64_t>(function->machine_code());
+  assert_true((host_address >> 32) == 0);
+  x64_backend_->code_cache()->AddIndirection(
+      function->address(), static_cast<uint32_t>(host_address));
+
+  return true;
+}
+
 void X64Assembler::DumpMachineCode(
     void* machine_code, size_t code_size,
     const std::vector<SourceMapEntry>& source_map, StringBuffer* str) {
@@ -15,9 +15,13 @@
 #include "third_party/capstone/include/capstone/x86.h"
 
 #include "xenia/base/exception_handler.h"
+#include "xenia/base/filesystem.h"
 #include "xenia/base/logging.h"
+#include "xenia/base/mapped_memory.h"
+#include "xenia/base/xxhash.h"
 #include "xenia/cpu/backend/x64/x64_assembler.h"
 #include "xenia/cpu/backend/x64/x64_code_cache.h"
+#include "xenia/cpu/backend/x64/x64_code_cache_storage.h"
 #include "xenia/cpu/backend/x64/x64_emitter.h"
 #include "xenia/cpu/backend/x64/x64_function.h"
 #include "xenia/cpu/backend/x64/x64_sequences.h"
@@ -41,6 +45,14 @@ DEFINE_bool(enable_host_guest_stack_synchronization, true,
             "and checks for reentry at return sites. Has slight performance "
             "impact, but fixes crashes in games that use setjmp/longjmp.",
             "x64");
+
+DEFINE_bool(x64_persistent_code_cache, false,
+            "Store the generated x64 code for guest functions in the cache "
+            "directory and reuse it on subsequent launches of the same title, "
+            "skipping the translation of the functions stored previously. "
+            "The storage is invalidated when the emulator executable, the "
+            "host CPU or any CPU settings change.",
+            "x64");
 #if XE_X64_PROFILER_AVAILABLE == 1
 DECLARE_bool(instrument_call_times);
 #endif
@@ -140,6 +152,8 @@ X64Backend::~X64Backend() {
     cs_close(&capstone_handle_);
   }
 
+  code_storages_.clear();
+
   X64Emitter::FreeConstData(emitter_data_);
   ExceptionHandler::Uninstall(&ExceptionCallbackThunk, this);
   if (guest_trampoline_memory_) {
@@ -328,6 +342,105 @@ void X64Backend::CommitExecutableRange(uint32_t guest_low,
   code_cache_->CommitExecutableRange(guest_low, guest_high);
 }
 
+std::vector<uint32_t> X64Backend::InitializeCodeStorage(
+    const std::filesystem::path& storage_root, uint32_t guest_low,
+    uint32_t guest_high) {
+  std::vector<uint32_t> stored_addresses;
+  if (!cvars::x64_persistent_code_cache) {
+    return stored_addresses;
+  }
+  std::lock_guard<std::mutex> lock(code_storages_mutex_);
+
+  if (!code_storage_fingerprint_) {
+    // Everything the emitted code may depend on other than the guest code.
+    XXH3_state_t hash_state;
+    XXH3_64bits_reset(&hash_state);
+    uint32_t storage_version = X64CodeCacheStorage::kVersion;
+    XXH3_64bits_update(&hash_state, &storage_version, sizeof(storage_version));
+    // Host functions and data are referenced relatively to the anchor, but
+    // their layout is specific to the executable.
+    auto executable =
+        MappedMemory::Open(xe::filesystem::GetExecutablePath(),
+                           MappedMemory::Mode::kRead);
+    if (!executable) {
+      XELOGE(
+          "Failed to read the emulator executable, persistent code cache will "
+          "be disabled");
+      return stored_addresses;
+    }
+    XXH3_64bits_update(&hash_state, executable->data(), executable->size());
+    executable->Close();
+    // Thunks, helpers and constants are referenced by absolute addresses.
+    const void* fixed_addresses[] = {
+        reinterpret_cast<const void*>(emitter_data_),
+        reinterpret_cast<const void*>(host_to_guest_thunk_),
+        reinterpret_cast<const void*>(guest_to_host_thunk_),
+        reinterpret_cast<const void*>(resolve_function_thunk_),
+        synchronize_guest_and_host_stack_helper_,
+        synchronize_guest_and_host_stack_helper_size8_,
+        synchronize_guest_and_host_stack_helper_size16_,
+        synchronize_guest_and_host_stack_helper_size32_,
+        try_acquire_reservation_helper_,
+        reserved_store_32_helper,
+        reserved_store_64_helper,
+        vrsqrtefp_vector_helper,
+        vrsqrtefp_scalar_helper,
+        frsqrtefp_helper,
+        // Some sequences are selected based on the value of the base.
+        processor()->memory()->virtual_membase(),
+    };
+    XXH3_64bits_update(&hash_state, fixed_addresses, sizeof(fixed_addresses));
+    uint64_t feature_flags = amd64::GetFeatureFlags();
+    XXH3_64bits_update(&hash_state, &feature_flags, sizeof(feature_flags));
+    // Code generation options, including the frontend and the compiler ones.
+    if (cvar::ConfigVars) {
+      for (const auto& config_var : *cvar::ConfigVars) {
+        const std::string& category = config_var.second->category();
+        if (category != "CPU" && category != "x64") {
+          continue;
+        }
+        std::string value = config_var.first + '=' +
+                            config_var.second->config_value();
+        XXH3_64bits_update(&hash_state, value.data(), value.size() + 1);
+      }
+    }
+    code_storage_fingerprint_ = XXH3_64bits_digest(&hash_state);
+  }
+
+  auto storage = std::make_shared<X64CodeCacheStorage>(code_cache_.get(),
+                                                       guest_low, guest_high);
+  std::filesystem::create_directories(storage_root);
+  if (!storage->Initialize(storage_root / "code_x64.bin",
+                           code_storage_fingerprint_, &stored_addresses)) {
+    return stored_addresses;
+  }
+  code_storages_.push_back(std::move(storage));
+  return stored_addresses;
+}
+
+void X64Backend::ShutdownCodeStorage(uint32_t guest_low,
+                                     uint32_t guest_high) {
+  std::lock_guard<std::mutex> lock(code_storages_mutex_);
+  // The file is closed when the last compilation using it is done.
+  code_storages_.erase(
+      std::remove_if(code_storages_.begin(), code_storages_.end(),
+                     [guest_low](const auto& storage) {
+                       return storage->ContainsAddress(guest_low);
+                     }),
+      code_storages_.end());
+}
+
+std::shared_ptr<X64CodeCacheStorage> X64Backend::LookupCodeStorage(
+    uint32_t guest_address) const {
+  std::lock_guard<std::mutex> lock(code_storages_mutex_);
+  for (const auto& storage : code_storages_) {
+    if (storage->ContainsAddress(guest_address)) {
+      return storage;
+    }
+  }
+  return nullptr;
+}
+
 std::unique_ptr<Assembler> X64Backend::CreateAssembler() {
   return std::make_unique<X64Assembler>(this);
 }
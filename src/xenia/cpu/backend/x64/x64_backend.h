@@ -11,6 +11,8 @@
 #define XENIA_CPU_BACKEND_X64_X64_BACKEND_H_
 
 #include <memory>
+#include <mutex>
+#include <vector>
 
 #include "xenia/base/bit_map.h"
 #include "xenia/base/cvar.h"
@@ -27,6 +29,7 @@
 DECLARE_int64(x64_extension_mask);
 DECLARE_int64(max_stackpoints);
 DECLARE_bool(enable_host_guest_stack_synchronization);
+DECLARE_bool(x64_persistent_code_cache);
 namespace xe {
 class Exception;
 }  // namespace xe
@@ -38,6 +41,7 @@ namespace x64 {
 using GuestProfilerData = std::map<uint32_t, uint64_t>;
 
 class X64CodeCache;
+class X64CodeCacheStorage;
 
 typedef void* (*HostToGuestThunk)(void* target, void* arg0, void* arg1);
 typedef void* (*GuestToHostThunk)(void* target, void* arg0, void* arg1);
@@ -154,6 +158,15 @@ class X64Backend : public Backend {
 
   void CommitExecutableRange(uint32_t guest_low, uint32_t guest_high) override;
 
+  std::vector<uint32_t> InitializeCodeStorage(
+      const std::filesystem::path& storage_root, uint32_t guest_low,
+      uint32_t guest_high) override;
+  void ShutdownCodeStorage(uint32_t guest_low, uint32_t guest_high) override;
+  // Shared because a storage may be closed when its module is unloaded while a
+  // function is being compiled with it.
+  std::shared_ptr<X64CodeCacheStorage> LookupCodeStorage(
+      uint32_t guest_address) const;
+
   std::unique_ptr<Assembler> CreateAssembler() override;
 
   std::unique_ptr<GuestFunction> CreateGuestFunction(Module* module,
@@ -199,6 +212,11 @@ class X64Backend : public Backend {
   std::unique_ptr<X64CodeCache> code_cache_;
   uintptr_t emitter_data_ = 0;
 
+  // One per module, created when the module is loaded.
+  mutable std::mutex code_storages_mutex_;
+  std::vector<std::shared_ptr<X64CodeCacheStorage>> code_storages_;
+  uint64_t code_storage_fingerprint_ = 0;
+
   HostToGuestThunk host_to_guest_thunk_;
   GuestToHostThunk guest_to_host_thunk_;
   ResolveFunctionThunk resolve_function_thunk_;
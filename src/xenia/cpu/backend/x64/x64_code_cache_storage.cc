@@ -0,0 +1,390 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/backend/x64/x64_code_cache_storage.h"
+
+#include <cstddef>
+#include <cstring>
+
+#include "xenia/base/byte_order.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/xxhash.h"
+#include "xenia/cpu/backend/x64/x64_function.h"
+#include "xenia/cpu/module.h"
+#include "xenia/cpu/xex_module.h"
+#include "xenia/memory.h"
+
+namespace xe {
+namespace cpu {
+namespace backend {
+namespace x64 {
+
+namespace {
+// Only the address of this function matters, it's the base for relocations of
+// pointers to the executable.
+void HostImageAnchorFunction() {}
+}  // namespace
+
+X64CodeCacheStorage::X64CodeCacheStorage(X64CodeCache* code_cache,
+                                         uint32_t guest_low,
+                                         uint32_t guest_high)
+    : code_cache_(code_cache), guest_low_(guest_low), guest_high_(guest_high) {}
+
+X64CodeCacheStorage::~X64CodeCacheStorage() { Shutdown(); }
+
+uintptr_t X64CodeCacheStorage::HostImageAnchor() {
+  return reinterpret_cast<uintptr_t>(&HostImageAnchorFunction);
+}
+
+uint64_t X64CodeCacheStorage::HashGuestCode(
+    const GuestFunction* function, uint32_t end_address,
+    const GuestFunction::CodeRange* external_ranges,
+    uint32_t external_range_count) {
+  if (end_address < function->address()) {
+    return 0;
+  }
+  Module* module = function->module();
+  auto xex_module = dynamic_cast<XexModule*>(module);
+  XXH3_state_t hash_state;
+  XXH3_64bits_reset(&hash_state);
+  auto hash_range = [&](uint32_t start_address, uint32_t end_address) {
+    XXH3_64bits_update(&hash_state,
+                       module->memory()->TranslateVirtual(start_address),
+                       end_address - start_address + 4);
+    if (xex_module) {
+      for (uint32_t address = start_address; address <= end_address;
+           address += 4) {
+        InfoCacheFlags* flags = xex_module->GetInstructionAddressFlags(address);
+        if (flags && flags->accessed_mmio) {
+          XXH3_64bits_update(&hash_state, &address, sizeof(address));
+        }
+      }
+    }
+  };
+  hash_range(function->address(), end_address);
+  for (uint32_t i = 0; i < external_range_count; ++i) {
+    const GuestFunction::CodeRange& range = external_ranges[i];
+    XXH3_64bits_update(&hash_state, &range, sizeof(range));
+    hash_range(range.start_address, range.end_address);
+  }
+  return XXH3_64bits_digest(&hash_state);
+}
+
+bool X64CodeCacheStorage::Initialize(
+    const std::filesystem::path& path, uint64_t host_fingerprint,
+    std::vector<uint32_t>* stored_addresses_out) {
+  Shutdown();
+
+  file_ = xe::filesystem::OpenFile(path, "a+b");
+  if (!file_) {
+    XELOGE(
+        "Failed to open the code cache storage file for writing, persistent "
+        "code cache will be disabled: {}",
+        path);
+    return false;
+  }
+
+  struct {
+    uint32_t magic;
+    uint32_t version_swapped;
+    uint64_t host_fingerprint;
+  } file_header;
+  // 'XEJC'.
+  const uint32_t file_magic = 0x434A4558;
+  if (fread(&file_header, sizeof(file_header), 1, file_) &&
+      file_header.magic == file_magic &&
+      xe::byte_swap(file_header.version_swapped) == kVersion &&
+      file_header.host_fingerprint == host_fingerprint) {
+    xe::filesystem::Seek(file_, 0, SEEK_END);
+    int64_t file_told_end = xe::filesystem::Tell(file_);
+    if (file_told_end > int64_t(sizeof(file_header)) &&
+        xe::filesystem::Seek(file_, int64_t(sizeof(file_header)), SEEK_SET)) {
+      stored_data_.resize(size_t(file_told_end) - sizeof(file_header));
+      stored_data_.resize(
+          fread(stored_data_.data(), 1, stored_data_.size(), file_));
+    }
+
+    // Index the records until the end of the file or until a corrupted one is
+    // detected.
+    size_t offset = 0;
+    while (stored_data_.size() - offset >= sizeof(StoredFunctionHeader)) {
+      StoredFunctionHeader header;
+      std::memcpy(&header, stored_data_.data() + offset, sizeof(header));
+      size_t data_size =
+          size_t(header.code_size) +
+          sizeof(SourceMapEntry) * header.source_map_count +
+          sizeof(X64CodeRelocation) * header.relocation_count +
+          sizeof(GuestFunction::CodeRange) * header.external_range_count;
+      if (stored_data_.size() - offset - sizeof(header) < data_size) {
+        break;
+      }
+      const uint8_t* data = stored_data_.data() + offset + sizeof(header);
+      XXH3_state_t hash_state;
+      XXH3_64bits_reset(&hash_state);
+      XXH3_64bits_update(&hash_state, &header,
+                         offsetof(StoredFunctionHeader, data_hash));
+      XXH3_64bits_update(&hash_state, data, data_size);
+      if (XXH3_64bits_digest(&hash_state) != header.data_hash) {
+        break;
+      }
+      // The guest code the record was generated from is hashed when loading,
+      // so it must be within the module.
+      if (header.guest_end_address < header.guest_address ||
+          !ContainsAddress(header.guest_end_address)) {
+        break;
+      }
+      const uint8_t* relocation_data =
+          data + header.code_size +
+          sizeof(SourceMapEntry) * header.source_map_count;
+      bool relocations_valid = true;
+      for (uint32_t i = 0; i < header.relocation_count; ++i) {
+        X64CodeRelocation relocation;
+        std::memcpy(&relocation,
+                    relocation_data + sizeof(X64CodeRelocation) * i,
+                    sizeof(relocation));
+        uint32_t field_size;
+        switch (relocation.type) {
+          case X64CodeRelocationType::kCodeCacheRel32:
+            field_size = sizeof(int32_t);
+            break;
+          case X64CodeRelocationType::kHostImageAbs64:
+            field_size = sizeof(uint64_t);
+            break;
+          default:
+            field_size = UINT32_MAX;
+        }
+        if (field_size > header.code_size ||
+            relocation.offset > header.code_size - field_size) {
+          relocations_valid = false;
+          break;
+        }
+      }
+      if (!relocations_valid) {
+        break;
+      }
+      const uint8_t* external_range_data =
+          relocation_data +
+          sizeof(X64CodeRelocation) * header.relocation_count;
+      bool external_ranges_valid = true;
+      for (uint32_t i = 0; i < header.external_range_count; ++i) {
+        GuestFunction::CodeRange range;
+        std::memcpy(&range,
+                    external_range_data + sizeof(GuestFunction::CodeRange) * i,
+                    sizeof(range));
+        if (range.start_address > range.end_address ||
+            !ContainsAddress(range.start_address) ||
+            !ContainsAddress(range.end_address)) {
+          external_ranges_valid = false;
+          break;
+        }
+      }
+      if (!external_ranges_valid) {
+        break;
+      }
+      if (ContainsAddress(header.guest_address)) {
+        // Functions may be stored multiple times if the guest code has been
+        // modified, the latest version is the most likely to be up to date.
+        stored_functions_[header.guest_address] = offset;
+      }
+      offset += sizeof(header) + data_size;
+    }
+    stored_data_.resize(offset);
+    // If any records were corrupted (or the whole file has excess bytes in the
+    // end), truncate to the last valid record.
+    xe::filesystem::TruncateStdioFile(file_,
+                                      uint64_t(sizeof(file_header) + offset));
+  } else {
+    xe::filesystem::TruncateStdioFile(file_, 0);
+    file_header.magic = file_magic;
+    file_header.version_swapped = xe::byte_swap(kVersion);
+    file_header.host_fingerprint = host_fingerprint;
+    fwrite(&file_header, sizeof(file_header), 1, file_);
+  }
+
+  if (stored_addresses_out) {
+    stored_addresses_out->clear();
+    stored_addresses_out->reserve(stored_functions_.size());
+    for (const auto& stored_function : stored_functions_) {
+      stored_addresses_out->push_back(stored_function.first);
+    }
+  }
+  XELOGI("Code cache storage: {} functions available in {}",
+         stored_functions_.size(), path);
+  return true;
+}
+
+void X64CodeCacheStorage::Shutdown() {
+  std::lock_guard<std::mutex> lock(file_mutex_);
+  if (file_) {
+    XELOGI("Code cache storage: {} functions loaded, {} functions stored",
+           loaded_function_count_.load(), stored_function_count_.load());
+    fclose(file_);
+    file_ = nullptr;
+  }
+  stored_functions_.clear();
+  stored_data_.clear();
+  stored_data_.shrink_to_fit();
+}
+
+bool X64CodeCacheStorage::LoadFunction(X64Function* function) {
+  auto it = stored_functions_.find(function->address());
+  if (it == stored_functions_.cend()) {
+    return false;
+  }
+  const uint8_t* record = stored_data_.data() + it->second;
+  StoredFunctionHeader header;
+  std::memcpy(&header, record, sizeof(header));
+  const uint8_t* code = record + sizeof(header);
+  const uint8_t* source_map_data = code + header.code_size;
+  const uint8_t* relocation_data =
+      source_map_data + sizeof(SourceMapEntry) * header.source_map_count;
+  std::vector<GuestFunction::CodeRange> external_ranges(
+      header.external_range_count);
+  std::memcpy(external_ranges.data(),
+              relocation_data +
+                  sizeof(X64CodeRelocation) * header.relocation_count,
+              sizeof(GuestFunction::CodeRange) * header.external_range_count);
+  // Don't hash guest memory outside the module if the record doesn't belong
+  // to this function.
+  if (header.guest_address != function->address() ||
+      header.guest_end_address < header.guest_address ||
+      !ContainsAddress(header.guest_end_address)) {
+    return false;
+  }
+  for (const GuestFunction::CodeRange& range : external_ranges) {
+    if (range.start_address > range.end_address ||
+        !ContainsAddress(range.start_address) ||
+        !ContainsAddress(range.end_address)) {
+      return false;
+    }
+  }
+  // Any of the guest code compiled into the function, including inlined
+  // callees, may have been modified.
+  if (HashGuestCode(function, header.guest_end_address,
+                    external_ranges.data(), header.external_range_count) !=
+      header.guest_code_hash) {
+    return false;
+  }
+
+  EmitFunctionInfo func_info = {};
+  func_info.code_size.prolog = header.code_size_prolog;
+  func_info.code_size.body = header.code_size_body;
+  func_info.code_size.epilog = header.code_size_epilog;
+  func_info.code_size.tail = header.code_size_tail;
+  func_info.code_size.total = header.code_size;
+  func_info.prolog_stack_alloc_offset = header.prolog_stack_alloc_offset;
+  func_info.stack_size = header.stack_size;
+
+  // Not passing the guest address so the indirection table is not updated
+  // before the relocations are applied.
+  void* code_execute_address;
+  void* code_write_address;
+  code_cache_->PlaceGuestCode(0, const_cast<uint8_t*>(code), func_info,
+                              function, code_execute_address,
+                              code_write_address);
+
+  auto execute_base = reinterpret_cast<uintptr_t>(code_execute_address);
+  auto write_base = reinterpret_cast<uint8_t*>(code_write_address);
+  for (uint32_t i = 0; i < header.relocation_count; ++i) {
+    X64CodeRelocation relocation;
+    std::memcpy(&relocation, relocation_data + sizeof(X64CodeRelocation) * i,
+                sizeof(relocation));
+    uint8_t* field = write_base + relocation.offset;
+    switch (relocation.type) {
+      case X64CodeRelocationType::kCodeCacheRel32: {
+        // Relative to the end of the instruction, which the field is the last
+        // part of.
+        auto displacement = int32_t(int64_t(relocation.value) -
+                                    int64_t(execute_base + relocation.offset +
+                                            sizeof(int32_t)));
+        std::memcpy(field, &displacement, sizeof(displacement));
+      } break;
+      case X64CodeRelocationType::kHostImageAbs64: {
+        uint64_t host_address = HostImageAnchor() + relocation.value;
+        std::memcpy(field, &host_address, sizeof(host_address));
+      } break;
+    }
+  }
+
+  function->set_end_address(header.guest_end_address);
+  function->external_code_ranges() = std::move(external_ranges);
+  std::vector<SourceMapEntry>& source_map = function->source_map();
+  source_map.resize(header.source_map_count);
+  std::memcpy(source_map.data(), source_map_data,
+              sizeof(SourceMapEntry) * header.source_map_count);
+  function->Setup(reinterpret_cast<uint8_t*>(code_execute_address),
+                  header.code_size);
+
+  ++loaded_function_count_;
+  return true;
+}
+
+void X64CodeCacheStorage::StoreFunction(
+    X64Function* function, const EmitFunctionInfo& func_info,
+    const std::vector<X64CodeRelocation>& relocations) {
+  StoredFunctionHeader header = {};
+  header.guest_address = function->address();
+  header.guest_end_address = function->end_address();
+  const std::vector<GuestFunction::CodeRange>& external_ranges =
+      function->external_code_ranges();
+  for (const GuestFunction::CodeRange& range : external_ranges) {
+    if (!ContainsAddress(range.start_address) ||
+        !ContainsAddress(range.end_address)) {
+      // Code from another module, which can't be validated when loading.
+      return;
+    }
+  }
+  header.external_range_count = uint32_t(external_ranges.size());
+  header.guest_code_hash =
+      HashGuestCode(function, header.guest_end_address, external_ranges.data(),
+                    header.external_range_count);
+  header.code_size = uint32_t(function->machine_code_length());
+  header.code_size_prolog = uint32_t(func_info.code_size.prolog);
+  header.code_size_body = uint32_t(func_info.code_size.body);
+  header.code_size_epilog = uint32_t(func_info.code_size.epilog);
+  header.code_size_tail = uint32_t(func_info.code_size.tail);
+  header.prolog_stack_alloc_offset =
+      uint32_t(func_info.prolog_stack_alloc_offset);
+  header.stack_size = uint32_t(func_info.stack_size);
+  const std::vector<SourceMapEntry>& source_map = function->source_map();
+  header.source_map_count = uint32_t(source_map.size());
+  header.relocation_count = uint32_t(relocations.size());
+
+  XXH3_state_t hash_state;
+  XXH3_64bits_reset(&hash_state);
+  XXH3_64bits_update(&hash_state, &header,
+                     offsetof(StoredFunctionHeader, data_hash));
+  XXH3_64bits_update(&hash_state, function->machine_code(), header.code_size);
+  XXH3_64bits_update(&hash_state, source_map.data(),
+                     sizeof(SourceMapEntry) * source_map.size());
+  XXH3_64bits_update(&hash_state, relocations.data(),
+                     sizeof(X64CodeRelocation) * relocations.size());
+  XXH3_64bits_update(&hash_state, external_ranges.data(),
+                     sizeof(GuestFunction::CodeRange) * external_ranges.size());
+  header.data_hash = XXH3_64bits_digest(&hash_state);
+
+  std::lock_guard<std::mutex> lock(file_mutex_);
+  if (!file_) {
+    return;
+  }
+  fwrite(&header, sizeof(header), 1, file_);
+  fwrite(function->machine_code(), 1, header.code_size, file_);
+  fwrite(source_map.data(), sizeof(SourceMapEntry), source_map.size(), file_);
+  fwrite(relocations.data(), sizeof(X64CodeRelocation), relocations.size(),
+         file_);
+  fwrite(external_ranges.data(), sizeof(GuestFunction::CodeRange),
+         external_ranges.size(), file_);
+  ++stored_function_count_;
+}
+
+}  // namespace x64
+}  // namespace backend
+}  // namespace cpu
+}  // namespace xe
@@ -0,0 +1,147 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_BACKEND_X64_X64_CODE_CACHE_STORAGE_H_
+#define XENIA_CPU_BACKEND_X64_X64_CODE_CACHE_STORAGE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "xenia/base/assert.h"
+#include "xenia/cpu/backend/x64/x64_code_cache.h"
+#include "xenia/cpu/function.h"
+
+namespace xe {
+namespace cpu {
+namespace backend {
+namespace x64 {
+
+class X64Function;
+
+enum class X64CodeRelocationType : uint32_t {
+  // rel32 of a call or a jump to a fixed address in the code cache, such as
+  // the thunks and the helpers emitted by the backend during initialization.
+  // The value is the absolute target address.
+  kCodeCacheRel32,
+  // 64-bit immediate containing the address of a function or of data in the
+  // emulator executable. The value is relative to HostImageAnchor(), which
+  // stays the same across launches of the same executable even with ASLR.
+  kHostImageAbs64,
+};
+
+struct X64CodeRelocation {
+  // Offset of the patched field from the beginning of the function code.
+  uint32_t offset;
+  X64CodeRelocationType type;
+  uint64_t value;
+};
+
+// Persistent storage of machine code generated for guest functions of one
+// module, so it can be placed in the code cache on subsequent launches without
+// running the frontend and the compiler passes again.
+//
+// The storage is an append-only file of records, each containing the code, the
+// source map, the information needed for unwinding, the relocations that need
+// to be applied after placing the code at a new location, and the ranges of
+// guest code from outside the function compiled into it. Records are keyed by
+// the guest address and validated by the hash of all the guest code they were
+// generated from before being used. The whole file is discarded if the host
+// fingerprint (the executable, the host CPU features and the code generation
+// settings) changes.
+class X64CodeCacheStorage {
+ public:
+  // Increment when the record layout or the emitted code changes in a way not
+  // covered by the host fingerprint.
+  static constexpr uint32_t kVersion = 2;
+
+  X64CodeCacheStorage(X64CodeCache* code_cache, uint32_t guest_low,
+                      uint32_t guest_high);
+  ~X64CodeCacheStorage();
+
+  // Address used as the base for relocations of pointers to the emulator
+  // executable.
+  static uintptr_t HostImageAnchor();
+
+  // Hash of the guest code the function is generated from - its own range and
+  // the external ranges compiled into it - also covering the instructions
+  // recorded as accessing MMIO, as that changes the emitted code.
+  static uint64_t HashGuestCode(
+      const GuestFunction* function, uint32_t end_address,
+      const GuestFunction::CodeRange* external_ranges,
+      uint32_t external_range_count);
+
+  // Opens the storage file, discarding its contents if it was created with a
+  // different fingerprint. Addresses of the stored functions are written to
+  // stored_addresses_out.
+  bool Initialize(const std::filesystem::path& path, uint64_t host_fingerprint,
+                  std::vector<uint32_t>* stored_addresses_out);
+  void Shutdown();
+
+  bool ContainsAddress(uint32_t guest_address) const {
+    return guest_address >= guest_low_ && guest_address < guest_high_;
+  }
+
+  // Places the stored code for the function in the code cache if it has been
+  // generated from the same guest code. The indirection table entry is not
+  // updated, that's the responsibility of the caller.
+  bool LoadFunction(X64Function* function);
+  void StoreFunction(X64Function* function,
+                     const EmitFunctionInfo& func_info,
+                     const std::vector<X64CodeRelocation>& relocations);
+
+  uint32_t loaded_function_count() const { return loaded_function_count_; }
+  uint32_t stored_function_count() const { return stored_function_count_; }
+
+ private:
+  struct StoredFunctionHeader {
+    uint32_t guest_address;
+    uint32_t guest_end_address;
+    uint64_t guest_code_hash;
+    uint32_t code_size;
+    uint32_t code_size_prolog;
+    uint32_t code_size_body;
+    uint32_t code_size_epilog;
+    uint32_t code_size_tail;
+    uint32_t prolog_stack_alloc_offset;
+    uint32_t stack_size;
+    uint32_t source_map_count;
+    uint32_t relocation_count;
+    uint32_t external_range_count;
+    // XXH3 of the data following the header.
+    uint64_t data_hash;
+  };
+  static_assert_size(StoredFunctionHeader, 64);
+
+  X64CodeCache* code_cache_;
+  uint32_t guest_low_;
+  uint32_t guest_high_;
+
+  std::mutex file_mutex_;
+  FILE* file_ = nullptr;
+
+  // Records read from the file during initialization, immutable afterwards.
+  std::vector<uint8_t> stored_data_;
+  // Guest address -> offset of the latest record for it in stored_data_.
+  std::unordered_map<uint32_t, size_t> stored_functions_;
+
+  std::atomic<uint32_t> loaded_function_count_ = {0};
+  std::atomic<uint32_t> stored_function_count_ = {0};
+};
+
+}  // namespace x64
+}  // namespace backend
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_BACKEND_X64_X64_CODE_CACHE_STORAGE_H_
@@ -120,16 +120,28 @@ bool X64Emitter::Emit(GuestFunction* function, HIRBuilder* builder,
   debug_info_flags_ = debug_info_flags;
   trace_data_ = &function->trace_data();
   source_map_arena_.Reset();
+  // Debug info and tracing reference per-session data, don't persist code
+  // with them.
+  code_storage_ = debug_info_flags
+                      ? nullptr
+                      : backend_->LookupCodeStorage(function->address());
+  relocations_.clear();
+  // Not when recompiling the function after profiling.
+  profiled_function_ = function->tier() == GuestFunction::Tier::kBaseline &&
+                               function->profile_data() &&
+                               !function->machine_code()
+                           ? function
+                           : nullptr;
 
   // Fill the generator with code.
-  EmitFunctionInfo func_info = {};
-  if (!Emit(builder, func_info)) {
+  func_info_ = {};
+  if (!Emit(builder, func_info_)) {
     return false;
   }
 
   // Copy the final code to the cache and relocate it.
   *out_code_size = getSize();
-  *out_code_address = Emplace(func_info, function);
+  *out_code_address = Emplace(func_info_, function);
 
   // Stash source map.
   source_map_arena_.CloneContents(out_source_map);
@@ -169,6 +181,14 @@ void* X64Emitter::Emplace(const EmitFunctionInfo& func_info,
   return new_execute_address;
 }
 
+// Called by the baseline tier code of a function once it's hot.
+uint64_t OptimizeHotFunction(void* raw_context, uint64_t function_ptr) {
+  auto guest_context = reinterpret_cast<ppc::PPCContext_s*>(raw_context);
+  guest_context->processor->OptimizeFunctionAsync(
+      reinterpret_cast<GuestFunction*>(function_ptr));
+  return 0;
+}
+
 bool X64Emitter::Emit(HIRBuilder* builder, EmitFunctionInfo& func_info) {
   Xbyak::Label epilog_label;
   epilog_label_ = &epilog_label;
@@ -286,6 +306,26 @@ bool X64Emitter::Emit(HIRBuilder* builder, EmitFunctionInfo& func_info) {
     bts(qword[low_address(&trace_header->function_thread_use)], rax);
   }
 
+  Xbyak::Label optimize_resume_label;
+  if (profiled_function_) {
+    // Not atomic as that's expensive, the countdown will still reach zero at
+    // some point if updates are lost.
+    MarkCodeNotPersistable();
+    mov(rax, reinterpret_cast<uintptr_t>(
+                 &profiled_function_->profile_data()->entry_countdown));
+    sub(dword[rax], 1);
+    GuestFunction* function = profiled_function_;
+    jz(AddToTail([function, &optimize_resume_label](X64Emitter& e,
+                                                    Xbyak::Label& tail_label) {
+         e.L(tail_label);
+         e.CallNative(OptimizeHotFunction,
+                      reinterpret_cast<uint64_t>(function));
+         e.jmp(optimize_resume_label, e.T_NEAR);
+       }),
+       T_NEAR);
+    L(optimize_resume_label);
+  }
+
   // Load membase.
   /*
   * chrispy: removed this, as long as we load it in HostToGuestThunk we can
@@ -308,6 +348,14 @@ bool X64Emitter::Emit(HIRBuilder* builder, EmitFunctionInfo& func_info) {
     if (cvars::align_all_basic_blocks) {
       align(cvars::align_all_basic_blocks, true);
     }
+    if (profiled_function_) {
+      FunctionProfileData* profile_data = profiled_function_->profile_data();
+      if (block->ordinal < profile_data->block_addresses.size()) {
+        mov(rax, reinterpret_cast<uintptr_t>(
+                     &profile_data->block_counts[block->ordinal]));
+        inc(dword[rax]);
+      }
+    }
     // Process instructions.
     const Instr* instr = block->instr_head;
     while (instr) {
@@ -380,6 +428,7 @@ void X64Emitter::EmitProfilerEpilogue() {
 
     mov(ecx, 0x7ffe0014);
     mov(rdx, qword[rcx]);
+    MarkCodeNotPersistable();
     mov(r10, (uintptr_t)profiler_entry);
     sub(rdx, qword[rsp + StackLayout::GUEST_PROFILER_START]);
 
@@ -702,7 +751,11 @@ void X64Emitter::Call(const hir::Instr* instr, GuestFunction* function) {
   auto fn = static_cast<X64Function*>(function);
   // Resolve address to the function to call and store in rax.
 
-  if (fn->machine_code()) {
+  // The target will be at a different location when the code is loaded from
+  // the storage, go through the indirection table in this case. The same
+  // applies to baseline tier code that will be replaced.
+  if (fn->machine_code() && !code_storage_ &&
+      fn->tier() == GuestFunction::Tier::kOptimized) {
     if (!(instr->flags & hir::CALL_TAIL)) {
       mov(rcx, qword[rsp + StackLayout::GUEST_CALL_RET_ADDR]);
 
@@ -775,7 +828,7 @@ void X64Emitter::CallIndirect(const hir::Instr* instr,
     // Old-style resolve.
     // Not too important because indirection table is almost always available.
     mov(edx, reg.cvt32());
-    mov(rax, reinterpret_cast<uint64_t>(ResolveFunction));
+    MovHostImageAddress(rax, reinterpret_cast<const void*>(ResolveFunction));
     mov(rcx, GetContextReg());
     call(rax);
   }
@@ -818,6 +871,7 @@ void X64Emitter::CallExtern(const hir::Instr* instr, const Function* function) {
     auto builtin_function = static_cast<const BuiltinFunction*>(function);
     if (builtin_function->handler()) {
       undefined = false;
+      MarkCodeNotPersistable();
       // rcx = target function
       // rdx = arg0
       // r8  = arg1
@@ -836,7 +890,8 @@ void X64Emitter::CallExtern(const hir::Instr* instr, const Function* function) {
       // rdx = arg0
       // r8  = arg1
       // r9  = arg2
-      mov(rcx, reinterpret_cast<uint64_t>(extern_function->extern_handler()));
+      MovHostImageAddress(
+          rcx, reinterpret_cast<const void*>(extern_function->extern_handler()));
       mov(rdx,
           qword[GetContextReg() + offsetof(ppc::PPCContext, kernel_state)]);
       call(backend()->guest_to_host_thunk());
@@ -844,6 +899,7 @@ void X64Emitter::CallExtern(const hir::Instr* instr, const Function* function) {
     }
   }
   if (undefined) {
+    MarkCodeNotPersistable();
     CallNative(UndefinedCallExtern, reinterpret_cast<uint64_t>(function));
   }
 }
@@ -869,11 +925,47 @@ void X64Emitter::CallNativeSafe(void* fn) {
   // rdx = arg0
   // r8  = arg1
   // r9  = arg2
-  mov(rcx, reinterpret_cast<uint64_t>(fn));
+  MovHostImageAddress(rcx, fn);
   call(backend()->guest_to_host_thunk());
   // rax = host return
 }
 
+void X64Emitter::call(const void* addr) {
+  CodeGenerator::call(addr);
+  if (code_storage_) {
+    relocations_.push_back({uint32_t(getSize() - sizeof(int32_t)),
+                            X64CodeRelocationType::kCodeCacheRel32,
+                            uint64_t(reinterpret_cast<uintptr_t>(addr))});
+  }
+}
+
+void X64Emitter::jmp(const void* addr, LabelType type) {
+  // Always rel32 since AutoGrow only supports T_NEAR.
+  CodeGenerator::jmp(addr, type);
+  if (code_storage_) {
+    relocations_.push_back({uint32_t(getSize() - sizeof(int32_t)),
+                            X64CodeRelocationType::kCodeCacheRel32,
+                            uint64_t(reinterpret_cast<uintptr_t>(addr))});
+  }
+}
+
+void X64Emitter::MovHostImageAddress(const Xbyak::Reg64& reg,
+                                     const void* address) {
+  if (!code_storage_) {
+    mov(reg, reinterpret_cast<uint64_t>(address));
+    return;
+  }
+  // Force the 10-byte mov r64, imm64 form so the immediate can be patched
+  // regardless of its value.
+  db(0x48 | (reg.getIdx() >> 3));
+  db(0xB8 | (reg.getIdx() & 7));
+  relocations_.push_back(
+      {uint32_t(getSize()), X64CodeRelocationType::kHostImageAbs64,
+       uint64_t(reinterpret_cast<uintptr_t>(address) -
+                X64CodeCacheStorage::HostImageAnchor())});
+  dq(reinterpret_cast<uint64_t>(address));
+}
+
 void X64Emitter::SetReturnAddress(uint64_t value) {
   mov(rax, value);
   mov(qword[rsp + StackLayout::GUEST_CALL_RET_ADDR], rax);
@@ -1184,6 +1276,17 @@ static const vec128_t xmm_consts[] = {
     v128_setr_bytes(13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3, 0x80),
     // XMMVSRMask
     vec128b(1),
+    /* XMMPack8_IN_16_Shuffle */
+    v128_setr_bytes(4, 6, 0, 2, 12, 14, 8, 10, 4, 6, 0, 2, 12, 14, 8, 10),
+    /* XMMPack8_IN_16_Permute */
+    v128_setr_bytes(4, 6, 0, 2, 12, 14, 8, 10, 20, 22, 16, 18, 28, 30, 24, 26),
+    /* XMMPack16_IN_32_Permute */
+    v128_setr_words(0x00000002, 0x00040006, 0x0008000A, 0x000C000E),
+    /* XMMPack8_IN_16_UnsignedMax */
+    vec128s(0x00FF),
+    /* XMMUnpackHighSwapWords */
+    v128_setr_bytes(10, 11, 8, 9, 14, 15, 12, 13, 0x80, 0x80, 0x80, 0x80, 0x80,
+                    0x80, 0x80, 0x80),
     // XMMVRsqrteTableStart
     v128_setr_words(0x568B4FD, 0x4F3AF97, 0x48DAAA5, 0x435A618),
     v128_setr_words(0x3E7A1E4, 0x3A29DFE, 0x3659A5C, 0x32E96F8),
@@ -10,9 +10,11 @@
 #ifndef XENIA_CPU_BACKEND_X64_X64_EMITTER_H_
 #define XENIA_CPU_BACKEND_X64_X64_EMITTER_H_
 
+#include <memory>
 #include <vector>
 
 #include "xenia/base/arena.h"
+#include "xenia/cpu/backend/x64/x64_code_cache_storage.h"
 #include "xenia/cpu/function.h"
 #include "xenia/cpu/function_trace_data.h"
 #include "xenia/cpu/hir/hir_builder.h"
@@ -38,8 +40,6 @@ using namespace amd64;
 class X64Backend;
 class X64CodeCache;
 
-struct EmitFunctionInfo;
-
 enum RegisterFlags {
   REG_DEST = (1 << 0),
   REG_ABCD = (1 << 1),
@@ -175,6 +175,11 @@ enum XmmConst {
   XMMSTVRSwapMask,  // swapwordmask with bit 7 set
   XMMVSRShlByteshuf,
   XMMVSRMask,
+  XMMPack8_IN_16_Shuffle,
+  XMMPack8_IN_16_Permute,
+  XMMPack16_IN_32_Permute,
+  XMMPack8_IN_16_UnsignedMax,
+  XMMUnpackHighSwapWords,
   XMMVRsqrteTableStart,
   XMMVRsqrteTableBase =
       XMMVRsqrteTableStart +
@@ -221,6 +226,32 @@ class X64Emitter : public Xbyak::CodeGenerator {
             void** out_code_address, size_t* out_code_size,
             std::vector<SourceMapEntry>* out_source_map);
 
+  // Storage the code emitted by the last Emit should be saved to, or nullptr
+  // if it can't be persisted.
+  X64CodeCacheStorage* code_storage() const { return code_storage_.get(); }
+  const EmitFunctionInfo& func_info() const { return func_info_; }
+  const std::vector<X64CodeRelocation>& relocations() const {
+    return relocations_;
+  }
+  // Must be called when emitting anything depending on the current session,
+  // such as pointers to heap objects, that can't be relocated.
+  void MarkCodeNotPersistable() { code_storage_.reset(); }
+
+  // Calls and jumps to fixed locations in the code cache, recorded as
+  // relocations if the code is going to be persisted.
+  using Xbyak::CodeGenerator::call;
+  using Xbyak::CodeGenerator::jmp;
+  void call(const void* addr);
+  template <class RET, class... Params>
+  void call(RET (*func)(Params...)) {
+    call(reinterpret_cast<const void*>(func));
+  }
+  void jmp(const void* addr, LabelType type = T_AUTO);
+
+  // Loads the address of a function or of data in the emulator executable,
+  // which is relocatable unlike other host pointers.
+  void MovHostImageAddress(const Xbyak::Reg64& reg, const void* address);
+
  public:
   // Reserved:  rsp, rsi, rdi
   // Scratch:   rax/rcx/rdx
@@ -405,6 +436,9 @@ class X64Emitter : public Xbyak::CodeGenerator {
   Xbyak::util::Cpu cpu_;
   uint64_t feature_flags_ = 0;
   uint32_t current_guest_function_ = 0;
+  // The function being compiled by the baseline tier of tiered compilation,
+  // for which entry and block counters are emitted.
+  GuestFunction* profiled_function_ = nullptr;
   Xbyak::Label* epilog_label_ = nullptr;
 
   hir::Instr* current_instr_ = nullptr;
@@ -414,6 +448,10 @@ class X64Emitter : public Xbyak::CodeGenerator {
   FunctionTraceData* trace_data_ = nullptr;
   Arena source_map_arena_;
 
+  std::shared_ptr<X64CodeCacheStorage> code_storage_;
+  EmitFunctionInfo func_info_ = {};
+  std::vector<X64CodeRelocation> relocations_;
+
   size_t stack_size_ = 0;
 
   static const uint32_t gpr_reg_map_[GPR_COUNT];
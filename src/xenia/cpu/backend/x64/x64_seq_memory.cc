@@ -1126,6 +1126,7 @@ struct LOAD_MMIO_I32
     // uint64_t (context, addr)
     auto mmio_range = reinterpret_cast<MMIORange*>(i.src1.value);
     auto read_address = uint32_t(i.src2.value);
+    e.MarkCodeNotPersistable();
     e.mov(e.GetNativeParam(0), uint64_t(mmio_range->callback_context));
     e.mov(e.GetNativeParam(1).cvt32(), read_address);
     e.CallNativeSafe(reinterpret_cast<void*>(mmio_range->read));
@@ -1151,6 +1152,7 @@ struct STORE_MMIO_I32
     // void (context, addr, value)
     auto mmio_range = reinterpret_cast<MMIORange*>(i.src1.value);
     auto write_address = uint32_t(i.src2.value);
+    e.MarkCodeNotPersistable();
     e.mov(e.GetNativeParam(0), uint64_t(mmio_range->callback_context));
     e.mov(e.GetNativeParam(1).cvt32(), write_address);
     if (i.src3.is_constant) {
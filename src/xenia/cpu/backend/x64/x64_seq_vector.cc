@@ -2171,7 +2171,7 @@ struct EXTRACT_I32
       e.mov(e.al, i.src2);
       e.and_(e.al, 0x03);
       e.shl(e.al, 4);
-      e.mov(e.rdx, reinterpret_cast<uint64_t>(extract_table_32));
+      e.MovHostImageAddress(e.rdx, extract_table_32);
       e.vmovaps(e.xmm0, e.ptr[e.rdx + e.rax]);
       e.vpshufb(e.xmm0, src1, e.xmm0);
       e.vpextrd(i.dest, e.xmm0, 0);
@@ -2562,7 +2562,9 @@ static void emit_fast_f16_unpack(X64Emitter& e, const Inst& i,
   e.vpsrld(e.xmm2, e.xmm1, 10);
   e.vpmovsxwd(e.xmm0, i.dest);
   e.vpand(e.xmm0, e.xmm0, e.GetXmmConstPtr(XMMSignMaskPS));
-  e.vpand(e.xmm2, e.xmm2, e.GetXmmConstPtr(XMMPermuteByteMask));
+  // The exponent is 5 bits in every dword, the source is sign-extended so the
+  // sign bit must not end up in it.
+  e.vpand(e.xmm2, e.xmm2, e.GetXmmConstPtr(XMMXOPDwordShiftMask));
 
   e.vpslld(e.xmm3, e.xmm2, 23);
 
@@ -2700,30 +2702,19 @@ struct PACK : Sequence<PACK, I<OPCODE_PACK, V128Op, V128Op, V128Op>> {
     //     ((src1.uy & 0xFF) << 8) | (src1.uz & 0xFF)
     e.vpshufb(i.dest, i.dest, e.GetXmmConstPtr(XMMPackD3DCOLOR));
   }
-  static __m128i EmulateFLOAT16_2(void*, __m128 src1) {
-    alignas(16) float a[4];
-    alignas(16) uint16_t b[8];
-    _mm_store_ps(a, src1);
-    std::memset(b, 0, sizeof(b));
-
-    for (int i = 0; i < 2; i++) {
-      b[7 - i] = float_to_xenos_half(a[i]);
-    }
-
-    return _mm_load_si128(reinterpret_cast<__m128i*>(b));
-  }
   static void EmitFLOAT16_2(X64Emitter& e, const EmitArgType& i) {
     assert_true(i.src2.value->IsConstantZero());
-    // http://blogs.msdn.com/b/chuckw/archive/2012/09/11/directxmath-f16c-and-fma.aspx
     // dest = [(src1.x | src1.y), 0, 0, 0]
-
-    if (i.src1.is_constant) {
-      e.lea(e.GetNativeParam(0), e.StashConstantXmm(0, i.src1.constant()));
+    if (!i.src1.is_constant) {
+      emit_fast_f16_pack(e, i, XMMPackFLOAT16_2);
     } else {
-      e.lea(e.GetNativeParam(0), e.StashXmm(0, i.src1));
+      vec128_t result = vec128b(0);
+      for (unsigned idx = 0; idx < 2; ++idx) {
+        result.u16[7 - idx] = float_to_xenos_half(i.src1.constant().f32[idx]);
+      }
+
+      e.LoadConstantXmm(i.dest, result);
     }
-    e.CallNativeSafe(reinterpret_cast<void*>(EmulateFLOAT16_2));
-    e.vmovaps(i.dest, e.xmm0);
   }
 
   static void EmitFLOAT16_4(X64Emitter& e, const EmitArgType& i) {
@@ -2831,55 +2822,47 @@ struct PACK : Sequence<PACK, I<OPCODE_PACK, V128Op, V128Op, V128Op>> {
     // Merge XZ and YW.
     e.vorps(i.dest, e.xmm0);
   }
-  static __m128i EmulatePack8_IN_16_UN_UN_SAT(void*, __m128i src1,
-                                              __m128i src2) {
-    alignas(16) uint16_t a[8];
-    alignas(16) uint16_t b[8];
-    alignas(16) uint8_t c[16];
-    _mm_store_si128(reinterpret_cast<__m128i*>(a), src1);
-    _mm_store_si128(reinterpret_cast<__m128i*>(b), src2);
-    for (int i = 0; i < 8; ++i) {
-      c[i] = uint8_t(std::max(uint16_t(0), std::min(uint16_t(255), a[i])));
-      c[i + 8] = uint8_t(std::max(uint16_t(0), std::min(uint16_t(255), b[i])));
-    }
-    return _mm_load_si128(reinterpret_cast<__m128i*>(c));
-  }
-  static __m128i EmulatePack8_IN_16_UN_UN(void*, __m128i src1, __m128i src2) {
-    alignas(16) uint8_t a[16];
-    alignas(16) uint8_t b[16];
-    alignas(16) uint8_t c[16];
-    _mm_store_si128(reinterpret_cast<__m128i*>(a), src1);
-    _mm_store_si128(reinterpret_cast<__m128i*>(b), src2);
-    for (int i = 0; i < 8; ++i) {
-      c[i] = a[i * 2];
-      c[i + 8] = b[i * 2];
-    }
-    return _mm_load_si128(reinterpret_cast<__m128i*>(c));
+  // Packs the low bytes of the words of src1 and src2, in guest element order.
+  static void EmitPack8_IN_16_Truncate(X64Emitter& e, const Xmm& dest,
+                                       const Xmm& src1, const Xmm& src2) {
+    if (e.IsFeatureEnabled(kX64EmitAVX512Ortho | kX64EmitAVX512VBMI)) {
+      // The permutation indices include the byte order swap.
+      if (dest != src1 && dest != src2) {
+        e.vmovdqa(dest, e.GetXmmConstPtr(XMMPack8_IN_16_Permute));
+        e.vpermi2b(dest, src1, src2);
+      } else {
+        e.vmovdqa(e.xmm2, e.GetXmmConstPtr(XMMPack8_IN_16_Permute));
+        e.vpermi2b(e.xmm2, src1, src2);
+        e.vmovdqa(dest, e.xmm2);
+      }
+    } else {
+      e.vpshufb(e.xmm2, src1, e.GetXmmConstPtr(XMMPack8_IN_16_Shuffle));
+      e.vpshufb(dest, src2, e.GetXmmConstPtr(XMMPack8_IN_16_Shuffle));
+      e.vpunpcklqdq(dest, e.xmm2, dest);
+    }
   }
   static void Emit8_IN_16(X64Emitter& e, const EmitArgType& i, uint32_t flags) {
     // TODO(benvanik): handle src2 (or src1) being constant zero
     if (IsPackInUnsigned(flags)) {
       if (IsPackOutUnsigned(flags)) {
+        Xmm src1 = i.src1.is_constant ? e.xmm0 : i.src1;
+        if (i.src1.is_constant) {
+          e.LoadConstantXmm(src1, i.src1.constant());
+        }
+        Xmm src2 = i.src2.is_constant ? e.xmm1 : i.src2;
+        if (i.src2.is_constant) {
+          e.LoadConstantXmm(src2, i.src2.constant());
+        }
         if (IsPackOutSaturate(flags)) {
           // unsigned -> unsigned + saturate
-          if (i.src2.is_constant) {
-            e.lea(e.GetNativeParam(1),
-                  e.StashConstantXmm(1, i.src2.constant()));
-          } else {
-            e.lea(e.GetNativeParam(1), e.StashXmm(1, i.src2));
-          }
-          e.lea(e.GetNativeParam(0), e.StashXmm(0, i.src1));
-          e.CallNativeSafe(
-              reinterpret_cast<void*>(EmulatePack8_IN_16_UN_UN_SAT));
-          e.vmovaps(i.dest, e.xmm0);
-          e.vpshufb(i.dest, i.dest, e.GetXmmConstPtr(XMMByteOrderMask));
+          e.vpminuw(e.xmm0, src1,
+                    e.GetXmmConstPtr(XMMPack8_IN_16_UnsignedMax));
+          e.vpminuw(e.xmm1, src2,
+                    e.GetXmmConstPtr(XMMPack8_IN_16_UnsignedMax));
+          EmitPack8_IN_16_Truncate(e, i.dest, e.xmm0, e.xmm1);
         } else {
           // unsigned -> unsigned
-          e.lea(e.GetNativeParam(1), e.StashXmm(1, i.src2));
-          e.lea(e.GetNativeParam(0), e.StashXmm(0, i.src1));
-          e.CallNativeSafe(reinterpret_cast<void*>(EmulatePack8_IN_16_UN_UN));
-          e.vmovaps(i.dest, e.xmm0);
-          e.vpshufb(i.dest, i.dest, e.GetXmmConstPtr(XMMByteOrderMask));
+          EmitPack8_IN_16_Truncate(e, i.dest, src1, src2);
         }
       } else {
         if (IsPackOutSaturate(flags)) {
@@ -2929,6 +2912,30 @@ struct PACK : Sequence<PACK, I<OPCODE_PACK, V128Op, V128Op, V128Op>> {
                            uint32_t flags) {
     // TODO(benvanik): handle src2 (or src1) being constant zero
     if (IsPackInUnsigned(flags)) {
+      if (IsPackOutUnsigned(flags) &&
+          e.IsFeatureEnabled(kX64EmitAVX512Ortho | kX64EmitAVX512BW)) {
+        // unsigned -> unsigned (+ saturate), the low words of the dwords are
+        // gathered with a single two-source word permutation, with the
+        // indices including the word order swap.
+        Xmm src1 = i.src1.is_constant ? e.xmm0 : i.src1;
+        if (i.src1.is_constant) {
+          e.LoadConstantXmm(src1, i.src1.constant());
+        }
+        Xmm src2 = i.src2.is_constant ? e.xmm1 : i.src2;
+        if (i.src2.is_constant) {
+          e.LoadConstantXmm(src2, i.src2.constant());
+        }
+        if (IsPackOutSaturate(flags)) {
+          e.vpminud(e.xmm0, src1, e.GetXmmConstPtr(XMMMaskEvenPI16));
+          e.vpminud(e.xmm1, src2, e.GetXmmConstPtr(XMMMaskEvenPI16));
+          src1 = e.xmm0;
+          src2 = e.xmm1;
+        }
+        e.vmovdqa(e.xmm2, e.GetXmmConstPtr(XMMPack16_IN_32_Permute));
+        e.vpermi2w(e.xmm2, src1, src2);
+        e.vmovdqa(i.dest, e.xmm2);
+        return;
+      }
       if (IsPackOutUnsigned(flags)) {
         if (IsPackOutSaturate(flags)) {
           // unsigned -> unsigned + saturate
@@ -3083,41 +3090,40 @@ struct UNPACK : Sequence<UNPACK, I<OPCODE_UNPACK, V128Op, V128Op>> {
     e.vpor(i.dest, e.GetXmmConstPtr(XMMOne));
     // To convert to 0 to 1, games multiply by 0x47008081 and add 0xC7008081.
   }
-  static __m128 EmulateFLOAT16_2(void*, __m128i src1) {
-    alignas(16) uint16_t a[8];
-    alignas(16) float b[4];
-    _mm_store_si128(reinterpret_cast<__m128i*>(a), src1);
-
-    for (int i = 0; i < 2; i++) {
-      b[i] = xenos_half_to_float(a[VEC128_W(6 + i)]);
+  // Replaces the components equal to the overflow value (the bit pattern of
+  // the most negative integer plus 3.0) with quiet NaNs.
+  static void EmitOverflowToQNaN(X64Emitter& e, const Xmm& dest,
+                                 XmmConst overflow) {
+    if (e.IsFeatureEnabled(kX64EmitAVX512Ortho)) {
+      // The overflow value is not a NaN or a zero, so comparing the bits is
+      // the same as comparing the floats.
+      Opmask overflowed = e.k1;
+      e.vpcmpeqd(overflowed, dest, e.GetXmmConstPtr(overflow));
+      e.vmovdqa32(dest | overflowed, e.GetXmmConstPtr(XMMQNaN));
+      return;
     }
-
-    // Constants, or something
-    b[2] = 0.f;
-    b[3] = 1.f;
-
-    return _mm_load_ps(b);
+    e.vcmpeqps(e.xmm0, dest, e.GetXmmConstPtr(overflow));
+    e.vblendvps(dest, dest, e.GetXmmConstPtr(XMMQNaN), e.xmm0);
   }
   static void EmitFLOAT16_2(X64Emitter& e, const EmitArgType& i) {
     // 1 bit sign, 5 bit exponent, 10 bit mantissa
     // D3D10 half float format
-    // TODO(benvanik):
-    // http://blogs.msdn.com/b/chuckw/archive/2012/09/11/directxmath-f16c-and-fma.aspx
-    // Use _mm_cvtph_ps -- requires very modern processors (SSE5+)
-    // Unpacking half floats:
-    // http://fgiesen.wordpress.com/2012/03/28/half-to-float-done-quic/
-    // Packing half floats: https://gist.github.com/rygorous/2156668
-    // Load source, move from tight pack of X16Y16.... to X16...Y16...
-    // Also zero out the high end.
-    // TODO(benvanik): special case constant unpacks that just get 0/1/etc.
-
+    // Unpacks X16Y16 from the last word to XY, with Z = 0 and W = 1.
     if (i.src1.is_constant) {
-      e.lea(e.GetNativeParam(0), e.StashConstantXmm(0, i.src1.constant()));
+      vec128_t result{};
+
+      for (int idx = 0; idx < 2; ++idx) {
+        result.f32[idx] =
+            xenos_half_to_float(i.src1.constant().u16[VEC128_W(6 + idx)]);
+      }
+      result.f32[3] = 1.0f;
+
+      e.LoadConstantXmm(i.dest, result);
+
     } else {
-      e.lea(e.GetNativeParam(0), e.StashXmm(0, i.src1));
+      emit_fast_f16_unpack(e, i, XMMUnpackFLOAT16_2);
+      e.vpor(i.dest, e.GetXmmConstPtr(XMM0001));
     }
-    e.CallNativeSafe(reinterpret_cast<void*>(EmulateFLOAT16_2));
-    e.vmovaps(i.dest, e.xmm0);
   }
 
   static void EmitFLOAT16_4(X64Emitter& e, const EmitArgType& i) {
@@ -3161,8 +3167,7 @@ struct UNPACK : Sequence<UNPACK, I<OPCODE_UNPACK, V128Op, V128Op>> {
     // Add 3,3,0,1.
     e.vpaddd(i.dest, e.GetXmmConstPtr(XMM3301));
     // Return quiet NaNs in case of negative overflow.
-    e.vcmpeqps(e.xmm0, i.dest, e.GetXmmConstPtr(XMMUnpackSHORT_Overflow));
-    e.vblendvps(i.dest, i.dest, e.GetXmmConstPtr(XMMQNaN), e.xmm0);
+    EmitOverflowToQNaN(e, i.dest, XMMUnpackSHORT_Overflow);
   }
   static void EmitSHORT_4(X64Emitter& e, const EmitArgType& i) {
     // (VD.x) = 3.0 + (VB.x>>16)*2^-22
@@ -3190,8 +3195,7 @@ struct UNPACK : Sequence<UNPACK, I<OPCODE_UNPACK, V128Op, V128Op>> {
     // Add 3,3,3,3.
     e.vpaddd(i.dest, e.GetXmmConstPtr(XMM3333));
     // Return quiet NaNs in case of negative overflow.
-    e.vcmpeqps(e.xmm0, i.dest, e.GetXmmConstPtr(XMMUnpackSHORT_Overflow));
-    e.vblendvps(i.dest, i.dest, e.GetXmmConstPtr(XMMQNaN), e.xmm0);
+    EmitOverflowToQNaN(e, i.dest, XMMUnpackSHORT_Overflow);
   }
   static void EmitUINT_2101010(X64Emitter& e, const EmitArgType& i) {
     Xmm src;
@@ -3230,9 +3234,7 @@ struct UNPACK : Sequence<UNPACK, I<OPCODE_UNPACK, V128Op, V128Op>> {
     // Add 3,3,3,1.
     e.vpaddd(i.dest, e.GetXmmConstPtr(XMM3331));
     // Return quiet NaNs in case of negative overflow.
-    e.vcmpeqps(e.xmm0, i.dest,
-               e.GetXmmConstPtr(XMMUnpackUINT_2101010_Overflow));
-    e.vblendvps(i.dest, i.dest, e.GetXmmConstPtr(XMMQNaN), e.xmm0);
+    EmitOverflowToQNaN(e, i.dest, XMMUnpackUINT_2101010_Overflow);
     // To convert XYZ to -1 to 1, games multiply by 0x46004020 & sub 0x46C06030.
     // For W to 0 to 1, they multiply by and subtract 0x4A2AAAAB.
   }
@@ -3263,9 +3265,7 @@ struct UNPACK : Sequence<UNPACK, I<OPCODE_UNPACK, V128Op, V128Op>> {
     // Add 3,3,3,1.
     e.vpaddd(i.dest, e.GetXmmConstPtr(XMM3331));
     // Return quiet NaNs in case of negative overflow.
-    e.vcmpeqps(e.xmm0, i.dest,
-               e.GetXmmConstPtr(XMMUnpackULONG_4202020_Overflow));
-    e.vblendvps(i.dest, i.dest, e.GetXmmConstPtr(XMMQNaN), e.xmm0);
+    EmitOverflowToQNaN(e, i.dest, XMMUnpackULONG_4202020_Overflow);
   }
   static void Emit8_IN_16(X64Emitter& e, const EmitArgType& i, uint32_t flags) {
     assert_false(IsPackOutSaturate(flags));
@@ -3292,9 +3292,9 @@ struct UNPACK : Sequence<UNPACK, I<OPCODE_UNPACK, V128Op, V128Op>> {
           assert_always();
         } else {
           // signed -> signed
-          e.vpshufb(i.dest, src, e.GetXmmConstPtr(XMMByteOrderMask));
-          e.vpunpckhbw(i.dest, i.dest, i.dest);
-          e.vpsraw(i.dest, 8);
+          // Gather the upper 8 bytes in the guest order and sign-extend them.
+          e.vpshufb(i.dest, src, e.GetXmmConstPtr(XMMUnpackHighSwapWords));
+          e.vpmovsxbw(i.dest, i.dest);
         }
       }
     } else {
@@ -3314,8 +3314,7 @@ struct UNPACK : Sequence<UNPACK, I<OPCODE_UNPACK, V128Op, V128Op>> {
         } else {
           // signed -> signed
           e.vpshufb(i.dest, src, e.GetXmmConstPtr(XMMByteOrderMask));
-          e.vpunpcklbw(i.dest, i.dest, i.dest);
-          e.vpsraw(i.dest, 8);
+          e.vpmovsxbw(i.dest, i.dest);
         }
       }
     }
@@ -3346,8 +3345,9 @@ struct UNPACK : Sequence<UNPACK, I<OPCODE_UNPACK, V128Op, V128Op>> {
           assert_always();
         } else {
           // signed -> signed
-          e.vpunpckhwd(i.dest, src, src);
-          e.vpsrad(i.dest, 16);
+          // Gather the upper 4 words in the guest order and sign-extend them.
+          e.vpshufb(i.dest, src, e.GetXmmConstPtr(XMMUnpackHighSwapWords));
+          e.vpmovsxwd(i.dest, i.dest);
         }
       }
     } else {
@@ -3366,12 +3366,11 @@ struct UNPACK : Sequence<UNPACK, I<OPCODE_UNPACK, V128Op, V128Op>> {
           assert_always();
         } else {
           // signed -> signed
-          e.vpunpcklwd(i.dest, src, src);
-          e.vpsrad(i.dest, 16);
+          e.vpshuflw(i.dest, src, 0b10110001);
+          e.vpmovsxwd(i.dest, i.dest);
         }
       }
     }
-    e.vpshufd(i.dest, i.dest, 0xB1);
   }
 };
 EMITTER_OPCODE_TABLE(OPCODE_UNPACK, UNPACK);
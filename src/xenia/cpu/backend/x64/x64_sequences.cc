@@ -85,6 +85,7 @@ struct COMMENT : Sequence<COMMENT, I<OPCODE_COMMENT, VoidOp, OffsetOp>> {
       // TODO(benvanik): pass through.
       // TODO(benvanik): don't just leak this memory.
       auto str_copy = strdup(str);
+      e.MarkCodeNotPersistable();
       e.mov(e.rdx, reinterpret_cast<uint64_t>(str_copy));
       e.CallNative(reinterpret_cast<void*>(TraceString));
     }
@@ -3225,7 +3226,7 @@ struct SET_ROUNDING_MODE_I32
 
       e.mov(e.ecx, i.src1);
       e.cmovc(e.edx, e.eax);
-      e.mov(e.rax, uintptr_t(mxcsr_table));
+      e.MovHostImageAddress(e.rax, mxcsr_table);
       e.mov(flags_ptr, e.edx);
       e.mov(e.edx, e.ptr[e.rax + e.rcx * 4]);
       // this was not here
@@ -0,0 +1,106 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/compiler/passes/block_layout_pass.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "xenia/base/profiling.h"
+#include "xenia/cpu/function.h"
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+// TODO(benvanik): remove when enums redefined.
+using namespace xe::cpu::hir;
+
+using xe::cpu::hir::Block;
+using xe::cpu::hir::HIRBuilder;
+
+BlockLayoutPass::BlockLayoutPass() : CompilerPass() {}
+
+BlockLayoutPass::~BlockLayoutPass() {}
+
+bool BlockLayoutPass::Run(HIRBuilder* builder) {
+  const FunctionProfileData* profile_data =
+      function_ ? function_->profile_data() : nullptr;
+  if (!profile_data || !profile_data->block_counts) {
+    return true;
+  }
+  uint32_t function_start = function_->address();
+  uint32_t function_end = function_->end_address();
+  SCOPE_profile_cpu_f("cpu");
+
+  // Blocks of the optimized code don't match the profiled ones exactly, as
+  // they may have been merged or split, so look up the count of the profiled
+  // block containing the first instruction.
+  std::vector<std::pair<uint32_t, uint32_t>> block_counts;
+  for (size_t i = 0; i < profile_data->block_addresses.size(); ++i) {
+    uint32_t address = profile_data->block_addresses[i];
+    if (address) {
+      block_counts.emplace_back(address, profile_data->block_counts[i]);
+    }
+  }
+  if (block_counts.empty()) {
+    return true;
+  }
+  std::sort(block_counts.begin(), block_counts.end());
+
+  // The entry block must stay first.
+  std::vector<Block*> cold_blocks;
+  auto block = builder->first_block()->next;
+  while (block) {
+    uint32_t address = 0;
+    auto instr = block->instr_head;
+    while (instr) {
+      if (instr->opcode == &OPCODE_SOURCE_OFFSET_info) {
+        address = static_cast<uint32_t>(instr->src1.offset);
+        break;
+      }
+      instr = instr->next;
+    }
+    // Blocks without guest instructions, or with instructions of other
+    // functions that the profile doesn't cover, are kept where they are.
+    if (address >= function_start && address <= function_end) {
+      auto it = std::upper_bound(
+          block_counts.cbegin(), block_counts.cend(),
+          std::make_pair(address, UINT32_MAX));
+      if (it != block_counts.cbegin() && !(it - 1)->second) {
+        cold_blocks.push_back(block);
+      }
+    }
+    block = block->next;
+  }
+  if (cold_blocks.empty()) {
+    return true;
+  }
+
+  // Make the control flow independent of the order of the blocks, the
+  // branches to the next block are dropped by the finalization pass.
+  block = builder->first_block();
+  while (block) {
+    builder->MakeFallthroughExplicit(block);
+    block = block->next;
+  }
+
+  for (Block* cold_block : cold_blocks) {
+    builder->MoveBlockToEnd(cold_block);
+  }
+
+  return true;
+}
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
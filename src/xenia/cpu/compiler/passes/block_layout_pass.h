@@ -0,0 +1,52 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_COMPILER_PASSES_BLOCK_LAYOUT_PASS_H_
+#define XENIA_CPU_COMPILER_PASSES_BLOCK_LAYOUT_PASS_H_
+
+#include "xenia/cpu/compiler/compiler_pass.h"
+
+namespace xe {
+namespace cpu {
+class GuestFunction;
+}  // namespace cpu
+}  // namespace xe
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+// Moves the blocks that have never been executed according to the profile to
+// the end of the function, so the hot path is laid out contiguously and
+// mostly falls through. Does nothing if there's no profile. Only the blocks
+// of the function itself are profiled - the code emitted into it from other
+// functions, such as inlined callees and stitched tail calls, is kept in
+// place.
+class BlockLayoutPass : public CompilerPass {
+ public:
+  BlockLayoutPass();
+  ~BlockLayoutPass() override;
+
+  // The function being compiled to use the profile of, or null to not use a
+  // profile - must be set before every compilation.
+  void set_function(const GuestFunction* function) { function_ = function; }
+
+  bool Run(hir::HIRBuilder* builder) override;
+
+ private:
+  const GuestFunction* function_ = nullptr;
+};
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_COMPILER_PASSES_BLOCK_LAYOUT_PASS_H_
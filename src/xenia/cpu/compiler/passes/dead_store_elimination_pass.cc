@@ -0,0 +1,146 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/compiler/passes/dead_store_elimination_pass.h"
+
+#include "xenia/base/cvar.h"
+#include "xenia/base/profiling.h"
+#include "xenia/cpu/ppc/ppc_context.h"
+
+DECLARE_bool(debug);
+DECLARE_bool(store_all_context_values);
+DECLARE_bool(full_optimization_even_with_debug);
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+// TODO(benvanik): remove when enums redefined.
+using namespace xe::cpu::hir;
+
+using xe::cpu::hir::Block;
+using xe::cpu::hir::HIRBuilder;
+using xe::cpu::hir::Instr;
+
+DeadStoreEliminationPass::DeadStoreEliminationPass() : CompilerPass() {}
+
+DeadStoreEliminationPass::~DeadStoreEliminationPass() {}
+
+bool DeadStoreEliminationPass::Initialize(Compiler* compiler) {
+  if (!CompilerPass::Initialize(compiler)) {
+    return false;
+  }
+  state_.resize(static_cast<uint32_t>(sizeof(ppc::PPCContext)));
+  return true;
+}
+
+bool DeadStoreEliminationPass::Run(HIRBuilder* builder) {
+  // Same as in ContextPromotionPass, the stored values are needed for
+  // debugging.
+  if (!cvars::full_optimization_even_with_debug &&
+      (cvars::debug || cvars::store_all_context_values)) {
+    return true;
+  }
+  SCOPE_profile_cpu_f("cpu");
+
+  uint16_t block_count = 0;
+  auto block = builder->first_block();
+  while (block) {
+    block->ordinal = block_count++;
+    block = block->next;
+  }
+  if (entry_states_.size() < block_count) {
+    entry_states_.resize(block_count);
+  }
+  // Start from everything being overwritten and remove what may be read until
+  // nothing changes.
+  for (uint16_t i = 0; i < block_count; ++i) {
+    entry_states_[i].resize(static_cast<uint32_t>(sizeof(ppc::PPCContext)));
+    entry_states_[i].set();
+  }
+  bool changed;
+  do {
+    changed = false;
+    block = builder->last_block();
+    while (block) {
+      ProcessBlock(block, state_, false);
+      if (state_ != entry_states_[block->ordinal]) {
+        entry_states_[block->ordinal] = state_;
+        changed = true;
+      }
+      block = block->prev;
+    }
+  } while (changed);
+
+  block = builder->first_block();
+  while (block) {
+    ProcessBlock(block, state_, true);
+    block = block->next;
+  }
+
+  return true;
+}
+
+void DeadStoreEliminationPass::ProcessBlock(Block* block,
+                                            llvm::BitVector& state,
+                                            bool remove_dead_stores) {
+  // Falling through to the next block or to the epilog.
+  state.set();
+  if (!block->instr_tail || block->instr_tail->opcode != &OPCODE_BRANCH_info) {
+    if (block->next) {
+      state &= entry_states_[block->next->ordinal];
+    } else {
+      state.reset();
+    }
+  }
+
+  Instr* i = block->instr_tail;
+  while (i) {
+    Instr* prev = i->prev;
+    if (i->opcode == &OPCODE_BRANCH_info) {
+      state &= entry_states_[i->src1.label->block->ordinal];
+    } else if (i->opcode == &OPCODE_BRANCH_TRUE_info ||
+               i->opcode == &OPCODE_BRANCH_FALSE_info) {
+      state &= entry_states_[i->src2.label->block->ordinal];
+    } else if (i->opcode->flags & OPCODE_FLAG_VOLATILE ||
+               i->opcode == &OPCODE_LOAD_MMIO_info ||
+               i->opcode == &OPCODE_STORE_MMIO_info ||
+               i->opcode == &OPCODE_CONTEXT_BARRIER_info) {
+      // The context may be accessed by other code.
+      state.reset();
+    } else if (i->opcode == &OPCODE_LOAD_CONTEXT_info) {
+      auto offset = static_cast<uint32_t>(i->src1.offset);
+      state.reset(offset, offset + uint32_t(GetTypeSize(i->dest->type)));
+    } else if (i->opcode == &OPCODE_STORE_CONTEXT_info) {
+      auto offset = static_cast<uint32_t>(i->src1.offset);
+      auto end = offset + uint32_t(GetTypeSize(i->src2.value->type));
+      bool dead = true;
+      for (uint32_t n = offset; n < end; ++n) {
+        if (!state.test(n)) {
+          dead = false;
+          break;
+        }
+      }
+      if (dead) {
+        if (remove_dead_stores) {
+          i->UnlinkAndNOP();
+        }
+      } else {
+        state.set(offset, end);
+      }
+    }
+    i = prev;
+  }
+}
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
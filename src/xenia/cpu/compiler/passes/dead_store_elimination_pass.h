@@ -0,0 +1,63 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_COMPILER_PASSES_DEAD_STORE_ELIMINATION_PASS_H_
+#define XENIA_CPU_COMPILER_PASSES_DEAD_STORE_ELIMINATION_PASS_H_
+
+#include <vector>
+
+#include "xenia/base/platform.h"
+#include "xenia/cpu/compiler/compiler_pass.h"
+
+#if XE_COMPILER_MSVC
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#pragma warning(disable : 4267)
+#include <llvm/ADT/BitVector.h>
+#pragma warning(pop)
+#else
+#include <llvm/ADT/BitVector.h>
+#endif  // XE_COMPILER_MSVC
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+// Removes context stores that are overwritten on every path before the value
+// is loaded or the context is exposed to other code (calls, returns, traps and
+// other volatile instructions). Unlike the per-block removal in
+// ContextPromotionPass, this follows the branches between the blocks.
+class DeadStoreEliminationPass : public CompilerPass {
+ public:
+  DeadStoreEliminationPass();
+  ~DeadStoreEliminationPass() override;
+
+  bool Initialize(Compiler* compiler) override;
+
+  bool Run(hir::HIRBuilder* builder) override;
+
+ private:
+  // Walks the block backwards from the state at its end, producing the state
+  // at its beginning. The state is the set of context bytes that will be
+  // overwritten before being read.
+  void ProcessBlock(hir::Block* block, llvm::BitVector& state,
+                    bool remove_dead_stores);
+
+  // By block ordinal.
+  std::vector<llvm::BitVector> entry_states_;
+  llvm::BitVector state_;
+};
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_COMPILER_PASSES_DEAD_STORE_ELIMINATION_PASS_H_
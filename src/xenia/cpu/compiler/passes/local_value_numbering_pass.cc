@@ -0,0 +1,174 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/compiler/passes/local_value_numbering_pass.h"
+
+#include <cstring>
+#include <utility>
+
+#include "xenia/base/profiling.h"
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+// TODO(benvanik): remove when enums redefined.
+using namespace xe::cpu::hir;
+
+using xe::cpu::hir::Block;
+using xe::cpu::hir::HIRBuilder;
+using xe::cpu::hir::Instr;
+using xe::cpu::hir::Value;
+
+LocalValueNumberingPass::LocalValueNumberingPass()
+    : ConditionalGroupSubpass() {}
+
+LocalValueNumberingPass::~LocalValueNumberingPass() {}
+
+bool LocalValueNumberingPass::Expression::operator==(
+    const Expression& other) const {
+  // Zero-initialized, including the padding.
+  return !std::memcmp(this, &other, sizeof(*this));
+}
+
+bool LocalValueNumberingPass::Run(HIRBuilder* builder, bool& result) {
+  SCOPE_profile_cpu_f("cpu");
+  result = false;
+  auto block = builder->first_block();
+  while (block) {
+    result |= NumberBlock(block);
+    block = block->next;
+  }
+  return true;
+}
+
+bool LocalValueNumberingPass::IsPure(const Instr* i) {
+  // Operations that depend on the floating-point state (rounding, denormal
+  // flushing, saturation tracking) may produce different results for the same
+  // operands within a block, only integer and data movement operations are
+  // considered.
+  bool is_int = i->dest && i->dest->type <= INT64_TYPE;
+  switch (i->GetOpcodeNum()) {
+    case OPCODE_CAST:
+    case OPCODE_ZERO_EXTEND:
+    case OPCODE_SIGN_EXTEND:
+    case OPCODE_TRUNCATE:
+    case OPCODE_LOAD_VECTOR_SHL:
+    case OPCODE_LOAD_VECTOR_SHR:
+    case OPCODE_SELECT:
+    case OPCODE_AND:
+    case OPCODE_AND_NOT:
+    case OPCODE_OR:
+    case OPCODE_XOR:
+    case OPCODE_NOT:
+    case OPCODE_VECTOR_SHL:
+    case OPCODE_VECTOR_SHR:
+    case OPCODE_VECTOR_SHA:
+    case OPCODE_VECTOR_ROTATE_LEFT:
+    case OPCODE_INSERT:
+    case OPCODE_EXTRACT:
+    case OPCODE_SPLAT:
+    case OPCODE_PERMUTE:
+    case OPCODE_SWIZZLE:
+      return true;
+    case OPCODE_COMPARE_EQ:
+    case OPCODE_COMPARE_NE:
+    case OPCODE_COMPARE_SLT:
+    case OPCODE_COMPARE_SLE:
+    case OPCODE_COMPARE_SGT:
+    case OPCODE_COMPARE_SGE:
+    case OPCODE_COMPARE_ULT:
+    case OPCODE_COMPARE_ULE:
+    case OPCODE_COMPARE_UGT:
+    case OPCODE_COMPARE_UGE:
+      return i->src1.value->type <= INT64_TYPE;
+    case OPCODE_ADD:
+    case OPCODE_SUB:
+    case OPCODE_MUL:
+    case OPCODE_MUL_HI:
+    case OPCODE_NEG:
+    case OPCODE_SHL:
+    case OPCODE_SHR:
+    case OPCODE_SHA:
+    case OPCODE_ROTATE_LEFT:
+    case OPCODE_BYTE_SWAP:
+    case OPCODE_CNTLZ:
+      return is_int;
+    default:
+      return false;
+  }
+}
+
+bool LocalValueNumberingPass::MakeExpression(const Instr* i,
+                                             Expression& expression_out) {
+  std::memset(&expression_out, 0, sizeof(expression_out));
+  expression_out.opcode = i->opcode;
+  expression_out.flags_and_type =
+      uint64_t(i->flags) | (uint64_t(i->dest->type) << 16);
+  uint32_t signature = i->opcode->signature;
+  const Instr::Op* sources[] = {&i->src1, &i->src2, &i->src3};
+  for (uint32_t n = 0; n < 3; ++n) {
+    Operand& operand = expression_out.operands[n];
+    switch ((signature >> ((n + 1) * 3)) & 0x7) {
+      case OPCODE_SIG_TYPE_X:
+        break;
+      case OPCODE_SIG_TYPE_V: {
+        const Value* value = sources[n]->value;
+        if (value->IsConstant()) {
+          operand.kind = 2 | (uint64_t(value->type) << 8);
+          std::memcpy(operand.data, &value->constant, GetTypeSize(value->type));
+        } else {
+          operand.kind = 1;
+          operand.data[0] = reinterpret_cast<uintptr_t>(value);
+        }
+      } break;
+      case OPCODE_SIG_TYPE_O:
+        operand.kind = 3;
+        operand.data[0] = sources[n]->offset;
+        break;
+      default:
+        // Labels and symbols.
+        return false;
+    }
+  }
+  // The order of the operands of commutative operations doesn't matter.
+  if (i->opcode->flags & OPCODE_FLAG_COMMUNATIVE &&
+      std::memcmp(&expression_out.operands[0], &expression_out.operands[1],
+                  sizeof(Operand)) > 0) {
+    std::swap(expression_out.operands[0], expression_out.operands[1]);
+  }
+  return true;
+}
+
+bool LocalValueNumberingPass::NumberBlock(Block* block) {
+  bool changed = false;
+  expressions_.clear();
+  Expression expression;
+  Instr* i = block->instr_head;
+  while (i) {
+    if (IsPure(i) && MakeExpression(i, expression)) {
+      auto it = expressions_.find(expression);
+      if (it != expressions_.end()) {
+        i->Replace(&OPCODE_ASSIGN_info, 0);
+        i->set_src1(it->second);
+        changed = true;
+      } else {
+        expressions_.emplace(expression, i->dest);
+      }
+    }
+    i = i->next;
+  }
+  return changed;
+}
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
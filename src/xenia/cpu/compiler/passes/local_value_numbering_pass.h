@@ -0,0 +1,65 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_COMPILER_PASSES_LOCAL_VALUE_NUMBERING_PASS_H_
+#define XENIA_CPU_COMPILER_PASSES_LOCAL_VALUE_NUMBERING_PASS_H_
+
+#include <unordered_map>
+
+#include "xenia/base/hash.h"
+#include "xenia/cpu/compiler/passes/conditional_group_subpass.h"
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+// Common subexpression elimination by local value numbering. Instructions
+// computing the same pure expression as an earlier one in the same block, such
+// as guest address calculations, are replaced with assignments of the earlier
+// result.
+//
+// Only done within blocks, as HIR values don't live across blocks (the
+// register allocator spills everything at block boundaries). Redundant context
+// loads are handled by ContextPromotionPass. Guest memory loads are not
+// merged, as they may be MMIO register reads.
+class LocalValueNumberingPass : public ConditionalGroupSubpass {
+ public:
+  LocalValueNumberingPass();
+  ~LocalValueNumberingPass() override;
+
+  bool Run(hir::HIRBuilder* builder, bool& result) override;
+
+ private:
+  struct Operand {
+    // 0 - none, 1 - value, 2 - constant (| type << 8), 3 - offset.
+    uint64_t kind;
+    uint64_t data[2];
+  };
+  struct Expression {
+    const hir::OpcodeInfo* opcode;
+    uint64_t flags_and_type;
+    Operand operands[3];
+    bool operator==(const Expression& other) const;
+  };
+
+  bool NumberBlock(hir::Block* block);
+  static bool IsPure(const hir::Instr* i);
+  static bool MakeExpression(const hir::Instr* i, Expression& expression_out);
+
+  std::unordered_map<Expression, hir::Value*, xe::hash::XXHasher<Expression>>
+      expressions_;
+};
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_COMPILER_PASSES_LOCAL_VALUE_NUMBERING_PASS_H_
@@ -10,6 +10,7 @@
 #include "xenia/cpu/compiler/passes/memory_sequence_combination_pass.h"
 
 #include "xenia/base/profiling.h"
+#include "xenia/cpu/ppc/ppc_context.h"
 
 namespace xe {
 namespace cpu {
@@ -23,8 +24,13 @@ using xe::cpu::hir::HIRBuilder;
 using xe::cpu::hir::Instr;
 using xe::cpu::hir::Value;
 
-MemorySequenceCombinationPass::MemorySequenceCombinationPass()
-    : CompilerPass() {}
+// Maximum number of instructions between two accesses to merge, enough for
+// the loads/stores of lmw/stmw with the register moves between them.
+constexpr uint32_t kMaxAdjacentAccessDistance = 8;
+
+MemorySequenceCombinationPass::MemorySequenceCombinationPass(
+    bool combine_adjacent_accesses)
+    : CompilerPass(), combine_adjacent_accesses_(combine_adjacent_accesses) {}
 
 MemorySequenceCombinationPass::~MemorySequenceCombinationPass() = default;
 
@@ -46,6 +52,27 @@ bool MemorySequenceCombinationPass::Run(HIRBuilder* builder) {
     }
     block = block->next;
   }
+
+  combined_sequence_count_ = 0;
+  if (combine_adjacent_accesses_) {
+    block = builder->first_block();
+    while (block) {
+      auto i = block->instr_head;
+      while (i) {
+        // Merged accesses are inserted before i or replace it, and the one
+        // merged with i is after it, so continuing from the next instruction
+        // is fine either way.
+        auto next = i->next;
+        if (i->opcode == &OPCODE_LOAD_OFFSET_info) {
+          CombineAdjacentLoads(builder, i);
+        } else if (i->opcode == &OPCODE_STORE_OFFSET_info) {
+          CombineAdjacentStores(builder, i);
+        }
+        i = next;
+      }
+      block = block->next;
+    }
+  }
   return true;
 }
 
@@ -150,6 +177,214 @@ void MemorySequenceCombinationPass::CombineStoreSequence(Instr* i) {
   // TODO(benvanik): extend/truncate.
 }
 
+// Whether the address is relative to the stack pointer or to the thread
+// block, which are never in MMIO ranges. The MMIO handler can only decode
+// 32-bit accesses, so wider accesses must not be created for other bases.
+static bool IsStackOrThreadAddress(Value* value) {
+  while (value->def) {
+    auto def = value->def;
+    if (def->opcode == &OPCODE_ASSIGN_info) {
+      value = def->src1.value;
+    } else if (def->opcode == &OPCODE_ADD_info &&
+               def->src2.value->IsConstant()) {
+      // stwu r1 / addi r1 updates within the block.
+      value = def->src1.value;
+    } else if (def->opcode == &OPCODE_LOAD_CONTEXT_info) {
+      return def->src1.offset == offsetof(ppc::PPCContext, r[1]) ||
+             def->src1.offset == offsetof(ppc::PPCContext, r[13]);
+    } else {
+      return false;
+    }
+  }
+  return false;
+}
+
+static TypeName GetDoubleWidthType(TypeName type) {
+  switch (type) {
+    case INT8_TYPE:
+      return INT16_TYPE;
+    case INT16_TYPE:
+      return INT32_TYPE;
+    case INT32_TYPE:
+      return INT64_TYPE;
+    default:
+      return MAX_TYPENAME;
+  }
+}
+
+// Moves the instruction the builder has just appended for a value before i.
+// Nothing is appended if the value has been folded.
+static Value* PlaceBefore(HIRBuilder* builder, Value* value, Instr* i) {
+  if (!value->IsConstant() && value->def == builder->last_instr()) {
+    value->def->MoveBefore(i);
+  }
+  return value;
+}
+
+Instr* MemorySequenceCombinationPass::FindAdjacentAccess(Instr* i) {
+  Value* offset = i->src2.value;
+  if (!offset->IsConstant()) {
+    return nullptr;
+  }
+  TypeName type = i->opcode == &OPCODE_LOAD_OFFSET_info ? i->dest->type
+                                                        : i->src3.value->type;
+  if (GetDoubleWidthType(type) == MAX_TYPENAME ||
+      !IsStackOrThreadAddress(i->src1.value)) {
+    return nullptr;
+  }
+  int64_t size = int64_t(GetTypeSize(type));
+  uint32_t distance = 0;
+  for (auto j = i->next; j && distance < kMaxAdjacentAccessDistance;
+       j = j->next) {
+    if (j->opcode->flags & OPCODE_FLAG_IGNORE) {
+      continue;
+    }
+    ++distance;
+    if (j->opcode == i->opcode && j->flags == i->flags &&
+        j->src1.value == i->src1.value && j->src2.value->IsConstant()) {
+      TypeName j_type = j->opcode == &OPCODE_LOAD_OFFSET_info
+                            ? j->dest->type
+                            : j->src3.value->type;
+      int64_t delta = j->src2.value->constant.i64 - offset->constant.i64;
+      if (j_type == type && (delta == size || delta == -size)) {
+        return j;
+      }
+    }
+    if (j->opcode->flags & (OPCODE_FLAG_MEMORY | OPCODE_FLAG_VOLATILE)) {
+      // Loads may move past other loads, but nothing may move past stores,
+      // barriers or calls.
+      if (i->opcode != &OPCODE_LOAD_OFFSET_info ||
+          (j->opcode != &OPCODE_LOAD_info &&
+           j->opcode != &OPCODE_LOAD_OFFSET_info)) {
+        return nullptr;
+      }
+    }
+  }
+  return nullptr;
+}
+
+void MemorySequenceCombinationPass::CombineAdjacentLoads(HIRBuilder* builder,
+                                                         Instr* i) {
+  // Adjacent loads:
+  //   v1.i32 = load_offset v0, 0x10, [swap]
+  //   ...
+  //   v2.i32 = load_offset v0, 0x14, [swap]
+  // becomes:
+  //   v3.i64 = load_offset v0, 0x10, [swap]
+  //   v4.i64 = shr v3.i64, 32
+  //   v5.i32 = truncate v4.i64
+  //   v6.i32 = truncate v3.i64
+  //   v1.i32 = assign v5.i32
+  //   ...
+  //   v2.i32 = assign v6.i32
+  if (!i->dest->use_head) {
+    // Will be killed by DCE.
+    return;
+  }
+  Instr* j = FindAdjacentAccess(i);
+  if (!j) {
+    return;
+  }
+  TypeName type = i->dest->type;
+  TypeName wide_type = GetDoubleWidthType(type);
+  Instr* low_address = j->src2.value->constant.i64 < i->src2.value->constant.i64
+                           ? j
+                           : i;
+  Instr* high_address = low_address == i ? j : i;
+
+  Value* wide = PlaceBefore(
+      builder,
+      builder->LoadOffset(i->src1.value, low_address->src2.value, wide_type,
+                          i->flags),
+      i);
+  Value* high_half = PlaceBefore(
+      builder,
+      builder->Truncate(
+          PlaceBefore(builder,
+                      builder->Shr(wide, int8_t(GetTypeSize(type) * 8)), i),
+          type),
+      i);
+  Value* low_half = PlaceBefore(builder, builder->Truncate(wide, type), i);
+
+  // With byte swapping, the big-endian value at the lower address is in the
+  // upper half.
+  bool swap = (i->flags & LoadStoreFlags::LOAD_STORE_BYTE_SWAP) != 0;
+  low_address->Replace(&OPCODE_ASSIGN_info, 0);
+  low_address->set_src1(swap ? high_half : low_half);
+  high_address->Replace(&OPCODE_ASSIGN_info, 0);
+  high_address->set_src1(swap ? low_half : high_half);
+
+  ++combined_sequence_count_;
+}
+
+void MemorySequenceCombinationPass::CombineAdjacentStores(HIRBuilder* builder,
+                                                          Instr* i) {
+  // Adjacent stores:
+  //   store_offset v0, 0x10, v1.i32, [swap]
+  //   ...
+  //   store_offset v0, 0x14, v2.i32, [swap]
+  // becomes:
+  //   ...
+  //   v3.i64 = zero_extend v1.i32
+  //   v4.i64 = shl v3.i64, 32
+  //   v5.i64 = zero_extend v2.i32
+  //   v6.i64 = or v4.i64, v5.i64
+  //   store_offset v0, 0x10, v6.i64, [swap]
+  Instr* j = FindAdjacentAccess(i);
+  if (!j) {
+    return;
+  }
+  TypeName type = i->src3.value->type;
+  TypeName wide_type = GetDoubleWidthType(type);
+  Instr* low_address = j->src2.value->constant.i64 < i->src2.value->constant.i64
+                           ? j
+                           : i;
+  Instr* high_address = low_address == i ? j : i;
+  bool swap = (i->flags & LoadStoreFlags::LOAD_STORE_BYTE_SWAP) != 0;
+  Value* high_half = swap ? low_address->src3.value : high_address->src3.value;
+  Value* low_half = swap ? high_address->src3.value : low_address->src3.value;
+  uint32_t half_bits = uint32_t(GetTypeSize(type) * 8);
+
+  Value* wide;
+  if (high_half->IsConstant() && low_half->IsConstant()) {
+    if (swap) {
+      // The backend can't swap constants, they're stored pre-swapped.
+      return;
+    }
+    uint64_t wide_constant =
+        (high_half->AsUint64() << half_bits) | low_half->AsUint64();
+    switch (wide_type) {
+      case INT16_TYPE:
+        wide = builder->LoadConstantUint16(uint16_t(wide_constant));
+        break;
+      case INT32_TYPE:
+        wide = builder->LoadConstantUint32(uint32_t(wide_constant));
+        break;
+      default:
+        wide = builder->LoadConstantUint64(wide_constant);
+        break;
+    }
+  } else {
+    Value* high_part = PlaceBefore(
+        builder,
+        builder->Shl(
+            PlaceBefore(builder, builder->ZeroExtend(high_half, wide_type), j),
+            int8_t(half_bits)),
+        j);
+    Value* low_part =
+        PlaceBefore(builder, builder->ZeroExtend(low_half, wide_type), j);
+    wide = PlaceBefore(builder, builder->Or(high_part, low_part), j);
+  }
+
+  // The merged store replaces the later one so it stays after everything
+  // computing the values.
+  j->set_src2(low_address->src2.value);
+  j->set_src3(wide);
+  i->UnlinkAndNOP();
+
+  ++combined_sequence_count_;
+}
+
 }  // namespace passes
 }  // namespace compiler
 }  // namespace cpu
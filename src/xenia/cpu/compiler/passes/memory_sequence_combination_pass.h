@@ -17,17 +17,34 @@ namespace cpu {
 namespace compiler {
 namespace passes {
 
+// Folds byte swaps into loads and stores, and optionally merges pairs of
+// adjacent accesses of the same size relative to the same base (such as the
+// ones generated for lmw/stmw or consecutive lwz/stw) into a single access of
+// twice the size.
 class MemorySequenceCombinationPass : public CompilerPass {
  public:
-  MemorySequenceCombinationPass();
+  explicit MemorySequenceCombinationPass(
+      bool combine_adjacent_accesses = false);
   ~MemorySequenceCombinationPass() override;
 
   bool Run(hir::HIRBuilder* builder) override;
 
+  // Number of access pairs merged during the last run.
+  uint32_t combined_sequence_count() const { return combined_sequence_count_; }
+
  private:
   void CombineMemorySequences(hir::HIRBuilder* builder);
   void CombineLoadSequence(hir::Instr* i);
   void CombineStoreSequence(hir::Instr* i);
+  void CombineAdjacentLoads(hir::HIRBuilder* builder, hir::Instr* i);
+  void CombineAdjacentStores(hir::HIRBuilder* builder, hir::Instr* i);
+  // Finds the next access of the same kind, size and base after i that is
+  // right before or after it in memory, with nothing accessing memory or
+  // having side effects in between.
+  hir::Instr* FindAdjacentAccess(hir::Instr* i);
+
+  bool combine_adjacent_accesses_;
+  uint32_t combined_sequence_count_ = 0;
 };
 
 }  // namespace passes
@@ -33,6 +33,25 @@ DEFINE_bool(trace_function_data, false,
 DEFINE_bool(validate_hir, false,
             "Perform validation checks on the HIR during compilation.", "CPU");
 
+DEFINE_bool(
+    tiered_compilation, false,
+    "Compile guest functions quickly with minimal optimizations and execution "
+    "counters first, and recompile the ones called often with all "
+    "optimizations and the block layout based on the gathered profile in the "
+    "background. Speeds up loading at the cost of slower code until the "
+    "functions are recompiled.",
+    "CPU");
+DEFINE_uint32(tiered_compilation_threshold, 1000,
+              "Number of calls after which a function compiled with "
+              "tiered_compilation is recompiled with all optimizations.",
+              "CPU");
+DEFINE_bool(stitch_tail_calls, false,
+            "Compile functions reached through tail calls (b to another "
+            "function) together with the function making the call, turning "
+            "the tail call into a jump. With tiered_compilation, only tail "
+            "calls frequently taken before recompilation are followed.",
+            "CPU");
+
 DEFINE_uint64(
     pvr, 0x710700,
     "Processor version and revision number.\nBits 0 to 15 are the version "
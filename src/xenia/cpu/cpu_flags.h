@@ -24,6 +24,10 @@ DECLARE_bool(trace_function_data);
 
 DECLARE_bool(validate_hir);
 
+DECLARE_bool(tiered_compilation);
+DECLARE_uint32(tiered_compilation_threshold);
+DECLARE_bool(stitch_tail_calls);
+
 DECLARE_uint64(pvr);
 
 // Breakpoints:
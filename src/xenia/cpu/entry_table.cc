@@ -9,97 +9,141 @@
 
 #include "xenia/cpu/entry_table.h"
 
+#include <algorithm>
+
 #include "xenia/base/profiling.h"
 #include "xenia/base/threading.h"
 
 namespace xe {
 namespace cpu {
 
-EntryTable::EntryTable() = default;
+EntryTable::EntryTable() : pages_(new std::atomic<Page*>[kPageCount]()) {}
 
 EntryTable::~EntryTable() {
-  auto global_lock = global_critical_region_.Acquire();
-  for (auto it : map_.Values()) {
-    Entry* entry = it;
+  for (Entry* entry : entries_) {
+    delete entry;
+  }
+  for (Entry* entry : deleted_entries_) {
     delete entry;
   }
+  for (uint32_t i = 0; i < kPageCount; ++i) {
+    delete pages_[i].load(std::memory_order_relaxed);
+  }
+  delete[] pages_;
+}
+
+std::atomic<Entry*>* EntryTable::GetOrCreateSlot(uint32_t address) {
+  std::atomic<Page*>& page_pointer = pages_[address >> kPageShift];
+  Page* page = page_pointer.load(std::memory_order_acquire);
+  if (!page) {
+    Page* new_page = new Page();
+    if (page_pointer.compare_exchange_strong(page, new_page,
+                                             std::memory_order_acq_rel,
+                                             std::memory_order_acquire)) {
+      page = new_page;
+    } else {
+      // Another thread has allocated the page first.
+      delete new_page;
+    }
+  }
+  return &page->slots[(address >> 2) & (kSlotsPerPage - 1)];
 }
 
 Entry* EntryTable::Get(uint32_t address) {
-  auto global_lock = global_critical_region_.Acquire();
-  uint32_t idx = map_.IndexForKey(address);
-  if (idx == map_.size() || *map_.KeyAt(idx) != address) {
+  std::atomic<Entry*>* slot = LookupSlot(address);
+  if (!slot) {
     return nullptr;
   }
-  Entry* entry = *map_.ValueAt(idx);
-  if (entry) {
-    // TODO(benvanik): wait if needed?
-    if (entry->status != Entry::STATUS_READY) {
-      entry = nullptr;
-    }
+  Entry* entry = slot->load(std::memory_order_acquire);
+  if (!entry || entry->address != address) {
+    return nullptr;
+  }
+  // TODO(benvanik): wait if needed?
+  if (entry->status.load(std::memory_order_acquire) != Entry::STATUS_READY) {
+    return nullptr;
   }
   return entry;
 }
 
 Entry::Status EntryTable::GetOrCreate(uint32_t address, Entry** out_entry) {
-  // TODO(benvanik): replace with a map with wait-free for find.
-  // https://github.com/facebook/folly/blob/master/folly/AtomicHashMap.h
-
-  auto global_lock = global_critical_region_.Acquire();
-
-  uint32_t idx = map_.IndexForKey(address);
+  if (address & 3) {
+    // Not a valid instruction address, and would alias an aligned one.
+    *out_entry = nullptr;
+    return Entry::STATUS_FAILED;
+  }
 
-  Entry* entry = idx != map_.size() && *map_.KeyAt(idx) == address
-                     ? *map_.ValueAt(idx)
-                     : nullptr;
-  Entry::Status status;
-  if (entry) {
-    // If we aren't ready yet spin and wait.
-    if (entry->status == Entry::STATUS_COMPILING) {
-      // chrispy: i think this is dead code, if we are compiling we're holding
-      // the global lock, arent we? so we wouldnt be executing here
-      // Still compiling, so spin.
-      do {
-        global_lock.unlock();
-        // TODO(benvanik): sleep for less time?
-        xe::threading::Sleep(std::chrono::microseconds(10));
-        global_lock.lock();
-      } while (entry->status == Entry::STATUS_COMPILING);
-    }
-    status = entry->status;
-  } else {
+  std::atomic<Entry*>* slot = LookupSlot(address);
+  Entry* entry = slot ? slot->load(std::memory_order_acquire) : nullptr;
+  if (!entry) {
     // Create and return for initialization.
-    entry = new Entry();
-    entry->address = address;
-    entry->end_address = 0;
-    entry->status = Entry::STATUS_COMPILING;
-    entry->function = 0;
-    map_.InsertAt(address, entry, idx);
-    // map_[address] = entry;
-    status = Entry::STATUS_NEW;
+    slot = GetOrCreateSlot(address);
+    Entry* new_entry = new Entry();
+    new_entry->address = address;
+    new_entry->end_address = 0;
+    new_entry->status.store(Entry::STATUS_COMPILING, std::memory_order_relaxed);
+    new_entry->function.store(nullptr, std::memory_order_relaxed);
+    if (slot->compare_exchange_strong(entry, new_entry,
+                                      std::memory_order_acq_rel,
+                                      std::memory_order_acquire)) {
+      {
+        std::lock_guard<std::mutex> lock(entries_mutex_);
+        entries_.push_back(new_entry);
+      }
+      *out_entry = new_entry;
+      return Entry::STATUS_NEW;
+    }
+    // Another thread has created the entry first, it's in `entry` now.
+    delete new_entry;
+  }
+
+  // If we aren't ready yet, wait for the thread resolving the function.
+  Entry::Status status = entry->status.load(std::memory_order_acquire);
+  while (status == Entry::STATUS_COMPILING) {
+    // TODO(benvanik): sleep for less time?
+    xe::threading::Sleep(std::chrono::microseconds(10));
+    status = entry->status.load(std::memory_order_acquire);
   }
-  global_lock.unlock();
   *out_entry = entry;
   return status;
 }
 
 void EntryTable::Delete(uint32_t address) {
-  auto global_lock = global_critical_region_.Acquire();
-  // doesnt this leak memory by not deleting the entry?
-  uint32_t idx = map_.IndexForKey(address);
-  if (idx != map_.size() && *map_.KeyAt(idx) == address) {
-    map_.EraseAt(idx);
+  std::atomic<Entry*>* slot = LookupSlot(address);
+  if (!slot) {
+    return;
+  }
+  Entry* entry = slot->load(std::memory_order_acquire);
+  if (!entry || entry->address != address ||
+      !slot->compare_exchange_strong(entry, nullptr,
+                                     std::memory_order_acq_rel)) {
+    return;
+  }
+  // Other threads may still be using the entry obtained before the deletion.
+  std::lock_guard<std::mutex> lock(entries_mutex_);
+  auto it = std::find(entries_.begin(), entries_.end(), entry);
+  if (it != entries_.end()) {
+    entries_.erase(it);
+  }
+  deleted_entries_.push_back(entry);
+}
+
+bool EntryTable::Replace(uint32_t address, Function* function) {
+  Entry* entry = Get(address);
+  if (!entry) {
+    return false;
   }
+  entry->function.store(function, std::memory_order_release);
+  return true;
 }
 
 std::vector<Function*> EntryTable::FindWithAddress(uint32_t address) {
-  auto global_lock = global_critical_region_.Acquire();
+  std::lock_guard<std::mutex> lock(entries_mutex_);
   std::vector<Function*> fns;
-  for (auto& it : map_.Values()) {
-    Entry* entry = it;
-    if (address >= entry->address && address <= entry->end_address) {
-      if (entry->status == Entry::STATUS_READY) {
-        fns.push_back(entry->function);
+  for (Entry* entry : entries_) {
+    if (entry->status.load(std::memory_order_acquire) ==
+        Entry::STATUS_READY) {
+      if (address >= entry->address && address <= entry->end_address) {
+        fns.push_back(entry->function.load(std::memory_order_acquire));
       }
     }
   }
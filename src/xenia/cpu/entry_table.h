@@ -10,11 +10,11 @@
 #ifndef XENIA_CPU_ENTRY_TABLE_H_
 #define XENIA_CPU_ENTRY_TABLE_H_
 
-#include <unordered_map>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
 #include <vector>
 
-#include "xenia/base/mutex.h"
-#include "xenia/base/split_map.h"
 namespace xe {
 namespace cpu {
 
@@ -23,33 +23,74 @@ class Function;
 typedef struct Entry_t {
   typedef enum {
     STATUS_NEW = 0,
+    // Pending - created by GetOrCreate, the function is being resolved by the
+    // thread that received STATUS_NEW.
     STATUS_COMPILING,
+    // Published - function and end_address are valid.
     STATUS_READY,
     STATUS_FAILED,
   } Status;
 
   uint32_t address;
   uint32_t end_address;
-  Status status;
-  Function* function;
+  // Stored with release semantics after function and end_address are set,
+  // loaded with acquire semantics before they are read.
+  std::atomic<Status> status;
+  // May be swapped for a recompiled version of the function after the entry
+  // has been published.
+  std::atomic<Function*> function;
 } Entry;
 
+// Guest address -> Entry map. Lookups are wait-free: the table is a two-level
+// direct-mapped array with one slot per possible instruction address, with the
+// pages of the second level allocated on first insertion into them (so only the
+// ranges of the modules containing code are populated). Entries are never
+// freed until the table is destroyed, so a pointer obtained by a lookup stays
+// valid even if the entry is concurrently deleted.
 class EntryTable {
  public:
   EntryTable();
   ~EntryTable();
 
+  // Returns the entry only if it's ready.
   Entry* Get(uint32_t address);
+  // Returns STATUS_NEW if the entry has been created by this call, in this case
+  // the caller must resolve the function and set the status to
+  // STATUS_READY or STATUS_FAILED. Waits if another thread is resolving it.
   Entry::Status GetOrCreate(uint32_t address, Entry** out_entry);
   void Delete(uint32_t address);
+  // Makes lookups of a ready entry return the new function. Threads that have
+  // obtained the old function before keep using it, so it must stay alive.
+  bool Replace(uint32_t address, Function* function);
 
   std::vector<Function*> FindWithAddress(uint32_t address);
 
  private:
-  xe::global_critical_region global_critical_region_;
-  // TODO(benvanik): replace with a better data structure.
-  xe::split_map<uint32_t, Entry*> map_;
-  // std::unordered_map<uint32_t, Entry*> map_;
+  // 64 KB of guest code per page.
+  static constexpr uint32_t kPageShift = 16;
+  static constexpr uint32_t kPageCount = uint32_t(1) << (32 - kPageShift);
+  static constexpr uint32_t kSlotsPerPage = uint32_t(1) << (kPageShift - 2);
+
+  struct Page {
+    std::atomic<Entry*> slots[kSlotsPerPage];
+  };
+
+  std::atomic<Entry*>* LookupSlot(uint32_t address) const {
+    Page* page = pages_[address >> kPageShift].load(std::memory_order_acquire);
+    if (!page) {
+      return nullptr;
+    }
+    return &page->slots[(address >> 2) & (kSlotsPerPage - 1)];
+  }
+  std::atomic<Entry*>* GetOrCreateSlot(uint32_t address);
+
+  std::atomic<Page*>* pages_;
+
+  // Protects the list of all entries, only taken when an entry is created or
+  // deleted, or when iterating.
+  std::mutex entries_mutex_;
+  std::vector<Entry*> entries_;
+  std::vector<Entry*> deleted_entries_;
 };
 
 }  // namespace cpu
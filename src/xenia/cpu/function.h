@@ -10,6 +10,7 @@
 #ifndef XENIA_CPU_FUNCTION_H_
 #define XENIA_CPU_FUNCTION_H_
 
+#include <atomic>
 #include <memory>
 #include <vector>
 
@@ -33,6 +34,20 @@ struct SourceMapEntry {
 };
 enum class SaveRestoreType : uint8_t { NONE, GPR, VMX, FPR };
 
+// Execution counts gathered by the code generated by the baseline tier of
+// tiered compilation, used when recompiling the function once it's hot.
+struct FunctionProfileData {
+  // Decremented on every call, the function is queued for recompilation when
+  // it reaches zero.
+  int32_t entry_countdown = 0;
+  std::atomic<bool> optimization_queued = {false};
+  // Guest address of the first instruction of every HIR block of the baseline
+  // code (or 0 if there's none), by block ordinal.
+  std::vector<uint32_t> block_addresses;
+  // How many times every block has been entered, by block ordinal.
+  std::unique_ptr<uint32_t[]> block_counts;
+};
+
 class Function : public Symbol {
  public:
   enum class Behavior : uint8_t {
@@ -119,6 +134,20 @@ class GuestFunction : public Function {
   typedef void (*ExternHandler)(ppc::PPCContext* ppc_context,
                                 kernel::KernelState* kernel_state);
 
+  // Inclusive range of guest instructions.
+  struct CodeRange {
+    uint32_t start_address;
+    uint32_t end_address;
+  };
+
+  enum class Tier : uint8_t {
+    // Compiled with all the optimizations, the machine code won't change.
+    kOptimized,
+    // Compiled quickly with profiling, will be replaced with optimized code
+    // once the function is hot.
+    kBaseline,
+  };
+
   GuestFunction(Module* module, uint32_t address);
   ~GuestFunction() override;
 
@@ -136,6 +165,40 @@ class GuestFunction : public Function {
   }
   FunctionTraceData& trace_data() { return trace_data_; }
   std::vector<SourceMapEntry>& source_map() { return source_map_; }
+  // Guest code outside the range of the function that has been compiled into
+  // its machine code, such as inlined callees, which the machine code must be
+  // invalidated with.
+  std::vector<CodeRange>& external_code_ranges() {
+    return external_code_ranges_;
+  }
+  const std::vector<CodeRange>& external_code_ranges() const {
+    return external_code_ranges_;
+  }
+
+  // Result of PPCScanner::IsInlineableLeaf for the function, cached as it's
+  // needed at every call site - the address of the blr ending it if it can be
+  // inlined, kNotInlineableLeaf if it can't, or 0 if not checked yet.
+  static constexpr uint32_t kNotInlineableLeaf = 1;
+  uint32_t inline_leaf_end_address() const {
+    return inline_leaf_end_address_.load(std::memory_order_relaxed);
+  }
+  void set_inline_leaf_end_address(uint32_t value) {
+    inline_leaf_end_address_.store(value, std::memory_order_relaxed);
+  }
+
+  Tier tier() const { return tier_.load(std::memory_order_acquire); }
+  // Published after the machine code for the tier has been set up.
+  void set_tier(Tier tier) { tier_.store(tier, std::memory_order_release); }
+  // Kept alive with the function, as the baseline code may still be running
+  // on other threads after being replaced. Shared with the function object
+  // containing the optimized code.
+  FunctionProfileData* profile_data() const { return profile_data_.get(); }
+  const std::shared_ptr<FunctionProfileData>& shared_profile_data() const {
+    return profile_data_;
+  }
+  void set_profile_data(std::shared_ptr<FunctionProfileData> profile_data) {
+    profile_data_ = std::move(profile_data);
+  }
 
   ExternHandler extern_handler() const { return extern_handler_; }
   Export* export_data() const { return export_data_; }
@@ -158,6 +221,10 @@ class GuestFunction : public Function {
   std::unique_ptr<FunctionDebugInfo> debug_info_;
   FunctionTraceData trace_data_;
   std::vector<SourceMapEntry> source_map_;
+  std::vector<CodeRange> external_code_ranges_;
+  std::atomic<uint32_t> inline_leaf_end_address_ = {0};
+  std::atomic<Tier> tier_ = {Tier::kOptimized};
+  std::shared_ptr<FunctionProfileData> profile_data_;
   ExternHandler extern_handler_ = nullptr;
   Export* export_data_ = nullptr;
 };
@@ -0,0 +1,106 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/function_optimizer.h"
+
+#include <algorithm>
+
+#include "xenia/base/assert.h"
+#include "xenia/base/logging.h"
+#include "xenia/cpu/function.h"
+#include "xenia/cpu/processor.h"
+
+namespace xe {
+namespace cpu {
+
+FunctionOptimizer::FunctionOptimizer(Processor* processor)
+    : processor_(processor) {}
+
+FunctionOptimizer::~FunctionOptimizer() { Shutdown(); }
+
+void FunctionOptimizer::Start(uint32_t thread_count) {
+  if (!thread_count) {
+    uint32_t logical_processor_count =
+        xe::threading::logical_processor_count();
+    if (!logical_processor_count) {
+      // Pick some reasonable amount if couldn't determine the number of cores.
+      logical_processor_count = 6;
+    }
+    // Hot functions trickle in while the title is running, don't take too many
+    // cores from it.
+    thread_count = std::max(logical_processor_count / 4, uint32_t(1));
+  }
+  for (uint32_t i = 0; i < thread_count; ++i) {
+    auto thread =
+        xe::threading::Thread::Create({}, [this]() { WorkerThread(); });
+    assert_not_null(thread);
+    thread->set_name("Function Optimizer");
+    thread->set_priority(xe::threading::ThreadPriority::kBelowNormal);
+    threads_.push_back(std::move(thread));
+  }
+}
+
+void FunctionOptimizer::Shutdown() {
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    shutting_down_ = true;
+    queue_.clear();
+  }
+  queue_cond_.notify_all();
+  for (auto& thread : threads_) {
+    xe::threading::Wait(thread.get(), false);
+  }
+  threads_.clear();
+}
+
+void FunctionOptimizer::Enqueue(GuestFunction* function) {
+  FunctionProfileData* profile_data = function->profile_data();
+  if (!profile_data ||
+      profile_data->optimization_queued.exchange(true,
+                                                 std::memory_order_relaxed)) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    if (shutting_down_) {
+      return;
+    }
+    queue_.push_back(function);
+  }
+  queue_cond_.notify_one();
+}
+
+void FunctionOptimizer::WorkerThread() {
+  while (true) {
+    GuestFunction* function;
+    {
+      std::unique_lock<std::mutex> lock(queue_mutex_);
+      queue_cond_.wait(lock,
+                       [this]() { return shutting_down_ || !queue_.empty(); });
+      if (shutting_down_) {
+        return;
+      }
+      function = queue_.front();
+      queue_.pop_front();
+    }
+
+    if (function->tier() != GuestFunction::Tier::kBaseline) {
+      continue;
+    }
+    if (processor_->OptimizeFunction(function)) {
+      ++optimized_count_;
+    } else {
+      // Keep running the baseline code.
+      XELOGE("Failed to recompile hot function {:08X}", function->address());
+    }
+  }
+}
+
+}  // namespace cpu
+}  // namespace xe
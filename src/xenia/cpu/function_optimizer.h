@@ -0,0 +1,70 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_FUNCTION_OPTIMIZER_H_
+#define XENIA_CPU_FUNCTION_OPTIMIZER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "xenia/base/threading.h"
+
+namespace xe {
+namespace cpu {
+
+class GuestFunction;
+class Processor;
+
+// Recompiles hot functions compiled by the baseline tier of tiered compilation
+// with all the optimizations on background threads. The new code is built into
+// a new function object, which replaces the baseline one in the entry table and
+// the module, and is published through the indirection table, so callers switch
+// to it on their next call. The baseline function isn't modified and is kept
+// alive, so the threads already running its code finish it normally.
+class FunctionOptimizer {
+ public:
+  explicit FunctionOptimizer(Processor* processor);
+  ~FunctionOptimizer();
+
+  // Spawns the worker threads, 0 for choosing the count based on the number of
+  // logical processors.
+  void Start(uint32_t thread_count = 0);
+  // Abandons the remaining work and waits for the workers to exit.
+  void Shutdown();
+
+  // Queues the function if it hasn't been queued already. Called from the
+  // generated code, must be cheap.
+  void Enqueue(GuestFunction* function);
+
+  uint32_t optimized_count() const { return optimized_count_; }
+
+ private:
+  void WorkerThread();
+
+  Processor* processor_;
+
+  std::mutex queue_mutex_;
+  std::condition_variable queue_cond_;
+  std::deque<GuestFunction*> queue_;
+  bool shutting_down_ = false;
+
+  std::vector<std::unique_ptr<xe::threading::Thread>> threads_;
+
+  std::atomic<uint32_t> optimized_count_ = {0};
+};
+
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_FUNCTION_OPTIMIZER_H_
@@ -0,0 +1,170 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/function_precompiler.h"
+
+#include <algorithm>
+
+#include "xenia/base/assert.h"
+#include "xenia/base/clock.h"
+#include "xenia/base/logging.h"
+#include "xenia/cpu/function.h"
+#include "xenia/cpu/processor.h"
+
+namespace xe {
+namespace cpu {
+
+FunctionPrecompiler::FunctionPrecompiler(Processor* processor)
+    : processor_(processor) {}
+
+FunctionPrecompiler::~FunctionPrecompiler() { Shutdown(); }
+
+void FunctionPrecompiler::Start(uint32_t thread_count) {
+  if (!thread_count) {
+    uint32_t logical_processor_count =
+        xe::threading::logical_processor_count();
+    if (!logical_processor_count) {
+      // Pick some reasonable amount if couldn't determine the number of cores.
+      logical_processor_count = 6;
+    }
+    // Leave a core for the title itself.
+    thread_count = std::max(logical_processor_count - 1, uint32_t(1));
+  }
+  for (uint32_t i = 0; i < thread_count; ++i) {
+    auto thread =
+        xe::threading::Thread::Create({}, [this]() { WorkerThread(); });
+    assert_not_null(thread);
+    thread->set_name("Function Precompiler");
+    thread->set_priority(xe::threading::ThreadPriority::kBelowNormal);
+    threads_.push_back(std::move(thread));
+  }
+}
+
+void FunctionPrecompiler::Shutdown() {
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    shutting_down_ = true;
+    for (auto& queue : queues_) {
+      queue.clear();
+    }
+  }
+  queue_cond_.notify_all();
+  for (auto& thread : threads_) {
+    xe::threading::Wait(thread.get(), false);
+  }
+  threads_.clear();
+}
+
+void FunctionPrecompiler::Enqueue(const std::vector<uint32_t>& addresses,
+                                  Priority priority) {
+  if (addresses.empty()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    if (shutting_down_) {
+      return;
+    }
+    auto& queue = queues_[size_t(priority)];
+    for (uint32_t address : addresses) {
+      queue.push_back({address, nullptr});
+    }
+  }
+  queue_cond_.notify_all();
+}
+
+void FunctionPrecompiler::EnqueueGenerator(AddressGenerator generator,
+                                           Priority priority) {
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    if (shutting_down_) {
+      return;
+    }
+    queues_[size_t(priority)].push_back({0, std::move(generator)});
+  }
+  queue_cond_.notify_one();
+}
+
+void FunctionPrecompiler::Finish() {
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    finishing_ = true;
+  }
+  queue_cond_.notify_all();
+}
+
+void FunctionPrecompiler::WorkerThread() {
+  uint64_t start_time = xe::Clock::QueryHostTickCount();
+  while (true) {
+    Job job;
+    Priority priority;
+    {
+      std::unique_lock<std::mutex> lock(queue_mutex_);
+      auto queue_it = queues_;
+      while (true) {
+        if (shutting_down_) {
+          return;
+        }
+        queue_it = std::find_if(
+            std::begin(queues_), std::end(queues_),
+            [](const std::deque<Job>& queue) { return !queue.empty(); });
+        if (queue_it != std::end(queues_)) {
+          break;
+        }
+        // Generators still running may add more work.
+        if (finishing_ && !running_generator_count_) {
+          break;
+        }
+        queue_cond_.wait(lock);
+      }
+      if (queue_it == std::end(queues_)) {
+        break;
+      }
+      job = std::move(queue_it->front());
+      queue_it->pop_front();
+      priority = Priority(queue_it - queues_);
+      if (job.generator) {
+        ++running_generator_count_;
+      }
+    }
+
+    if (job.generator) {
+      std::vector<uint32_t> addresses = job.generator();
+      {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        auto& queue = queues_[size_t(priority)];
+        for (uint32_t address : addresses) {
+          queue.push_back({address, nullptr});
+        }
+        --running_generator_count_;
+      }
+      queue_cond_.notify_all();
+      continue;
+    }
+
+    // Functions already resolved by the title or by another worker (if the
+    // address has been queued multiple times) are skipped, the ones being
+    // compiled by a guest thread are waited for in ResolveFunction.
+    Function* function = processor_->LookupFunction(job.address);
+    if (function && function->status() != Symbol::Status::kDefined &&
+        function->status() != Symbol::Status::kFailed) {
+      if (processor_->ResolveFunction(job.address)) {
+        ++compiled_count_;
+      }
+    }
+  }
+
+  XELOGCPU("Function precompiler thread done in {} ms, {} functions compiled",
+           (xe::Clock::QueryHostTickCount() - start_time) * 1000 /
+               xe::Clock::QueryHostTickFrequency(),
+           compiled_count_.load());
+}
+
+}  // namespace cpu
+}  // namespace xe
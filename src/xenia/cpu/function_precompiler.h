@@ -0,0 +1,92 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_FUNCTION_PRECOMPILER_H_
+#define XENIA_CPU_FUNCTION_PRECOMPILER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "xenia/base/threading.h"
+
+namespace xe {
+namespace cpu {
+
+class Processor;
+
+// Resolves guest functions on background threads so the title can start
+// running while they are being compiled. Results are published through
+// Processor::ResolveFunction, so a guest thread calling a function that is
+// being compiled by a worker waits for it instead of compiling it again, and a
+// function that is still queued is just compiled by the guest thread itself.
+class FunctionPrecompiler {
+ public:
+  enum class Priority : uint32_t {
+    // Functions known to be called, such as the ones resolved during previous
+    // runs.
+    kHigh,
+    // Functions found by heuristics.
+    kLow,
+
+    kCount,
+  };
+
+  // Produces addresses to compile, invoked on a worker thread.
+  using AddressGenerator = std::function<std::vector<uint32_t>()>;
+
+  explicit FunctionPrecompiler(Processor* processor);
+  ~FunctionPrecompiler();
+
+  // Spawns the worker threads, 0 for choosing the count based on the number of
+  // logical processors.
+  void Start(uint32_t thread_count = 0);
+  // Abandons the remaining work and waits for the workers to exit.
+  void Shutdown();
+
+  void Enqueue(const std::vector<uint32_t>& addresses, Priority priority);
+  // The generator is invoked when all the work with a higher priority has been
+  // taken, and its results are compiled with the same priority.
+  void EnqueueGenerator(AddressGenerator generator, Priority priority);
+  // Lets the workers exit once the queues are empty.
+  void Finish();
+
+  uint32_t compiled_count() const { return compiled_count_; }
+
+ private:
+  struct Job {
+    uint32_t address;
+    AddressGenerator generator;
+  };
+
+  void WorkerThread();
+
+  Processor* processor_;
+
+  std::mutex queue_mutex_;
+  std::condition_variable queue_cond_;
+  std::deque<Job> queues_[size_t(Priority::kCount)];
+  uint32_t running_generator_count_ = 0;
+  bool finishing_ = false;
+  bool shutting_down_ = false;
+
+  std::vector<std::unique_ptr<xe::threading::Thread>> threads_;
+
+  std::atomic<uint32_t> compiled_count_ = {0};
+};
+
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_FUNCTION_PRECOMPILER_H_
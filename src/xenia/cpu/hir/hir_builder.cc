@@ -671,6 +671,37 @@ void HIRBuilder::MergeAdjacentBlocks(Block* left, Block* right) {
   }
 }
 
+void HIRBuilder::MakeFallthroughExplicit(Block* block) {
+  if (block->instr_tail && IsUnconditionalJump(block->instr_tail)) {
+    return;
+  }
+  Block* old_current_block = current_block_;
+  current_block_ = block;
+  if (block->next) {
+    Branch(block->next);
+    AddEdge(block, block->next, Edge::UNCONDITIONAL);
+  } else {
+    Return();
+  }
+  current_block_ = old_current_block;
+}
+
+void HIRBuilder::MoveBlockToEnd(Block* block) {
+  if (block == block_tail_) {
+    return;
+  }
+  if (block->prev) {
+    block->prev->next = block->next;
+  } else {
+    block_head_ = block->next;
+  }
+  block->next->prev = block->prev;
+  block->prev = block_tail_;
+  block->next = nullptr;
+  block_tail_->next = block;
+  block_tail_ = block;
+}
+
 Block* HIRBuilder::AppendBlock() {
   Block* block = arena_->Alloc<Block>();
   block->ordinal = UINT16_MAX;
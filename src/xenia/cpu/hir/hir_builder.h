@@ -76,6 +76,12 @@ class HIRBuilder {
   void RemoveEdge(Edge* edge);
   void RemoveBlock(Block* block);
   void MergeAdjacentBlocks(Block* left, Block* right);
+  // Ends the block with an explicit branch (or a return for the last block) if
+  // it falls through, so the blocks can be reordered.
+  void MakeFallthroughExplicit(Block* block);
+  // Moves the block to the end of the block list. The block must not fall
+  // through.
+  void MoveBlockToEnd(Block* block);
 
   Instr* AllocateInstruction();
 
@@ -303,11 +309,11 @@ class HIRBuilder {
  protected:
   void DumpValue(StringBuffer* str, Value* value);
   void DumpOp(StringBuffer* str, OpcodeSignatureType sig_type, Instr::Op* op);
+  bool IsUnconditionalJump(Instr* instr);
 
  private:
   Block* AppendBlock();
   void EndBlock();
-  bool IsUnconditionalJump(Instr* instr);
   Instr* AppendInstr(const OpcodeInfo& opcode, uint16_t flags, Value* dest = 0);
   void CommentBuffer(const char* p);
   Value* CompareXX(const OpcodeInfo& opcode, Value* value1, Value* value2);
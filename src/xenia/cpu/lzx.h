@@ -10,6 +10,8 @@
 #ifndef XENIA_CPU_LZX_H_
 #define XENIA_CPU_LZX_H_
 
+#include <cstddef>
+#include <functional>
 #include <string>
 #include <vector>
 
@@ -23,6 +25,15 @@ int lzx_decompress(const void* lzx_data, size_t lzx_len, void* dest,
                    size_t dest_len, uint32_t window_size, void* window_data,
                    size_t window_data_len);
 
+// Reads up to size bytes of the compressed data into the buffer, returning the
+// number of bytes read (0 at the end of the data), or -1 if the data can't be
+// provided, failing the decompression. May block until the data is ready, so
+// the decompression can overlap with producing the following data.
+using LzxReadCallback = std::function<ptrdiff_t(void* buffer, size_t size)>;
+
+int lzx_decompress(const LzxReadCallback& read_callback, void* dest,
+                   size_t dest_len, uint32_t window_size);
+
 int lzxdelta_apply_patch(xe::xex2_delta_patch* patch, size_t patch_len,
                          uint32_t window_size, void* dest);
 
@@ -147,6 +147,21 @@ Symbol::Status Module::DefineVariable(Symbol* symbol) {
   return DefineSymbol(symbol);
 }
 
+void Module::ReplaceFunction(Function* old_function,
+                             std::unique_ptr<Function> new_function) {
+  auto global_lock = global_critical_region_.Acquire();
+  map_[new_function->address()] = new_function.get();
+  // Keep the index of the symbol in the list.
+  for (auto& symbol : list_) {
+    if (symbol.get() == old_function) {
+      replaced_list_.push_back(std::move(symbol));
+      symbol = std::move(new_function);
+      return;
+    }
+  }
+  list_.push_back(std::move(new_function));
+}
+
 const std::vector<uint32_t> Module::GetAddressedFunctions() {
   std::vector<uint32_t> addresses;
 
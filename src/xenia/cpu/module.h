@@ -10,6 +10,7 @@
 #ifndef XENIA_CPU_MODULE_H_
 #define XENIA_CPU_MODULE_H_
 
+#include <atomic>
 #include <functional>
 #include <memory>
 #include <string>
@@ -46,6 +47,16 @@ class Module {
   Symbol::Status DefineFunction(Function* symbol);
   Symbol::Status DefineVariable(Symbol* symbol);
 
+  // Creates a function that isn't visible to lookups, for building a new
+  // version of a defined function to pass to ReplaceFunction.
+  std::unique_ptr<Function> CreateReplacementFunction(uint32_t address) {
+    return CreateFunction(address);
+  }
+  // Makes lookups of the address return the new function. The old one is kept
+  // alive until the module is destroyed, as its code may still be running.
+  void ReplaceFunction(Function* old_function,
+                       std::unique_ptr<Function> new_function);
+
   const std::vector<uint32_t> GetAddressedFunctions();
   void ForEachFunction(std::function<void(Function*)> callback);
   void ForEachSymbol(size_t start_index, size_t end_index,
@@ -56,6 +67,15 @@ class Module {
 
   virtual void Precompile() {}
 
+  // Number of pairs of adjacent guest memory accesses merged by the compiler in
+  // the functions of the module.
+  uint64_t combined_memory_sequence_count() const {
+    return combined_memory_sequence_count_;
+  }
+  void add_combined_memory_sequences(uint32_t count) {
+    combined_memory_sequence_count_ += count;
+  }
+
  protected:
   virtual std::unique_ptr<Function> CreateFunction(uint32_t address) = 0;
 
@@ -71,6 +91,9 @@ class Module {
   // TODO(benvanik): replace with a better data structure.
   std::unordered_map<uint32_t, Symbol*> map_;
   std::vector<std::unique_ptr<Symbol>> list_;
+  std::vector<std::unique_ptr<Symbol>> replaced_list_;
+
+  std::atomic<uint64_t> combined_memory_sequence_count_ = {0};
 };
 
 }  // namespace cpu
@@ -63,7 +63,7 @@ int InstrEmit_branch(PPCHIRBuilder& f, const char* src, uint64_t cia,
     // recursion.
     uint32_t nia_value = nia->AsUint64() & 0xFFFFFFFF;
     bool is_recursion = false;
-    if (nia_value == f.function()->address() && lk) {
+    if (lk && f.IsFunctionEntry(nia_value)) {
       is_recursion = true;
     }
     Label* label = is_recursion ? NULL : f.LookupLabel(nia_value);
@@ -87,7 +87,7 @@ int InstrEmit_branch(PPCHIRBuilder& f, const char* src, uint64_t cia,
           cond = f.IsFalse(cond);
         }
         f.CallTrue(cond, function, call_flags);
-      } else {
+      } else if (!lk || !f.EmitInlinedCall(function)) {
         f.Call(function, call_flags);
       }
     }
@@ -129,6 +129,14 @@ bool PPCFrontend::DefineFunction(GuestFunction* function,
   return result;
 }
 
+bool PPCFrontend::OptimizeFunction(GuestFunction* function) {
+  auto translator = translator_pool_.Allocate(this);
+  bool result = translator->Translate(function, 0, true);
+  translator->Reset();
+  translator_pool_.Release(translator);
+  return result;
+}
+
 }  // namespace ppc
 }  // namespace cpu
 }  // namespace xe
@@ -49,6 +49,9 @@ class PPCFrontend {
 
   bool DeclareFunction(GuestFunction* function);
   bool DefineFunction(GuestFunction* function, uint32_t debug_info_flags);
+  // Compiles a new function object for a function profiled by the baseline
+  // tier, sharing its profile data, with all the optimizations.
+  bool OptimizeFunction(GuestFunction* function);
 
  private:
   Processor* processor_;
@@ -10,6 +10,7 @@
 #include "xenia/cpu/ppc/ppc_hir_builder.h"
 
 #include <stddef.h>
+#include <algorithm>
 #include <cstring>
 
 #include "third_party/fmt/include/fmt/format.h"
@@ -33,6 +34,14 @@ DEFINE_bool(
     "Break to the host debugger (or crash if no debugger attached) if an "
     "unimplemented PowerPC instruction is encountered.",
     "CPU");
+DEFINE_bool(inline_leaf_functions, false,
+            "Emit the code of small leaf functions in place of calls to them, "
+            "avoiding the guest call sequence.",
+            "CPU");
+DEFINE_uint32(inline_leaf_function_max_instructions, 16,
+              "Maximum number of instructions in a leaf function for it to be "
+              "inlined.",
+              "CPU");
 
 namespace xe {
 namespace cpu {
@@ -45,6 +54,13 @@ using xe::cpu::hir::Label;
 using xe::cpu::hir::TypeName;
 using xe::cpu::hir::Value;
 
+// Limit of the total number of instructions inlined into one function.
+constexpr uint32_t kMaxInlinedInstrCount = 256;
+// Limits of the functions stitched into one function by tail calls.
+constexpr size_t kMaxTraceSegmentCount = 8;
+constexpr uint32_t kMaxTraceSegmentInstrCount = 1024;
+constexpr uint32_t kMaxTraceInstrCount = 4096;
+
 // The number of times each opcode has been translated.
 // Accumulated across the entire run.
 uint32_t opcode_translation_counts[static_cast<int>(PPCOpcode::kInvalid)] = {0};
@@ -66,7 +82,10 @@ void DumpAllOpcodeCounts() {
 }
 
 PPCHIRBuilder::PPCHIRBuilder(PPCFrontend* frontend)
-    : HIRBuilder(), frontend_(frontend), comment_buffer_(4096) {}
+    : HIRBuilder(),
+      frontend_(frontend),
+      scanner_(frontend),
+      comment_buffer_(4096) {}
 
 PPCHIRBuilder::~PPCHIRBuilder() = default;
 
@@ -74,10 +93,11 @@ PPCBuiltins* PPCHIRBuilder::builtins() const { return frontend_->builtins(); }
 
 void PPCHIRBuilder::Reset() {
   function_ = nullptr;
-  start_address_ = 0;
+  segments_.clear();
   instr_count_ = 0;
   instr_offset_list_ = NULL;
   label_list_ = NULL;
+  inlined_instr_count_ = 0;
   with_debug_info_ = false;
   HIRBuilder::Reset();
 }
@@ -88,12 +108,14 @@ bool PPCHIRBuilder::Emit(GuestFunction* function, uint32_t flags) {
   Memory* memory = frontend_->memory();
 
   function_ = function;
-  start_address_ = function_->address();
+  function_->external_code_ranges().clear();
   // chrispy: i've seen this one happen, not sure why but i think from trying to
   // precompile twice i've also seen ones with a start and end address that are
   // the same...
   assert_true(function_->address() <= function_->end_address());
   instr_count_ = (function_->end_address() - function_->address()) / 4 + 1;
+  segments_.push_back(
+      {function_, function_->address(), function_->end_address(), 0});
 
   with_debug_info_ = (flags & EMIT_DEBUG_COMMENTS) == EMIT_DEBUG_COMMENTS;
   if (with_debug_info_) {
@@ -102,6 +124,10 @@ bool PPCHIRBuilder::Emit(GuestFunction* function, uint32_t flags) {
                   function_->name().c_str());
   }
 
+  if (flags & EMIT_TRACES) {
+    CollectTraceSegments();
+  }
+
   // Allocate offset list.
   // This is used to quickly map labels to instructions.
   // The list is built as the instructions are traversed, with the values
@@ -114,89 +140,254 @@ bool PPCHIRBuilder::Emit(GuestFunction* function, uint32_t flags) {
   std::memset(instr_offset_list_, 0, list_size);
   std::memset(label_list_, 0, list_size);
 
-  // Always mark entry with label.
-  label_list_[0] = NewLabel();
-
-  uint32_t start_address = function_->address();
-  uint32_t end_address = function_->end_address();
-  for (uint32_t address = start_address, offset = 0; address <= end_address;
-       address += 4, offset++) {
-    trace_info_.dest_count = 0;
-    uint32_t code =
-        xe::load_and_swap<uint32_t>(memory->TranslateVirtual(address));
-    auto opcode = LookupOpcode(code);
-    auto& opcode_info = GetOpcodeInfo(opcode);
+  // Always mark entries with labels.
+  for (const CodeSegment& segment : segments_) {
+    label_list_[segment.offset] = NewLabel();
+  }
 
-    // Mark label, if we were assigned one earlier on in the walk.
-    // We may still get a label, but it'll be inserted by LookupLabel
-    // as needed.
-    Label* label = label_list_[offset];
-    if (label) {
-      MarkLabel(label);
+  for (const CodeSegment& segment : segments_) {
+    if (segment.offset) {
+      // Not a continuation of the previous segment - handle falling through
+      // the end of it like Finalize does for the last block.
+      Instr* prev_instr = last_instr();
+      if (!prev_instr || !IsUnconditionalJump(prev_instr)) {
+        Trap();
+        Return();
+      }
     }
-
-    Instr* first_instr = 0;
-    if (with_debug_info_) {
+    for (uint32_t address = segment.start_address, offset = segment.offset;
+         address <= segment.end_address; address += 4, offset++) {
+      trace_info_.dest_count = 0;
+      uint32_t code =
+          xe::load_and_swap<uint32_t>(memory->TranslateVirtual(address));
+      auto opcode = LookupOpcode(code);
+
+      // Mark label, if we were assigned one earlier on in the walk.
+      // We may still get a label, but it'll be inserted by LookupLabel
+      // as needed.
+      Label* label = label_list_[offset];
       if (label) {
-        AnnotateLabel(address, label);
+        MarkLabel(label);
       }
-      comment_buffer_.Reset();
-      comment_buffer_.AppendFormat("{:08X} {:08X} ", address, code);
-      DisasmPPC(address, code, &comment_buffer_);
-      Comment(comment_buffer_);
-      first_instr = last_instr();
+
+      Instr* first_instr = 0;
+      if (with_debug_info_) {
+        if (label) {
+          AnnotateLabel(address, label);
+        }
+        comment_buffer_.Reset();
+        comment_buffer_.AppendFormat("{:08X} {:08X} ", address, code);
+        DisasmPPC(address, code, &comment_buffer_);
+        Comment(comment_buffer_);
+        first_instr = last_instr();
+      }
+
+      // Mark source offset for debugging.
+      // We could omit this if we never wanted to debug.
+      SourceOffset(address);
+      if (!first_instr) {
+        first_instr = last_instr();
+      }
+
+      // Stash instruction offset. It's either the SOURCE_OFFSET or the
+      // COMMENT.
+      instr_offset_list_[offset] = first_instr;
+
+      EmitInstruction(address, code, opcode);
     }
+  }
 
-    // Mark source offset for debugging.
-    // We could omit this if we never wanted to debug.
-    SourceOffset(address);
-    if (!first_instr) {
-      first_instr = last_instr();
+  if (false) {
+    DumpAllOpcodeCounts();
+  }
+
+  return Finalize();
+}
+
+void PPCHIRBuilder::CollectTraceSegments() {
+  Memory* memory = frontend_->memory();
+
+  // Segments appended during the walk are walked too, following chains of
+  // tail calls.
+  for (size_t i = 0;
+       i < segments_.size() && segments_.size() < kMaxTraceSegmentCount; ++i) {
+    const CodeSegment segment = segments_[i];
+    for (uint32_t address = segment.start_address;
+         address <= segment.end_address &&
+         segments_.size() < kMaxTraceSegmentCount;
+         address += 4) {
+      uint32_t code =
+          xe::load_and_swap<uint32_t>(memory->TranslateVirtual(address));
+      if (LookupOpcode(code) != PPCOpcode::bx) {
+        continue;
+      }
+      PPCDecodeData d;
+      d.address = address;
+      d.code = code;
+      if (d.I.LK()) {
+        continue;
+      }
+      uint32_t target = d.I.ADDR();
+      if (FindSegment(target)) {
+        continue;
+      }
+      // Only functions that have already been defined have a known extent.
+      Function* function = LookupFunction(target);
+      if (!function || !function->is_guest() ||
+          function->behavior() != Function::Behavior::kDefault ||
+          function->status() != Symbol::Status::kDefined ||
+          !function->has_end_address() || function->address() != target) {
+        continue;
+      }
+      uint32_t instr_count = (function->end_address() - target) / 4 + 1;
+      if (instr_count > kMaxTraceSegmentInstrCount ||
+          instr_count_ + instr_count > kMaxTraceInstrCount ||
+          !IsHotTailCall(segment.function, address)) {
+        continue;
+      }
+      segments_.push_back({static_cast<GuestFunction*>(function), target,
+                           function->end_address(),
+                           static_cast<uint32_t>(instr_count_)});
+      instr_count_ += instr_count;
+      // Invalidate the stored code of the head function along with the
+      // stitched one.
+      function_->external_code_ranges().push_back(
+          {target, function->end_address()});
     }
+  }
+}
 
-    // Stash instruction offset. It's either the SOURCE_OFFSET or the COMMENT.
-    instr_offset_list_[offset] = first_instr;
+bool PPCHIRBuilder::IsHotTailCall(GuestFunction* function, uint32_t address) {
+  FunctionProfileData* profile_data = function->profile_data();
+  if (!profile_data || !profile_data->block_counts) {
+    // Without tiered compilation there's nothing to tell hot paths apart,
+    // follow every tail call.
+    return !cvars::tiered_compilation;
+  }
+  // The block containing the branch is the closest one starting before it.
+  uint32_t entry_count = 0;
+  uint32_t branch_block_address = 0;
+  uint32_t branch_count = 0;
+  for (size_t i = 0; i < profile_data->block_addresses.size(); ++i) {
+    uint32_t block_address = profile_data->block_addresses[i];
+    uint32_t block_count = profile_data->block_counts[i];
+    if (block_address == function->address()) {
+      entry_count = std::max(entry_count, block_count);
+    }
+    if (block_address >= function->address() && block_address <= address &&
+        block_address >= branch_block_address) {
+      branch_block_address = block_address;
+      branch_count = block_count;
+    }
+  }
+  // Taken on at least half of the calls to the function.
+  return branch_count && uint64_t(branch_count) * 2 >= entry_count;
+}
 
-    if (opcode == PPCOpcode::kInvalid) {
-      XELOGE("Invalid instruction {:08X} {:08X}", address, code);
-      Comment("INVALID!");
-      // TraceInvalidInstruction(i);
-      continue;
+const PPCHIRBuilder::CodeSegment* PPCHIRBuilder::FindSegment(
+    uint32_t address) const {
+  for (const CodeSegment& segment : segments_) {
+    if (address >= segment.start_address && address <= segment.end_address) {
+      return &segment;
     }
-    ++opcode_translation_counts[static_cast<int>(opcode)];
+  }
+  return nullptr;
+}
 
-    // Synchronize the PPC context as required.
-    // This will ensure all registers are saved to the PPC context before this
-    // instruction executes.
-    if (opcode_info.type == PPCOpcodeType::kSync) {
-      ContextBarrier();
+bool PPCHIRBuilder::IsFunctionEntry(uint32_t address) const {
+  for (const CodeSegment& segment : segments_) {
+    if (address == segment.start_address) {
+      return true;
     }
+  }
+  return false;
+}
 
-    MaybeBreakOnInstruction(address);
-
-    InstrData i;
-    i.address = address;
-    i.code = code;
-    i.opcode = opcode;
-    i.opcode_info = &opcode_info;
-    if (!opcode_info.emit || opcode_info.emit(*this, i)) {
-      auto& disasm_info = GetOpcodeDisasmInfo(opcode);
-      XELOGE(
-          "Unimplemented instr {:08X} {:08X} {} - report the game to Xenia "
-          "developers; to skip, disable break_on_unimplemented_instructions",
-          address, code, disasm_info.name);
-      Comment("UNIMPLEMENTED!");
-      if (cvars::break_on_unimplemented_instructions) {
-        DebugBreak();
-      }
+void PPCHIRBuilder::EmitInstruction(uint32_t address, uint32_t code,
+                                    PPCOpcode opcode) {
+  if (opcode == PPCOpcode::kInvalid) {
+    XELOGE("Invalid instruction {:08X} {:08X}", address, code);
+    Comment("INVALID!");
+    // TraceInvalidInstruction(i);
+    return;
+  }
+  ++opcode_translation_counts[static_cast<int>(opcode)];
+  auto& opcode_info = GetOpcodeInfo(opcode);
+
+  // Synchronize the PPC context as required.
+  // This will ensure all registers are saved to the PPC context before this
+  // instruction executes.
+  if (opcode_info.type == PPCOpcodeType::kSync) {
+    ContextBarrier();
+  }
+
+  MaybeBreakOnInstruction(address);
+
+  InstrData i;
+  i.address = address;
+  i.code = code;
+  i.opcode = opcode;
+  i.opcode_info = &opcode_info;
+  if (!opcode_info.emit || opcode_info.emit(*this, i)) {
+    auto& disasm_info = GetOpcodeDisasmInfo(opcode);
+    XELOGE(
+        "Unimplemented instr {:08X} {:08X} {} - report the game to Xenia "
+        "developers; to skip, disable break_on_unimplemented_instructions",
+        address, code, disasm_info.name);
+    Comment("UNIMPLEMENTED!");
+    if (cvars::break_on_unimplemented_instructions) {
+      DebugBreak();
     }
   }
+}
 
-  if (false) {
-    DumpAllOpcodeCounts();
+bool PPCHIRBuilder::EmitInlinedCall(Function* function) {
+  if (!cvars::inline_leaf_functions || !function || !function->is_guest() ||
+      function->behavior() != Function::Behavior::kDefault) {
+    return false;
+  }
+  // Breakpoints and tracing work on whole functions, keep the calls visible
+  // to them.
+  if (with_debug_info_ || frontend_->processor()->is_debugger_attached()) {
+    return false;
   }
 
-  return Finalize();
+  auto guest_function = static_cast<GuestFunction*>(function);
+  uint32_t start_address = function->address();
+  uint32_t end_address = guest_function->inline_leaf_end_address();
+  if (!end_address) {
+    if (!scanner_.IsInlineableLeaf(
+            start_address, cvars::inline_leaf_function_max_instructions,
+            &end_address)) {
+      end_address = GuestFunction::kNotInlineableLeaf;
+    }
+    guest_function->set_inline_leaf_end_address(end_address);
+  }
+  if (end_address == GuestFunction::kNotInlineableLeaf) {
+    return false;
+  }
+  uint32_t instr_count = (end_address - start_address) / 4;
+  if (inlined_instr_count_ + instr_count > kMaxInlinedInstrCount) {
+    return false;
+  }
+  inlined_instr_count_ += instr_count;
+  // The machine code of the caller now depends on the callee too.
+  function_->external_code_ranges().push_back({start_address, end_address});
+
+  // LR has already been set to the return address by the caller, and the
+  // callee doesn't modify it, so only the body needs to be emitted, without
+  // the trailing blr. Source offsets point to the callee's instructions so the
+  // stack walker and the debugger see where in it the code is.
+  Memory* memory = frontend_->memory();
+  for (uint32_t address = start_address; address < end_address;
+       address += 4) {
+    trace_info_.dest_count = 0;
+    uint32_t code =
+        xe::load_and_swap<uint32_t>(memory->TranslateVirtual(address));
+    SourceOffset(address);
+    EmitInstruction(address, code, LookupOpcode(code));
+  }
+  return true;
 }
 
 void PPCHIRBuilder::MaybeBreakOnInstruction(uint32_t address) {
@@ -260,13 +451,11 @@ Function* PPCHIRBuilder::LookupFunction(uint32_t address) {
 }
 
 Label* PPCHIRBuilder::LookupLabel(uint32_t address) {
-  if (address < start_address_) {
-    return nullptr;
-  }
-  size_t offset = (address - start_address_) / 4;
-  if (offset >= instr_count_) {
+  const CodeSegment* segment = FindSegment(address);
+  if (!segment) {
     return nullptr;
   }
+  size_t offset = segment->offset + (address - segment->start_address) / 4;
   Label* label = label_list_[offset];
   if (label) {
     return label;
@@ -10,9 +10,13 @@
 #ifndef XENIA_CPU_PPC_PPC_HIR_BUILDER_H_
 #define XENIA_CPU_PPC_PPC_HIR_BUILDER_H_
 
+#include <vector>
+
 #include "xenia/base/string_buffer.h"
 #include "xenia/cpu/function.h"
 #include "xenia/cpu/hir/hir_builder.h"
+#include "xenia/cpu/ppc/ppc_opcode.h"
+#include "xenia/cpu/ppc/ppc_scanner.h"
 
 namespace xe {
 namespace cpu {
@@ -37,12 +41,22 @@ class PPCHIRBuilder : public hir::HIRBuilder {
   enum EmitFlags {
     // Emit comment nodes.
     EMIT_DEBUG_COMMENTS = 1 << 0,
+    // Stitch functions reached through frequently taken tail calls into the
+    // function, with branches out of them going through normal dispatch.
+    EMIT_TRACES = 1 << 1,
   };
   bool Emit(GuestFunction* function, uint32_t flags);
 
   GuestFunction* function() const { return function_; }
   Function* LookupFunction(uint32_t address);
   Label* LookupLabel(uint32_t address);
+  // Whether the address is the entry of the function or of one stitched into
+  // it, calls to which must not become branches.
+  bool IsFunctionEntry(uint32_t address) const;
+
+  // Emits the body of a small leaf function in place of a call to it.
+  // Returns false if the function can't be inlined and must be called.
+  bool EmitInlinedCall(Function* function);
 
   Value* LoadLR();
   void StoreLR(Value* value);
@@ -85,10 +99,25 @@ class PPCHIRBuilder : public hir::HIRBuilder {
   void SetReturnAddress(Value* value);
 
  private:
+  // Guest code emitted into the function - the function itself, or one reached
+  // through a tail call.
+  struct CodeSegment {
+    GuestFunction* function;
+    uint32_t start_address;
+    uint32_t end_address;
+    // Index of the first instruction in instr_offset_list_ and label_list_.
+    uint32_t offset;
+  };
+
+  void CollectTraceSegments();
+  bool IsHotTailCall(GuestFunction* function, uint32_t address);
+  const CodeSegment* FindSegment(uint32_t address) const;
+  void EmitInstruction(uint32_t address, uint32_t code, PPCOpcode opcode);
   void MaybeBreakOnInstruction(uint32_t address);
   void AnnotateLabel(uint32_t address, Label* label);
 
   PPCFrontend* frontend_;
+  PPCScanner scanner_;
 
   // Reset whenever needed:
   StringBuffer comment_buffer_;
@@ -96,10 +125,11 @@ class PPCHIRBuilder : public hir::HIRBuilder {
   // Reset each Emit:
   bool with_debug_info_;
   GuestFunction* function_;
-  uint64_t start_address_;
+  std::vector<CodeSegment> segments_;
   uint64_t instr_count_;
   Instr** instr_offset_list_;
   Label** label_list_;
+  uint32_t inlined_instr_count_;
 
   // Reset each instruction.
   struct {
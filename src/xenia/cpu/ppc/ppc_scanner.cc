@@ -364,6 +364,48 @@ std::vector<BlockInfo> PPCScanner::FindBlocks(GuestFunction* function) {
   return blocks;
 }
 
+bool PPCScanner::IsInlineableLeaf(uint32_t address,
+                                  uint32_t max_instruction_count,
+                                  uint32_t* end_address_out) {
+  Memory* memory = frontend_->memory();
+
+  for (uint32_t i = 0; i <= max_instruction_count; ++i, address += 4) {
+    uint32_t code =
+        xe::load_and_swap<uint32_t>(memory->TranslateVirtual(address));
+    if (code == 0x4E800020) {
+      // blr -- the only way out of the function.
+      *end_address_out = address;
+      return true;
+    }
+    if (i == max_instruction_count) {
+      break;
+    }
+    auto opcode = LookupOpcode(code);
+    if (opcode == PPCOpcode::kInvalid || !GetOpcodeInfo(opcode).emit) {
+      return false;
+    }
+    switch (opcode) {
+      case PPCOpcode::bx:
+      case PPCOpcode::bcx:
+      case PPCOpcode::bclrx:
+      case PPCOpcode::bcctrx:
+      case PPCOpcode::sc:
+        return false;
+      case PPCOpcode::mtspr: {
+        // mtlr would change where the blr returns to.
+        PPCDecodeData d;
+        d.code = code;
+        if ((((d.XFX.SPR() & 0x1F) << 5) | ((d.XFX.SPR() >> 5) & 0x1F)) == 8) {
+          return false;
+        }
+      } break;
+      default:
+        break;
+    }
+  }
+  return false;
+}
+
 }  // namespace ppc
 }  // namespace cpu
 }  // namespace xe
@@ -35,6 +35,13 @@ class PPCScanner {
 
   std::vector<BlockInfo> FindBlocks(GuestFunction* function);
 
+  // Checks whether the function at the address is a leaf that can be inlined
+  // into its callers - straight-line code of at most max_instruction_count
+  // instructions ending with a blr, without branches, system calls or LR
+  // writes. Returns the address of the blr in end_address_out.
+  bool IsInlineableLeaf(uint32_t address, uint32_t max_instruction_count,
+                        uint32_t* end_address_out);
+
  private:
   bool IsRestGprLr(uint32_t address);
 
@@ -9,9 +9,13 @@
 
 #include "xenia/cpu/ppc/ppc_translator.h"
 
+#include <algorithm>
+#include <atomic>
+
 #include "xenia/base/assert.h"
 #include "xenia/base/byte_order.h"
 #include "xenia/base/cvar.h"
+#include "xenia/base/logging.h"
 #include "xenia/base/memory.h"
 #include "xenia/base/profiling.h"
 #include "xenia/base/reset_scope.h"
@@ -33,6 +37,28 @@ DEFINE_bool(disable_context_promotion, false,
             "some sports games, but will reduce performance.",
             "CPU");
 
+DEFINE_bool(disable_local_value_numbering, false,
+            "Disables elimination of common subexpressions within HIR blocks.",
+            "CPU");
+
+DEFINE_bool(disable_dead_store_elimination, false,
+            "Disables elimination of context stores overwritten in subsequent "
+            "blocks.",
+            "CPU");
+
+DEFINE_bool(combine_adjacent_memory_accesses, true,
+            "Merge pairs of adjacent stack or thread block loads/stores of the "
+            "same size (as done by lmw/stmw and consecutive lwz/stw) into "
+            "single accesses of twice the size.",
+            "CPU");
+
+DEFINE_bool(log_hir_instruction_counts, false,
+            "Log the total number of HIR instructions before and after "
+            "optimization, with and without local value numbering and dead "
+            "store elimination, for evaluating the compiler passes. Functions "
+            "are compiled twice for this.",
+            "CPU");
+
 namespace xe {
 namespace cpu {
 namespace ppc {
@@ -41,6 +67,11 @@ using xe::cpu::backend::Backend;
 using xe::cpu::compiler::Compiler;
 namespace passes = xe::cpu::compiler::passes;
 
+std::atomic<uint64_t> PPCTranslator::optimized_function_count_ = {0};
+std::atomic<uint64_t> PPCTranslator::raw_instruction_count_ = {0};
+std::atomic<uint64_t> PPCTranslator::reference_instruction_count_ = {0};
+std::atomic<uint64_t> PPCTranslator::optimized_instruction_count_ = {0};
+
 PPCTranslator::PPCTranslator(PPCFrontend* frontend) : frontend_(frontend) {
   Backend* backend = frontend->processor()->backend();
 
@@ -52,22 +83,64 @@ PPCTranslator::PPCTranslator(PPCFrontend* frontend) : frontend_(frontend) {
 
   bool validate = cvars::validate_hir;
 
+  AddOptimizingPasses(compiler_.get(), false);
+  // For log_hir_instruction_counts, the same pipeline without the passes that
+  // eliminate redundant computations and stores, to report what they remove.
+  if (cvars::log_hir_instruction_counts) {
+    reference_compiler_.reset(new Compiler(frontend->processor()));
+    AddOptimizingPasses(reference_compiler_.get(), true);
+  }
+
+  // The baseline tier only does what's required for emitting the code. The
+  // x64 sequences don't accept instructions with only constant operands, which
+  // constant propagation folds, so it's still needed along with the
+  // simplification that makes it converge.
+  baseline_compiler_.reset(new Compiler(frontend->processor()));
+  auto baseline_sap = std::make_unique<passes::ConditionalGroupPass>();
+  baseline_sap->AddPass(std::make_unique<passes::SimplificationPass>());
+  if (validate) {
+    baseline_sap->AddPass(std::make_unique<passes::ValidationPass>());
+  }
+  baseline_sap->AddPass(std::make_unique<passes::ConstantPropagationPass>());
+  if (validate) {
+    baseline_sap->AddPass(std::make_unique<passes::ValidationPass>());
+  }
+  baseline_compiler_->AddPass(std::move(baseline_sap));
+  baseline_compiler_->AddPass(
+      std::make_unique<passes::DeadCodeEliminationPass>());
+  if (validate) {
+    baseline_compiler_->AddPass(std::make_unique<passes::ValidationPass>());
+  }
+  baseline_compiler_->AddPass(std::make_unique<passes::RegisterAllocationPass>(
+      backend->machine_info()));
+  if (validate) {
+    baseline_compiler_->AddPass(std::make_unique<passes::ValidationPass>());
+  }
+  baseline_compiler_->AddPass(std::make_unique<passes::FinalizationPass>());
+}
+
+PPCTranslator::~PPCTranslator() = default;
+
+void PPCTranslator::AddOptimizingPasses(Compiler* compiler, bool reference) {
+  Backend* backend = frontend_->processor()->backend();
+  bool validate = cvars::validate_hir;
+
   // Merge blocks early. This will let us use more context in other passes.
   // The CFG is required for simplification and dirtied by it.
-  compiler_->AddPass(std::make_unique<passes::ControlFlowAnalysisPass>());
-  compiler_->AddPass(std::make_unique<passes::ControlFlowSimplificationPass>());
+  compiler->AddPass(std::make_unique<passes::ControlFlowAnalysisPass>());
+  compiler->AddPass(std::make_unique<passes::ControlFlowSimplificationPass>());
 
   // Passes are executed in the order they are added. Multiple of the same
   // pass type may be used.
   if (!cvars::disable_context_promotion) {
     if (validate) {
-      compiler_->AddPass(std::make_unique<passes::ValidationPass>());
+      compiler->AddPass(std::make_unique<passes::ValidationPass>());
     }
 
-    compiler_->AddPass(std::make_unique<passes::ContextPromotionPass>());
+    compiler->AddPass(std::make_unique<passes::ContextPromotionPass>());
 
     if (validate) {
-      compiler_->AddPass(std::make_unique<passes::ValidationPass>());
+      compiler->AddPass(std::make_unique<passes::ValidationPass>());
     }
   }
   // Grouped simplification + constant propagation.
@@ -77,42 +150,64 @@ PPCTranslator::PPCTranslator(PPCFrontend* frontend) : frontend_(frontend) {
   if (validate) sap->AddPass(std::make_unique<passes::ValidationPass>());
   sap->AddPass(std::make_unique<passes::ConstantPropagationPass>());
   if (validate) sap->AddPass(std::make_unique<passes::ValidationPass>());
-  compiler_->AddPass(std::move(sap));
+  if (!reference && !cvars::disable_local_value_numbering) {
+    sap->AddPass(std::make_unique<passes::LocalValueNumberingPass>());
+    if (validate) sap->AddPass(std::make_unique<passes::ValidationPass>());
+  }
+  compiler->AddPass(std::move(sap));
 
   if (backend->machine_info()->supports_extended_load_store) {
     // Backend supports the advanced LOAD/STORE instructions.
     // These will save us a lot of HIR opcodes.
-    compiler_->AddPass(
-        std::make_unique<passes::MemorySequenceCombinationPass>());
+    auto memory_sequence_combination_pass =
+        std::make_unique<passes::MemorySequenceCombinationPass>(
+            cvars::combine_adjacent_memory_accesses);
+    if (!reference) {
+      memory_sequence_combination_pass_ =
+          memory_sequence_combination_pass.get();
+    }
+    compiler->AddPass(std::move(memory_sequence_combination_pass));
     if (validate)
-      compiler_->AddPass(std::make_unique<passes::ValidationPass>());
+      compiler->AddPass(std::make_unique<passes::ValidationPass>());
+  }
+  compiler->AddPass(std::make_unique<passes::SimplificationPass>());
+  if (validate) compiler->AddPass(std::make_unique<passes::ValidationPass>());
+  if (!reference && !cvars::disable_context_promotion &&
+      !cvars::disable_dead_store_elimination) {
+    compiler->AddPass(std::make_unique<passes::DeadStoreEliminationPass>());
+    if (validate) {
+      compiler->AddPass(std::make_unique<passes::ValidationPass>());
+    }
+  }
+  compiler->AddPass(std::make_unique<passes::DeadCodeEliminationPass>());
+  if (validate) compiler->AddPass(std::make_unique<passes::ValidationPass>());
+
+  // Profile-guided layout when recompiling hot functions.
+  if (!reference) {
+    auto block_layout_pass = std::make_unique<passes::BlockLayoutPass>();
+    block_layout_pass_ = block_layout_pass.get();
+    compiler->AddPass(std::move(block_layout_pass));
+    if (validate) {
+      compiler->AddPass(std::make_unique<passes::ValidationPass>());
+    }
   }
-  compiler_->AddPass(std::make_unique<passes::SimplificationPass>());
-  if (validate) compiler_->AddPass(std::make_unique<passes::ValidationPass>());
-  // compiler_->AddPass(std::make_unique<passes::DeadStoreEliminationPass>());
-  // if (validate)
-  // compiler_->AddPass(std::make_unique<passes::ValidationPass>());
-  compiler_->AddPass(std::make_unique<passes::DeadCodeEliminationPass>());
-  if (validate) compiler_->AddPass(std::make_unique<passes::ValidationPass>());
 
   //// Removes all unneeded variables. Try not to add new ones after this.
-  // compiler_->AddPass(new passes::ValueReductionPass());
-  // if (validate) compiler_->AddPass(new passes::ValidationPass());
+  // compiler->AddPass(new passes::ValueReductionPass());
+  // if (validate) compiler->AddPass(new passes::ValidationPass());
 
   // Register allocation for the target backend.
   // Will modify the HIR to add loads/stores.
   // This should be the last pass before finalization, as after this all
   // registers are assigned and ready to be emitted.
-  compiler_->AddPass(std::make_unique<passes::RegisterAllocationPass>(
+  compiler->AddPass(std::make_unique<passes::RegisterAllocationPass>(
       backend->machine_info()));
-  if (validate) compiler_->AddPass(std::make_unique<passes::ValidationPass>());
+  if (validate) compiler->AddPass(std::make_unique<passes::ValidationPass>());
 
   // Must come last. The HIR is not really HIR after this.
-  compiler_->AddPass(std::make_unique<passes::FinalizationPass>());
+  compiler->AddPass(std::make_unique<passes::FinalizationPass>());
 }
 
-PPCTranslator::~PPCTranslator() = default;
-
 class HirBuilderScope {
   PPCHIRBuilder* builder_;
 
@@ -163,12 +258,13 @@ void PPCTranslator::DumpHIR(GuestFunction* function, PPCHIRBuilder* builder) {
   }
 }
 bool PPCTranslator::Translate(GuestFunction* function,
-                              uint32_t debug_info_flags) {
+                              uint32_t debug_info_flags, bool optimize_hot) {
   SCOPE_profile_cpu_f("cpu");
   HirBuilderScope hir_build_scope{builder_.get()};
   // Reset() all caching when we leave.
   xe::make_reset_scope(builder_);
   xe::make_reset_scope(compiler_);
+  xe::make_reset_scope(baseline_compiler_);
   xe::make_reset_scope(assembler_);
   xe::make_reset_scope(&string_buffer_);
 
@@ -191,8 +287,18 @@ bool PPCTranslator::Translate(GuestFunction* function,
   std::unique_ptr<FunctionDebugInfo> debug_info;
   if (debug_info_flags) {
     debug_info.reset(new FunctionDebugInfo());
+  } else if (!optimize_hot && assembler_->AssembleStored(function)) {
+    // Generated during a previous run, nothing else to do.
+    return true;
   }
 
+  // Profiling is only done once, functions defined again (or when debugging)
+  // are optimized right away.
+  bool baseline = cvars::tiered_compilation && !optimize_hot &&
+                  !debug_info_flags && !function->profile_data();
+  Compiler* compiler = baseline ? baseline_compiler_.get() : compiler_.get();
+  block_layout_pass_->set_function(optimize_hot ? function : nullptr);
+
   // Scan the function to find its extents and gather debug data.
   if (!scanner_->Scan(function, debug_info.get())) {
     return false;
@@ -231,6 +337,21 @@ bool PPCTranslator::Translate(GuestFunction* function,
   if (debug_info) {
     emit_flags |= PPCHIRBuilder::EMIT_DEBUG_COMMENTS;
   }
+  if (cvars::stitch_tail_calls && !baseline && !debug_info) {
+    emit_flags |= PPCHIRBuilder::EMIT_TRACES;
+  }
+  bool count_instructions = cvars::log_hir_instruction_counts && !baseline;
+  uint64_t reference_instruction_count = 0;
+  if (count_instructions) {
+    // The reference pipeline modifies the HIR, so it's emitted twice.
+    if (!builder_->Emit(function, emit_flags) ||
+        !reference_compiler_->Compile(builder_.get())) {
+      return false;
+    }
+    reference_instruction_count = CountInstructions(builder_.get());
+    builder_->Reset();
+    reference_compiler_->Reset();
+  }
   if (!builder_->Emit(function, emit_flags)) {
     return false;
   }
@@ -242,10 +363,26 @@ bool PPCTranslator::Translate(GuestFunction* function,
     string_buffer_.Reset();
   }
 
+  uint64_t raw_instruction_count =
+      count_instructions ? CountInstructions(builder_.get()) : 0;
+
   // Compile/optimize/etc.
-  if (!compiler_->Compile(builder_.get())) {
+  if (!compiler->Compile(builder_.get())) {
     return false;
   }
+  if (memory_sequence_combination_pass_ && !baseline) {
+    function->module()->add_combined_memory_sequences(
+        memory_sequence_combination_pass_->combined_sequence_count());
+  }
+  if (count_instructions) {
+    ++optimized_function_count_;
+    raw_instruction_count_ += raw_instruction_count;
+    reference_instruction_count_ += reference_instruction_count;
+    optimized_instruction_count_ += CountInstructions(builder_.get());
+  }
+  if (baseline) {
+    SetupProfileData(function);
+  }
 
   // Stash optimized HIR.
   if (debug_info_flags & DebugInfoFlags::kDebugInfoDisasmHir) {
@@ -261,9 +398,83 @@ bool PPCTranslator::Translate(GuestFunction* function,
                             std::move(debug_info))) {
     return false;
   }
+  if (!baseline) {
+    // Direct calls to the function can be emitted now that its code is final.
+    function->set_tier(GuestFunction::Tier::kOptimized);
+  }
 
   return true;
 }
+
+uint64_t PPCTranslator::CountInstructions(PPCHIRBuilder* builder) {
+  uint64_t count = 0;
+  auto block = builder->first_block();
+  while (block) {
+    auto instr = block->instr_head;
+    while (instr) {
+      if (!(instr->opcode->flags & hir::OPCODE_FLAG_IGNORE)) {
+        ++count;
+      }
+      instr = instr->next;
+    }
+    block = block->next;
+  }
+  return count;
+}
+
+void PPCTranslator::LogInstructionCounts() {
+  if (!cvars::log_hir_instruction_counts || !optimized_function_count_) {
+    return;
+  }
+  uint64_t raw_count = raw_instruction_count_;
+  uint64_t reference_count = reference_instruction_count_;
+  uint64_t optimized_count = optimized_instruction_count_;
+  auto percentage = [](uint64_t count, uint64_t total) {
+    return total ? double(count) * 100.0 / double(total) : 100.0;
+  };
+  XELOGI("HIR instruction counts for {} functions:",
+         optimized_function_count_.load());
+  XELOGI("  {:>12} before optimization", raw_count);
+  XELOGI("  {:>12} after, without local value numbering and dead store "
+         "elimination ({:.2f}%)",
+         reference_count, percentage(reference_count, raw_count));
+  XELOGI("  {:>12} after ({:.2f}%, {:.2f}% of the above)", optimized_count,
+         percentage(optimized_count, raw_count),
+         percentage(optimized_count, reference_count));
+}
+
+void PPCTranslator::LogModuleStatistics(const Module* module) {
+  if (!cvars::log_hir_instruction_counts) {
+    return;
+  }
+  XELOGI("{}: {} adjacent memory access pairs combined", module->name(),
+         module->combined_memory_sequence_count());
+}
+
+void PPCTranslator::SetupProfileData(GuestFunction* function) {
+  auto profile_data = std::make_unique<FunctionProfileData>();
+  profile_data->entry_countdown =
+      int32_t(std::max(cvars::tiered_compilation_threshold, uint32_t(1)));
+  // Blocks are numbered sequentially by the finalization pass.
+  auto block = builder_->first_block();
+  while (block) {
+    uint32_t address = 0;
+    auto instr = block->instr_head;
+    while (instr) {
+      if (instr->opcode == &hir::OPCODE_SOURCE_OFFSET_info) {
+        address = static_cast<uint32_t>(instr->src1.offset);
+        break;
+      }
+      instr = instr->next;
+    }
+    profile_data->block_addresses.push_back(address);
+    block = block->next;
+  }
+  profile_data->block_counts =
+      std::make_unique<uint32_t[]>(profile_data->block_addresses.size());
+  function->set_profile_data(std::move(profile_data));
+  function->set_tier(GuestFunction::Tier::kBaseline);
+}
 void PPCTranslator::Reset() { builder_->ResetPools(); }
 void PPCTranslator::DumpSource(GuestFunction* function,
                                StringBuffer* string_buffer) {
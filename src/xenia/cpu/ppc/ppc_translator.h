@@ -10,6 +10,7 @@
 #ifndef XENIA_CPU_PPC_PPC_TRANSLATOR_H_
 #define XENIA_CPU_PPC_PPC_TRANSLATOR_H_
 
+#include <atomic>
 #include <memory>
 
 #include "xenia/base/string_buffer.h"
@@ -19,6 +20,12 @@
 
 namespace xe {
 namespace cpu {
+namespace compiler {
+namespace passes {
+class BlockLayoutPass;
+class MemorySequenceCombinationPass;
+}  // namespace passes
+}  // namespace compiler
 namespace ppc {
 
 class PPCFrontend;
@@ -30,20 +37,53 @@ class PPCTranslator {
   explicit PPCTranslator(PPCFrontend* frontend);
   ~PPCTranslator();
 
-  bool Translate(GuestFunction* function, uint32_t debug_info_flags);
+  // With tiered compilation enabled, the function is compiled with the
+  // baseline tier first if possible, optimize_hot recompiles a function that
+  // has been profiled with all the optimizations.
+  bool Translate(GuestFunction* function, uint32_t debug_info_flags,
+                 bool optimize_hot = false);
   void DumpHIR(GuestFunction* function, PPCHIRBuilder* builder);
   void Reset();
 
+  // Logs the HIR instruction counts gathered with log_hir_instruction_counts
+  // for all the functions compiled with the optimizing pipeline - before
+  // optimization, after it without local value numbering and dead store
+  // elimination, and after the full pipeline.
+  static void LogInstructionCounts();
+  // Logs the per-module statistics of the compiler passes with
+  // log_hir_instruction_counts.
+  static void LogModuleStatistics(const Module* module);
+
  private:
   void DumpSource(GuestFunction* function, StringBuffer* string_buffer);
+  void SetupProfileData(GuestFunction* function);
+  // The reference pipeline for log_hir_instruction_counts has no local value
+  // numbering, dead store elimination and profile-guided block layout, and
+  // its passes aren't referenced by the translator.
+  void AddOptimizingPasses(compiler::Compiler* compiler, bool reference);
+  static uint64_t CountInstructions(PPCHIRBuilder* builder);
 
   PPCFrontend* frontend_;
   std::unique_ptr<PPCScanner> scanner_;
   std::unique_ptr<PPCHIRBuilder> builder_;
   std::unique_ptr<compiler::Compiler> compiler_;
+  // Owned by compiler_.
+  compiler::passes::BlockLayoutPass* block_layout_pass_ = nullptr;
+  compiler::passes::MemorySequenceCombinationPass*
+      memory_sequence_combination_pass_ = nullptr;
+  // Minimal passes for the baseline tier of tiered compilation.
+  std::unique_ptr<compiler::Compiler> baseline_compiler_;
+  // The optimizing pipeline without local value numbering and dead store
+  // elimination, only with log_hir_instruction_counts.
+  std::unique_ptr<compiler::Compiler> reference_compiler_;
   std::unique_ptr<backend::Assembler> assembler_;
 
   StringBuffer string_buffer_;
+
+  static std::atomic<uint64_t> optimized_function_count_;
+  static std::atomic<uint64_t> raw_instruction_count_;
+  static std::atomic<uint64_t> reference_instruction_count_;
+  static std::atomic<uint64_t> optimized_instruction_count_;
 };
 
 }  // namespace ppc
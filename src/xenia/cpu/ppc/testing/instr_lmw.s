@@ -0,0 +1,49 @@
+test_lmw_1:
+  #_ REGISTER_IN r28 0x11223344
+  #_ REGISTER_IN r29 0x55667788
+  #_ REGISTER_IN r30 0x99AABBCC
+  #_ REGISTER_IN r31 0xDDEEFF00
+  stmw r28, -16(r1)
+  lhz r3, -16(r1)
+  lwz r4, -12(r1)
+  ld r5, -8(r1)
+  li r28, 0
+  li r29, 0
+  li r30, 0
+  li r31, 0
+  lmw r28, -16(r1)
+  blr
+  #_ REGISTER_OUT r3 0x1122
+  #_ REGISTER_OUT r4 0x55667788
+  #_ REGISTER_OUT r5 0x99AABBCCDDEEFF00
+  #_ REGISTER_OUT r28 0x11223344
+  #_ REGISTER_OUT r29 0x55667788
+  #_ REGISTER_OUT r30 0x99AABBCC
+  #_ REGISTER_OUT r31 0xDDEEFF00
+
+test_lmw_1_constant:
+  lis r28, 0x1122
+  ori r28, r28, 0x3344
+  lis r29, 0x5566
+  ori r29, r29, 0x7788
+  lis r30, 0x99AA
+  ori r30, r30, 0xBBCC
+  lis r31, 0xDDEE
+  ori r31, r31, 0xFF00
+  stmw r28, -16(r1)
+  lhz r3, -16(r1)
+  lwz r4, -12(r1)
+  ld r5, -8(r1)
+  li r28, 0
+  li r29, 0
+  li r30, 0
+  li r31, 0
+  lmw r28, -16(r1)
+  blr
+  #_ REGISTER_OUT r3 0x1122
+  #_ REGISTER_OUT r4 0x55667788
+  #_ REGISTER_OUT r5 0x99AABBCCDDEEFF00
+  #_ REGISTER_OUT r28 0x11223344
+  #_ REGISTER_OUT r29 0x55667788
+  #_ REGISTER_OUT r30 0x99AABBCC
+  #_ REGISTER_OUT r31 0xDDEEFF00
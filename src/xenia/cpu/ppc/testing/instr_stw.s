@@ -0,0 +1,61 @@
+test_stw_adjacent_1:
+  #_ REGISTER_IN r4 0x01020304
+  #_ REGISTER_IN r5 0x05060708
+  stw r4, -8(r1)
+  stw r5, -4(r1)
+  lwz r6, -4(r1)
+  lwz r7, -8(r1)
+  ld r3, -8(r1)
+  blr
+  #_ REGISTER_OUT r3 0x0102030405060708
+  #_ REGISTER_OUT r4 0x01020304
+  #_ REGISTER_OUT r5 0x05060708
+  #_ REGISTER_OUT r6 0x05060708
+  #_ REGISTER_OUT r7 0x01020304
+
+test_stw_adjacent_1_constant:
+  lis r4, 0x0102
+  ori r4, r4, 0x0304
+  lis r5, 0x0506
+  ori r5, r5, 0x0708
+  stw r4, -8(r1)
+  stw r5, -4(r1)
+  lwz r6, -4(r1)
+  lwz r7, -8(r1)
+  ld r3, -8(r1)
+  blr
+  #_ REGISTER_OUT r3 0x0102030405060708
+  #_ REGISTER_OUT r4 0x01020304
+  #_ REGISTER_OUT r5 0x05060708
+  #_ REGISTER_OUT r6 0x05060708
+  #_ REGISTER_OUT r7 0x01020304
+
+test_stw_adjacent_2:
+  #_ REGISTER_IN r4 0x1234
+  #_ REGISTER_IN r5 0xABCD
+  sth r5, -2(r1)
+  sth r4, -4(r1)
+  lhz r6, -4(r1)
+  lhz r7, -2(r1)
+  lwz r3, -4(r1)
+  blr
+  #_ REGISTER_OUT r3 0x1234ABCD
+  #_ REGISTER_OUT r4 0x1234
+  #_ REGISTER_OUT r5 0xABCD
+  #_ REGISTER_OUT r6 0x1234
+  #_ REGISTER_OUT r7 0xABCD
+
+test_stw_adjacent_3:
+  #_ REGISTER_IN r4 0x12
+  #_ REGISTER_IN r5 0x34
+  stb r4, -2(r1)
+  stb r5, -1(r1)
+  lbz r6, -2(r1)
+  lbz r7, -1(r1)
+  lhz r3, -2(r1)
+  blr
+  #_ REGISTER_OUT r3 0x1234
+  #_ REGISTER_OUT r4 0x12
+  #_ REGISTER_OUT r5 0x34
+  #_ REGISTER_OUT r6 0x12
+  #_ REGISTER_OUT r7 0x34
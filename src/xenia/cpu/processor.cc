@@ -28,6 +28,7 @@
 #include "xenia/cpu/module.h"
 #include "xenia/cpu/ppc/ppc_decode_data.h"
 #include "xenia/cpu/ppc/ppc_frontend.h"
+#include "xenia/cpu/ppc/ppc_translator.h"
 #include "xenia/cpu/stack_walker.h"
 #include "xenia/cpu/thread.h"
 #include "xenia/cpu/thread_state.h"
@@ -86,14 +87,24 @@ Processor::Processor(xe::Memory* memory, ExportResolver* export_resolver)
     : memory_(memory), export_resolver_(export_resolver) {}
 
 Processor::~Processor() {
+  // Must not access the functions while they're being deleted.
+  function_optimizer_.reset();
+
   {
     auto global_lock = global_critical_region_.Acquire();
+    for (auto& module : modules_) {
+      ppc::PPCTranslator::LogModuleStatistics(module.get());
+    }
     modules_.clear();
   }
 
   frontend_.reset();
   backend_.reset();
 
+  // Totals of all the processors created so far, the last one in the ppc
+  // tests reports all the suites.
+  ppc::PPCTranslator::LogInstructionCounts();
+
   if (functions_trace_file_) {
     functions_trace_file_->Flush();
     functions_trace_file_.reset();
@@ -131,6 +142,11 @@ bool Processor::Setup(std::unique_ptr<backend::Backend> backend) {
   backend_ = std::move(backend);
   frontend_ = std::move(frontend);
 
+  if (cvars::tiered_compilation) {
+    function_optimizer_ = std::make_unique<FunctionOptimizer>(this);
+    function_optimizer_->Start();
+  }
+
   // Stack walker is used when profiling, debugging, and dumping.
   // Note that creation may fail, in which case we'll have to disable those
   // features.
@@ -238,7 +254,7 @@ Function* Processor::QueryFunction(uint32_t address) {
   if (!entry) {
     return nullptr;
   }
-  return entry->function;
+  return entry->function.load(std::memory_order_acquire);
 }
 
 std::vector<Function*> Processor::FindFunctionsWithAddress(uint32_t address) {
@@ -259,12 +275,12 @@ Function* Processor::ResolveFunction(uint32_t address) {
     auto function = LookupFunction(address);
 
     if (!function) {
-      entry->status = Entry::STATUS_FAILED;
+      entry->status.store(Entry::STATUS_FAILED, std::memory_order_release);
       return nullptr;
     }
 
     if (!DemandFunction(function)) {
-      entry->status = Entry::STATUS_FAILED;
+      entry->status.store(Entry::STATUS_FAILED, std::memory_order_release);
       return nullptr;
     }
     // only add it to the list of resolved functions if resolving succeeded
@@ -278,18 +294,40 @@ Function* Processor::ResolveFunction(uint32_t address) {
       }
     }
 
-    entry->function = function;
+    entry->function.store(function, std::memory_order_relaxed);
     entry->end_address = function->end_address();
-    status = entry->status = Entry::STATUS_READY;
+    // Publish the entry to the threads waiting for it or looking it up.
+    status = Entry::STATUS_READY;
+    entry->status.store(status, std::memory_order_release);
   }
   if (status == Entry::STATUS_READY) {
     // Ready to use.
-    return entry->function;
+    return entry->function.load(std::memory_order_acquire);
   } else {
     // Failed or bad state.
     return nullptr;
   }
 }
+bool Processor::OptimizeFunction(GuestFunction* function) {
+  Module* module = function->module();
+  std::unique_ptr<Function> new_function =
+      module->CreateReplacementFunction(function->address());
+  assert_true(new_function->is_guest());
+  auto optimized_function = static_cast<GuestFunction*>(new_function.get());
+  optimized_function->set_name(function->name());
+  optimized_function->set_profile_data(function->shared_profile_data());
+  // Once assembled, the new code is already reachable through the indirection
+  // table, so it must be complete by then.
+  if (!frontend_->OptimizeFunction(optimized_function)) {
+    return false;
+  }
+  OnFunctionDefined(optimized_function);
+  optimized_function->set_status(Symbol::Status::kDefined);
+  module->ReplaceFunction(function, std::move(new_function));
+  entry_table_.Replace(function->address(), optimized_function);
+  return true;
+}
+
 Module* Processor::LookupModule(uint32_t address) {
   auto global_lock = global_critical_region_.Acquire();
   // TODO(benvanik): sort by code address (if contiguous) so can bsearch.
@@ -23,6 +23,7 @@
 #include "xenia/cpu/entry_table.h"
 #include "xenia/cpu/export_resolver.h"
 #include "xenia/cpu/function.h"
+#include "xenia/cpu/function_optimizer.h"
 #include "xenia/cpu/module.h"
 #include "xenia/cpu/ppc/ppc_frontend.h"
 #include "xenia/cpu/thread_debug_info.h"
@@ -118,6 +119,17 @@ class Processor {
   Module* LookupModule(uint32_t address);
   Function* LookupFunction(Module* module, uint32_t address);
   Function* ResolveFunction(uint32_t address);
+  // Queues a hot function compiled by the baseline tier of tiered compilation
+  // for recompilation with all the optimizations.
+  void OptimizeFunctionAsync(GuestFunction* function) {
+    if (function_optimizer_) {
+      function_optimizer_->Enqueue(function);
+    }
+  }
+  // Recompiles a function compiled by the baseline tier into a new function
+  // object and makes it the one used for the address. The baseline function
+  // is left untouched for the threads still running its code.
+  bool OptimizeFunction(GuestFunction* function);
 
   bool Execute(ThreadState* thread_state, uint32_t address);
   bool ExecuteRaw(ThreadState* thread_state, uint32_t address);
@@ -263,6 +275,7 @@ class Processor {
 
   std::unique_ptr<ppc::PPCFrontend> frontend_;
   std::unique_ptr<backend::Backend> backend_;
+  std::unique_ptr<FunctionOptimizer> function_optimizer_;
   ExportResolver* export_resolver_ = nullptr;
 
   EntryTable entry_table_;
@@ -0,0 +1,181 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "xenia/cpu/entry_table.h"
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe {
+namespace cpu {
+namespace test {
+
+// The table never dereferences the functions.
+static Function* FakeFunction(uint32_t address) {
+  return reinterpret_cast<Function*>(uintptr_t(address) | 1);
+}
+
+static void Publish(Entry* entry, uint32_t end_address) {
+  entry->function = FakeFunction(entry->address);
+  entry->end_address = end_address;
+  entry->status.store(Entry::STATUS_READY, std::memory_order_release);
+}
+
+TEST_CASE("EntryTable GetOrCreate and Get", "[entry_table]") {
+  EntryTable table;
+  REQUIRE(table.Get(0x82000000) == nullptr);
+
+  Entry* entry;
+  REQUIRE(table.GetOrCreate(0x82000000, &entry) == Entry::STATUS_NEW);
+  REQUIRE(entry->address == 0x82000000);
+  // Pending entries are not visible to Get.
+  REQUIRE(table.Get(0x82000000) == nullptr);
+  Publish(entry, 0x82000010);
+
+  REQUIRE(table.Get(0x82000000) == entry);
+  REQUIRE(table.Get(0x82000004) == nullptr);
+  Entry* existing_entry;
+  REQUIRE(table.GetOrCreate(0x82000000, &existing_entry) ==
+          Entry::STATUS_READY);
+  REQUIRE(existing_entry == entry);
+
+  // Unaligned addresses must not alias aligned ones.
+  REQUIRE(table.Get(0x82000001) == nullptr);
+  REQUIRE(table.GetOrCreate(0x82000002, &existing_entry) ==
+          Entry::STATUS_FAILED);
+
+  // Same slot index in different pages.
+  Entry* other_page_entry;
+  REQUIRE(table.GetOrCreate(0x82010000, &other_page_entry) ==
+          Entry::STATUS_NEW);
+  REQUIRE(other_page_entry != entry);
+  Publish(other_page_entry, 0x82010000);
+  REQUIRE(table.Get(0x82000000) == entry);
+  REQUIRE(table.Get(0x82010000) == other_page_entry);
+}
+
+TEST_CASE("EntryTable Delete and FindWithAddress", "[entry_table]") {
+  EntryTable table;
+  Entry* entry;
+  REQUIRE(table.GetOrCreate(0x82000100, &entry) == Entry::STATUS_NEW);
+  Publish(entry, 0x82000200);
+
+  auto functions = table.FindWithAddress(0x82000180);
+  REQUIRE(functions.size() == 1);
+  REQUIRE(functions[0] == FakeFunction(0x82000100));
+  REQUIRE(table.FindWithAddress(0x82000204).empty());
+
+  table.Delete(0x82000100);
+  REQUIRE(table.Get(0x82000100) == nullptr);
+  REQUIRE(table.FindWithAddress(0x82000180).empty());
+  // The deleted entry remains accessible to its previous users.
+  REQUIRE(entry->address == 0x82000100);
+
+  Entry* new_entry;
+  REQUIRE(table.GetOrCreate(0x82000100, &new_entry) == Entry::STATUS_NEW);
+  REQUIRE(new_entry != entry);
+}
+
+TEST_CASE("EntryTable concurrent creation", "[entry_table]") {
+  // Every address must be created exactly once, with the other threads waiting
+  // for the pending entry to be published.
+  constexpr uint32_t kThreadCount = 6;
+  constexpr uint32_t kAddressCount = 4096;
+  constexpr uint32_t kBaseAddress = 0x82000000;
+  EntryTable table;
+  std::atomic<uint32_t> created_count = {0};
+  std::atomic<uint32_t> mismatch_count = {0};
+  std::vector<std::thread> threads;
+  for (uint32_t i = 0; i < kThreadCount; ++i) {
+    threads.emplace_back([&, i]() {
+      for (uint32_t j = 0; j < kAddressCount; ++j) {
+        // Different order on each thread for more contention.
+        uint32_t address =
+            kBaseAddress + ((j * (i * 2 + 1)) % kAddressCount) * 4;
+        Entry* entry;
+        Entry::Status status = table.GetOrCreate(address, &entry);
+        if (status == Entry::STATUS_NEW) {
+          ++created_count;
+          Publish(entry, address);
+        } else if (status != Entry::STATUS_READY ||
+                   entry->function != FakeFunction(address)) {
+          ++mismatch_count;
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  REQUIRE(created_count == kAddressCount);
+  REQUIRE(mismatch_count == 0);
+}
+
+TEST_CASE("EntryTable contended lookup benchmark",
+          "[entry_table][.][benchmark]") {
+  // Lookups of ready entries from 6 threads, as done by ResolveFunction for
+  // indirect calls on many guest threads.
+  constexpr uint32_t kThreadCount = 6;
+  constexpr uint32_t kAddressCount = 65536;
+  constexpr uint32_t kLookupsPerThread = 1 << 22;
+  constexpr uint32_t kBaseAddress = 0x82000000;
+  EntryTable table;
+  for (uint32_t i = 0; i < kAddressCount; ++i) {
+    Entry* entry;
+    REQUIRE(table.GetOrCreate(kBaseAddress + i * 4, &entry) ==
+            Entry::STATUS_NEW);
+    Publish(entry, entry->address);
+  }
+
+  std::atomic<uint32_t> ready_thread_count = {0};
+  std::atomic<uint32_t> miss_count = {0};
+  std::vector<std::thread> threads;
+  auto start_time = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < kThreadCount; ++i) {
+    threads.emplace_back([&, i]() {
+      ++ready_thread_count;
+      while (ready_thread_count < kThreadCount) {
+        std::this_thread::yield();
+      }
+      uint32_t misses = 0;
+      uint32_t index = i * 7919;
+      for (uint32_t j = 0; j < kLookupsPerThread; ++j) {
+        index = (index * 1103515245 + 12345) & (kAddressCount - 1);
+        Entry* entry;
+        if (table.GetOrCreate(kBaseAddress + index * 4, &entry) !=
+            Entry::STATUS_READY) {
+          ++misses;
+        }
+      }
+      miss_count += misses;
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - start_time);
+  REQUIRE(miss_count == 0);
+  double lookups_per_second =
+      double(uint64_t(kLookupsPerThread) * kThreadCount) /
+      std::max(double(elapsed.count()), 1.0) * 1000000.0;
+  WARN("EntryTable: " << kThreadCount << " threads, "
+                      << uint64_t(kLookupsPerThread) * kThreadCount
+                      << " lookups in " << elapsed.count() << " us ("
+                      << lookups_per_second / 1000000.0 << " M/s)");
+}
+
+}  // namespace test
+}  // namespace cpu
+}  // namespace xe
@@ -0,0 +1,79 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <chrono>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "xenia/base/byte_stream.h"
+#include "xenia/memory.h"
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe {
+namespace cpu {
+namespace test {
+
+TEST_CASE("Memory save state benchmark", "[memory][.][benchmark]") {
+  // A synthetic title heap - a quarter of the pages are zero, the rest
+  // contain compressible data, and one in 16 pages is modified between the
+  // full and the incremental snapshot.
+  constexpr uint32_t kHeapDataSize = 256 * 1024 * 1024;
+  constexpr uint32_t kPageSize = 4096;
+  constexpr uint32_t kModifiedPageInterval = 16;
+
+  Memory memory;
+  REQUIRE(memory.Initialize());
+  uint32_t address;
+  REQUIRE(memory.LookupHeap(0x40000000)
+              ->Alloc(kHeapDataSize, 0,
+                      kMemoryAllocationReserve | kMemoryAllocationCommit,
+                      kMemoryProtectRead | kMemoryProtectWrite, false,
+                      &address));
+  auto data = memory.TranslateVirtual<uint8_t*>(address);
+  std::mt19937 random(1);
+  for (uint32_t page = 0; page < kHeapDataSize / kPageSize; ++page) {
+    uint8_t* page_data = data + page * kPageSize;
+    if (page % 4 == 3) {
+      std::memset(page_data, 0, kPageSize);
+      continue;
+    }
+    for (uint32_t i = 0; i < kPageSize; ++i) {
+      page_data[i] = uint8_t(random() % 16);
+    }
+  }
+
+  // Enough for the data stored uncompressed, and the page tables.
+  std::vector<uint8_t> buffer(size_t(kHeapDataSize) * 2);
+  auto save = [&](bool incremental, const char* name) {
+    ByteStream stream(buffer.data(), buffer.size());
+    auto start_time = std::chrono::steady_clock::now();
+    REQUIRE(memory.Save(&stream, incremental));
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start_time);
+    WARN(name << " memory snapshot: " << stream.offset() << " bytes in "
+              << elapsed.count() / 1000 << " ms");
+    return stream.offset();
+  };
+
+  size_t full_size = save(false, "Full");
+  for (uint32_t page = 0; page < kHeapDataSize / kPageSize;
+       page += kModifiedPageInterval) {
+    data[page * kPageSize] ^= 1;
+  }
+  size_t incremental_size = save(true, "Incremental");
+  REQUIRE(incremental_size < full_size);
+
+  memory.LookupHeap(0x40000000)->Release(address);
+}
+
+}  // namespace test
+}  // namespace cpu
+}  // namespace xe
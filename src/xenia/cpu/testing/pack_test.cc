@@ -111,3 +111,132 @@ TEST_CASE("PACK_SHORT_2", "[instr]") {
         REQUIRE(result == vec128i(0, 0, 0, 0x80018001));
       });
 }
+
+TEST_CASE("PACK_8_IN_16_UN_UN", "[instr]") {
+  ForEachHostExtensionSet([]() {
+    TestFunction test([](HIRBuilder& b) {
+      StoreVR(b, 3,
+              b.Pack(LoadVR(b, 4), LoadVR(b, 5),
+                     PACK_TYPE_8_IN_16 | PACK_TYPE_IN_UNSIGNED |
+                         PACK_TYPE_OUT_UNSIGNED | PACK_TYPE_OUT_UNSATURATE));
+      b.Return();
+    });
+    test.Run(
+        [](PPCContext* ctx) {
+          ctx->v[4] = vec128s(0x1100, 0x1101, 0x1102, 0x1103, 0x1104, 0x1105,
+                              0x1106, 0x1107);
+          ctx->v[5] = vec128s(0x2208, 0x2209, 0x220A, 0x220B, 0x220C, 0x220D,
+                              0x220E, 0x220F);
+        },
+        [](PPCContext* ctx) {
+          auto result = ctx->v[3];
+          REQUIRE(result == vec128b(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12,
+                                    13, 14, 15));
+        });
+  });
+}
+
+TEST_CASE("PACK_8_IN_16_UN_UN_SAT", "[instr]") {
+  ForEachHostExtensionSet([]() {
+    TestFunction test([](HIRBuilder& b) {
+      StoreVR(b, 3,
+              b.Pack(LoadVR(b, 4), LoadVR(b, 5),
+                     PACK_TYPE_8_IN_16 | PACK_TYPE_IN_UNSIGNED |
+                         PACK_TYPE_OUT_UNSIGNED | PACK_TYPE_OUT_SATURATE));
+      b.Return();
+    });
+    test.Run(
+        [](PPCContext* ctx) {
+          ctx->v[4] = vec128s(0x0000, 0x0001, 0x00FE, 0x00FF, 0x0100, 0x7FFF,
+                              0x8000, 0xFFFF);
+          ctx->v[5] = vec128s(0x0010, 0x0020, 0x0030, 0x0040, 0x0050, 0x0060,
+                              0x0070, 0x0080);
+        },
+        [](PPCContext* ctx) {
+          auto result = ctx->v[3];
+          REQUIRE(result == vec128b(0x00, 0x01, 0xFE, 0xFF, 0xFF, 0xFF, 0xFF,
+                                    0xFF, 0x10, 0x20, 0x30, 0x40, 0x50, 0x60,
+                                    0x70, 0x80));
+        });
+  });
+}
+
+TEST_CASE("PACK_16_IN_32_UN_UN", "[instr]") {
+  ForEachHostExtensionSet([]() {
+    TestFunction test([](HIRBuilder& b) {
+      StoreVR(b, 3,
+              b.Pack(LoadVR(b, 4), LoadVR(b, 5),
+                     PACK_TYPE_16_IN_32 | PACK_TYPE_IN_UNSIGNED |
+                         PACK_TYPE_OUT_UNSIGNED | PACK_TYPE_OUT_UNSATURATE));
+      b.Return();
+    });
+    test.Run(
+        [](PPCContext* ctx) {
+          ctx->v[4] = vec128i(0x11110000, 0x11110001, 0x11110002, 0x11110003);
+          ctx->v[5] = vec128i(0x22220004, 0x22220005, 0x22220006, 0x22220007);
+        },
+        [](PPCContext* ctx) {
+          auto result = ctx->v[3];
+          REQUIRE(result == vec128s(0, 1, 2, 3, 4, 5, 6, 7));
+        });
+  });
+}
+
+TEST_CASE("PACK_16_IN_32_UN_UN_SAT", "[instr]") {
+  ForEachHostExtensionSet([]() {
+    TestFunction test([](HIRBuilder& b) {
+      StoreVR(b, 3,
+              b.Pack(LoadVR(b, 4), LoadVR(b, 5),
+                     PACK_TYPE_16_IN_32 | PACK_TYPE_IN_UNSIGNED |
+                         PACK_TYPE_OUT_UNSIGNED | PACK_TYPE_OUT_SATURATE));
+      b.Return();
+    });
+    test.Run(
+        [](PPCContext* ctx) {
+          ctx->v[4] = vec128i(0x00000000, 0x0000FFFF, 0x00010000, 0xFFFFFFFF);
+          ctx->v[5] = vec128i(0x00000001, 0x00000002, 0x00008000, 0x7FFFFFFF);
+        },
+        [](PPCContext* ctx) {
+          auto result = ctx->v[3];
+          REQUIRE(result ==
+                  vec128s(0, 0xFFFF, 0xFFFF, 0xFFFF, 1, 2, 0x8000, 0xFFFF));
+        });
+  });
+}
+
+TEST_CASE("PACK benchmark", "[instr][.][benchmark]") {
+  const struct {
+    const char* name;
+    uint32_t flags;
+    bool two_sources;
+  } ops[] = {
+      {"PACK_D3DCOLOR", PACK_TYPE_D3DCOLOR, false},
+      {"PACK_FLOAT16_2", PACK_TYPE_FLOAT16_2, false},
+      {"PACK_FLOAT16_4", PACK_TYPE_FLOAT16_4, false},
+      {"PACK_SHORT_2", PACK_TYPE_SHORT_2, false},
+      {"PACK_8_IN_16_UN_UN",
+       PACK_TYPE_8_IN_16 | PACK_TYPE_IN_UNSIGNED | PACK_TYPE_OUT_UNSIGNED |
+           PACK_TYPE_OUT_UNSATURATE,
+       true},
+      {"PACK_8_IN_16_UN_UN_SAT",
+       PACK_TYPE_8_IN_16 | PACK_TYPE_IN_UNSIGNED | PACK_TYPE_OUT_UNSIGNED |
+           PACK_TYPE_OUT_SATURATE,
+       true},
+      {"PACK_16_IN_32_UN_UN",
+       PACK_TYPE_16_IN_32 | PACK_TYPE_IN_UNSIGNED | PACK_TYPE_OUT_UNSIGNED |
+           PACK_TYPE_OUT_UNSATURATE,
+       true},
+      {"PACK_16_IN_32_UN_UN_SAT",
+       PACK_TYPE_16_IN_32 | PACK_TYPE_IN_UNSIGNED | PACK_TYPE_OUT_UNSIGNED |
+           PACK_TYPE_OUT_SATURATE,
+       true},
+  };
+  for (const auto& op : ops) {
+    BenchmarkForEachHostExtensionSet(
+        op.name, vec128i(0x449A4000, 0x45B17000, 0x41103261, 0x40922B6B),
+        [&op](HIRBuilder& b, Value* value) {
+          return op.two_sources ? b.Pack(value, value, op.flags)
+                                : b.Pack(value, op.flags);
+        });
+  }
+}
@@ -63,6 +63,13 @@ TEST_CASE("UNPACK_FLOAT16_2", "[instr]") {
              REQUIRE(result ==
                      vec128i(0x42AAA000, 0x44CCC000, 0x00000000, 0x3F800000));
            });
+  // Negative zero and denormals (flushed to zero) keep their sign.
+  test.Run([](PPCContext* ctx) { ctx->v[4] = vec128i(0, 0, 0, 0x800083FF); },
+           [](PPCContext* ctx) {
+             auto result = ctx->v[3];
+             REQUIRE(result ==
+                     vec128i(0x80000000, 0x80000000, 0x00000000, 0x3F800000));
+           });
 }
 
 TEST_CASE("UNPACK_FLOAT16_4", "[instr]") {
@@ -117,50 +124,136 @@ TEST_CASE("UNPACK_SHORT_2", "[instr]") {
       });
 }
 
-// TEST_CASE("UNPACK_S8_IN_16_LO", "[instr]") {
-//  TestFunction test([](HIRBuilder& b) {
-//    StoreVR(b, 3, b.Unpack(LoadVR(b, 4), PACK_TYPE_S8_IN_16_LO));
-//    b.Return();
-//  });
-//  test.Run([](PPCContext* ctx) { ctx->v[4] = vec128b(0); },
-//           [](PPCContext* ctx) {
-//             auto result = ctx->v[3];
-//             REQUIRE(result == vec128b(0));
-//           });
-//}
-//
-// TEST_CASE("UNPACK_S8_IN_16_HI", "[instr]") {
-//  TestFunction test([](HIRBuilder& b) {
-//    StoreVR(b, 3, b.Unpack(LoadVR(b, 4), PACK_TYPE_S8_IN_16_HI));
-//    b.Return();
-//  });
-//  test.Run([](PPCContext* ctx) { ctx->v[4] = vec128b(0); },
-//           [](PPCContext* ctx) {
-//             auto result = ctx->v[3];
-//             REQUIRE(result == vec128b(0));
-//           });
-//}
-//
-// TEST_CASE("UNPACK_S16_IN_32_LO", "[instr]") {
-//  TestFunction test([](HIRBuilder& b) {
-//    StoreVR(b, 3, b.Unpack(LoadVR(b, 4), PACK_TYPE_S16_IN_32_LO));
-//    b.Return();
-//  });
-//  test.Run([](PPCContext* ctx) { ctx->v[4] = vec128b(0); },
-//           [](PPCContext* ctx) {
-//             auto result = ctx->v[3];
-//             REQUIRE(result == vec128b(0));
-//           });
-//}
-//
-// TEST_CASE("UNPACK_S16_IN_32_HI", "[instr]") {
-//  TestFunction test([](HIRBuilder& b) {
-//    StoreVR(b, 3, b.Unpack(LoadVR(b, 4), PACK_TYPE_S16_IN_32_HI));
-//    b.Return();
-//  });
-//  test.Run([](PPCContext* ctx) { ctx->v[4] = vec128b(0); },
-//           [](PPCContext* ctx) {
-//             auto result = ctx->v[3];
-//             REQUIRE(result == vec128b(0));
-//           });
-//}
+TEST_CASE("UNPACK_SHORT_2_OVERFLOW", "[instr]") {
+  ForEachHostExtensionSet([]() {
+    TestFunction test([](HIRBuilder& b) {
+      StoreVR(b, 3, b.Unpack(LoadVR(b, 4), PACK_TYPE_SHORT_2));
+      b.Return();
+    });
+    // The most negative value is reserved and unpacks to a quiet NaN.
+    test.Run(
+        [](PPCContext* ctx) {
+          ctx->v[4] = vec128i(0, 0, 0, (0x8000u << 16) | 0x1234u);
+        },
+        [](PPCContext* ctx) {
+          auto result = ctx->v[3];
+          REQUIRE(result ==
+                  vec128i(0x7FC00000, 0x40401234, 0x00000000, 0x3F800000));
+        });
+  });
+}
+
+TEST_CASE("UNPACK_S8_IN_16_LO", "[instr]") {
+  ForEachHostExtensionSet([]() {
+    TestFunction test([](HIRBuilder& b) {
+      StoreVR(b, 3,
+              b.Unpack(LoadVR(b, 4), PACK_TYPE_8_IN_16 | PACK_TYPE_TO_LO |
+                                         PACK_TYPE_IN_SIGNED |
+                                         PACK_TYPE_OUT_SIGNED));
+      b.Return();
+    });
+    test.Run(
+        [](PPCContext* ctx) {
+          ctx->v[4] = vec128b(0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88,
+                              0x00, 0x01, 0x7F, 0x80, 0xFF, 0x81, 0x10, 0xF0);
+        },
+        [](PPCContext* ctx) {
+          auto result = ctx->v[3];
+          REQUIRE(result == vec128s(0x0000, 0x0001, 0x007F, 0xFF80, 0xFFFF,
+                                    0xFF81, 0x0010, 0xFFF0));
+        });
+  });
+}
+
+TEST_CASE("UNPACK_S8_IN_16_HI", "[instr]") {
+  ForEachHostExtensionSet([]() {
+    TestFunction test([](HIRBuilder& b) {
+      StoreVR(b, 3,
+              b.Unpack(LoadVR(b, 4), PACK_TYPE_8_IN_16 | PACK_TYPE_TO_HI |
+                                         PACK_TYPE_IN_SIGNED |
+                                         PACK_TYPE_OUT_SIGNED));
+      b.Return();
+    });
+    test.Run(
+        [](PPCContext* ctx) {
+          ctx->v[4] = vec128b(0x00, 0x01, 0x7F, 0x80, 0xFF, 0x81, 0x10, 0xF0,
+                              0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88);
+        },
+        [](PPCContext* ctx) {
+          auto result = ctx->v[3];
+          REQUIRE(result == vec128s(0x0000, 0x0001, 0x007F, 0xFF80, 0xFFFF,
+                                    0xFF81, 0x0010, 0xFFF0));
+        });
+  });
+}
+
+TEST_CASE("UNPACK_S16_IN_32_LO", "[instr]") {
+  ForEachHostExtensionSet([]() {
+    TestFunction test([](HIRBuilder& b) {
+      StoreVR(b, 3,
+              b.Unpack(LoadVR(b, 4), PACK_TYPE_16_IN_32 | PACK_TYPE_TO_LO |
+                                         PACK_TYPE_IN_SIGNED |
+                                         PACK_TYPE_OUT_SIGNED));
+      b.Return();
+    });
+    test.Run(
+        [](PPCContext* ctx) {
+          ctx->v[4] = vec128s(0x1111, 0x2222, 0x3333, 0x4444, 0x0001, 0x7FFF,
+                              0x8000, 0xFFFF);
+        },
+        [](PPCContext* ctx) {
+          auto result = ctx->v[3];
+          REQUIRE(result ==
+                  vec128i(0x00000001, 0x00007FFF, 0xFFFF8000, 0xFFFFFFFF));
+        });
+  });
+}
+
+TEST_CASE("UNPACK_S16_IN_32_HI", "[instr]") {
+  ForEachHostExtensionSet([]() {
+    TestFunction test([](HIRBuilder& b) {
+      StoreVR(b, 3,
+              b.Unpack(LoadVR(b, 4), PACK_TYPE_16_IN_32 | PACK_TYPE_TO_HI |
+                                         PACK_TYPE_IN_SIGNED |
+                                         PACK_TYPE_OUT_SIGNED));
+      b.Return();
+    });
+    test.Run(
+        [](PPCContext* ctx) {
+          ctx->v[4] = vec128s(0x0001, 0x7FFF, 0x8000, 0xFFFF, 0x1111, 0x2222,
+                              0x3333, 0x4444);
+        },
+        [](PPCContext* ctx) {
+          auto result = ctx->v[3];
+          REQUIRE(result ==
+                  vec128i(0x00000001, 0x00007FFF, 0xFFFF8000, 0xFFFFFFFF));
+        });
+  });
+}
+
+TEST_CASE("UNPACK benchmark", "[instr][.][benchmark]") {
+  const struct {
+    const char* name;
+    uint32_t flags;
+  } ops[] = {
+      {"UNPACK_D3DCOLOR", PACK_TYPE_D3DCOLOR},
+      {"UNPACK_FLOAT16_2", PACK_TYPE_FLOAT16_2},
+      {"UNPACK_FLOAT16_4", PACK_TYPE_FLOAT16_4},
+      {"UNPACK_SHORT_2", PACK_TYPE_SHORT_2},
+      {"UNPACK_S8_IN_16_LO", PACK_TYPE_8_IN_16 | PACK_TYPE_TO_LO |
+                                 PACK_TYPE_IN_SIGNED | PACK_TYPE_OUT_SIGNED},
+      {"UNPACK_S8_IN_16_HI", PACK_TYPE_8_IN_16 | PACK_TYPE_TO_HI |
+                                 PACK_TYPE_IN_SIGNED | PACK_TYPE_OUT_SIGNED},
+      {"UNPACK_S16_IN_32_LO", PACK_TYPE_16_IN_32 | PACK_TYPE_TO_LO |
+                                  PACK_TYPE_IN_SIGNED | PACK_TYPE_OUT_SIGNED},
+      {"UNPACK_S16_IN_32_HI", PACK_TYPE_16_IN_32 | PACK_TYPE_TO_HI |
+                                  PACK_TYPE_IN_SIGNED | PACK_TYPE_OUT_SIGNED},
+  };
+  for (const auto& op : ops) {
+    BenchmarkForEachHostExtensionSet(
+        op.name, vec128i(0x11223344, 0x55667788, 0x00017F80, 0xFF8110F0),
+        [&op](HIRBuilder& b, Value* value) {
+          return b.Unpack(value, op.flags);
+        });
+  }
+}
@@ -10,9 +10,15 @@
 #ifndef XENIA_CPU_TESTING_UTIL_H_
 #define XENIA_CPU_TESTING_UTIL_H_
 
+#include <chrono>
+#include <functional>
+#include <memory>
 #include <vector>
 
 #include "xenia/base/platform.h"
+#if XE_ARCH_AMD64
+#include "xenia/base/platform_amd64.h"
+#endif  // XE_ARCH_AMD64
 #include "xenia/cpu/backend/x64/x64_backend.h"
 #include "xenia/cpu/hir/hir_builder.h"
 #include "xenia/cpu/ppc/ppc_context.h"
@@ -112,6 +118,85 @@ inline void StoreVR(hir::HIRBuilder& b, int reg, hir::Value* value) {
   b.StoreContext(offsetof(PPCContext, v) + reg * 16, value);
 }
 
+// Runs the test with code generated for several sets of host instruction set
+// extensions, so all paths of sequences with multiple implementations are
+// checked against the same expected results. The name of the set is passed to
+// the test.
+inline void ForEachNamedHostExtensionSet(
+    std::function<void(const char* name)> test) {
+#if XE_ARCH_AMD64
+  // Without any optional extensions, the code is generated for the baseline
+  // SSE-level paths, VEX-encoded as AVX is required.
+  const struct {
+    const char* name;
+    int64_t mask;
+  } extension_sets[] = {
+      {"SSE", 0},
+      {"AVX2", amd64::kX64EmitAVX2},
+      {"AVX-512", -1},
+  };
+  int64_t original_mask = cvars::x64_extension_mask;
+  for (const auto& extension_set : extension_sets) {
+    cvars::x64_extension_mask = extension_set.mask;
+    amd64::InitFeatureFlags();
+    if (extension_set.mask == -1 &&
+        (amd64::GetFeatureFlags() & amd64::kX64EmitAVX512Ortho) !=
+            amd64::kX64EmitAVX512Ortho) {
+      test("all available, no AVX-512");
+    } else {
+      test(extension_set.name);
+    }
+  }
+  cvars::x64_extension_mask = original_mask;
+  amd64::InitFeatureFlags();
+#else
+  test("host");
+#endif  // XE_ARCH_AMD64
+}
+
+inline void ForEachHostExtensionSet(std::function<void()> test) {
+  ForEachNamedHostExtensionSet([&test](const char* name) { test(); });
+}
+
+// Reports the time per operation of a function applying the operation to its
+// own result many times, with code generated for each set of host instruction
+// set extensions. The call overhead is amortized over the operations.
+inline void BenchmarkForEachHostExtensionSet(
+    const char* name, const vec128_t& input,
+    std::function<hir::Value*(hir::HIRBuilder& b, hir::Value* value)> op) {
+  constexpr uint32_t kOpCount = 256;
+  constexpr uint32_t kCallCount = 10000;
+  ForEachNamedHostExtensionSet([&](const char* extension_set_name) {
+    TestFunction test([&op](hir::HIRBuilder& b) {
+      hir::Value* value = LoadVR(b, 4);
+      for (uint32_t i = 0; i < kOpCount; ++i) {
+        value = op(b, value);
+      }
+      StoreVR(b, 3, value);
+      b.Return();
+    });
+    for (auto& processor : test.processors) {
+      auto fn = processor->ResolveFunction(0x80000000);
+      auto thread_state = std::make_unique<ThreadState>(processor.get(), 0x100);
+      auto ctx = thread_state->context();
+      ctx->v[4] = input;
+      // Not timing the translation of the function.
+      ctx->lr = 0xBCBCBCBC;
+      fn->Call(thread_state.get(), uint32_t(ctx->lr));
+      auto start_time = std::chrono::steady_clock::now();
+      for (uint32_t i = 0; i < kCallCount; ++i) {
+        ctx->lr = 0xBCBCBCBC;
+        fn->Call(thread_state.get(), uint32_t(ctx->lr));
+      }
+      auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now() - start_time);
+      WARN(name << " (" << extension_set_name << "): "
+                << double(elapsed.count()) / double(kCallCount * kOpCount)
+                << " ns per operation");
+    }
+  });
+}
+
 }  // namespace testing
 }  // namespace cpu
 }  // namespace xe
@@ -10,15 +10,23 @@
 #include "xenia/cpu/xex_module.h"
 
 #include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
 #include "third_party/fmt/include/fmt/format.h"
 
 #include "xenia/base/byte_order.h"
+#include "xenia/base/crypto.h"
 #include "xenia/base/cvar.h"
+#include "xenia/base/filesystem.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 #include "xenia/base/memory.h"
+#include "xenia/base/threading.h"
+#include "xenia/base/xxhash.h"
 
+#include "xenia/cpu/backend/backend.h"
 #include "xenia/cpu/cpu_flags.h"
 #include "xenia/cpu/export_resolver.h"
 #include "xenia/cpu/lzx.h"
@@ -27,9 +35,6 @@
 #include "xenia/kernel/kernel_state.h"
 #include "xenia/kernel/xmodule.h"
 
-#include "third_party/crypto/TinySHA1.hpp"
-#include "third_party/crypto/rijndael-alg-fst.c"
-#include "third_party/crypto/rijndael-alg-fst.h"
 #include "third_party/pe/pe_image.h"
 #include "xenia/cpu/ppc/ppc_decode_data.h"
 #include "xenia/cpu/ppc/ppc_instr.h"
@@ -48,6 +53,15 @@ DEFINE_bool(
     "finding/stress testing with the JIT",
     "CPU");
 
+DEFINE_bool(cache_xex_images, true,
+            "Store the final decrypted, decompressed and patched images of "
+            "XEX modules with LZX compression in the cache directory, and "
+            "load them from there on subsequent launches instead of "
+            "decompressing and patching them again. Only the latest version "
+            "of the unpatched and of the patched image of each module is "
+            "kept.",
+            "CPU");
+
 DECLARE_bool(allow_plugins);
 
 static const uint8_t xe_xex2_retail_key[16] = {
@@ -60,21 +74,8 @@ static const uint8_t xe_xex2_devkit_key[16] = {
 void aes_decrypt_buffer(const uint8_t* session_key, const uint8_t* input_buffer,
                         const size_t input_size, uint8_t* output_buffer,
                         const size_t output_size) {
-  uint32_t rk[4 * (MAXNR + 1)];
-  uint8_t ivec[16] = {0};
-  int32_t Nr = rijndaelKeySetupDec(rk, session_key, 128);
-  const uint8_t* ct = input_buffer;
-  uint8_t* pt = output_buffer;
-  for (size_t n = 0; n < input_size; n += 16, ct += 16, pt += 16) {
-    // Decrypt 16 uint8_ts from input -> output.
-    rijndaelDecrypt(rk, Nr, ct, pt);
-    for (size_t i = 0; i < 16; i++) {
-      // XOR with previous.
-      pt[i] ^= ivec[i];
-      // Set previous.
-      ivec[i] = ct[i];
-    }
-  }
+  xe::crypto::Aes128CbcDecryptor(session_key)
+      .Decrypt(input_buffer, output_buffer, input_size);
 }
 
 namespace xe {
@@ -87,6 +88,25 @@ XexModule::XexModule(Processor* processor, KernelState* kernel_state)
 
 XexModule::~XexModule() {}
 
+namespace {
+struct ImageCacheHeader {
+  uint32_t magic;
+  uint32_t version_swapped;
+  uint32_t base_address;
+  uint32_t image_size;
+  uint32_t is_dev_kit;
+  uint32_t reserved;
+  // XXH3 of the image following the header.
+  uint64_t image_hash;
+};
+static_assert_size(ImageCacheHeader, 32);
+// 'XEXI'.
+constexpr uint32_t kImageCacheMagic = 0x49584558;
+// Increment when the layout or the contents of the cached images change.
+constexpr uint32_t kImageCacheVersion = 1;
+constexpr size_t kImageCacheHeaderSize = sizeof(ImageCacheHeader);
+}  // namespace
+
 bool XexModule::GetOptHeader(const xex2_header* header, xex2_header_keys key,
                              void** out_ptr) {
   assert_not_null(header);
@@ -225,6 +245,8 @@ int XexModule::ApplyPatch(XexModule* module) {
   }
 
   const uint32_t original_base_address = module->base_address();
+  // Checked before the headers of the base module are patched.
+  const bool use_image_cache = module->IsImageCacheable();
 
   // Grab the delta descriptor and get to work.
   xex2_opt_delta_patch_descriptor* patch_header = nullptr;
@@ -388,6 +410,67 @@ int XexModule::ApplyPatch(XexModule* module) {
     return 7;
   }
 
+  // The patched image may have been cached on a previous launch.
+  std::unique_ptr<MappedMemory> cached_image;
+  if (use_image_cache) {
+    xe::crypto::Sha1 key_sha1;
+    key_sha1.Update(module->image_cache_key_, sizeof(module->image_cache_key_));
+    key_sha1.Update(xex_header_mem_.data(), xex_header_mem_.size());
+    key_sha1.Finalize(module->image_cache_key_);
+    module->image_cache_patched_ = true;
+    bool cached_is_dev_kit;
+    cached_image = module->OpenCachedImage(&cached_is_dev_kit);
+  }
+
+  if (cached_image) {
+    std::memcpy(memory()->TranslateVirtual(module->base_address_),
+                cached_image->data() + kImageCacheHeaderSize, new_image_size);
+    result_code = 0;
+  } else {
+    result_code = ApplyImagePatch(module, patch_header, original_image_size);
+    if (!result_code && use_image_cache) {
+      module->StoreCachedImage();
+    }
+  }
+
+  if (!result_code) {
+    // Decommit unused pages if new image size is smaller than original
+    if (original_image_size > new_image_size) {
+      uint32_t size_delta = original_image_size - new_image_size;
+      uint32_t addr_free_mem = module->base_address_ + new_image_size;
+
+      bool free_result = memory()
+                             ->LookupHeap(addr_free_mem)
+                             ->Decommit(addr_free_mem, size_delta);
+
+      if (!free_result) {
+        XELOGE("Unable to decommit XEX memory at {:08X}-{:08X}.", addr_free_mem,
+               size_delta);
+        assert_always();
+      }
+    }
+
+    xex2_version source_ver, target_ver;
+    source_ver = patch_header->source_version();
+    target_ver = patch_header->target_version();
+    XELOGI(
+        "XEX patch applied successfully: base version: {}.{}.{}.{}, new "
+        "version: {}.{}.{}.{}",
+        source_ver.major, source_ver.minor, source_ver.build, source_ver.qfe,
+        target_ver.major, target_ver.minor, target_ver.build, target_ver.qfe);
+  } else {
+    XELOGE("XEX patch application failed, error code {}", result_code);
+  }
+
+  return result_code;
+}
+
+int XexModule::ApplyImagePatch(
+    XexModule* module, const xex2_opt_delta_patch_descriptor* patch_header,
+    uint32_t original_image_size) {
+  auto file_format_header = opt_file_format_info();
+  int result_code = 0;
+
   // Decrypt (if needed).
   bool free_input = false;
   const uint8_t* patch_buffer = xexp_data_mem_.data();
@@ -436,15 +519,15 @@ int XexModule::ApplyPatch(XexModule* module) {
   }
 
   uint8_t digest[0x14];
-  sha1::SHA1 s;
+  xe::crypto::Sha1 s;
   // Now loop through each block and apply the delta patches inside
   while (cur_block->block_size) {
     const auto* next_block = (const xex2_compressed_block_info*)p;
 
     // Compare block hash, if no match we probably used wrong decrypt key
-    s.reset();
-    s.processBytes(p, cur_block->block_size);
-    s.finalize(digest);
+    s.Reset();
+    s.Update(p, cur_block->block_size);
+    s.Finalize(digest);
 
     if (memcmp(digest, cur_block->block_hash, 0x14) != 0) {
       result_code = 9;
@@ -470,39 +553,64 @@ int XexModule::ApplyPatch(XexModule* module) {
     cur_block = next_block;
   }
 
-  if (!result_code) {
-    // Decommit unused pages if new image size is smaller than original
-    if (original_image_size > new_image_size) {
-      uint32_t size_delta = original_image_size - new_image_size;
-      uint32_t addr_free_mem = module->base_address_ + new_image_size;
+  if (free_input) {
+    free((void*)input_buffer);
+  }
+  return result_code;
+}
 
-      bool free_result = memory()
-                             ->LookupHeap(addr_free_mem)
-                             ->Decommit(addr_free_mem, size_delta);
+bool XexModule::IsImageKeyPlausible(const void* xex_addr, size_t xex_length,
+                                    bool use_dev_key) const {
+  const xex2_opt_file_format_info* file_format_info = opt_file_format_info();
+  if (!file_format_info || is_patch() ||
+      file_format_info->encryption_type != XEX_ENCRYPTION_NORMAL) {
+    // The key is not used for loading the image.
+    return true;
+  }
+  const uint32_t header_size = xex_header()->header_size;
+  if (xex_length < header_size) {
+    return false;
+  }
+  const uint8_t* exe_buffer =
+      reinterpret_cast<const uint8_t*>(xex_addr) + header_size;
+  const size_t exe_length = xex_length - header_size;
 
-      if (!free_result) {
-        XELOGE("Unable to decommit XEX memory at {:08X}-{:08X}.", addr_free_mem,
-               size_delta);
-        assert_always();
+  uint8_t session_key[16];
+  aes_decrypt_buffer(
+      use_dev_key ? xe_xex2_devkit_key : xe_xex2_retail_key,
+      reinterpret_cast<const uint8_t*>(xex_security_info()->aes_key), 16,
+      session_key, 16);
+  xe::crypto::Aes128CbcDecryptor decryptor(session_key);
+
+  switch (file_format_info->compression_type) {
+    case XEX_COMPRESSION_NONE:
+    case XEX_COMPRESSION_BASIC: {
+      // The image begins with the PE header, checked like in
+      // is_valid_executable.
+      if (exe_length < 16) {
+        return false;
       }
+      uint8_t first_block[16];
+      decryptor.Decrypt(exe_buffer, first_block, sizeof(first_block));
+      return xe::load<uint32_t>(first_block) == 0x905A4D;
     }
-
-    xex2_version source_ver, target_ver;
-    source_ver = patch_header->source_version();
-    target_ver = patch_header->target_version();
-    XELOGI(
-        "XEX patch applied successfully: base version: {}.{}.{}.{}, new "
-        "version: {}.{}.{}.{}",
-        source_ver.major, source_ver.minor, source_ver.build, source_ver.qfe,
-        target_ver.major, target_ver.minor, target_ver.build, target_ver.qfe);
-  } else {
-    XELOGE("XEX patch application failed, error code {}", result_code);
-  }
-
-  if (free_input) {
-    free((void*)input_buffer);
+    case XEX_COMPRESSION_NORMAL: {
+      // The hash of the first compressed block is in the header.
+      const xex2_compressed_block_info& first_block =
+          file_format_info->compression_info.normal.first_block;
+      const uint32_t block_size = first_block.block_size;
+      if (!block_size || block_size > exe_length) {
+        return false;
+      }
+      std::vector<uint8_t> block(block_size);
+      decryptor.Decrypt(exe_buffer, block.data(), block_size);
+      uint8_t digest[0x14];
+      xe::crypto::Sha1::Digest(block.data(), block_size, digest);
+      return !memcmp(digest, first_block.block_hash, 0x14);
+    }
+    default:
+      return true;
   }
-  return result_code;
 }
 
 int XexModule::ReadImage(const void* xex_addr, size_t xex_length,
@@ -648,9 +756,8 @@ int XexModule::ReadImageBasicCompressed(const void* xex_addr,
   std::memset(buffer, 0, total_size);  // Quickly zero the contents.
   uint8_t* d = buffer;
 
-  uint32_t rk[4 * (MAXNR + 1)];
-  uint8_t ivec[16] = {0};
-  int32_t Nr = rijndaelKeySetupDec(rk, session_key_, 128);
+  // The chain continues across the blocks.
+  xe::crypto::Aes128CbcDecryptor decryptor(session_key_);
 
   for (size_t n = 0; n < block_count; n++) {
     const uint32_t data_size = comp_info.blocks[n].data_size;
@@ -664,20 +771,9 @@ int XexModule::ReadImageBasicCompressed(const void* xex_addr,
         }
         memcpy(d, p, data_size);
         break;
-      case XEX_ENCRYPTION_NORMAL: {
-        const uint8_t* ct = p;
-        uint8_t* pt = d;
-        for (size_t m = 0; m < data_size; m += 16, ct += 16, pt += 16) {
-          // Decrypt 16 uint8_ts from input -> output.
-          rijndaelDecrypt(rk, Nr, ct, pt);
-          for (size_t i = 0; i < 16; i++) {
-            // XOR with previous.
-            pt[i] ^= ivec[i];
-            // Set previous.
-            ivec[i] = ct[i];
-          }
-        }
-      } break;
+      case XEX_ENCRYPTION_NORMAL:
+        decryptor.Decrypt(p, d, data_size);
+        break;
       default:
         assert_always();
         return 1;
@@ -703,27 +799,17 @@ int XexModule::ReadImageCompressed(const void* xex_addr, size_t xex_length) {
   //   20b hash of entire next block (including size/hash)
   //    Nb block uint8_ts
   // - decompress block contents
+  //
+  // Decryption and de-blocking are done on a separate thread, block by block,
+  // while the decompressor consumes the data de-blocked so far.
 
-  uint8_t* compress_buffer = NULL;
-  const uint8_t* p = NULL;
-  uint8_t* d = NULL;
-  sha1::SHA1 s;
-
-  // Decrypt (if needed).
-  bool free_input = false;
-  const uint8_t* input_buffer = exe_buffer;
-  size_t input_size = exe_length;
-
+  bool is_encrypted;
   switch (opt_file_format_info()->encryption_type) {
     case XEX_ENCRYPTION_NONE:
-      // No-op.
+      is_encrypted = false;
       break;
     case XEX_ENCRYPTION_NORMAL:
-      // TODO: a way to do without a copy/alloc?
-      free_input = true;
-      input_buffer = (const uint8_t*)calloc(1, exe_length);
-      aes_decrypt_buffer(session_key_, exe_buffer, exe_length,
-                         (uint8_t*)input_buffer, exe_length);
+      is_encrypted = true;
       break;
     default:
       assert_always();
@@ -731,83 +817,151 @@ int XexModule::ReadImageCompressed(const void* xex_addr, size_t xex_length) {
   }
 
   const auto* compression_info = &opt_file_format_info()->compression_info;
-  const xex2_compressed_block_info* cur_block =
-      &compression_info->normal.first_block;
+  uint32_t uncompressed_size = image_size();
 
-  compress_buffer = (uint8_t*)calloc(1, exe_length);
-
-  p = input_buffer;
-  d = compress_buffer;
-
-  // De-block.
-  int result_code = 0;
-
-  uint8_t block_calced_digest[0x14];
-  while (cur_block->block_size) {
-    const uint8_t* pnext = p + cur_block->block_size;
-    const auto* next_block = (const xex2_compressed_block_info*)p;
+  // Allocate in-place the XEX memory.
+  bool alloc_result =
+      memory()
+          ->LookupHeap(base_address_)
+          ->AllocFixed(
+              base_address_, uncompressed_size, 4096,
+              xe::kMemoryAllocationReserve | xe::kMemoryAllocationCommit,
+              xe::kMemoryProtectRead | xe::kMemoryProtectWrite);
+  if (!alloc_result) {
+    XELOGE("Unable to allocate XEX memory at {:08X}-{:08X}.", base_address_,
+           uncompressed_size);
+    return 3;
+  }
+  uint8_t* buffer = memory()->TranslateVirtual(base_address_);
+  std::memset(buffer, 0, uncompressed_size);
 
-    // Compare block hash, if no match we probably used wrong decrypt key
-    s.reset();
-    s.processBytes(p, cur_block->block_size);
-    s.finalize(block_calced_digest);
-    if (memcmp(block_calced_digest, cur_block->block_hash, 0x14) != 0) {
-      result_code = 2;
-      break;
-    }
+  // Decrypted input, filled progressively (the chain continues across the
+  // blocks).
+  std::vector<uint8_t> decrypt_buffer;
+  if (is_encrypted) {
+    decrypt_buffer.resize(exe_length);
+  }
+  std::vector<uint8_t> compress_buffer(exe_length);
+
+  std::mutex deblock_mutex;
+  std::condition_variable deblock_cond;
+  size_t deblocked_size = 0;
+  bool deblock_done = false;
+  int deblock_result = 0;
+
+  std::thread deblock_thread([&]() {
+    xe::threading::set_name("XEX De-block");
+
+    xe::crypto::Aes128CbcDecryptor decryptor(session_key_);
+    const uint8_t* input_buffer =
+        is_encrypted ? decrypt_buffer.data() : exe_buffer;
+    size_t decrypted_size = 0;
+
+    const xex2_compressed_block_info* cur_block =
+        &compression_info->normal.first_block;
+    size_t p = 0;
+    uint8_t* d = compress_buffer.data();
+    xe::crypto::Sha1 s;
+    uint8_t block_calced_digest[0x14];
+    int result_code = 0;
+    while (cur_block->block_size) {
+      const size_t block_size = cur_block->block_size;
+      if (block_size > exe_length - p ||
+          block_size < sizeof(xex2_compressed_block_info)) {
+        result_code = 2;
+        break;
+      }
+      const size_t pnext = p + block_size;
+
+      if (is_encrypted && decrypted_size < pnext) {
+        size_t decrypt_end = std::min(
+            xe::align(pnext, xe::crypto::Aes128CbcDecryptor::kBlockSize),
+            size_t(exe_length));
+        decryptor.Decrypt(exe_buffer + decrypted_size,
+                          decrypt_buffer.data() + decrypted_size,
+                          decrypt_end - decrypted_size);
+        decrypted_size = decrypt_end;
+      }
 
-    // skip block info
-    p += 4;
-    p += 20;
+      const uint8_t* block = input_buffer + p;
+      const auto* next_block =
+          reinterpret_cast<const xex2_compressed_block_info*>(block);
 
-    while (true) {
-      const size_t chunk_size = (p[0] << 8) | p[1];
-      p += 2;
-      if (!chunk_size) {
+      // Compare block hash, if no match we probably used wrong decrypt key
+      s.Reset();
+      s.Update(block, block_size);
+      s.Finalize(block_calced_digest);
+      if (memcmp(block_calced_digest, cur_block->block_hash, 0x14) != 0) {
+        result_code = 2;
         break;
       }
 
-      memcpy(d, p, chunk_size);
-      p += chunk_size;
-      d += chunk_size;
-    }
-
-    p = pnext;
-    cur_block = next_block;
-  }
+      // skip block info
+      const uint8_t* chunk = block + 4 + 20;
+      const uint8_t* block_end = block + block_size;
 
-  if (!result_code) {
-    uint32_t uncompressed_size = image_size();
+      while (chunk + 2 <= block_end) {
+        const size_t chunk_size = (chunk[0] << 8) | chunk[1];
+        chunk += 2;
+        if (!chunk_size) {
+          break;
+        }
+        if (chunk_size > size_t(block_end - chunk)) {
+          result_code = 2;
+          break;
+        }
 
-    // Allocate in-place the XEX memory.
-    bool alloc_result =
-        memory()
-            ->LookupHeap(base_address_)
-            ->AllocFixed(
-                base_address_, uncompressed_size, 4096,
-                xe::kMemoryAllocationReserve | xe::kMemoryAllocationCommit,
-                xe::kMemoryProtectRead | xe::kMemoryProtectWrite);
+        memcpy(d, chunk, chunk_size);
+        chunk += chunk_size;
+        d += chunk_size;
+      }
+      if (result_code) {
+        break;
+      }
 
-    if (alloc_result) {
-      uint8_t* buffer = memory()->TranslateVirtual(base_address_);
-      std::memset(buffer, 0, uncompressed_size);
+      {
+        std::lock_guard<std::mutex> lock(deblock_mutex);
+        deblocked_size = d - compress_buffer.data();
+      }
+      deblock_cond.notify_one();
 
-      // Decompress into XEX base
-      result_code = lzx_decompress(
-          compress_buffer, d - compress_buffer, buffer, uncompressed_size,
-          compression_info->normal.window_size, nullptr, 0);
-    } else {
-      XELOGE("Unable to allocate XEX memory at {:08X}-{:08X}.", base_address_,
-             uncompressed_size);
-      result_code = 3;
+      p = pnext;
+      cur_block = next_block;
     }
-  }
 
-  if (compress_buffer) {
-    free((void*)compress_buffer);
-  }
-  if (free_input) {
-    free((void*)input_buffer);
+    {
+      std::lock_guard<std::mutex> lock(deblock_mutex);
+      deblock_result = result_code;
+      deblock_done = true;
+    }
+    deblock_cond.notify_one();
+  });
+
+  // Decompress into XEX base
+  size_t read_offset = 0;
+  int result_code = lzx_decompress(
+      [&](void* read_buffer, size_t read_size) -> ptrdiff_t {
+        std::unique_lock<std::mutex> lock(deblock_mutex);
+        deblock_cond.wait(lock, [&]() {
+          return deblock_done || deblocked_size > read_offset;
+        });
+        if (deblock_result) {
+          return -1;
+        }
+        read_size = std::min(read_size, deblocked_size - read_offset);
+        lock.unlock();
+        std::memcpy(read_buffer, compress_buffer.data() + read_offset,
+                    read_size);
+        read_offset += read_size;
+        return ptrdiff_t(read_size);
+      },
+      buffer, uncompressed_size, compression_info->normal.window_size);
+
+  deblock_thread.join();
+  // A block hash mismatch is reported even if the decompressor has stopped
+  // before reaching it, as it's used to detect the wrong key.
+  if (deblock_result) {
+    result_code = deblock_result;
   }
   return result_code;
 }
@@ -969,14 +1123,26 @@ bool XexModule::Load(const std::string_view name, const std::string_view path,
   name_ = name;
   path_ = path;
 
+  // The headers (including the hash and the key of the image in the security
+  // info) identify the image.
+  xe::crypto::Sha1::Digest(xex_header_mem_.data(), xex_header_mem_.size(),
+                           image_cache_key_);
+  bool use_image_cache = IsImageCacheable();
+  if (use_image_cache && ReadImageFromCache()) {
+    return true;
+  }
+
   // Load in the XEX basefile
-  // We'll try using both XEX2 keys to see if any give a valid PE
-  int result_code = ReadImage(xex_addr, xex_length, false);
+  // Pick the XEX2 key by decrypting only the beginning of the image, but still
+  // try the other key if the whole image doesn't give a valid PE
+  bool use_dev_key = !IsImageKeyPlausible(xex_addr, xex_length, false) &&
+                     IsImageKeyPlausible(xex_addr, xex_length, true);
+  int result_code = ReadImage(xex_addr, xex_length, use_dev_key);
   if (result_code) {
-    XELOGW("XEX load failed with code {}, trying with devkit encryption key...",
-           result_code);
+    XELOGW("XEX load failed with code {}, trying with {} encryption key...",
+           result_code, use_dev_key ? "retail" : "devkit");
 
-    result_code = ReadImage(xex_addr, xex_length, true);
+    result_code = ReadImage(xex_addr, xex_length, !use_dev_key);
     if (result_code) {
       XELOGE("XEX load failed with code {}, tried both encryption keys",
              result_code);
@@ -984,11 +1150,153 @@ bool XexModule::Load(const std::string_view name, const std::string_view path,
     }
   }
 
+  if (use_image_cache) {
+    StoreCachedImage();
+  }
+
   // Note: caller will have to call LoadContinue once it's determined whether a
   // patch file exists or not!
   return true;
 }
 
+bool XexModule::IsImageCacheEnabled() const {
+  return cvars::cache_xex_images && kernel_state_ &&
+         kernel_state_->emulator() &&
+         !kernel_state_->emulator()->cache_root().empty();
+}
+
+bool XexModule::IsImageCacheable() const {
+  const xex2_opt_file_format_info* file_format_info = opt_file_format_info();
+  return !is_patch() && file_format_info &&
+         file_format_info->compression_type == XEX_COMPRESSION_NORMAL &&
+         IsImageCacheEnabled();
+}
+
+std::filesystem::path XexModule::GetImageCachePath() const {
+  // Each directory holds the image of one module of one title, so the images
+  // made outdated by a title update can be evicted.
+  const xex2_opt_execution_info* execution_info = opt_execution_info();
+  uint32_t title_id = execution_info ? uint32_t(execution_info->title_id) : 0;
+  std::string key_str;
+  for (uint8_t key_byte : image_cache_key_) {
+    key_str += fmt::format("{:02X}", key_byte);
+  }
+  return kernel_state_->emulator()->cache_root() / "modules" / "images" /
+         fmt::format("{:08X}", title_id) /
+         xe::to_path(name_ + (image_cache_patched_ ? ".patched" : "")) /
+         (key_str + ".bin");
+}
+
+std::unique_ptr<MappedMemory> XexModule::OpenCachedImage(
+    bool* is_dev_kit_out) const {
+  std::filesystem::path path = GetImageCachePath();
+  std::error_code error_code;
+  if (!std::filesystem::is_regular_file(path, error_code)) {
+    return nullptr;
+  }
+  auto mapping = MappedMemory::Open(path, MappedMemory::Mode::kRead);
+  if (!mapping || mapping->size() < kImageCacheHeaderSize) {
+    return nullptr;
+  }
+  ImageCacheHeader header;
+  std::memcpy(&header, mapping->data(), sizeof(header));
+  uint32_t size = image_size();
+  if (header.magic != kImageCacheMagic ||
+      xe::byte_swap(header.version_swapped) != kImageCacheVersion ||
+      header.base_address != base_address_ || header.image_size != size ||
+      mapping->size() != kImageCacheHeaderSize + size ||
+      XXH3_64bits(mapping->data() + kImageCacheHeaderSize, size) !=
+          header.image_hash) {
+    XELOGW("Discarding the outdated or corrupted cached XEX image {}", path);
+    mapping.reset();
+    std::filesystem::remove(path, error_code);
+    return nullptr;
+  }
+  *is_dev_kit_out = header.is_dev_kit != 0;
+  return mapping;
+}
+
+bool XexModule::ReadImageFromCache() {
+  bool cached_is_dev_kit;
+  auto cached_image = OpenCachedImage(&cached_is_dev_kit);
+  if (!cached_image) {
+    return false;
+  }
+
+  auto heap = memory()->LookupHeap(base_address_);
+  heap->Reset();
+  uint32_t size = image_size();
+  if (!heap->AllocFixed(
+          base_address_, size, 4096,
+          xe::kMemoryAllocationReserve | xe::kMemoryAllocationCommit,
+          xe::kMemoryProtectRead | xe::kMemoryProtectWrite)) {
+    XELOGE("Unable to allocate XEX memory at {:08X}-{:08X}.", base_address_,
+           size);
+    return false;
+  }
+  std::memcpy(memory()->TranslateVirtual(base_address_),
+              cached_image->data() + kImageCacheHeaderSize, size);
+  if (!is_valid_executable()) {
+    return false;
+  }
+
+  // The session key is still needed for applying a title update.
+  is_dev_kit_ = cached_is_dev_kit;
+  aes_decrypt_buffer(
+      is_dev_kit_ ? xe_xex2_devkit_key : xe_xex2_retail_key,
+      reinterpret_cast<const uint8_t*>(xex_security_info()->aes_key), 16,
+      session_key_, 16);
+
+  XELOGI("Loaded the XEX image of {} from the cache", name_);
+  return true;
+}
+
+void XexModule::StoreCachedImage() const {
+  std::filesystem::path path = GetImageCachePath();
+  std::error_code error_code;
+  std::filesystem::create_directories(path.parent_path(), error_code);
+
+  // Written to a temporary file first so a partially written file is never
+  // picked up.
+  std::filesystem::path temp_path = path;
+  temp_path += ".tmp";
+  FILE* file = xe::filesystem::OpenFile(temp_path, "wb");
+  if (!file) {
+    XELOGW("Failed to open {} for writing the cached XEX image", temp_path);
+    return;
+  }
+  uint32_t size = image_size();
+  const uint8_t* image = memory()->TranslateVirtual(base_address_);
+  ImageCacheHeader header = {};
+  header.magic = kImageCacheMagic;
+  header.version_swapped = xe::byte_swap(kImageCacheVersion);
+  header.base_address = base_address_;
+  header.image_size = size;
+  header.is_dev_kit = is_dev_kit_ ? 1 : 0;
+  header.image_hash = XXH3_64bits(image, size);
+  bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                 fwrite(image, 1, size, file) == size;
+  written = fclose(file) == 0 && written;
+  if (written) {
+    std::filesystem::rename(temp_path, path, error_code);
+    written = !error_code;
+  }
+  if (!written) {
+    XELOGW("Failed to write the cached XEX image {}", path);
+    std::filesystem::remove(temp_path, error_code);
+    return;
+  }
+
+  // Evict the images of other versions of the module.
+  for (const std::filesystem::directory_entry& entry :
+       std::filesystem::directory_iterator(path.parent_path(), error_code)) {
+    if (entry.path().extension() == ".bin" && entry.path() != path) {
+      XELOGI("Removing the outdated cached XEX image {}", entry.path());
+      std::filesystem::remove(entry.path(), error_code);
+    }
+  }
+}
+
 bool XexModule::LoadContinue() {
   // Second part of image load
   // Split from Load() so that we can patch the XEX before loading this data
@@ -1126,15 +1434,10 @@ bool XexModule::LoadContinue() {
 }
 
 void XexModule::Precompile() {
-  sha1::SHA1 final_image_sha_;
-
-  final_image_sha_.reset();
-
   unsigned high_code = this->high_address_ - this->low_address_;
 
-  final_image_sha_.processBytes(memory()->TranslateVirtual(this->low_address_),
-                                high_code);
-  final_image_sha_.finalize(image_sha_bytes_);
+  xe::crypto::Sha1::Digest(memory()->TranslateVirtual(this->low_address_),
+                           high_code, image_sha_bytes_);
 
   char fmtbuf[16];
 
@@ -1150,7 +1453,12 @@ void XexModule::Precompile() {
   }
 
   info_cache_.Init(this);
+  PrecompileStoredFunctions();
+  PrecompileKnownFunctions();
   PrecompileDiscoveredFunctions();
+  if (precompiler_) {
+    precompiler_->Finish();
+  }
 }
 bool XexModule::Unload() {
   if (!loaded_) {
@@ -1158,6 +1466,10 @@ bool XexModule::Unload() {
   }
   loaded_ = false;
 
+  // Must not compile anything after the code is gone.
+  precompiler_.reset();
+  processor_->backend()->ShutdownCodeStorage(low_address_, high_address_);
+
   // If this isn't a patch, just deallocate the memory occupied by the exe
   if (!is_patch()) {
     assert_not_zero(base_address_);
@@ -1417,44 +1729,65 @@ InfoCacheFlags* XexModule::GetInstructionAddressFlags(uint32_t guest_addr) {
 
   return info_cache_.LookupFlags(guest_addr);
 }
+FunctionPrecompiler* XexModule::GetPrecompiler() {
+  if (!precompiler_) {
+    precompiler_ = std::make_unique<FunctionPrecompiler>(processor_);
+    precompiler_->Start();
+  }
+  return precompiler_.get();
+}
 void XexModule::PrecompileDiscoveredFunctions() {
   if (!cvars::enable_early_precompilation) {
     return;
   }
-  auto others = PreanalyzeCode();
-
-  for (auto&& other : others) {
-    if (other < low_address_ || other >= high_address_) {
-      continue;
-    }
-    auto sym = processor_->LookupFunction(other);
-
-    if (!sym || sym->status() != Symbol::Status::kDefined) {
-      processor_->ResolveFunction(other);
-    }
+  // Scanning the whole image takes a while too, so it's done on a worker after
+  // the functions known to be used are taken.
+  GetPrecompiler()->EnqueueGenerator(
+      [this]() {
+        auto others = PreanalyzeCode();
+        others.erase(std::remove_if(others.begin(), others.end(),
+                                    [this](uint32_t other) {
+                                      return other < low_address_ ||
+                                             other >= high_address_;
+                                    }),
+                     others.end());
+        return others;
+      },
+      FunctionPrecompiler::Priority::kLow);
+}
+void XexModule::PrecompileStoredFunctions() {
+  std::filesystem::path storage_root =
+      kernel_state_->emulator()->cache_root() / "modules" / image_sha_str_;
+  auto stored_addresses = processor_->backend()->InitializeCodeStorage(
+      storage_root, low_address_, high_address_);
+  // Functions found in the storage don't need to be translated, so placing
+  // them all is cheap and avoids doing it on first call. Without early
+  // precompilation, they're still loaded from the storage when first called.
+  if (cvars::enable_early_precompilation && !stored_addresses.empty()) {
+    GetPrecompiler()->Enqueue(stored_addresses,
+                              FunctionPrecompiler::Priority::kHigh);
   }
 }
 void XexModule::PrecompileKnownFunctions() {
   if (!cvars::enable_early_precompilation) {
     return;
   }
-  uint32_t start = 0;
   uint32_t end = (high_address_ - low_address_) / 4;
   auto flags = info_cache_.LookupFlags(0);
   if (!flags) {
     return;
   }
-  // maybe should pre-acquire global crit?
+  std::vector<uint32_t> known_addresses;
   for (uint32_t i = 0; i < end; i++) {
     if (flags[i].was_resolved) {
-      uint32_t addr = low_address_ + (i * 4);
-      auto sym = processor_->LookupFunction(addr);
-
-      if (!sym || sym->status() != Symbol::Status::kDefined) {
-        processor_->ResolveFunction(addr);
-      }
+      known_addresses.push_back(low_address_ + (i * 4));
     }
   }
+  if (known_addresses.empty()) {
+    return;
+  }
+  GetPrecompiler()->Enqueue(known_addresses,
+                            FunctionPrecompiler::Priority::kHigh);
 }
 
 static uint32_t GetBLCalledFunction(XexModule* xexmod, uint32_t current_base,
@@ -10,9 +10,12 @@
 #ifndef XENIA_CPU_XEX_MODULE_H_
 #define XENIA_CPU_XEX_MODULE_H_
 
+#include <filesystem>
+#include <memory>
 #include <string>
 #include <vector>
 #include "xenia/base/mapped_memory.h"
+#include "xenia/cpu/function_precompiler.h"
 #include "xenia/cpu/module.h"
 #include "xenia/kernel/util/xex2_info.h"
 
@@ -238,16 +241,41 @@ class XexModule : public xe::cpu::Module {
   std::unique_ptr<Function> CreateFunction(uint32_t address) override;
 
  private:
+  FunctionPrecompiler* GetPrecompiler();
   void PrecompileKnownFunctions();
   void PrecompileDiscoveredFunctions();
+  void PrecompileStoredFunctions();
   std::vector<uint32_t> PreanalyzeCode();
   friend struct XexInfoCache;
   void ReadSecurityInfo();
 
+  // Checks whether the key decrypts the beginning of the image as expected,
+  // without decrypting and loading the whole image, to pick the key to load it
+  // with.
+  bool IsImageKeyPlausible(const void* xex_addr, size_t xex_length,
+                           bool use_dev_key) const;
   int ReadImage(const void* xex_addr, size_t xex_length, bool use_dev_key);
   int ReadImageUncompressed(const void* xex_addr, size_t xex_length);
   int ReadImageBasicCompressed(const void* xex_addr, size_t xex_length);
   int ReadImageCompressed(const void* xex_addr, size_t xex_length);
+  // Applies the delta patch of this patch module to the image of the module.
+  int ApplyImagePatch(XexModule* module,
+                      const xex2_opt_delta_patch_descriptor* patch_header,
+                      uint32_t original_image_size);
+
+  // Cache of the final (decrypted, decompressed and patched) image in the
+  // cache directory, keyed by the hash of the XEX headers and, after a title
+  // update is applied, of the headers of the patch. Only one image is kept for
+  // the unpatched and one for the patched module of each title.
+  bool IsImageCacheEnabled() const;
+  // Only LZX-compressed images are cached, the others are cheap to load.
+  bool IsImageCacheable() const;
+  std::filesystem::path GetImageCachePath() const;
+  // Returns the mapping of the cached image if it's valid for the current load
+  // address and image size.
+  std::unique_ptr<MappedMemory> OpenCachedImage(bool* is_dev_kit_out) const;
+  bool ReadImageFromCache();
+  void StoreCachedImage() const;
 
   int ReadPEHeaders();
 
@@ -270,6 +298,8 @@ class XexModule : public xe::cpu::Module {
   std::vector<uint32_t> opt_alternate_title_ids_;
 
   uint8_t session_key_[0x10];
+  uint8_t image_cache_key_[0x14] = {};
+  bool image_cache_patched_ = false;
   bool is_dev_kit_ = false;
 
   bool loaded_ = false;         // Loaded into memory?
@@ -285,6 +315,9 @@ class XexModule : public xe::cpu::Module {
   uint8_t image_sha_bytes_[20];
   std::string image_sha_str_;
   XexInfoCache info_cache_;
+
+  // Compiles the functions known or assumed to be used in the background.
+  std::unique_ptr<FunctionPrecompiler> precompiler_;
 };
 
 }  // namespace cpu
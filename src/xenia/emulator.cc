@@ -66,6 +66,12 @@
 #include "xenia/cpu/backend/x64/x64_backend.h"
 #endif  // XE_ARCH
 
+#if XE_PLATFORM_LINUX
+#include <sys/wait.h>
+#include <unistd.h>
+#include <cerrno>
+#endif  // XE_PLATFORM_LINUX
+
 DEFINE_double(time_scalar, 1.0,
               "Scalar used to speed or slow time (1x, 2x, 1/2x, etc).",
               "General");
@@ -83,6 +89,19 @@ DEFINE_bool(allow_game_relative_writes, false,
             "generating test data to compare with original hardware. ",
             "General");
 
+DEFINE_bool(save_state_in_background, false,
+            "Write the guest memory of save states from a copy-on-write clone "
+            "of the process, so the title can resume without waiting for it "
+            "(Linux only).",
+            "General");
+
+DEFINE_bool(save_state_incremental, false,
+            "Write save states after the first one as incremental snapshots, "
+            "containing only the guest memory pages changed since the "
+            "previous save state, which must be kept to restore them. Save "
+            "state memory is not written in background then.",
+            "General");
+
 DECLARE_int32(user_language);
 
 DECLARE_bool(allow_plugins);
@@ -188,6 +207,8 @@ Emulator::~Emulator() {
   export_resolver_.reset();
 
   ExceptionHandler::Uninstall(Emulator::ExceptionCallbackThunk, this);
+
+  WaitForBackgroundSave();
 }
 
 X_STATUS Emulator::Setup(
@@ -1029,8 +1050,87 @@ void Emulator::Resume() {
   }
 }
 
+namespace {
+
+struct SaveStateHeader {
+  std::optional<uint32_t> title_id;
+  // Save state containing the memory snapshot an incremental one is based on,
+  // and the offset of the snapshot in it. Empty for full snapshots.
+  std::filesystem::path base_path;
+  uint64_t base_memory_offset = 0;
+};
+
+bool ReadSaveStateHeader(ByteStream& stream, SaveStateHeader& header) {
+  // ByteStream only checks the bounds in debug builds.
+  auto has_bytes = [&stream](size_t count) {
+    return stream.data_length() - stream.offset() >= count;
+  };
+  // Older save states are rejected before reading anything else from them.
+  if (!has_bytes(sizeof(uint32_t) * 2) ||
+      stream.Read<uint32_t>() != kEmulatorSaveSignature) {
+    return false;
+  }
+  if (stream.Read<uint32_t>() != kEmulatorSaveVersion) {
+    XELOGE("Unsupported save state version");
+    return false;
+  }
+  if (!has_bytes(sizeof(bool))) {
+    return false;
+  }
+  if (stream.Read<bool>()) {
+    if (!has_bytes(sizeof(uint32_t))) {
+      return false;
+    }
+    header.title_id = stream.Read<uint32_t>();
+  } else {
+    header.title_id = {};
+  }
+  if (!has_bytes(sizeof(bool))) {
+    return false;
+  }
+  if (stream.Read<bool>()) {
+    if (!has_bytes(sizeof(uint32_t))) {
+      return false;
+    }
+    uint32_t base_path_length = stream.Read<uint32_t>();
+    if (!has_bytes(size_t(base_path_length) + sizeof(uint64_t))) {
+      return false;
+    }
+    header.base_path = xe::to_path(std::string_view(
+        reinterpret_cast<const char*>(stream.data() + stream.offset()),
+        base_path_length));
+    stream.Advance(base_path_length);
+    header.base_memory_offset = stream.Read<uint64_t>();
+  } else {
+    header.base_path.clear();
+    header.base_memory_offset = 0;
+  }
+  return true;
+}
+
+}  // namespace
+
 bool Emulator::SaveToFile(const std::filesystem::path& path) {
+  // The previous save state may still be being written.
+  WaitForBackgroundSave();
+
   Pause();
+  uint64_t pause_start_tick_count = Clock::QueryHostTickCount();
+
+  std::error_code error_code;
+  std::filesystem::path absolute_path =
+      std::filesystem::absolute(path, error_code);
+  if (error_code) {
+    absolute_path = path;
+  }
+  // Overwriting the save state that the next incremental one would be based
+  // on.
+  if (absolute_path == memory_snapshot_path_) {
+    memory_snapshot_path_.clear();
+  }
+  bool incremental = cvars::save_state_incremental &&
+                     !memory_snapshot_path_.empty() &&
+                     memory_->saved_snapshot_id();
 
   filesystem::CreateEmptyFile(path);
   auto map = MappedMemory::Open(path, MappedMemory::Mode::kReadWrite, 0, 2_GiB);
@@ -1041,10 +1141,16 @@ bool Emulator::SaveToFile(const std::filesystem::path& path) {
   // Save the emulator state to a file
   ByteStream stream(map->data(), map->size());
   stream.Write(kEmulatorSaveSignature);
+  stream.Write(kEmulatorSaveVersion);
   stream.Write(title_id_.has_value());
   if (title_id_.has_value()) {
     stream.Write(title_id_.value());
   }
+  stream.Write(incremental);
+  if (incremental) {
+    stream.Write(std::string_view(xe::path_to_utf8(memory_snapshot_path_)));
+    stream.Write(memory_snapshot_offset_);
+  }
 
   // It's important we don't hold the global lock here! XThreads need to step
   // forward (possibly through guarded regions) without worry!
@@ -1052,14 +1158,71 @@ bool Emulator::SaveToFile(const std::filesystem::path& path) {
   graphics_system_->Save(&stream);
   audio_system_->Save(&stream);
   kernel_state_->Save(&stream);
-  memory_->Save(&stream);
-  map->Close(stream.offset());
+  if (!cvars::save_state_incremental && cvars::save_state_in_background &&
+      SaveMemoryInBackground(map.get(), stream)) {
+    // The forked process owns the file now, don't truncate it.
+    map.reset();
+  } else {
+    size_t memory_offset = stream.offset();
+    memory_->Save(&stream, incremental);
+    map->Close(stream.offset());
+    memory_snapshot_path_ = absolute_path;
+    memory_snapshot_offset_ = memory_offset;
+  }
+  XELOGI("Paused for {} ms to save the state",
+         (Clock::QueryHostTickCount() - pause_start_tick_count) * 1000 /
+             Clock::QueryHostTickFrequency());
 
   Resume();
   return true;
 }
 
+bool Emulator::SaveMemoryInBackground(MappedMemory* map, ByteStream& stream) {
+#if XE_PLATFORM_LINUX
+  // Guest memory views are private anonymous mappings on Linux, so the forked
+  // process sees them as they were at the time of the fork, and pages are only
+  // copied when either process writes to them.
+  uint64_t start_tick_count = Clock::QueryHostTickCount();
+  pid_t pid = fork();
+  if (pid < 0) {
+    XELOGE("Failed to fork the process to save the memory in background");
+    return false;
+  }
+  if (!pid) {
+    memory_->SaveFromForkedProcess(&stream);
+    map->Close(stream.offset());
+    // Don't run the exit handlers and the destructors of the parent's state.
+    _exit(0);
+  }
+  background_save_thread_ = std::thread([pid, start_tick_count]() {
+    int status = 0;
+    pid_t result;
+    do {
+      result = waitpid(pid, &status, 0);
+    } while (result < 0 && errno == EINTR);
+    if (result != pid || !WIFEXITED(status) || WEXITSTATUS(status)) {
+      XELOGE("Failed to write the save state memory in background");
+      return;
+    }
+    XELOGI("Wrote the save state memory in background in {} ms",
+           (Clock::QueryHostTickCount() - start_tick_count) * 1000 /
+               Clock::QueryHostTickFrequency());
+  });
+  return true;
+#else
+  return false;
+#endif  // XE_PLATFORM_LINUX
+}
+
+void Emulator::WaitForBackgroundSave() {
+  if (background_save_thread_.joinable()) {
+    background_save_thread_.join();
+  }
+}
+
 bool Emulator::RestoreFromFile(const std::filesystem::path& path) {
+  WaitForBackgroundSave();
+
   // Restore the emulator state from a file
   auto map = MappedMemory::Open(path, MappedMemory::Mode::kReadWrite);
   if (!map) {
@@ -1074,17 +1237,12 @@ bool Emulator::RestoreFromFile(const std::filesystem::path& path) {
 
   auto lock = global_critical_region::AcquireDirect();
   ByteStream stream(map->data(), map->size());
-  if (stream.Read<uint32_t>() != kEmulatorSaveSignature) {
+  SaveStateHeader header;
+  if (!ReadSaveStateHeader(stream, header)) {
     return false;
   }
 
-  auto has_title_id = stream.Read<bool>();
-  std::optional<uint32_t> title_id;
-  if (!has_title_id) {
-    title_id = {};
-  } else {
-    title_id = stream.Read<uint32_t>();
-  }
+  const std::optional<uint32_t>& title_id = header.title_id;
   if (title_id_.has_value() != title_id.has_value() ||
       title_id_.value() != title_id.value()) {
     // Swapping between titles is unsupported at the moment.
@@ -1108,10 +1266,22 @@ bool Emulator::RestoreFromFile(const std::filesystem::path& path) {
     XELOGE("Could not restore kernel state!");
     return false;
   }
-  if (!memory_->Restore(&stream)) {
+  // The memory of an incremental save state is restored on top of the chain
+  // of snapshots it's based on.
+  uint64_t base_snapshot_id = 0;
+  if (!header.base_path.empty() &&
+      !RestoreMemorySnapshot(header.base_path, header.base_memory_offset, 1,
+                             &base_snapshot_id)) {
+    XELOGE("Could not restore the base memory snapshot!");
+    return false;
+  }
+  if (!memory_->Restore(&stream, base_snapshot_id)) {
     XELOGE("Could not restore memory!");
     return false;
   }
+  // Incremental save states can't be based on a restored one, as the memory
+  // has to be saved fully again.
+  memory_snapshot_path_.clear();
 
   // Update the main thread.
   auto threads =
@@ -1131,6 +1301,44 @@ bool Emulator::RestoreFromFile(const std::filesystem::path& path) {
   return true;
 }
 
+bool Emulator::RestoreMemorySnapshot(const std::filesystem::path& path,
+                                     uint64_t memory_offset, uint32_t depth,
+                                     uint64_t* snapshot_id) {
+  // Base snapshots referencing each other.
+  constexpr uint32_t kMaxSnapshotChainLength = 1024;
+  if (depth > kMaxSnapshotChainLength) {
+    XELOGE("Memory snapshot chain is too long");
+    return false;
+  }
+
+  auto map = MappedMemory::Open(path, MappedMemory::Mode::kRead);
+  if (!map) {
+    XELOGE("Could not open the base save state {}", xe::path_to_utf8(path));
+    return false;
+  }
+  ByteStream stream(map->data(), map->size());
+  SaveStateHeader header;
+  if (!ReadSaveStateHeader(stream, header) ||
+      header.title_id != title_id_ || memory_offset >= map->size()) {
+    XELOGE("Invalid base save state {}", xe::path_to_utf8(path));
+    return false;
+  }
+
+  uint64_t base_snapshot_id = 0;
+  if (!header.base_path.empty() &&
+      !RestoreMemorySnapshot(header.base_path, header.base_memory_offset,
+                             depth + 1, &base_snapshot_id)) {
+    return false;
+  }
+  stream.set_offset(size_t(memory_offset));
+  if (!memory_->Restore(&stream, base_snapshot_id, snapshot_id)) {
+    XELOGE("Could not restore the memory of the base save state {}",
+           xe::path_to_utf8(path));
+    return false;
+  }
+  return true;
+}
+
 const std::filesystem::path Emulator::GetNewDiscPath(
     std::string window_message) {
   std::filesystem::path path = "";
@@ -15,6 +15,7 @@
 #include <functional>
 #include <optional>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "xenia/apu/audio_media_player.h"
@@ -31,6 +32,8 @@
 #include "xenia/xbox.h"
 
 namespace xe {
+class ByteStream;
+class MappedMemory;
 namespace apu {
 class AudioSystem;
 }  // namespace apu
@@ -55,6 +58,10 @@ class Window;
 namespace xe {
 
 constexpr fourcc_t kEmulatorSaveSignature = make_fourcc("XSAV");
+// Follows the signature, update if the layout of save states is changed.
+// Save states written before the version was added have a bool there, so the
+// low byte must not be 0 or 1.
+constexpr uint32_t kEmulatorSaveVersion = 0x20241016;
 static const std::string kDefaultGameSymbolicLink = "GAME:";
 static const std::string kDefaultPartitionSymbolicLink = "D:";
 
@@ -283,6 +290,18 @@ class Emulator {
   xe::Delegate<> on_exit;
 
  private:
+  // Writes the memory to the save state in a copy-on-write clone of the
+  // process, so the title can resume without waiting for it. Returns false if
+  // the process couldn't be forked, in which case the memory must be saved
+  // synchronously.
+  bool SaveMemoryInBackground(MappedMemory* map, ByteStream& stream);
+  void WaitForBackgroundSave();
+  // Restores the memory snapshot at memory_offset in the save state, after
+  // the snapshots it's based on if it's incremental, and returns its ID.
+  bool RestoreMemorySnapshot(const std::filesystem::path& path,
+                             uint64_t memory_offset, uint32_t depth,
+                             uint64_t* snapshot_id);
+
   enum : uint64_t { EmulatorFlagDisclaimerAcknowledged = 1ULL << 0 };
   static uint64_t GetPersistentEmulatorFlags();
   static void SetPersistentEmulatorFlags(uint64_t new_flags);
@@ -337,6 +356,14 @@ class Emulator {
   std::optional<uint32_t> title_id_;  // Currently running title ID
   std::unique_ptr<kernel::util::GameInfoDatabase> game_info_database_;
 
+  // Writing the memory of the last save state in a forked process.
+  std::thread background_save_thread_;
+  // Save state with the memory snapshot saved last, which the next incremental
+  // one is based on, and the offset of the snapshot in it. Empty if there's
+  // none, or if the memory has been restored since.
+  std::filesystem::path memory_snapshot_path_;
+  uint64_t memory_snapshot_offset_ = 0;
+
   bool paused_;
   bool restoring_;
   threading::Fence restore_fence_;  // Fired on restore finish.
@@ -40,6 +40,7 @@
 #include "xenia/gpu/dxbc_shader_translator.h"
 #include "xenia/gpu/gpu_flags.h"
 #include "xenia/gpu/registers.h"
+#include "xenia/gpu/shader_storage.h"
 #include "xenia/gpu/xenos.h"
 #include "xenia/ui/d3d12/d3d12_util.h"
 
@@ -362,15 +363,10 @@ void PipelineCache::InitializeShaderStorage(
   }
   ++shader_storage_index_;
   shader_storage_file_flush_needed_ = false;
-  struct {
-    uint32_t magic;
-    uint32_t version_swapped;
-  } shader_storage_file_header;
-  // 'XESH'.
-  const uint32_t shader_storage_magic = 0x48534558;
+  ShaderStorageFileHeader shader_storage_file_header;
   if (fread(&shader_storage_file_header, sizeof(shader_storage_file_header), 1,
             shader_storage_file_) &&
-      shader_storage_file_header.magic == shader_storage_magic &&
+      shader_storage_file_header.magic == kShaderStorageMagic &&
       xe::byte_swap(shader_storage_file_header.version_swapped) ==
           ShaderStoredHeader::kVersion) {
     uint64_t shader_storage_valid_bytes = sizeof(shader_storage_file_header);
@@ -560,7 +556,7 @@ void PipelineCache::InitializeShaderStorage(
                                       shader_storage_valid_bytes);
   } else {
     xe::filesystem::TruncateStdioFile(shader_storage_file_, 0);
-    shader_storage_file_header.magic = shader_storage_magic;
+    shader_storage_file_header.magic = kShaderStorageMagic;
     shader_storage_file_header.version_swapped =
         xe::byte_swap(ShaderStoredHeader::kVersion);
     fwrite(&shader_storage_file_header, sizeof(shader_storage_file_header), 1,
@@ -105,15 +105,6 @@ class PipelineCache {
   }
 
  private:
-  XEPACKEDSTRUCT(ShaderStoredHeader, {
-    uint64_t ucode_data_hash;
-
-    uint32_t ucode_dword_count : 31;
-    xenos::ShaderType type : 1;
-
-    static constexpr uint32_t kVersion = 0x20201219;
-  });
-
   // Update PipelineDescription::kVersion if any of the Pipeline* enums are
   // changed!
 
@@ -12,6 +12,12 @@
 DEFINE_path(trace_gpu_prefix, "scratch/gpu/",
             "Prefix path for GPU trace files.", "GPU");
 DEFINE_bool(trace_gpu_stream, false, "Trace all GPU packets.", "GPU");
+DEFINE_uint32(
+    trace_gpu_buffer_size, 256,
+    "Size of the buffer for GPU trace data waiting to be compressed and "
+    "written to the file by the trace writer thread, in megabytes. The GPU "
+    "command processor waits for the trace writer thread when it's full.",
+    "GPU");
 
 DEFINE_path(
     dump_shaders, "",
@@ -9,50 +9,353 @@
 
 #include "xenia/gpu/null/null_command_processor.h"
 
+#include "xenia/base/clock.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/xxhash.h"
+#include "xenia/gpu/gpu_flags.h"
+#include "xenia/gpu/registers.h"
+
 namespace xe {
 namespace gpu {
 namespace null {
 
 NullCommandProcessor::NullCommandProcessor(NullGraphicsSystem* graphics_system,
                                            kernel::KernelState* kernel_state)
-    : CommandProcessor(graphics_system, kernel_state) {}
+    : CommandProcessor(graphics_system, kernel_state),
+      emulate_frontend_(graphics_system->emulate_frontend()) {}
 NullCommandProcessor::~NullCommandProcessor() = default;
 
+void NullCommandProcessor::ClearCaches() {
+  CommandProcessor::ClearCaches();
+  if (emulate_frontend_) {
+    texture_cache_->ClearCache();
+    shared_memory_->ClearCache();
+  }
+}
+
 void NullCommandProcessor::TracePlaybackWroteMemory(uint32_t base_ptr,
-                                                    uint32_t length) {}
+                                                    uint32_t length) {
+  if (emulate_frontend_) {
+    shared_memory_->MemoryInvalidationCallback(base_ptr, length, true);
+    primitive_processor_->MemoryInvalidationCallback(base_ptr, length, true);
+  }
+}
 
 void NullCommandProcessor::RestoreEdramSnapshot(const void* snapshot) {}
 
 bool NullCommandProcessor::SetupContext() {
-  return CommandProcessor::SetupContext();
+  if (!CommandProcessor::SetupContext()) {
+    return false;
+  }
+  if (!emulate_frontend_) {
+    return true;
+  }
+
+  shared_memory_ = std::make_unique<NullSharedMemory>(*memory_, trace_writer_);
+  if (!shared_memory_->Initialize()) {
+    XELOGE("Failed to initialize shared memory");
+    return false;
+  }
+
+  primitive_processor_ = std::make_unique<NullPrimitiveProcessor>(
+      *register_file_, *memory_, trace_writer_, *shared_memory_);
+  if (!primitive_processor_->Initialize()) {
+    XELOGE("Failed to initialize the geometric primitive processor");
+    return false;
+  }
+
+  texture_cache_ =
+      std::make_unique<NullTextureCache>(*register_file_, *shared_memory_);
+
+  // Translate for a host with all optional features, like a desktop GPU.
+  shader_translator_ = std::make_unique<SpirvShaderTranslator>(
+      SpirvShaderTranslator::Features(true), true, true, false);
+
+  submission_current_ = 1;
+  texture_cache_->BeginSubmission(submission_current_);
+  texture_cache_->BeginFrame();
+  return true;
 }
 
 void NullCommandProcessor::ShutdownContext() {
+  shaders_.clear();
+  shader_translator_.reset();
+  texture_cache_.reset();
+  primitive_processor_.reset();
+  shared_memory_.reset();
   return CommandProcessor::ShutdownContext();
 }
 
+void NullCommandProcessor::WriteRegister(uint32_t index, uint32_t value) {
+  CommandProcessor::WriteRegister(index, value);
+
+  if (index >= XE_GPU_REG_SHADER_CONSTANT_FETCH_00_0 &&
+      index <= XE_GPU_REG_SHADER_CONSTANT_FETCH_31_5) {
+    if (texture_cache_) {
+      texture_cache_->TextureFetchConstantWritten(
+          (index - XE_GPU_REG_SHADER_CONSTANT_FETCH_00_0) / 6);
+    }
+  }
+}
+
 void NullCommandProcessor::IssueSwap(uint32_t frontbuffer_ptr,
                                      uint32_t frontbuffer_width,
-                                     uint32_t frontbuffer_height) {}
+                                     uint32_t frontbuffer_height) {
+  if (!emulate_frontend_) {
+    return;
+  }
+  // Treat every frame as a single submission completed immediately.
+  primitive_processor_->EndFrame();
+  texture_cache_->CompletedSubmissionUpdated(submission_current_);
+  texture_cache_->BeginSubmission(++submission_current_);
+  texture_cache_->BeginFrame();
+}
 
 Shader* NullCommandProcessor::LoadShader(xenos::ShaderType shader_type,
                                          uint32_t guest_address,
                                          const uint32_t* host_address,
                                          uint32_t dword_count) {
-  return nullptr;
+  if (!emulate_frontend_) {
+    return nullptr;
+  }
+  uint64_t data_hash =
+      XXH3_64bits(host_address, dword_count * sizeof(uint32_t));
+  auto it = shaders_.find(data_hash);
+  if (it != shaders_.end()) {
+    return it->second.get();
+  }
+  auto shader = std::make_unique<SpirvShader>(shader_type, data_hash,
+                                              host_address, dword_count);
+  Shader* shader_ptr = shader.get();
+  shaders_.emplace(data_hash, std::move(shader));
+  return shader_ptr;
+}
+
+void NullCommandProcessor::AnalyzeShaderUcode(Shader& shader) {
+  if (shader.is_ucode_analyzed()) {
+    return;
+  }
+  uint64_t start_ticks = Clock::QueryHostTickCount();
+  shader.AnalyzeUcode(ucode_disasm_buffer_);
+  frontend_statistics_.shader_analysis_ticks +=
+      Clock::QueryHostTickCount() - start_ticks;
+}
+
+bool NullCommandProcessor::TranslateShader(SpirvShader& shader,
+                                           uint64_t modification) {
+  Shader::Translation* translation =
+      shader.GetOrCreateTranslation(modification);
+  if (!translation->is_translated()) {
+    uint64_t start_ticks = Clock::QueryHostTickCount();
+    bool translated = shader_translator_->TranslateAnalyzedShader(*translation);
+    frontend_statistics_.shader_translation_ticks +=
+        Clock::QueryHostTickCount() - start_ticks;
+    if (!translated) {
+      XELOGE("Shader {:016X} translation failed; marking as ignored",
+             shader.ucode_data_hash());
+      return false;
+    }
+  }
+  return translation->is_valid();
 }
 
 bool NullCommandProcessor::IssueDraw(xenos::PrimitiveType prim_type,
                                      uint32_t index_count,
                                      IndexBufferInfo* index_buffer_info,
                                      bool major_mode_explicit) {
-  return true;
+  if (!emulate_frontend_) {
+    return true;
+  }
+
+  const RegisterFile& regs = *register_file_;
+
+  xenos::ModeControl edram_mode = regs.Get<reg::RB_MODECONTROL>().edram_mode;
+  if (edram_mode == xenos::ModeControl::kCopy) {
+    // Special copy handling.
+    return IssueCopy();
+  }
+
+  ++frontend_statistics_.draw_count;
+  memexport_ranges_.clear();
+
+  // Vertex shader analysis.
+  auto vertex_shader = static_cast<SpirvShader*>(active_vertex_shader());
+  if (!vertex_shader) {
+    // Always need a vertex shader.
+    return false;
+  }
+  AnalyzeShaderUcode(*vertex_shader);
+  if (vertex_shader->memexport_eM_written() != 0) {
+    draw_util::AddMemExportRanges(regs, *vertex_shader, memexport_ranges_);
+  }
+
+  // Pixel shader analysis.
+  bool primitive_polygonal = draw_util::IsPrimitivePolygonal(regs);
+  bool is_rasterization_done =
+      draw_util::IsRasterizationPotentiallyDone(regs, primitive_polygonal);
+  SpirvShader* pixel_shader = nullptr;
+  if (is_rasterization_done) {
+    // See xenos::ModeControl for explanation why the pixel shader is only used
+    // when it's kColorDepth here.
+    if (edram_mode == xenos::ModeControl::kColorDepth) {
+      pixel_shader = static_cast<SpirvShader*>(active_pixel_shader());
+      if (pixel_shader) {
+        AnalyzeShaderUcode(*pixel_shader);
+        if (!draw_util::IsPixelShaderNeededWithRasterization(*pixel_shader,
+                                                             regs)) {
+          pixel_shader = nullptr;
+        }
+      }
+    }
+  } else {
+    if (memexport_ranges_.empty()) {
+      // This draw has no effect.
+      return true;
+    }
+  }
+  if (pixel_shader && pixel_shader->memexport_eM_written() != 0) {
+    draw_util::AddMemExportRanges(regs, *pixel_shader, memexport_ranges_);
+  }
+
+  uint32_t ps_param_gen_pos = UINT32_MAX;
+  uint32_t interpolator_mask =
+      pixel_shader ? (vertex_shader->writes_interpolators() &
+                      pixel_shader->GetInterpolatorInputMask(
+                          regs.Get<reg::SQ_PROGRAM_CNTL>(),
+                          regs.Get<reg::SQ_CONTEXT_MISC>(), ps_param_gen_pos))
+                   : 0;
+
+  // Process primitives.
+  PrimitiveProcessor::ProcessingResult primitive_processing_result;
+  uint64_t primitive_processing_start_ticks = Clock::QueryHostTickCount();
+  bool primitives_processed =
+      primitive_processor_->Process(primitive_processing_result);
+  frontend_statistics_.primitive_processing_ticks +=
+      Clock::QueryHostTickCount() - primitive_processing_start_ticks;
+  if (!primitives_processed) {
+    return false;
+  }
+  if (!primitive_processing_result.host_draw_vertex_count) {
+    // Nothing to draw.
+    return true;
+  }
+
+  // Translate the shaders with the modifications a host backend would use.
+  auto sq_program_cntl = regs.Get<reg::SQ_PROGRAM_CNTL>();
+  SpirvShaderTranslator::Modification vertex_shader_modification(
+      shader_translator_->GetDefaultVertexShaderModification(
+          vertex_shader->GetDynamicAddressableRegisterCount(
+              sq_program_cntl.vs_num_reg),
+          primitive_processing_result.host_vertex_shader_type));
+  vertex_shader_modification.vertex.interpolator_mask = interpolator_mask;
+  if (!TranslateShader(*vertex_shader, vertex_shader_modification.value)) {
+    return false;
+  }
+  if (pixel_shader) {
+    SpirvShaderTranslator::Modification pixel_shader_modification(
+        shader_translator_->GetDefaultPixelShaderModification(
+            pixel_shader->GetDynamicAddressableRegisterCount(
+                sq_program_cntl.ps_num_reg)));
+    pixel_shader_modification.pixel.interpolator_mask = interpolator_mask;
+    if (ps_param_gen_pos < xenos::kMaxInterpolators) {
+      pixel_shader_modification.pixel.param_gen_enable = 1;
+      pixel_shader_modification.pixel.param_gen_interpolator = ps_param_gen_pos;
+      pixel_shader_modification.pixel.param_gen_point =
+          uint32_t(prim_type == xenos::PrimitiveType::kPointList);
+    }
+    if (!TranslateShader(*pixel_shader, pixel_shader_modification.value)) {
+      return false;
+    }
+  }
+
+  // Textures.
+  uint64_t texture_start_ticks = Clock::QueryHostTickCount();
+  texture_cache_->RequestTextures(
+      vertex_shader->GetUsedTextureMaskAfterTranslation() |
+      (pixel_shader != nullptr
+           ? pixel_shader->GetUsedTextureMaskAfterTranslation()
+           : 0));
+  frontend_statistics_.texture_ticks +=
+      Clock::QueryHostTickCount() - texture_start_ticks;
+
+  // Vertex buffers and memory export streams.
+  uint64_t shared_memory_start_ticks = Clock::QueryHostTickCount();
+  bool shared_memory_requested = true;
+  uint64_t vertex_buffers_resident[2] = {};
+  for (const Shader::VertexBinding& vertex_binding :
+       vertex_shader->vertex_bindings()) {
+    uint32_t vfetch_index = vertex_binding.fetch_constant;
+    if (vertex_buffers_resident[vfetch_index >> 6] &
+        (uint64_t(1) << (vfetch_index & 63))) {
+      continue;
+    }
+    xenos::xe_gpu_vertex_fetch_t vfetch_constant =
+        regs.GetVertexFetch(vfetch_index);
+    if (vfetch_constant.type != xenos::FetchConstantType::kVertex &&
+        (vfetch_constant.type != xenos::FetchConstantType::kInvalidVertex ||
+         !cvars::gpu_allow_invalid_fetch_constants)) {
+      shared_memory_requested = false;
+      break;
+    }
+    if (!shared_memory_->RequestRange(vfetch_constant.address << 2,
+                                      vfetch_constant.size << 2)) {
+      shared_memory_requested = false;
+      break;
+    }
+    vertex_buffers_resident[vfetch_index >> 6] |= uint64_t(1)
+                                                  << (vfetch_index & 63);
+  }
+  if (shared_memory_requested) {
+    for (const draw_util::MemExportRange& memexport_range :
+         memexport_ranges_) {
+      uint32_t memexport_range_base_bytes = memexport_range.base_address_dwords
+                                            << 2;
+      if (!shared_memory_->RequestRange(memexport_range_base_bytes,
+                                        memexport_range.size_bytes)) {
+        shared_memory_requested = false;
+        break;
+      }
+      shared_memory_->RangeWrittenByGpu(memexport_range_base_bytes,
+                                        memexport_range.size_bytes, false);
+    }
+  }
+  frontend_statistics_.shared_memory_ticks +=
+      Clock::QueryHostTickCount() - shared_memory_start_ticks;
+  return shared_memory_requested;
 }
 
-bool NullCommandProcessor::IssueCopy() { return true; }
+bool NullCommandProcessor::IssueCopy() {
+  if (!emulate_frontend_) {
+    return true;
+  }
+
+  ++frontend_statistics_.copy_count;
+  uint64_t start_ticks = Clock::QueryHostTickCount();
+  draw_util::ResolveInfo resolve_info;
+  bool resolved = draw_util::GetResolveInfo(
+      *register_file_, *memory_, trace_writer_, 1, 1, false, false,
+      resolve_info);
+  if (resolved && resolve_info.coordinate_info.width_div_8 &&
+      resolve_info.height_div_8 && resolve_info.copy_dest_extent_length) {
+    resolved =
+        shared_memory_->RequestRange(resolve_info.copy_dest_extent_start,
+                                     resolve_info.copy_dest_extent_length);
+    if (resolved) {
+      shared_memory_->RangeWrittenByGpu(resolve_info.copy_dest_extent_start,
+                                        resolve_info.copy_dest_extent_length,
+                                        true);
+      texture_cache_->MarkRangeAsResolved(
+          resolve_info.copy_dest_extent_start,
+          resolve_info.copy_dest_extent_length);
+    }
+  }
+  frontend_statistics_.resolve_ticks +=
+      Clock::QueryHostTickCount() - start_ticks;
+  return resolved;
+}
 
 void NullCommandProcessor::InitializeTrace() {}
 
 }  // namespace null
 }  // namespace gpu
-}  // namespace xe
\ No newline at end of file
+}  // namespace xe
@@ -10,8 +10,20 @@
 #ifndef XENIA_GPU_NULL_NULL_COMMAND_PROCESSOR_H_
 #define XENIA_GPU_NULL_NULL_COMMAND_PROCESSOR_H_
 
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "xenia/base/string_buffer.h"
 #include "xenia/gpu/command_processor.h"
+#include "xenia/gpu/draw_util.h"
 #include "xenia/gpu/null/null_graphics_system.h"
+#include "xenia/gpu/null/null_primitive_processor.h"
+#include "xenia/gpu/null/null_shared_memory.h"
+#include "xenia/gpu/null/null_texture_cache.h"
+#include "xenia/gpu/spirv_shader.h"
+#include "xenia/gpu/spirv_shader_translator.h"
 #include "xenia/gpu/xenos.h"
 #include "xenia/kernel/kernel_state.h"
 
@@ -21,18 +33,42 @@ namespace null {
 
 class NullCommandProcessor : public CommandProcessor {
  public:
+  // CPU time spent in the GPU frontend subsystems when emulating the frontend,
+  // in host ticks (see Clock::QueryHostTickFrequency).
+  struct FrontendStatistics {
+    uint64_t draw_count = 0;
+    uint64_t copy_count = 0;
+    uint64_t primitive_processing_ticks = 0;
+    uint64_t shader_analysis_ticks = 0;
+    uint64_t shader_translation_ticks = 0;
+    uint64_t texture_ticks = 0;
+    uint64_t shared_memory_ticks = 0;
+    uint64_t resolve_ticks = 0;
+  };
+
   NullCommandProcessor(NullGraphicsSystem* graphics_system,
                        kernel::KernelState* kernel_state);
   ~NullCommandProcessor();
 
+  void ClearCaches() override;
+
   void TracePlaybackWroteMemory(uint32_t base_ptr, uint32_t length) override;
 
   void RestoreEdramSnapshot(const void* snapshot) override;
 
+  // Must be accessed only while the command processor thread isn't executing
+  // anything, such as while trace playback is awaited.
+  const FrontendStatistics& frontend_statistics() const {
+    return frontend_statistics_;
+  }
+  void ResetFrontendStatistics() { frontend_statistics_ = {}; }
+
  private:
   bool SetupContext() override;
   void ShutdownContext() override;
 
+  void WriteRegister(uint32_t index, uint32_t value) override;
+
   void IssueSwap(uint32_t frontbuffer_ptr, uint32_t frontbuffer_width,
                  uint32_t frontbuffer_height) override;
 
@@ -46,10 +82,27 @@ class NullCommandProcessor : public CommandProcessor {
   bool IssueCopy() override;
 
   void InitializeTrace() override;
+
+  void AnalyzeShaderUcode(Shader& shader);
+  bool TranslateShader(SpirvShader& shader, uint64_t modification);
+
+  bool emulate_frontend_;
+
+  // Only created when emulating the frontend.
+  std::unique_ptr<NullSharedMemory> shared_memory_;
+  std::unique_ptr<NullPrimitiveProcessor> primitive_processor_;
+  std::unique_ptr<NullTextureCache> texture_cache_;
+  std::unique_ptr<SpirvShaderTranslator> shader_translator_;
+  std::unordered_map<uint64_t, std::unique_ptr<SpirvShader>> shaders_;
+  StringBuffer ucode_disasm_buffer_;
+  std::vector<draw_util::MemExportRange> memexport_ranges_;
+  uint64_t submission_current_ = 1;
+
+  FrontendStatistics frontend_statistics_;
 };
 
 }  // namespace null
 }  // namespace gpu
 }  // namespace xe
 
-#endif  // XENIA_GPU_NULL_NULL_COMMAND_PROCESSOR_H_
\ No newline at end of file
+#endif  // XENIA_GPU_NULL_NULL_COMMAND_PROCESSOR_H_
@@ -17,7 +17,8 @@ namespace xe {
 namespace gpu {
 namespace null {
 
-NullGraphicsSystem::NullGraphicsSystem() {}
+NullGraphicsSystem::NullGraphicsSystem(bool emulate_frontend)
+    : emulate_frontend_(emulate_frontend) {}
 
 NullGraphicsSystem::~NullGraphicsSystem() {}
 
@@ -27,7 +28,10 @@ X_STATUS NullGraphicsSystem::Setup(cpu::Processor* processor,
                                    bool is_surface_required) {
   // This is a null graphics system, but we still setup vulkan because UI needs
   // it through us :|
-  provider_ = xe::ui::vulkan::VulkanProvider::Create(is_surface_required);
+  // Not needed for headless frontend emulation, which must work without a GPU.
+  if (!emulate_frontend_) {
+    provider_ = xe::ui::vulkan::VulkanProvider::Create(is_surface_required);
+  }
   return GraphicsSystem::Setup(processor, kernel_state, app_context,
                                is_surface_required);
 }
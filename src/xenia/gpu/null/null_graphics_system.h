@@ -21,19 +21,27 @@ namespace null {
 
 class NullGraphicsSystem : public GraphicsSystem {
  public:
-  NullGraphicsSystem();
+  // If emulate_frontend is true, the command processor runs the host-agnostic
+  // parts of the GPU emulation (primitive processing, shader translation, the
+  // texture cache and the shared memory) without creating any host GPU
+  // objects, and no host GPU is required at all.
+  explicit NullGraphicsSystem(bool emulate_frontend = false);
   ~NullGraphicsSystem() override;
 
   static bool IsAvailable() { return true; }
 
   std::string name() const override { return "null"; }
 
+  bool emulate_frontend() const { return emulate_frontend_; }
+
   X_STATUS Setup(cpu::Processor* processor, kernel::KernelState* kernel_state,
                  ui::WindowedAppContext* app_context,
                  bool is_surface_required) override;
 
  private:
   std::unique_ptr<CommandProcessor> CreateCommandProcessor() override;
+
+  bool emulate_frontend_;
 };
 
 }  // namespace null
@@ -0,0 +1,71 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/gpu/null/null_primitive_processor.h"
+
+#include "xenia/base/assert.h"
+
+namespace xe {
+namespace gpu {
+namespace null {
+
+NullPrimitiveProcessor::~NullPrimitiveProcessor() { Shutdown(true); }
+
+bool NullPrimitiveProcessor::Initialize() {
+  if (!InitializeCommon(true, true, false, false, false, false)) {
+    Shutdown();
+    return false;
+  }
+  return true;
+}
+
+void NullPrimitiveProcessor::Shutdown(bool from_destructor) {
+  frame_index_buffers_.clear();
+  builtin_index_buffer_.reset();
+  if (!from_destructor) {
+    ShutdownCommon();
+  }
+}
+
+void NullPrimitiveProcessor::EndFrame() {
+  ClearPerFrameCache();
+  frame_index_buffers_.clear();
+}
+
+bool NullPrimitiveProcessor::InitializeBuiltinIndexBuffer(
+    size_t size_bytes, std::function<void(void*)> fill_callback) {
+  assert_not_zero(size_bytes);
+  assert_null(builtin_index_buffer_);
+  builtin_index_buffer_ = std::make_unique<uint8_t[]>(size_bytes);
+  fill_callback(builtin_index_buffer_.get());
+  return true;
+}
+
+void* NullPrimitiveProcessor::RequestHostConvertedIndexBufferForCurrentFrame(
+    xenos::IndexFormat format, uint32_t index_count, bool coalign_for_simd,
+    uint32_t coalignment_original_address, size_t& backend_handle_out) {
+  size_t index_size = format == xenos::IndexFormat::kInt16 ? sizeof(uint16_t)
+                                                           : sizeof(uint32_t);
+  uint8_t* mapping =
+      frame_index_buffers_
+          .emplace_back(std::make_unique<uint8_t[]>(
+              index_size * index_count +
+              (coalign_for_simd ? XE_GPU_PRIMITIVE_PROCESSOR_SIMD_SIZE : 0)))
+          .get();
+  if (coalign_for_simd) {
+    mapping +=
+        GetSimdCoalignmentOffset(mapping, coalignment_original_address);
+  }
+  backend_handle_out = frame_index_buffers_.size() - 1;
+  return mapping;
+}
+
+}  // namespace null
+}  // namespace gpu
+}  // namespace xe
@@ -0,0 +1,59 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_GPU_NULL_NULL_PRIMITIVE_PROCESSOR_H_
+#define XENIA_GPU_NULL_NULL_PRIMITIVE_PROCESSOR_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "xenia/gpu/primitive_processor.h"
+
+namespace xe {
+namespace gpu {
+namespace null {
+
+// Primitive processor converting indices into host memory that is discarded at
+// the end of the frame, reporting the capabilities of a typical host GPU (like
+// Vulkan without geometry shaders) so the same conversion paths are taken.
+class NullPrimitiveProcessor final : public PrimitiveProcessor {
+ public:
+  NullPrimitiveProcessor(const RegisterFile& register_file, Memory& memory,
+                         TraceWriter& trace_writer,
+                         SharedMemory& shared_memory)
+      : PrimitiveProcessor(register_file, memory, trace_writer,
+                           shared_memory) {}
+  ~NullPrimitiveProcessor();
+
+  bool Initialize();
+  void Shutdown(bool from_destructor = false);
+
+  void EndFrame();
+
+ protected:
+  bool InitializeBuiltinIndexBuffer(
+      size_t size_bytes, std::function<void(void*)> fill_callback) override;
+  void* RequestHostConvertedIndexBufferForCurrentFrame(
+      xenos::IndexFormat format, uint32_t index_count, bool coalign_for_simd,
+      uint32_t coalignment_original_address,
+      size_t& backend_handle_out) override;
+
+ private:
+  std::unique_ptr<uint8_t[]> builtin_index_buffer_;
+  std::vector<std::unique_ptr<uint8_t[]>> frame_index_buffers_;
+};
+
+}  // namespace null
+}  // namespace gpu
+}  // namespace xe
+
+#endif  // XENIA_GPU_NULL_NULL_PRIMITIVE_PROCESSOR_H_
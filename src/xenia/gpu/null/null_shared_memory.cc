@@ -0,0 +1,52 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/gpu/null/null_shared_memory.h"
+
+namespace xe {
+namespace gpu {
+namespace null {
+
+NullSharedMemory::NullSharedMemory(Memory& memory, TraceWriter& trace_writer)
+    : SharedMemory(memory), trace_writer_(trace_writer) {}
+
+NullSharedMemory::~NullSharedMemory() { Shutdown(true); }
+
+bool NullSharedMemory::Initialize() {
+  InitializeCommon();
+  uploaded_bytes_ = 0;
+  return true;
+}
+
+void NullSharedMemory::Shutdown(bool from_destructor) {
+  // If calling from the destructor, the SharedMemory destructor will call
+  // ShutdownCommon.
+  if (!from_destructor) {
+    ShutdownCommon();
+  }
+}
+
+bool NullSharedMemory::UploadRanges(
+    const std::pair<uint32_t, uint32_t>* upload_page_ranges,
+    uint32_t num_upload_ranges) {
+  for (uint32_t i = 0; i < num_upload_ranges; ++i) {
+    uint32_t upload_range_start = upload_page_ranges[i].first
+                                  << page_size_log2();
+    uint32_t upload_range_length = upload_page_ranges[i].second
+                                   << page_size_log2();
+    trace_writer_.WriteMemoryRead(upload_range_start, upload_range_length);
+    MakeRangeValid(upload_range_start, upload_range_length, false, false);
+    uploaded_bytes_ += upload_range_length;
+  }
+  return true;
+}
+
+}  // namespace null
+}  // namespace gpu
+}  // namespace xe
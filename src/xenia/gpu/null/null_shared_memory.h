@@ -0,0 +1,51 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_GPU_NULL_NULL_SHARED_MEMORY_H_
+#define XENIA_GPU_NULL_NULL_SHARED_MEMORY_H_
+
+#include <cstdint>
+#include <utility>
+
+#include "xenia/gpu/shared_memory.h"
+#include "xenia/gpu/trace_writer.h"
+#include "xenia/memory.h"
+
+namespace xe {
+namespace gpu {
+namespace null {
+
+// Shared memory without a host GPU buffer - only performs the page validity
+// and watch bookkeeping of the common implementation, for measuring its CPU
+// cost without a host GPU.
+class NullSharedMemory : public SharedMemory {
+ public:
+  NullSharedMemory(Memory& memory, TraceWriter& trace_writer);
+  ~NullSharedMemory() override;
+
+  bool Initialize();
+  void Shutdown(bool from_destructor = false);
+
+  // Total number of bytes that would have been uploaded to the host GPU.
+  uint64_t uploaded_bytes() const { return uploaded_bytes_; }
+
+ protected:
+  bool UploadRanges(const std::pair<uint32_t, uint32_t>* upload_page_ranges,
+                    uint32_t num_upload_ranges) override;
+
+ private:
+  TraceWriter& trace_writer_;
+  uint64_t uploaded_bytes_ = 0;
+};
+
+}  // namespace null
+}  // namespace gpu
+}  // namespace xe
+
+#endif  // XENIA_GPU_NULL_NULL_SHARED_MEMORY_H_
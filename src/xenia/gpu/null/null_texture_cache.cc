@@ -0,0 +1,83 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/gpu/null/null_texture_cache.h"
+
+#include "xenia/base/assert.h"
+#include "xenia/gpu/xenos.h"
+
+namespace xe {
+namespace gpu {
+namespace null {
+
+NullTextureCache::~NullTextureCache() {
+  // While the texture objects are still alive and may reference this cache.
+  DestroyAllTextures(true);
+}
+
+uint32_t NullTextureCache::GetHostFormatSwizzle(TextureKey key) const {
+  return xenos::XE_GPU_TEXTURE_SWIZZLE_RGBA;
+}
+
+uint32_t NullTextureCache::GetMaxHostTextureWidthHeight(
+    xenos::DataDimension dimension) const {
+  // Report the limits of the guest so no texture is rejected by the host.
+  switch (dimension) {
+    case xenos::DataDimension::k1D:
+    case xenos::DataDimension::k2DOrStacked:
+      return xenos::kTexture2DCubeMaxWidthHeight;
+    case xenos::DataDimension::k3D:
+      return xenos::kTexture3DMaxWidthHeight;
+    case xenos::DataDimension::kCube:
+      return xenos::kTexture2DCubeMaxWidthHeight;
+    default:
+      assert_unhandled_case(dimension);
+      return 0;
+  }
+}
+
+uint32_t NullTextureCache::GetMaxHostTextureDepthOrArraySize(
+    xenos::DataDimension dimension) const {
+  switch (dimension) {
+    case xenos::DataDimension::k1D:
+    case xenos::DataDimension::k2DOrStacked:
+      return xenos::kTexture2DMaxStackDepth;
+    case xenos::DataDimension::k3D:
+      return xenos::kTexture3DMaxDepth;
+    case xenos::DataDimension::kCube:
+      return 6;
+    default:
+      assert_unhandled_case(dimension);
+      return 0;
+  }
+}
+
+std::unique_ptr<TextureCache::Texture> NullTextureCache::CreateTexture(
+    TextureKey key) {
+  return std::unique_ptr<Texture>(new NullTexture(*this, key));
+}
+
+bool NullTextureCache::LoadTextureDataFromResidentMemoryImpl(Texture& texture,
+                                                             bool load_base,
+                                                             bool load_mips) {
+  ++texture_load_count_;
+  return true;
+}
+
+NullTextureCache::NullTexture::NullTexture(NullTextureCache& texture_cache,
+                                           const TextureKey& key)
+    : Texture(texture_cache, key) {
+  // Account for the guest size so the memory limits of the texture cache
+  // behave like on a real host.
+  SetHostMemoryUsage(GetGuestBaseSize() + GetGuestMipsSize());
+}
+
+}  // namespace null
+}  // namespace gpu
+}  // namespace xe
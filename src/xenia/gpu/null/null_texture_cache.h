@@ -0,0 +1,62 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_GPU_NULL_NULL_TEXTURE_CACHE_H_
+#define XENIA_GPU_NULL_NULL_TEXTURE_CACHE_H_
+
+#include <cstdint>
+#include <memory>
+
+#include "xenia/gpu/texture_cache.h"
+
+namespace xe {
+namespace gpu {
+namespace null {
+
+// Texture cache performing the key building, binding and invalidation logic of
+// the common implementation, but not creating any host textures or loading
+// anything into them.
+class NullTextureCache final : public TextureCache {
+ public:
+  NullTextureCache(const RegisterFile& register_file,
+                   SharedMemory& shared_memory)
+      : TextureCache(register_file, shared_memory, 1, 1) {}
+  ~NullTextureCache();
+
+  // Number of texture loads that would have been done on the host GPU.
+  uint64_t texture_load_count() const { return texture_load_count_; }
+
+ protected:
+  uint32_t GetHostFormatSwizzle(TextureKey key) const override;
+
+  uint32_t GetMaxHostTextureWidthHeight(
+      xenos::DataDimension dimension) const override;
+  uint32_t GetMaxHostTextureDepthOrArraySize(
+      xenos::DataDimension dimension) const override;
+
+  std::unique_ptr<Texture> CreateTexture(TextureKey key) override;
+
+  bool LoadTextureDataFromResidentMemoryImpl(Texture& texture, bool load_base,
+                                             bool load_mips) override;
+
+ private:
+  class NullTexture final : public Texture {
+   public:
+    explicit NullTexture(NullTextureCache& texture_cache,
+                         const TextureKey& key);
+  };
+
+  uint64_t texture_load_count_ = 0;
+};
+
+}  // namespace null
+}  // namespace gpu
+}  // namespace xe
+
+#endif  // XENIA_GPU_NULL_NULL_TEXTURE_CACHE_H_
@@ -0,0 +1,359 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "third_party/fmt/include/fmt/format.h"
+#include "xenia/base/clock.h"
+#include "xenia/base/console_app_main.h"
+#include "xenia/base/cvar.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/platform.h"
+#include "xenia/base/string.h"
+#include "xenia/emulator.h"
+#include "xenia/gpu/null/null_command_processor.h"
+#include "xenia/gpu/null/null_graphics_system.h"
+#include "xenia/gpu/packet_disassembler.h"
+#include "xenia/gpu/trace_player.h"
+#include "xenia/gpu/trace_protocol.h"
+#include "xenia/xbox.h"
+
+DECLARE_path(target_trace_file);
+
+DEFINE_uint32(trace_benchmark_iterations, 1,
+              "Number of times to play the whole trace in the headless trace "
+              "benchmark.",
+              "GPU");
+DEFINE_path(trace_benchmark_csv_path, "",
+            "Output path for per-frame timings of the headless trace benchmark "
+            "in CSV format, one row per frame, category and name.",
+            "GPU");
+
+namespace xe {
+namespace gpu {
+namespace null {
+
+// Replays a GPU trace through the GPU frontend emulation (command processor,
+// primitive processor, shader analysis and translation, texture cache and
+// shared memory bookkeeping) on the null graphics system, without a host GPU,
+// and reports the CPU time spent per frame, by packet type and by subsystem.
+class NullTraceBenchmark {
+ public:
+  int Main(const std::vector<std::string>& args);
+
+ private:
+  struct Timing {
+    uint64_t count = 0;
+    uint64_t ticks = 0;
+  };
+  // Ordered by name for stable output.
+  using TimingMap = std::map<std::string, Timing>;
+
+  bool Setup(const std::filesystem::path& trace_file_path);
+  void OnCommandPlayed(TraceCommandType type, const uint8_t* command_ptr,
+                       uint64_t host_ticks);
+  const std::string& GetPacketTypeName(const uint8_t* packet_ptr);
+  void AddSubsystemTimings(
+      const NullCommandProcessor::FrontendStatistics& statistics);
+  void ReportFrame(uint32_t iteration, int frame_index);
+  void ReportTotals(uint32_t frames_played) const;
+  double TicksToMilliseconds(uint64_t ticks) const {
+    return double(ticks) * 1000.0 / double(tick_frequency_);
+  }
+
+  std::unique_ptr<Emulator> emulator_;
+  NullCommandProcessor* command_processor_ = nullptr;
+  std::unique_ptr<TracePlayer> player_;
+  uint64_t tick_frequency_ = 1;
+
+  // The packet data of the packet last started, executed on its end.
+  const uint8_t* pending_packet_ = nullptr;
+  std::map<uint32_t, std::string> packet_type_names_;
+
+  TimingMap frame_packet_timings_;
+  TimingMap frame_subsystem_timings_;
+  uint64_t frame_ticks_ = 0;
+  TimingMap total_packet_timings_;
+  TimingMap total_subsystem_timings_;
+  uint64_t total_ticks_ = 0;
+  uint64_t max_frame_ticks_ = 0;
+
+  FILE* csv_file_ = nullptr;
+};
+
+int NullTraceBenchmark::Main(const std::vector<std::string>& args) {
+  // The host CPU features select the code paths of the GPU frontend, such as
+  // the primitive processor's, which must be the same as in the emulator.
+#if XE_ARCH_AMD64 == 1
+  amd64::InitFeatureFlags();
+#endif
+
+  std::filesystem::path path;
+  if (!cvars::target_trace_file.empty()) {
+    path = cvars::target_trace_file;
+  } else if (args.size() >= 2) {
+    path = xe::to_path(args[1]);
+  }
+  if (path.empty()) {
+    XELOGE("No trace file specified");
+    return 5;
+  }
+  auto abs_path = std::filesystem::absolute(path);
+  XELOGI("Loading trace file {}...", abs_path);
+
+  if (!Setup(abs_path)) {
+    return 4;
+  }
+
+  if (!cvars::trace_benchmark_csv_path.empty()) {
+    xe::filesystem::CreateParentFolder(cvars::trace_benchmark_csv_path);
+    csv_file_ = xe::filesystem::OpenFile(cvars::trace_benchmark_csv_path, "w");
+    if (!csv_file_) {
+      XELOGE("Failed to open {} for writing",
+             cvars::trace_benchmark_csv_path);
+    } else {
+      std::fputs("iteration,frame,category,name,count,milliseconds\n",
+                 csv_file_);
+    }
+  }
+
+  tick_frequency_ = std::max(Clock::QueryHostTickFrequency(), uint64_t(1));
+  player_->set_command_played_callback(
+      [this](TraceCommandType type, const uint8_t* command_ptr,
+             uint64_t host_ticks) {
+        OnCommandPlayed(type, command_ptr, host_ticks);
+      });
+
+  int frame_count = player_->frame_count();
+  uint32_t iterations = std::max(cvars::trace_benchmark_iterations, 1u);
+  uint32_t frames_played = 0;
+  for (uint32_t iteration = 0; iteration < iterations; ++iteration) {
+    for (int frame_index = 0; frame_index < frame_count; ++frame_index) {
+      command_processor_->ResetFrontendStatistics();
+      player_->PlayFrame(frame_index);
+      player_->WaitOnPlayback();
+      AddSubsystemTimings(command_processor_->frontend_statistics());
+      ReportFrame(iteration, frame_index);
+      ++frames_played;
+    }
+  }
+
+  ReportTotals(frames_played);
+
+  if (csv_file_) {
+    std::fclose(csv_file_);
+    csv_file_ = nullptr;
+  }
+  player_.reset();
+  emulator_.reset();
+  return 0;
+}
+
+bool NullTraceBenchmark::Setup(const std::filesystem::path& trace_file_path) {
+  emulator_ = std::make_unique<Emulator>("", "", "", "");
+  X_STATUS result = emulator_->Setup(
+      nullptr, nullptr, false, nullptr,
+      []() -> std::unique_ptr<gpu::GraphicsSystem> {
+        return std::make_unique<NullGraphicsSystem>(true);
+      },
+      nullptr);
+  if (XFAILED(result)) {
+    XELOGE("Failed to setup emulator: {:08X}", result);
+    return false;
+  }
+  GraphicsSystem* graphics_system = emulator_->graphics_system();
+  command_processor_ =
+      static_cast<NullCommandProcessor*>(graphics_system->command_processor());
+  player_ = std::make_unique<TracePlayer>(graphics_system);
+  if (!player_->Open(xe::path_to_utf8(trace_file_path))) {
+    XELOGE("Could not load trace file");
+    return false;
+  }
+  return true;
+}
+
+void NullTraceBenchmark::OnCommandPlayed(TraceCommandType type,
+                                         const uint8_t* command_ptr,
+                                         uint64_t host_ticks) {
+  const char* name;
+  switch (type) {
+    case TraceCommandType::kPacketStart:
+      // Copying the packet to the guest memory - attributed to the packet.
+      pending_packet_ = command_ptr + sizeof(PacketStartCommand);
+      name = nullptr;
+      break;
+    case TraceCommandType::kPacketEnd:
+      if (!pending_packet_) {
+        return;
+      }
+      name = nullptr;
+      break;
+    case TraceCommandType::kPrimaryBufferStart:
+    case TraceCommandType::kPrimaryBufferEnd:
+    case TraceCommandType::kIndirectBufferStart:
+    case TraceCommandType::kIndirectBufferEnd:
+      name = "Buffer markers";
+      break;
+    case TraceCommandType::kMemoryRead:
+    case TraceCommandType::kMemoryReadReference:
+      name = "Memory read";
+      break;
+    case TraceCommandType::kMemoryWrite:
+      name = "Memory write";
+      break;
+    case TraceCommandType::kEdramSnapshot:
+      name = "EDRAM snapshot";
+      break;
+    case TraceCommandType::kEvent:
+      name = "Event";
+      break;
+    case TraceCommandType::kRegisters:
+      name = "Register restore";
+      break;
+    case TraceCommandType::kGammaRamp:
+      name = "Gamma ramp";
+      break;
+    default:
+      name = "Unknown";
+      break;
+  }
+  Timing& timing = name ? frame_packet_timings_[name]
+                        : frame_packet_timings_[GetPacketTypeName(
+                              pending_packet_)];
+  if (type != TraceCommandType::kPacketStart) {
+    ++timing.count;
+  }
+  timing.ticks += host_ticks;
+  frame_ticks_ += host_ticks;
+  if (type == TraceCommandType::kPacketEnd) {
+    pending_packet_ = nullptr;
+  }
+}
+
+const std::string& NullTraceBenchmark::GetPacketTypeName(
+    const uint8_t* packet_ptr) {
+  uint32_t packet = xe::load_and_swap<uint32_t>(packet_ptr);
+  uint32_t packet_type = packet >> 30;
+  uint32_t key = packet_type << 8;
+  if (packet_type == 3) {
+    key |= (packet >> 8) & 0x7F;
+  }
+  auto it = packet_type_names_.find(key);
+  if (it != packet_type_names_.end()) {
+    return it->second;
+  }
+  PacketInfo packet_info = {};
+  std::string name;
+  if (PacketDisassembler::DisasmPacket(packet_ptr, &packet_info) &&
+      packet_info.type_info) {
+    name = packet_info.type_info->name;
+  } else {
+    name = fmt::format("PM4_TYPE{}_{:02X}", packet_type, key & 0xFF);
+  }
+  return packet_type_names_.emplace(key, std::move(name)).first->second;
+}
+
+void NullTraceBenchmark::AddSubsystemTimings(
+    const NullCommandProcessor::FrontendStatistics& statistics) {
+  auto add = [this](const char* name, uint64_t count, uint64_t ticks) {
+    Timing& timing = frame_subsystem_timings_[name];
+    timing.count += count;
+    timing.ticks += ticks;
+  };
+  add("Primitive processing", statistics.draw_count,
+      statistics.primitive_processing_ticks);
+  add("Shader analysis", 0, statistics.shader_analysis_ticks);
+  add("Shader translation", 0, statistics.shader_translation_ticks);
+  add("Textures", statistics.draw_count, statistics.texture_ticks);
+  add("Shared memory", statistics.draw_count, statistics.shared_memory_ticks);
+  add("Resolves", statistics.copy_count, statistics.resolve_ticks);
+}
+
+void NullTraceBenchmark::ReportFrame(uint32_t iteration, int frame_index) {
+  uint64_t draw_count = frame_subsystem_timings_["Primitive processing"].count;
+  uint64_t copy_count = frame_subsystem_timings_["Resolves"].count;
+  XELOGI("Frame {}: {:.3f} ms, {} draws, {} resolves", frame_index,
+         TicksToMilliseconds(frame_ticks_), draw_count, copy_count);
+
+  auto merge = [this, iteration, frame_index](const char* category,
+                                              TimingMap& frame_timings,
+                                              TimingMap& total_timings) {
+    for (const auto& frame_timing : frame_timings) {
+      if (csv_file_) {
+        std::fputs(fmt::format("{},{},{},{},{},{:.6f}\n", iteration,
+                               frame_index, category, frame_timing.first,
+                               frame_timing.second.count,
+                               TicksToMilliseconds(frame_timing.second.ticks))
+                       .c_str(),
+                   csv_file_);
+      }
+      Timing& total_timing = total_timings[frame_timing.first];
+      total_timing.count += frame_timing.second.count;
+      total_timing.ticks += frame_timing.second.ticks;
+    }
+    frame_timings.clear();
+  };
+  merge("packet", frame_packet_timings_, total_packet_timings_);
+  merge("subsystem", frame_subsystem_timings_, total_subsystem_timings_);
+
+  total_ticks_ += frame_ticks_;
+  max_frame_ticks_ = std::max(max_frame_ticks_, frame_ticks_);
+  frame_ticks_ = 0;
+}
+
+void NullTraceBenchmark::ReportTotals(uint32_t frames_played) const {
+  if (!frames_played) {
+    XELOGI("No frames in the trace");
+    return;
+  }
+  XELOGI("{} frames played, {:.3f} ms total, {:.3f} ms per frame average, "
+         "{:.3f} ms maximum",
+         frames_played, TicksToMilliseconds(total_ticks_),
+         TicksToMilliseconds(total_ticks_) / frames_played,
+         TicksToMilliseconds(max_frame_ticks_));
+
+  auto report = [this, frames_played](const char* title,
+                                      const TimingMap& timings) {
+    std::vector<std::pair<std::string, Timing>> sorted(timings.begin(),
+                                                       timings.end());
+    std::sort(sorted.begin(), sorted.end(),
+              [](const auto& a, const auto& b) {
+                return a.second.ticks > b.second.ticks;
+              });
+    XELOGI("{}:", title);
+    for (const auto& timing : sorted) {
+      XELOGI("  {:<32} {:>10} {:>12.3f} ms {:>10.3f} ms/frame", timing.first,
+             timing.second.count, TicksToMilliseconds(timing.second.ticks),
+             TicksToMilliseconds(timing.second.ticks) / frames_played);
+    }
+  };
+  report("By packet type", total_packet_timings_);
+  report("By subsystem (included in the packet times)",
+         total_subsystem_timings_);
+}
+
+int trace_benchmark_main(const std::vector<std::string>& args) {
+  NullTraceBenchmark trace_benchmark;
+  return trace_benchmark.Main(args);
+}
+
+}  // namespace null
+}  // namespace gpu
+}  // namespace xe
+
+XE_DEFINE_CONSOLE_APP("xenia-gpu-null-trace-benchmark",
+                      xe::gpu::null::trace_benchmark_main, "some.trace",
+                      "target_trace_file");
@@ -17,3 +17,67 @@ project("xenia-gpu-null")
     project_root.."/third_party/Vulkan-Headers/include",
   })
   local_platform_files()
+
+group("src")
+project("xenia-gpu-null-trace-benchmark")
+  uuid("6a2f4e1d-5c0b-4f0e-9d8e-3b1a7c5e2f90")
+  kind("ConsoleApp")
+  language("C++")
+  links({
+    "xenia-apu",
+    "xenia-apu-nop",
+    "xenia-base",
+    "xenia-core",
+    "xenia-cpu",
+    "xenia-gpu",
+    "xenia-gpu-null",
+    "xenia-hid",
+    "xenia-hid-nop",
+    "xenia-kernel",
+    "xenia-ui",
+    "xenia-ui-vulkan",
+    "xenia-vfs",
+    "xenia-patcher",
+  })
+  links({
+    "aes_128",
+    "capstone",
+    "fmt",
+    "glslang-spirv",
+    "imgui",
+    "libavcodec",
+    "libavutil",
+    "mspack",
+    "snappy",
+    "xxhash",
+  })
+  includedirs({
+    project_root.."/third_party/Vulkan-Headers/include",
+  })
+  files({
+    "null_trace_benchmark_main.cc",
+    "../../base/console_app_main_"..platform_suffix..".cc",
+  })
+
+  filter("architecture:x86_64")
+    links({
+      "xenia-cpu-backend-x64",
+    })
+
+  filter("platforms:Linux")
+    links({
+      "X11",
+      "xcb",
+      "X11-xcb",
+    })
+
+  filter("platforms:Windows")
+    -- Only create the .user file if it doesn't already exist.
+    local user_file = project_root.."/build/xenia-gpu-null-trace-benchmark.vcxproj.user"
+    if not os.isfile(user_file) then
+      debugdir(project_root)
+      debugargs({
+        "2>&1",
+        "1>scratch/stdout-trace-benchmark.txt",
+      })
+    end
@@ -14,12 +14,15 @@ project("xenia-gpu")
     "xenia-base",
     "xenia-ui",
     "xxhash",
+    "zstd",
   })
   includedirs({
     project_root.."/third_party/Vulkan-Headers/include",
   })
   local_platform_files()
 
+include("testing")
+
 group("src")
 project("xenia-gpu-shader-compiler")
   uuid("ad76d3e4-4c62-439b-a0f6-f83fcf0e83c5")
@@ -32,6 +35,7 @@ project("xenia-gpu-shader-compiler")
     "snappy",
     "xenia-base",
     "xenia-gpu",
+    "xenia-gpu-vulkan",
     "xenia-ui",
     "xenia-ui-vulkan",
   })
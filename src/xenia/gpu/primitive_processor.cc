@@ -1005,6 +1005,13 @@ bool PrimitiveProcessor::IsResetUsed(const uint16_t* source, uint32_t count,
       return true;
     }
   }
+#if XE_ARCH_AMD64
+  if (primitive_processor_amd64::IsResetUsed16(
+          primitive_processor_amd64::GetHostWideSimdLevel(), source, count,
+          reset_index_guest_endian)) {
+    return true;
+  }
+#endif  // XE_ARCH_AMD64
   if (count >= kSimdVectorU16Elements) {
     SimdVectorU16 reset_index_guest_endian_simd =
         ReplicateU16(reset_index_guest_endian);
@@ -1064,6 +1071,12 @@ void PrimitiveProcessor::Get16BitResetIndexUsage(
       is_ffff_used_as_vertex_index_out = true;
     }
   }
+#if XE_ARCH_AMD64
+  primitive_processor_amd64::Get16BitResetIndexUsage(
+      primitive_processor_amd64::GetHostWideSimdLevel(), source, count,
+      reset_index_guest_endian, is_reset_index_used_out,
+      is_ffff_used_as_vertex_index_out);
+#endif  // XE_ARCH_AMD64
   if (count >= kSimdVectorU16Elements) {
     SimdVectorU16 reset_index_guest_endian_simd =
         ReplicateU16(reset_index_guest_endian);
@@ -1136,6 +1149,13 @@ bool PrimitiveProcessor::IsResetUsed(const uint32_t* source, uint32_t count,
       return true;
     }
   }
+#if XE_ARCH_AMD64
+  if (primitive_processor_amd64::IsResetUsed32(
+          primitive_processor_amd64::GetHostWideSimdLevel(), source, count,
+          reset_index_guest_endian, low_bits_mask_guest_endian)) {
+    return true;
+  }
+#endif  // XE_ARCH_AMD64
   if (count >= kSimdVectorU32Elements) {
     SimdVectorU32 reset_index_guest_endian_simd =
         ReplicateU32(reset_index_guest_endian);
@@ -1183,6 +1203,11 @@ void PrimitiveProcessor::ReplaceResetIndex16To16(
     uint16_t index = *(source++);
     *(dest++) = index != reset_index_guest_endian ? index : UINT16_MAX;
   }
+#if XE_ARCH_AMD64
+  primitive_processor_amd64::ReplaceResetIndex16To16(
+      primitive_processor_amd64::GetHostWideSimdLevel(), dest, source, count,
+      reset_index_guest_endian);
+#endif  // XE_ARCH_AMD64
   if (count >= kSimdVectorU16Elements) {
     SimdVectorU16 reset_index_guest_endian_simd =
         ReplicateU16(reset_index_guest_endian);
@@ -1225,6 +1250,11 @@ void PrimitiveProcessor::ReplaceResetIndex16To24(
     uint16_t index = *(source++);
     *(dest++) = index != reset_index_guest_endian ? index : UINT32_MAX;
   }
+#if XE_ARCH_AMD64
+  primitive_processor_amd64::ReplaceResetIndex16To24(
+      primitive_processor_amd64::GetHostWideSimdLevel(), dest, source, count,
+      reset_index_guest_endian);
+#endif  // XE_ARCH_AMD64
   if (count >= kSimdVectorU16Elements) {
     SimdVectorU16 reset_index_guest_endian_simd =
         ReplicateU16(reset_index_guest_endian);
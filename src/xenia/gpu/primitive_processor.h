@@ -26,6 +26,7 @@
 #include "xenia/base/math.h"
 #include "xenia/base/mutex.h"
 #include "xenia/base/platform.h"
+#include "xenia/gpu/primitive_processor_amd64.h"
 #include "xenia/gpu/register_file.h"
 #include "xenia/gpu/shader.h"
 #include "xenia/gpu/shared_memory.h"
@@ -36,7 +37,8 @@
 #if XE_ARCH_AMD64
 // 128-bit SSSE3-level (SSE2+ for integer comparison, SSSE3 for pshufb) or AVX
 // (256-bit AVX only got integer operations such as comparison in AVX2, which is
-// above the minimum requirements of Xenia).
+// above the minimum requirements of Xenia). Wider AVX2 and AVX-512 loops are in
+// primitive_processor_amd64, selected at runtime.
 #include <tmmintrin.h>
 #define XE_GPU_PRIMITIVE_PROCESSOR_SIMD_SIZE 16
 #elif XE_ARCH_ARM64
@@ -389,6 +391,11 @@ class PrimitiveProcessor {
       sizeof(SimdVectorU32) / sizeof(uint32_t);
 #endif  // XE_GPU_PRIMITIVE_PROCESSOR_SIMD_SIZE
 
+ protected:
+  // Index buffer scanning and conversion, with the wide loops of
+  // primitive_processor_amd64 for the host CPU features. Protected rather than
+  // private so they can be used as the reference in the tests of the wide
+  // loops.
   static bool IsResetUsed(const uint16_t* source, uint32_t count,
                           uint16_t reset_index_guest_endian);
   static void Get16BitResetIndexUsage(const uint16_t* source, uint32_t count,
@@ -433,6 +440,11 @@ class PrimitiveProcessor {
                       ? xenos::GpuSwapInline(index, HostSwap)
                       : UINT32_MAX;
     }
+#if XE_ARCH_AMD64
+    primitive_processor_amd64::ReplaceResetIndex32To24(
+        primitive_processor_amd64::GetHostWideSimdLevel(), dest, source, count,
+        reset_index_guest_endian, low_bits_mask_guest_endian, HostSwap);
+#endif  // XE_ARCH_AMD64
     if (count >= kSimdVectorU32Elements) {
       SimdVectorU32 reset_index_guest_endian_simd =
           ReplicateU32(reset_index_guest_endian);
@@ -495,6 +507,7 @@ class PrimitiveProcessor {
     }
   }
 
+ private:
   // TODO(Triang3l): 16-bit > 32-bit primitive type conversion for Metal, where
   // primitive reset is always enabled, if UINT16_MAX is used as a real vertex
   // index.
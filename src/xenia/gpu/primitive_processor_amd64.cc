@@ -0,0 +1,434 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/gpu/primitive_processor_amd64.h"
+
+#if XE_ARCH_AMD64
+
+#include <immintrin.h>
+
+#include "xenia/base/platform_amd64.h"
+
+namespace xe {
+namespace gpu {
+namespace primitive_processor_amd64 {
+
+WideSimdLevel GetHostWideSimdLevel() {
+  uint64_t feature_flags = amd64::GetFeatureFlags();
+  constexpr uint64_t kAVX512BWFlags =
+      amd64::kX64EmitAVX512F | amd64::kX64EmitAVX512BW;
+  if ((feature_flags & kAVX512BWFlags) == kAVX512BWFlags) {
+    return WideSimdLevel::kAVX512BW;
+  }
+  if (feature_flags & amd64::kX64EmitAVX2) {
+    return WideSimdLevel::kAVX2;
+  }
+  return WideSimdLevel::kNone;
+}
+
+// Comparison produces 0 or 0xFFFF(FFFF) in AVX2 - like in the 128-bit loops,
+// the conversion result is `index | (index == reset_index)`. In AVX-512,
+// comparison produces a mask register instead, which is used to replace the
+// reset indices with all ones directly.
+
+XE_TARGET_AVX2 static bool IsResetUsed16AVX2(
+    const uint16_t*& source, uint32_t& count,
+    uint16_t reset_index_guest_endian) {
+  __m256i reset_index_guest_endian_simd =
+      _mm256_set1_epi16(int16_t(reset_index_guest_endian));
+  while (count >= 16) {
+    count -= 16;
+    __m256i source_simd =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source));
+    source += 16;
+    if (_mm256_movemask_epi8(
+            _mm256_cmpeq_epi16(source_simd, reset_index_guest_endian_simd))) {
+      return true;
+    }
+  }
+  return false;
+}
+
+XE_TARGET_AVX512BW static bool IsResetUsed16AVX512BW(
+    const uint16_t*& source, uint32_t& count,
+    uint16_t reset_index_guest_endian) {
+  __m512i reset_index_guest_endian_simd =
+      _mm512_set1_epi16(int16_t(reset_index_guest_endian));
+  while (count >= 32) {
+    count -= 32;
+    __m512i source_simd = _mm512_loadu_si512(source);
+    source += 32;
+    if (_mm512_cmpeq_epi16_mask(source_simd, reset_index_guest_endian_simd)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool IsResetUsed16(WideSimdLevel level, const uint16_t*& source,
+                   uint32_t& count, uint16_t reset_index_guest_endian) {
+  switch (level) {
+    case WideSimdLevel::kAVX2:
+      return IsResetUsed16AVX2(source, count, reset_index_guest_endian);
+    case WideSimdLevel::kAVX512BW:
+      return IsResetUsed16AVX512BW(source, count, reset_index_guest_endian);
+    default:
+      return false;
+  }
+}
+
+XE_TARGET_AVX2 static void Get16BitResetIndexUsageAVX2(
+    const uint16_t*& source, uint32_t& count,
+    uint16_t reset_index_guest_endian, bool& is_reset_index_used_out,
+    bool& is_ffff_used_as_vertex_index_out) {
+  __m256i reset_index_guest_endian_simd =
+      _mm256_set1_epi16(int16_t(reset_index_guest_endian));
+  __m256i ffff_simd = _mm256_set1_epi16(-1);
+  __m256i is_reset_simd = _mm256_setzero_si256();
+  __m256i is_ffff_simd = _mm256_setzero_si256();
+  while (count >= 16) {
+    count -= 16;
+    __m256i source_simd =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source));
+    source += 16;
+    is_reset_simd = _mm256_or_si256(
+        is_reset_simd,
+        _mm256_cmpeq_epi16(source_simd, reset_index_guest_endian_simd));
+    is_ffff_simd = _mm256_or_si256(is_ffff_simd,
+                                   _mm256_cmpeq_epi16(source_simd, ffff_simd));
+  }
+  if (_mm256_movemask_epi8(is_reset_simd)) {
+    is_reset_index_used_out = true;
+  }
+  if (_mm256_movemask_epi8(is_ffff_simd)) {
+    is_ffff_used_as_vertex_index_out = true;
+  }
+}
+
+XE_TARGET_AVX512BW static void Get16BitResetIndexUsageAVX512BW(
+    const uint16_t*& source, uint32_t& count,
+    uint16_t reset_index_guest_endian, bool& is_reset_index_used_out,
+    bool& is_ffff_used_as_vertex_index_out) {
+  __m512i reset_index_guest_endian_simd =
+      _mm512_set1_epi16(int16_t(reset_index_guest_endian));
+  __m512i ffff_simd = _mm512_set1_epi16(-1);
+  __mmask32 is_reset_mask = 0;
+  __mmask32 is_ffff_mask = 0;
+  while (count >= 32) {
+    count -= 32;
+    __m512i source_simd = _mm512_loadu_si512(source);
+    source += 32;
+    is_reset_mask |=
+        _mm512_cmpeq_epi16_mask(source_simd, reset_index_guest_endian_simd);
+    is_ffff_mask |= _mm512_cmpeq_epi16_mask(source_simd, ffff_simd);
+  }
+  if (is_reset_mask) {
+    is_reset_index_used_out = true;
+  }
+  if (is_ffff_mask) {
+    is_ffff_used_as_vertex_index_out = true;
+  }
+}
+
+void Get16BitResetIndexUsage(WideSimdLevel level, const uint16_t*& source,
+                             uint32_t& count,
+                             uint16_t reset_index_guest_endian,
+                             bool& is_reset_index_used_out,
+                             bool& is_ffff_used_as_vertex_index_out) {
+  switch (level) {
+    case WideSimdLevel::kAVX2:
+      Get16BitResetIndexUsageAVX2(source, count, reset_index_guest_endian,
+                                  is_reset_index_used_out,
+                                  is_ffff_used_as_vertex_index_out);
+      break;
+    case WideSimdLevel::kAVX512BW:
+      Get16BitResetIndexUsageAVX512BW(source, count, reset_index_guest_endian,
+                                      is_reset_index_used_out,
+                                      is_ffff_used_as_vertex_index_out);
+      break;
+    default:
+      break;
+  }
+}
+
+XE_TARGET_AVX2 static bool IsResetUsed32AVX2(
+    const uint32_t*& source, uint32_t& count,
+    uint32_t reset_index_guest_endian, uint32_t low_bits_mask_guest_endian) {
+  __m256i reset_index_guest_endian_simd =
+      _mm256_set1_epi32(int32_t(reset_index_guest_endian));
+  __m256i low_bits_mask_guest_endian_simd =
+      _mm256_set1_epi32(int32_t(low_bits_mask_guest_endian));
+  while (count >= 8) {
+    count -= 8;
+    __m256i source_simd = _mm256_and_si256(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source)),
+        low_bits_mask_guest_endian_simd);
+    source += 8;
+    if (_mm256_movemask_epi8(
+            _mm256_cmpeq_epi32(source_simd, reset_index_guest_endian_simd))) {
+      return true;
+    }
+  }
+  return false;
+}
+
+XE_TARGET_AVX512BW static bool IsResetUsed32AVX512BW(
+    const uint32_t*& source, uint32_t& count,
+    uint32_t reset_index_guest_endian, uint32_t low_bits_mask_guest_endian) {
+  __m512i reset_index_guest_endian_simd =
+      _mm512_set1_epi32(int32_t(reset_index_guest_endian));
+  __m512i low_bits_mask_guest_endian_simd =
+      _mm512_set1_epi32(int32_t(low_bits_mask_guest_endian));
+  while (count >= 16) {
+    count -= 16;
+    __m512i source_simd = _mm512_and_si512(_mm512_loadu_si512(source),
+                                           low_bits_mask_guest_endian_simd);
+    source += 16;
+    if (_mm512_cmpeq_epi32_mask(source_simd, reset_index_guest_endian_simd)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool IsResetUsed32(WideSimdLevel level, const uint32_t*& source,
+                   uint32_t& count, uint32_t reset_index_guest_endian,
+                   uint32_t low_bits_mask_guest_endian) {
+  switch (level) {
+    case WideSimdLevel::kAVX2:
+      return IsResetUsed32AVX2(source, count, reset_index_guest_endian,
+                               low_bits_mask_guest_endian);
+    case WideSimdLevel::kAVX512BW:
+      return IsResetUsed32AVX512BW(source, count, reset_index_guest_endian,
+                                   low_bits_mask_guest_endian);
+    default:
+      return false;
+  }
+}
+
+XE_TARGET_AVX2 static void ReplaceResetIndex16To16AVX2(
+    uint16_t*& dest, const uint16_t*& source, uint32_t& count,
+    uint16_t reset_index_guest_endian) {
+  __m256i reset_index_guest_endian_simd =
+      _mm256_set1_epi16(int16_t(reset_index_guest_endian));
+  while (count >= 16) {
+    count -= 16;
+    __m256i source_simd =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source));
+    source += 16;
+    _mm256_storeu_si256(
+        reinterpret_cast<__m256i*>(dest),
+        _mm256_or_si256(source_simd,
+                        _mm256_cmpeq_epi16(source_simd,
+                                           reset_index_guest_endian_simd)));
+    dest += 16;
+  }
+}
+
+XE_TARGET_AVX512BW static void ReplaceResetIndex16To16AVX512BW(
+    uint16_t*& dest, const uint16_t*& source, uint32_t& count,
+    uint16_t reset_index_guest_endian) {
+  __m512i reset_index_guest_endian_simd =
+      _mm512_set1_epi16(int16_t(reset_index_guest_endian));
+  __m512i ffff_simd = _mm512_set1_epi16(-1);
+  while (count >= 32) {
+    count -= 32;
+    __m512i source_simd = _mm512_loadu_si512(source);
+    source += 32;
+    _mm512_storeu_si512(
+        dest, _mm512_mask_mov_epi16(
+                  source_simd,
+                  _mm512_cmpeq_epi16_mask(source_simd,
+                                          reset_index_guest_endian_simd),
+                  ffff_simd));
+    dest += 32;
+  }
+}
+
+void ReplaceResetIndex16To16(WideSimdLevel level, uint16_t*& dest,
+                             const uint16_t*& source, uint32_t& count,
+                             uint16_t reset_index_guest_endian) {
+  switch (level) {
+    case WideSimdLevel::kAVX2:
+      ReplaceResetIndex16To16AVX2(dest, source, count,
+                                  reset_index_guest_endian);
+      break;
+    case WideSimdLevel::kAVX512BW:
+      ReplaceResetIndex16To16AVX512BW(dest, source, count,
+                                      reset_index_guest_endian);
+      break;
+    default:
+      break;
+  }
+}
+
+XE_TARGET_AVX2 static void ReplaceResetIndex16To24AVX2(
+    uint32_t*& dest, const uint16_t*& source, uint32_t& count,
+    uint16_t reset_index_guest_endian) {
+  __m256i reset_index_guest_endian_simd =
+      _mm256_set1_epi16(int16_t(reset_index_guest_endian));
+  while (count >= 16) {
+    count -= 16;
+    __m256i source_simd =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source));
+    source += 16;
+    // Unpacking in 256-bit vectors works within 128-bit lanes, so instead,
+    // zero-extending the indices and sign-extending the comparison results
+    // for each half, and merging them, getting 0xFFFFFFFF for primitive reset
+    // or 0x0000#### for non-primitive-reset indices.
+    __m256i are_reset =
+        _mm256_cmpeq_epi16(source_simd, reset_index_guest_endian_simd);
+    _mm256_storeu_si256(
+        reinterpret_cast<__m256i*>(dest),
+        _mm256_or_si256(
+            _mm256_cvtepu16_epi32(_mm256_castsi256_si128(source_simd)),
+            _mm256_cvtepi16_epi32(_mm256_castsi256_si128(are_reset))));
+    _mm256_storeu_si256(
+        reinterpret_cast<__m256i*>(dest + 8),
+        _mm256_or_si256(
+            _mm256_cvtepu16_epi32(_mm256_extracti128_si256(source_simd, 1)),
+            _mm256_cvtepi16_epi32(_mm256_extracti128_si256(are_reset, 1))));
+    dest += 16;
+  }
+}
+
+XE_TARGET_AVX512BW static void ReplaceResetIndex16To24AVX512BW(
+    uint32_t*& dest, const uint16_t*& source, uint32_t& count,
+    uint16_t reset_index_guest_endian) {
+  __m512i reset_index_guest_endian_simd =
+      _mm512_set1_epi16(int16_t(reset_index_guest_endian));
+  __m512i ffffffff_simd = _mm512_set1_epi32(-1);
+  while (count >= 32) {
+    count -= 32;
+    __m512i source_simd = _mm512_loadu_si512(source);
+    source += 32;
+    __mmask32 are_reset =
+        _mm512_cmpeq_epi16_mask(source_simd, reset_index_guest_endian_simd);
+    _mm512_storeu_si512(
+        dest, _mm512_mask_mov_epi32(
+                  _mm512_cvtepu16_epi32(_mm512_castsi512_si256(source_simd)),
+                  __mmask16(are_reset), ffffffff_simd));
+    _mm512_storeu_si512(
+        dest + 16,
+        _mm512_mask_mov_epi32(
+            _mm512_cvtepu16_epi32(_mm512_extracti64x4_epi64(source_simd, 1)),
+            __mmask16(are_reset >> 16), ffffffff_simd));
+    dest += 32;
+  }
+}
+
+void ReplaceResetIndex16To24(WideSimdLevel level, uint32_t*& dest,
+                             const uint16_t*& source, uint32_t& count,
+                             uint16_t reset_index_guest_endian) {
+  switch (level) {
+    case WideSimdLevel::kAVX2:
+      ReplaceResetIndex16To24AVX2(dest, source, count,
+                                  reset_index_guest_endian);
+      break;
+    case WideSimdLevel::kAVX512BW:
+      ReplaceResetIndex16To24AVX512BW(dest, source, count,
+                                      reset_index_guest_endian);
+      break;
+    default:
+      break;
+  }
+}
+
+// The same pshufb control for each 128-bit lane.
+static __m128i GetHostSwapShuffle(xenos::Endian host_swap) {
+  return _mm_set_epi32(
+      int32_t(xenos::GpuSwapInline(uint32_t(0x0F0E0D0C), host_swap)),
+      int32_t(xenos::GpuSwapInline(uint32_t(0x0B0A0908), host_swap)),
+      int32_t(xenos::GpuSwapInline(uint32_t(0x07060504), host_swap)),
+      int32_t(xenos::GpuSwapInline(uint32_t(0x03020100), host_swap)));
+}
+
+XE_TARGET_AVX2 static void ReplaceResetIndex32To24AVX2(
+    uint32_t*& dest, const uint32_t*& source, uint32_t& count,
+    uint32_t reset_index_guest_endian, uint32_t low_bits_mask_guest_endian,
+    xenos::Endian host_swap) {
+  __m256i reset_index_guest_endian_simd =
+      _mm256_set1_epi32(int32_t(reset_index_guest_endian));
+  __m256i low_bits_mask_guest_endian_simd =
+      _mm256_set1_epi32(int32_t(low_bits_mask_guest_endian));
+  bool swap = host_swap != xenos::Endian::kNone;
+  __m256i host_swap_shuffle =
+      _mm256_broadcastsi128_si256(GetHostSwapShuffle(host_swap));
+  while (count >= 8) {
+    count -= 8;
+    __m256i source_simd = _mm256_and_si256(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source)),
+        low_bits_mask_guest_endian_simd);
+    source += 8;
+    __m256i result_simd = _mm256_or_si256(
+        source_simd,
+        _mm256_cmpeq_epi32(source_simd, reset_index_guest_endian_simd));
+    if (swap) {
+      result_simd = _mm256_shuffle_epi8(result_simd, host_swap_shuffle);
+    }
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest), result_simd);
+    dest += 8;
+  }
+}
+
+XE_TARGET_AVX512BW static void ReplaceResetIndex32To24AVX512BW(
+    uint32_t*& dest, const uint32_t*& source, uint32_t& count,
+    uint32_t reset_index_guest_endian, uint32_t low_bits_mask_guest_endian,
+    xenos::Endian host_swap) {
+  __m512i reset_index_guest_endian_simd =
+      _mm512_set1_epi32(int32_t(reset_index_guest_endian));
+  __m512i low_bits_mask_guest_endian_simd =
+      _mm512_set1_epi32(int32_t(low_bits_mask_guest_endian));
+  __m512i ffffffff_simd = _mm512_set1_epi32(-1);
+  bool swap = host_swap != xenos::Endian::kNone;
+  __m512i host_swap_shuffle =
+      _mm512_broadcast_i32x4(GetHostSwapShuffle(host_swap));
+  while (count >= 16) {
+    count -= 16;
+    __m512i source_simd = _mm512_and_si512(_mm512_loadu_si512(source),
+                                           low_bits_mask_guest_endian_simd);
+    source += 16;
+    __m512i result_simd = _mm512_mask_mov_epi32(
+        source_simd,
+        _mm512_cmpeq_epi32_mask(source_simd, reset_index_guest_endian_simd),
+        ffffffff_simd);
+    if (swap) {
+      result_simd = _mm512_shuffle_epi8(result_simd, host_swap_shuffle);
+    }
+    _mm512_storeu_si512(dest, result_simd);
+    dest += 16;
+  }
+}
+
+void ReplaceResetIndex32To24(WideSimdLevel level, uint32_t*& dest,
+                             const uint32_t*& source, uint32_t& count,
+                             uint32_t reset_index_guest_endian,
+                             uint32_t low_bits_mask_guest_endian,
+                             xenos::Endian host_swap) {
+  switch (level) {
+    case WideSimdLevel::kAVX2:
+      ReplaceResetIndex32To24AVX2(dest, source, count,
+                                  reset_index_guest_endian,
+                                  low_bits_mask_guest_endian, host_swap);
+      break;
+    case WideSimdLevel::kAVX512BW:
+      ReplaceResetIndex32To24AVX512BW(dest, source, count,
+                                      reset_index_guest_endian,
+                                      low_bits_mask_guest_endian, host_swap);
+      break;
+    default:
+      break;
+  }
+}
+
+}  // namespace primitive_processor_amd64
+}  // namespace gpu
+}  // namespace xe
+
+#endif  // XE_ARCH_AMD64
@@ -0,0 +1,78 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_GPU_PRIMITIVE_PROCESSOR_AMD64_H_
+#define XENIA_GPU_PRIMITIVE_PROCESSOR_AMD64_H_
+
+#include <cstdint>
+
+#include "xenia/base/platform.h"
+#include "xenia/gpu/xenos.h"
+
+#if XE_ARCH_AMD64
+
+namespace xe {
+namespace gpu {
+namespace primitive_processor_amd64 {
+
+// 256-bit and 512-bit versions of the index buffer scanning and conversion
+// loops of the PrimitiveProcessor, for hosts supporting instruction set
+// extensions above the minimum requirements of Xenia (SSSE3 or AVX).
+//
+// Each function processes as many whole wide vectors from the beginning of the
+// range as possible, advancing the pointers and decreasing the count by the
+// number of indices processed, and leaves the rest to the common 128-bit and
+// scalar loops, so the results are exactly the same regardless of the level.
+// With WideSimdLevel::kNone, nothing is processed.
+//
+// The conversion functions don't return early, the scanning ones return true
+// as soon as the reset index is found, without processing the rest.
+
+enum class WideSimdLevel {
+  kNone,
+  // 256-bit.
+  kAVX2,
+  // 512-bit, AVX-512F and AVX-512BW (for 16-bit comparison and pshufb).
+  kAVX512BW,
+};
+
+// Based on amd64::GetFeatureFlags, which must be initialized.
+WideSimdLevel GetHostWideSimdLevel();
+
+bool IsResetUsed16(WideSimdLevel level, const uint16_t*& source,
+                   uint32_t& count, uint16_t reset_index_guest_endian);
+// Unlike the PrimitiveProcessor function, only sets the outputs to true, never
+// to false, so they can be combined with the results of the remaining indices.
+void Get16BitResetIndexUsage(WideSimdLevel level, const uint16_t*& source,
+                             uint32_t& count,
+                             uint16_t reset_index_guest_endian,
+                             bool& is_reset_index_used_out,
+                             bool& is_ffff_used_as_vertex_index_out);
+bool IsResetUsed32(WideSimdLevel level, const uint32_t*& source,
+                   uint32_t& count, uint32_t reset_index_guest_endian,
+                   uint32_t low_bits_mask_guest_endian);
+void ReplaceResetIndex16To16(WideSimdLevel level, uint16_t*& dest,
+                             const uint16_t*& source, uint32_t& count,
+                             uint16_t reset_index_guest_endian);
+void ReplaceResetIndex16To24(WideSimdLevel level, uint32_t*& dest,
+                             const uint16_t*& source, uint32_t& count,
+                             uint16_t reset_index_guest_endian);
+void ReplaceResetIndex32To24(WideSimdLevel level, uint32_t*& dest,
+                             const uint32_t*& source, uint32_t& count,
+                             uint32_t reset_index_guest_endian,
+                             uint32_t low_bits_mask_guest_endian,
+                             xenos::Endian host_swap);
+
+}  // namespace primitive_processor_amd64
+}  // namespace gpu
+}  // namespace xe
+
+#endif  // XE_ARCH_AMD64
+
+#endif  // XENIA_GPU_PRIMITIVE_PROCESSOR_AMD64_H_
@@ -830,6 +830,12 @@ class Shader {
     // If there was some failure during preparation on the implementation side.
     void MakeInvalid() { is_valid_ = false; }
 
+    // For post-processing of the translated binary on the implementation side,
+    // such as optimization, before it's used.
+    void SetTranslatedBinary(std::vector<uint8_t> binary) {
+      translated_binary_ = std::move(binary);
+    }
+
    private:
     friend class Shader;
     friend class ShaderTranslator;
@@ -7,24 +7,36 @@
  ******************************************************************************
  */
 
+#include <algorithm>
+#include <atomic>
 #include <cinttypes>
 #include <cstring>
+#include <mutex>
+#include <set>
 #include <sstream>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
 #include "third_party/glslang/SPIRV/disassemble.h"
 #include "xenia/base/assert.h"
+#include "xenia/base/byte_order.h"
+#include "xenia/base/clock.h"
 #include "xenia/base/console_app_main.h"
 #include "xenia/base/cvar.h"
+#include "xenia/base/filesystem.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/platform.h"
 #include "xenia/base/string.h"
 #include "xenia/base/string_buffer.h"
+#include "xenia/base/threading.h"
+#include "xenia/base/xxhash.h"
 #include "xenia/gpu/dxbc_shader_translator.h"
+#include "xenia/gpu/shader_storage.h"
 #include "xenia/gpu/shader_translator.h"
 #include "xenia/gpu/spirv_shader_translator.h"
+#include "xenia/gpu/vulkan/vulkan_pipeline_cache.h"
 #include "xenia/gpu/xenos.h"
 #include "xenia/ui/vulkan/spirv_tools_context.h"
 
@@ -33,7 +45,10 @@
 #include "xenia/ui/d3d12/d3d12_api.h"
 #endif  // XE_PLATFORM_WIN32
 
-DEFINE_path(shader_input, "", "Input shader binary file path.", "GPU");
+DEFINE_path(shader_input, "",
+            "Input shader binary file path, or, for batch translation, a "
+            "shader storage (.xsh) file or a directory containing them.",
+            "GPU");
 DEFINE_string(shader_input_type, "",
               "'vs', 'ps', or unspecified to infer from the given filename.",
               "GPU");
@@ -42,7 +57,10 @@ DEFINE_bool(
     "Whether the input shader binary is little-endian (from an Arm device with "
     "the Qualcomm Adreno 200, for instance).",
     "GPU");
-DEFINE_path(shader_output, "", "Output shader file path.", "GPU");
+DEFINE_path(shader_output, "",
+            "Output shader file path, or, for batch translation, the "
+            "directory to write all translated shaders to.",
+            "GPU");
 DEFINE_string(shader_output_type, "ucode",
               "Translator to use: [ucode, spirv, spirvtext, dxbc, dxbctext].",
               "GPU");
@@ -59,11 +77,545 @@ DEFINE_bool(
     "Output host shader with a render backend implementation based on pixel "
     "shader interlock.",
     "GPU");
+DEFINE_uint32(shader_batch_threads, 0,
+              "Number of threads translating shaders in batch translation, 0 "
+              "to use all logical processors.",
+              "GPU");
+DEFINE_bool(shader_batch_validate_spirv, true,
+            "Validate SPIR-V translated in batch translation with "
+            "SPIRV-Tools, if available.",
+            "GPU");
+DEFINE_bool(shader_batch_optimize_spirv, false,
+            "Optimize SPIR-V translated in batch translation with the "
+            "SPIRV-Tools optimizer, as done with --vulkan_optimize_spirv, and "
+            "report the instruction counts and the time spent before and after "
+            "optimization. Validation and output use the optimized SPIR-V.",
+            "GPU");
 
 namespace xe {
 namespace gpu {
 
+struct BatchShader {
+  xenos::ShaderType type;
+  uint64_t ucode_data_hash;
+  std::vector<uint32_t> ucode_dwords;
+};
+
+// Loads the valid shaders from a shader storage file, skipping the ones
+// already in shaders (by the ucode hash). Returns the number of shader records
+// in the file.
+size_t LoadBatchShaderStorage(
+    const std::filesystem::path& path, std::vector<BatchShader>& shaders,
+    std::unordered_map<uint64_t, size_t>& shader_indices) {
+  FILE* file = filesystem::OpenFile(path, "rb");
+  if (!file) {
+    XELOGE("Unable to open shader storage file: {}", path);
+    return 0;
+  }
+  ShaderStorageFileHeader file_header;
+  if (!fread(&file_header, sizeof(file_header), 1, file) ||
+      file_header.magic != kShaderStorageMagic ||
+      xe::byte_swap(file_header.version_swapped) !=
+          ShaderStoredHeader::kVersion) {
+    XELOGE("{} is not a shader storage file of a supported version", path);
+    fclose(file);
+    return 0;
+  }
+  size_t record_count = 0;
+  ShaderStoredHeader shader_header;
+  std::vector<uint32_t> ucode_dwords;
+  while (fread(&shader_header, sizeof(shader_header), 1, file)) {
+    ucode_dwords.resize(shader_header.ucode_dword_count);
+    size_t ucode_byte_count = sizeof(uint32_t) * ucode_dwords.size();
+    if (ucode_byte_count &&
+        !fread(ucode_dwords.data(), ucode_byte_count, 1, file)) {
+      break;
+    }
+    if (XXH3_64bits(ucode_dwords.data(), ucode_byte_count) !=
+        shader_header.ucode_data_hash) {
+      XELOGW("Shader storage file {} is corrupted after {} shaders", path,
+             record_count);
+      break;
+    }
+    ++record_count;
+    if (shader_indices.emplace(shader_header.ucode_data_hash, shaders.size())
+            .second) {
+      BatchShader& shader = shaders.emplace_back();
+      shader.type = shader_header.type;
+      shader.ucode_data_hash = shader_header.ucode_data_hash;
+      shader.ucode_dwords = ucode_dwords;
+    }
+  }
+  fclose(file);
+  return record_count;
+}
+
+// Gathers the <shader hash, modification bits> pairs used by the pipelines in
+// the Vulkan pipeline storage file written along with a shader storage file,
+// for the render target path of the output, if the file exists. Returns the
+// number of valid pipeline descriptions in the file.
+size_t LoadBatchVulkanPipelineStorage(
+    const std::filesystem::path& shader_storage_path,
+    std::set<std::pair<uint64_t, uint64_t>>& translations) {
+  bool edram_fragment_shader_interlock =
+      cvars::shader_output_pixel_shader_interlock;
+  std::filesystem::path path =
+      shader_storage_path.parent_path() /
+      fmt::format("{}.{}.vulkan.xpso",
+                  xe::path_to_utf8(shader_storage_path.stem()),
+                  edram_fragment_shader_interlock ? "fsi" : "rtv");
+  if (!std::filesystem::is_regular_file(path)) {
+    return 0;
+  }
+  FILE* file = filesystem::OpenFile(path, "rb");
+  if (!file) {
+    XELOGE("Unable to open pipeline storage file: {}", path);
+    return 0;
+  }
+  std::vector<vulkan::VulkanPipelineCache::PipelineStoredDescription>
+      descriptions;
+  if (!vulkan::VulkanPipelineCache::ReadPipelineStorage(
+          file, edram_fragment_shader_interlock, descriptions,
+          translations)) {
+    XELOGW("{} is not a pipeline storage file of a supported version", path);
+  }
+  fclose(file);
+  return descriptions.size();
+}
+
+// Number of instructions in a SPIR-V module, excluding the header.
+size_t CountSpirvInstructions(const uint32_t* words, size_t word_count) {
+  size_t instruction_count = 0;
+  // 5-dword header.
+  size_t word_index = 5;
+  while (word_index < word_count) {
+    uint32_t instruction_word_count = words[word_index] >> 16;
+    if (!instruction_word_count) {
+      break;
+    }
+    word_index += instruction_word_count;
+    ++instruction_count;
+  }
+  return instruction_count;
+}
+
+// Translates every shader from shader storage files for every host shader
+// variant the backends may need, for regression testing and profiling of the
+// translators. For SPIR-V, the modifications used by the pipelines in the
+// Vulkan pipeline storage files next to the shader storage files are
+// translated too.
+int shader_compiler_batch_main() {
+  std::vector<std::filesystem::path> storage_paths;
+  if (std::filesystem::is_directory(cvars::shader_input)) {
+    for (const filesystem::FileInfo& file_info :
+         filesystem::ListFiles(cvars::shader_input)) {
+      if (file_info.type == filesystem::FileInfo::Type::kFile &&
+          file_info.name.extension() == ".xsh") {
+        storage_paths.push_back(file_info.path / file_info.name);
+      }
+    }
+    std::sort(storage_paths.begin(), storage_paths.end());
+  } else {
+    storage_paths.push_back(cvars::shader_input);
+  }
+
+  uint64_t load_start_ticks = Clock::QueryHostTickCount();
+  std::vector<BatchShader> shaders;
+  std::unordered_map<uint64_t, size_t> shader_indices;
+  size_t record_count = 0;
+  // <Shader hash, modification bits>.
+  std::set<std::pair<uint64_t, uint64_t>> spirv_stored_translations;
+  size_t spirv_pipeline_count = 0;
+  for (const std::filesystem::path& storage_path : storage_paths) {
+    record_count +=
+        LoadBatchShaderStorage(storage_path, shaders, shader_indices);
+    spirv_pipeline_count += LoadBatchVulkanPipelineStorage(
+        storage_path, spirv_stored_translations);
+  }
+  uint64_t tick_frequency = Clock::QueryHostTickFrequency();
+  XELOGI(
+      "Loaded {} unique shaders from {} records in {} shader storage files in "
+      "{} ms",
+      shaders.size(), record_count, storage_paths.size(),
+      (Clock::QueryHostTickCount() - load_start_ticks) * 1000 / tick_frequency);
+  if (spirv_pipeline_count) {
+    XELOGI(
+        "Loaded {} Vulkan pipelines using {} stored SPIR-V shader "
+        "modifications",
+        spirv_pipeline_count, spirv_stored_translations.size());
+  }
+  if (shaders.empty()) {
+    return 1;
+  }
+
+  bool write_output = !cvars::shader_output.empty();
+  if (write_output) {
+    std::filesystem::create_directories(cvars::shader_output);
+  }
+
+  // Host vertex shader types the pipeline caches of the backends may request.
+  static const Shader::HostVertexShaderType kDxbcHostVertexShaderTypes[] = {
+      Shader::HostVertexShaderType::kVertex,
+      Shader::HostVertexShaderType::kTriangleDomainCPIndexed,
+      Shader::HostVertexShaderType::kTriangleDomainPatchIndexed,
+      Shader::HostVertexShaderType::kQuadDomainCPIndexed,
+      Shader::HostVertexShaderType::kQuadDomainPatchIndexed,
+  };
+  static const Shader::HostVertexShaderType kSpirvHostVertexShaderTypes[] = {
+      Shader::HostVertexShaderType::kVertex,
+      Shader::HostVertexShaderType::kPointListAsTriangleStrip,
+  };
+
+  enum Backend : uint32_t {
+    kBackendDxbc,
+    kBackendSpirv,
+    kBackendCount,
+  };
+  static const char* const kBackendNames[] = {"DXBC", "SPIR-V"};
+  static const char* const kBackendExtensions[] = {"dxbc", "spv"};
+
+  struct BackendStatistics {
+    uint64_t translation_count = 0;
+    uint64_t failure_count = 0;
+    uint64_t ticks = 0;
+    uint64_t max_ticks = 0;
+    uint64_t max_ticks_ucode_data_hash = 0;
+    uint64_t max_ticks_modification = 0;
+  };
+  struct SpirvOptimizationStatistics {
+    uint64_t shader_count = 0;
+    uint64_t failure_count = 0;
+    uint64_t instructions_before = 0;
+    uint64_t instructions_after = 0;
+    uint64_t bytes_before = 0;
+    uint64_t bytes_after = 0;
+    uint64_t translation_ticks = 0;
+    uint64_t optimization_ticks = 0;
+  };
+  struct ThreadStatistics {
+    uint64_t analysis_ticks = 0;
+    BackendStatistics backends[kBackendCount];
+    SpirvOptimizationStatistics spirv_optimization;
+  };
+
+  uint32_t thread_count = cvars::shader_batch_threads;
+  if (!thread_count) {
+    thread_count = std::max(xe::threading::logical_processor_count(), 1u);
+  }
+  thread_count = uint32_t(std::min(size_t(thread_count), shaders.size()));
+  std::vector<ThreadStatistics> thread_statistics(thread_count);
+  std::atomic<size_t> next_shader_index{0};
+  std::mutex failures_mutex;
+  std::vector<std::string> failures;
+
+  auto translation_thread_function = [&](ThreadStatistics& statistics) {
+    StringBuffer ucode_disasm_buffer;
+    SpirvShaderTranslator::Features spirv_features(true);
+    DxbcShaderTranslator dxbc_translator(
+        ui::GraphicsProvider::GpuVendorID(0),
+        cvars::shader_output_bindless_resources,
+        cvars::shader_output_pixel_shader_interlock);
+    SpirvShaderTranslator spirv_translator(
+        spirv_features, true, true,
+        cvars::shader_output_pixel_shader_interlock);
+    ui::vulkan::SpirvToolsContext spirv_tools_context;
+    bool spirv_tools_available =
+        (cvars::shader_batch_validate_spirv ||
+         cvars::shader_batch_optimize_spirv) &&
+        spirv_tools_context.Initialize(spirv_features.spirv_version);
+    bool validate_spirv =
+        spirv_tools_available && cvars::shader_batch_validate_spirv;
+    bool optimize_spirv = spirv_tools_available &&
+                          cvars::shader_batch_optimize_spirv &&
+                          spirv_tools_context.IsOptimizerAvailable();
+    std::vector<uint32_t> spirv_optimized;
+    ShaderTranslator* translators[kBackendCount] = {&dxbc_translator,
+                                                    &spirv_translator};
+    std::vector<uint64_t> modifications;
+
+    for (;;) {
+      size_t shader_index = next_shader_index.fetch_add(1);
+      if (shader_index >= shaders.size()) {
+        break;
+      }
+      const BatchShader& batch_shader = shaders[shader_index];
+      Shader shader(batch_shader.type, batch_shader.ucode_data_hash,
+                    batch_shader.ucode_dwords.data(),
+                    batch_shader.ucode_dwords.size());
+      uint64_t analysis_start_ticks = Clock::QueryHostTickCount();
+      shader.AnalyzeUcode(ucode_disasm_buffer);
+      statistics.analysis_ticks +=
+          Clock::QueryHostTickCount() - analysis_start_ticks;
+
+      for (uint32_t backend = 0; backend < kBackendCount; ++backend) {
+        ShaderTranslator& translator = *translators[backend];
+        modifications.clear();
+        if (batch_shader.type == xenos::ShaderType::kVertex) {
+          if (backend == kBackendDxbc) {
+            for (Shader::HostVertexShaderType host_vertex_shader_type :
+                 kDxbcHostVertexShaderTypes) {
+              modifications.push_back(
+                  translator.GetDefaultVertexShaderModification(
+                      xenos::kMaxShaderTempRegisters,
+                      host_vertex_shader_type));
+            }
+          } else {
+            for (Shader::HostVertexShaderType host_vertex_shader_type :
+                 kSpirvHostVertexShaderTypes) {
+              modifications.push_back(
+                  translator.GetDefaultVertexShaderModification(
+                      xenos::kMaxShaderTempRegisters,
+                      host_vertex_shader_type));
+            }
+          }
+        } else {
+          modifications.push_back(translator.GetDefaultPixelShaderModification(
+              xenos::kMaxShaderTempRegisters));
+        }
+        if (backend == kBackendSpirv) {
+          for (auto it = spirv_stored_translations.lower_bound(
+                   std::make_pair(batch_shader.ucode_data_hash, uint64_t(0)));
+               it != spirv_stored_translations.end() &&
+               it->first == batch_shader.ucode_data_hash;
+               ++it) {
+            if (std::find(modifications.cbegin(), modifications.cend(),
+                          it->second) == modifications.cend()) {
+              modifications.push_back(it->second);
+            }
+          }
+        }
+
+        BackendStatistics& backend_statistics = statistics.backends[backend];
+        for (uint64_t modification : modifications) {
+          Shader::Translation& translation =
+              *shader.GetOrCreateTranslation(modification);
+          uint64_t translation_start_ticks = Clock::QueryHostTickCount();
+          bool translated = translator.TranslateAnalyzedShader(translation);
+          uint64_t translation_ticks =
+              Clock::QueryHostTickCount() - translation_start_ticks;
+          ++backend_statistics.translation_count;
+          backend_statistics.ticks += translation_ticks;
+          if (translation_ticks > backend_statistics.max_ticks) {
+            backend_statistics.max_ticks = translation_ticks;
+            backend_statistics.max_ticks_ucode_data_hash =
+                batch_shader.ucode_data_hash;
+            backend_statistics.max_ticks_modification = modification;
+          }
+
+          // The translated or, if optimized, the optimized code.
+          const uint8_t* output_data = translation.translated_binary().data();
+          size_t output_size = translation.translated_binary().size();
+
+          std::string failure;
+          if (!translated || !translation.is_valid()) {
+            failure = "translation failed";
+            for (const Shader::Error& error : translation.errors()) {
+              failure.append(": ");
+              failure.append(error.message);
+            }
+          } else if (backend == kBackendSpirv) {
+            if (optimize_spirv) {
+              SpirvOptimizationStatistics& optimization_statistics =
+                  statistics.spirv_optimization;
+              const uint32_t* spirv =
+                  reinterpret_cast<const uint32_t*>(output_data);
+              size_t spirv_word_count = output_size / sizeof(uint32_t);
+              uint64_t optimization_start_ticks = Clock::QueryHostTickCount();
+              spv_result_t optimization_result = spirv_tools_context.Optimize(
+                  spirv, spirv_word_count, spirv_optimized);
+              ++optimization_statistics.shader_count;
+              optimization_statistics.optimization_ticks +=
+                  Clock::QueryHostTickCount() - optimization_start_ticks;
+              optimization_statistics.translation_ticks += translation_ticks;
+              optimization_statistics.instructions_before +=
+                  CountSpirvInstructions(spirv, spirv_word_count);
+              optimization_statistics.bytes_before += output_size;
+              if (optimization_result == SPV_SUCCESS &&
+                  !spirv_optimized.empty()) {
+                output_data =
+                    reinterpret_cast<const uint8_t*>(spirv_optimized.data());
+                output_size = sizeof(uint32_t) * spirv_optimized.size();
+                optimization_statistics.instructions_after +=
+                    CountSpirvInstructions(spirv_optimized.data(),
+                                           spirv_optimized.size());
+              } else {
+                ++optimization_statistics.failure_count;
+                optimization_statistics.instructions_after +=
+                    CountSpirvInstructions(spirv, spirv_word_count);
+                failure = fmt::format("optimization failed with error {}",
+                                      int(optimization_result));
+              }
+              optimization_statistics.bytes_after += output_size;
+            }
+            if (failure.empty() && validate_spirv) {
+              std::string spirv_validation_error;
+              spirv_tools_context.Validate(
+                  reinterpret_cast<const uint32_t*>(output_data),
+                  output_size / sizeof(uint32_t), &spirv_validation_error);
+              if (!spirv_validation_error.empty()) {
+                failure = "validation failed: " + spirv_validation_error;
+              }
+            }
+          }
+          if (!failure.empty()) {
+            ++backend_statistics.failure_count;
+            std::lock_guard<std::mutex> lock(failures_mutex);
+            failures.push_back(fmt::format(
+                "{:016X} {} shader, {} modification {:016X}: {}",
+                batch_shader.ucode_data_hash,
+                batch_shader.type == xenos::ShaderType::kVertex ? "vertex"
+                                                                : "pixel",
+                kBackendNames[backend], modification, failure));
+          }
+
+          if (write_output && translated) {
+            std::filesystem::path output_path =
+                cvars::shader_output /
+                fmt::format("{:016X}.{}.{:016X}.{}",
+                            batch_shader.ucode_data_hash,
+                            batch_shader.type == xenos::ShaderType::kVertex
+                                ? "vs"
+                                : "ps",
+                            modification, kBackendExtensions[backend]);
+            FILE* output_file = filesystem::OpenFile(output_path, "wb");
+            if (output_file) {
+              fwrite(output_data, 1, output_size, output_file);
+              fclose(output_file);
+            }
+          }
+          // The modification bits of the backends overlap, and translations
+          // of different backends can't be stored in the same shader.
+          shader.DestroyTranslation(modification);
+        }
+      }
+    }
+  };
+
+  uint64_t translation_start_ticks = Clock::QueryHostTickCount();
+  std::vector<std::unique_ptr<xe::threading::Thread>> translation_threads;
+  translation_threads.reserve(thread_count);
+  for (uint32_t i = 0; i < thread_count; ++i) {
+    ThreadStatistics& statistics = thread_statistics[i];
+    auto thread = xe::threading::Thread::Create(
+        {}, [&translation_thread_function, &statistics]() {
+          translation_thread_function(statistics);
+        });
+    assert_not_null(thread);
+    thread->set_name("Shader Translation");
+    translation_threads.push_back(std::move(thread));
+  }
+  for (auto& translation_thread : translation_threads) {
+    xe::threading::Wait(translation_thread.get(), false);
+  }
+  uint64_t translation_wall_ticks =
+      Clock::QueryHostTickCount() - translation_start_ticks;
+
+  std::sort(failures.begin(), failures.end());
+  for (const std::string& failure : failures) {
+    XELOGE("{}", failure);
+  }
+
+  double ticks_to_ms = 1000.0 / double(tick_frequency);
+  uint64_t analysis_ticks = 0;
+  for (const ThreadStatistics& statistics : thread_statistics) {
+    analysis_ticks += statistics.analysis_ticks;
+  }
+  XELOGI(
+      "Translated {} shaders on {} threads in {:.3f} ms, ucode analysis took "
+      "{:.3f} ms of thread time",
+      shaders.size(), thread_count, translation_wall_ticks * ticks_to_ms,
+      analysis_ticks * ticks_to_ms);
+  uint64_t failure_count = 0;
+  for (uint32_t backend = 0; backend < kBackendCount; ++backend) {
+    BackendStatistics backend_statistics;
+    for (const ThreadStatistics& statistics : thread_statistics) {
+      const BackendStatistics& thread_backend_statistics =
+          statistics.backends[backend];
+      backend_statistics.translation_count +=
+          thread_backend_statistics.translation_count;
+      backend_statistics.failure_count +=
+          thread_backend_statistics.failure_count;
+      backend_statistics.ticks += thread_backend_statistics.ticks;
+      if (thread_backend_statistics.max_ticks > backend_statistics.max_ticks) {
+        backend_statistics.max_ticks = thread_backend_statistics.max_ticks;
+        backend_statistics.max_ticks_ucode_data_hash =
+            thread_backend_statistics.max_ticks_ucode_data_hash;
+        backend_statistics.max_ticks_modification =
+            thread_backend_statistics.max_ticks_modification;
+      }
+    }
+    failure_count += backend_statistics.failure_count;
+    XELOGI(
+        "{}: {} translations, {} failed, {:.3f} ms of thread time ({:.3f} ms "
+        "average), slowest {:.3f} ms for {:016X} modification {:016X}",
+        kBackendNames[backend], backend_statistics.translation_count,
+        backend_statistics.failure_count,
+        backend_statistics.ticks * ticks_to_ms,
+        backend_statistics.translation_count
+            ? backend_statistics.ticks * ticks_to_ms /
+                  backend_statistics.translation_count
+            : 0.0,
+        backend_statistics.max_ticks * ticks_to_ms,
+        backend_statistics.max_ticks_ucode_data_hash,
+        backend_statistics.max_ticks_modification);
+  }
+  if (cvars::shader_batch_optimize_spirv) {
+    SpirvOptimizationStatistics optimization_statistics;
+    for (const ThreadStatistics& statistics : thread_statistics) {
+      const SpirvOptimizationStatistics& thread_optimization_statistics =
+          statistics.spirv_optimization;
+      optimization_statistics.shader_count +=
+          thread_optimization_statistics.shader_count;
+      optimization_statistics.failure_count +=
+          thread_optimization_statistics.failure_count;
+      optimization_statistics.instructions_before +=
+          thread_optimization_statistics.instructions_before;
+      optimization_statistics.instructions_after +=
+          thread_optimization_statistics.instructions_after;
+      optimization_statistics.bytes_before +=
+          thread_optimization_statistics.bytes_before;
+      optimization_statistics.bytes_after +=
+          thread_optimization_statistics.bytes_after;
+      optimization_statistics.translation_ticks +=
+          thread_optimization_statistics.translation_ticks;
+      optimization_statistics.optimization_ticks +=
+          thread_optimization_statistics.optimization_ticks;
+    }
+    if (optimization_statistics.shader_count) {
+      XELOGI(
+          "SPIR-V optimization: {} translations, {} failed, {} -> {} "
+          "instructions ({:+.1f}%), {} -> {} bytes, {:.3f} ms of translation "
+          "and {:.3f} ms of optimization thread time",
+          optimization_statistics.shader_count,
+          optimization_statistics.failure_count,
+          optimization_statistics.instructions_before,
+          optimization_statistics.instructions_after,
+          optimization_statistics.instructions_before
+              ? (double(optimization_statistics.instructions_after) /
+                     double(optimization_statistics.instructions_before) -
+                 1.0) *
+                    100.0
+              : 0.0,
+          optimization_statistics.bytes_before,
+          optimization_statistics.bytes_after,
+          optimization_statistics.translation_ticks * ticks_to_ms,
+          optimization_statistics.optimization_ticks * ticks_to_ms);
+    } else {
+      XELOGW(
+          "SPIR-V optimization was requested, but the SPIRV-Tools optimizer is "
+          "unavailable");
+    }
+  }
+
+  return failure_count ? 1 : 0;
+}
+
 int shader_compiler_main(const std::vector<std::string>& args) {
+  if (std::filesystem::is_directory(cvars::shader_input) ||
+      cvars::shader_input.extension() == ".xsh") {
+    return shader_compiler_batch_main();
+  }
+
   xenos::ShaderType shader_type;
   if (!cvars::shader_input_type.empty()) {
     if (cvars::shader_input_type == "vs") {
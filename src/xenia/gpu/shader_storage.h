@@ -0,0 +1,49 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_GPU_SHADER_STORAGE_H_
+#define XENIA_GPU_SHADER_STORAGE_H_
+
+#include <cstdint>
+
+#include "xenia/base/platform.h"
+#include "xenia/gpu/xenos.h"
+
+namespace xe {
+namespace gpu {
+
+// Guest shader storage (.xsh) file format, the same for all the GPU backends,
+// so the files are shareable between them:
+// - ShaderStorageFileHeader.
+// - ShaderStoredHeader and the ucode dwords, with the guest endianness, of
+//   every shader, until the end of the file or the first corrupted shader.
+
+// 'XESH'.
+constexpr uint32_t kShaderStorageMagic = 0x48534558;
+
+struct ShaderStorageFileHeader {
+  // Set to kShaderStorageMagic.
+  uint32_t magic;
+  // ShaderStoredHeader::kVersion, big-endian.
+  uint32_t version_swapped;
+};
+
+XEPACKEDSTRUCT(ShaderStoredHeader, {
+  uint64_t ucode_data_hash;
+
+  uint32_t ucode_dword_count : 31;
+  xenos::ShaderType type : 1;
+
+  static constexpr uint32_t kVersion = 0x20201219;
+});
+
+}  // namespace gpu
+}  // namespace xe
+
+#endif  // XENIA_GPU_SHADER_STORAGE_H_
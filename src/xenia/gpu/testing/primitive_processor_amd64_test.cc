@@ -0,0 +1,413 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/gpu/primitive_processor_amd64.h"
+
+#if XE_ARCH_AMD64
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "third_party/catch/include/catch.hpp"
+
+#include "xenia/base/cvar.h"
+#include "xenia/base/platform_amd64.h"
+#include "xenia/gpu/primitive_processor.h"
+
+DECLARE_int64(x64_extension_mask);
+
+namespace xe {
+namespace gpu {
+namespace test {
+
+using namespace primitive_processor_amd64;
+
+// The levels the host can run, from the lowest.
+static std::vector<WideSimdLevel> GetSupportedLevels() {
+  amd64::InitFeatureFlags();
+  WideSimdLevel host_level = GetHostWideSimdLevel();
+  std::vector<WideSimdLevel> levels;
+  for (WideSimdLevel level :
+       {WideSimdLevel::kNone, WideSimdLevel::kAVX2,
+        WideSimdLevel::kAVX512BW}) {
+    if (int(level) <= int(host_level)) {
+      levels.push_back(level);
+    }
+  }
+  return levels;
+}
+
+// Indices with frequent occurrences of the reset index and 0xFFFF(FFFF), and of
+// values differing from the reset index only in the ignored bits (the ones
+// masked out for 24-bit indices).
+template <typename T>
+static std::vector<T> GenerateIndices(std::mt19937& random, size_t count,
+                                      T reset_index, T ignored_bits = 0) {
+  std::uniform_int_distribution<uint32_t> kind_distribution(0, 7);
+  std::uniform_int_distribution<uint64_t> value_distribution(0, T(~T(0)));
+  std::vector<T> indices(count);
+  for (T& index : indices) {
+    switch (kind_distribution(random)) {
+      case 0:
+        index = reset_index;
+        break;
+      case 1:
+        index = T(~T(0));
+        break;
+      case 2:
+        index = T(reset_index | (T(value_distribution(random)) & ignored_bits));
+        break;
+      default:
+        index = T(value_distribution(random));
+        break;
+    }
+  }
+  return indices;
+}
+
+// The PrimitiveProcessor functions the wide loops are used in, as the
+// reference, with the wide loops disabled while a ScopedNoWideSimd exists.
+class ReferencePrimitiveProcessor : public PrimitiveProcessor {
+ public:
+  using PrimitiveProcessor::Get16BitResetIndexUsage;
+  using PrimitiveProcessor::IsResetUsed;
+  using PrimitiveProcessor::ReplaceResetIndex16To16;
+  using PrimitiveProcessor::ReplaceResetIndex16To24;
+
+  static void ReplaceResetIndex32To24(uint32_t* dest, const uint32_t* source,
+                                      uint32_t count,
+                                      uint32_t reset_index_guest_endian,
+                                      uint32_t low_bits_mask_guest_endian,
+                                      xenos::Endian host_swap) {
+    switch (host_swap) {
+      case xenos::Endian::k8in16:
+        PrimitiveProcessor::ReplaceResetIndex32To24<xenos::Endian::k8in16>(
+            dest, source, count, reset_index_guest_endian,
+            low_bits_mask_guest_endian);
+        break;
+      case xenos::Endian::k8in32:
+        PrimitiveProcessor::ReplaceResetIndex32To24<xenos::Endian::k8in32>(
+            dest, source, count, reset_index_guest_endian,
+            low_bits_mask_guest_endian);
+        break;
+      case xenos::Endian::k16in32:
+        PrimitiveProcessor::ReplaceResetIndex32To24<xenos::Endian::k16in32>(
+            dest, source, count, reset_index_guest_endian,
+            low_bits_mask_guest_endian);
+        break;
+      default:
+        PrimitiveProcessor::ReplaceResetIndex32To24<xenos::Endian::kNone>(
+            dest, source, count, reset_index_guest_endian,
+            low_bits_mask_guest_endian);
+        break;
+    }
+  }
+};
+using Reference = ReferencePrimitiveProcessor;
+
+// Makes GetHostWideSimdLevel return kNone, so the PrimitiveProcessor only
+// uses its 128-bit and scalar loops. The wide functions being tested take the
+// level explicitly and aren't affected.
+class ScopedNoWideSimd {
+ public:
+  ScopedNoWideSimd() : original_mask_(cvars::x64_extension_mask) {
+    cvars::x64_extension_mask = 0;
+    amd64::InitFeatureFlags();
+    REQUIRE(GetHostWideSimdLevel() == WideSimdLevel::kNone);
+  }
+  ~ScopedNoWideSimd() {
+    cvars::x64_extension_mask = original_mask_;
+    amd64::InitFeatureFlags();
+  }
+
+ private:
+  int64_t original_mask_;
+};
+
+// Various lengths around the vector sizes, and offsets to check unaligned
+// pointers.
+static const uint32_t kTestCounts[] = {0,  1,  7,   8,   15,  16,   17,
+                                       31, 32, 33,  63,  64,  100,  257,
+                                       1000, 4099};
+static const uint32_t kTestOffsets[] = {0, 1, 3, 8};
+
+TEST_CASE("Wide 16-bit reset index scanning", "[primitive_processor]") {
+  std::mt19937 random(1);
+  std::vector<WideSimdLevel> levels = GetSupportedLevels();
+  ScopedNoWideSimd no_wide_simd;
+  for (WideSimdLevel level : levels) {
+    for (uint32_t count : kTestCounts) {
+      for (uint32_t offset : kTestOffsets) {
+        // Sparse reset indices so whole vectors are scanned, and no reset
+        // indices at all.
+        for (uint32_t density = 0; density < 3; ++density) {
+          uint16_t reset_index = uint16_t(random());
+          std::vector<uint16_t> indices =
+              GenerateIndices<uint16_t>(random, offset + count, reset_index);
+          if (density) {
+            std::replace(indices.begin(), indices.end(), reset_index,
+                         uint16_t(reset_index + 1));
+            if (density == 2 && count) {
+              indices[offset + random() % count] = reset_index;
+            }
+          }
+          const uint16_t* source = indices.data() + offset;
+          bool expected = Reference::IsResetUsed(source, count, reset_index);
+
+          const uint16_t* wide_source = source;
+          uint32_t wide_count = count;
+          bool result =
+              IsResetUsed16(level, wide_source, wide_count, reset_index);
+          if (!result) {
+            REQUIRE(wide_source + wide_count == source + count);
+            result =
+                Reference::IsResetUsed(wide_source, wide_count, reset_index);
+          }
+          REQUIRE(result == expected);
+
+          // The PrimitiveProcessor uses IsResetUsed for the reset index
+          // 0xFFFF instead.
+          if (reset_index == UINT16_MAX) {
+            continue;
+          }
+          bool expected_reset, expected_ffff;
+          Reference::Get16BitResetIndexUsage(source, count, reset_index,
+                                             expected_reset, expected_ffff);
+          bool reset = false, ffff = false;
+          wide_source = source;
+          wide_count = count;
+          Get16BitResetIndexUsage(level, wide_source, wide_count, reset_index,
+                                  reset, ffff);
+          REQUIRE(wide_source + wide_count == source + count);
+          bool rest_reset, rest_ffff;
+          Reference::Get16BitResetIndexUsage(wide_source, wide_count,
+                                             reset_index, rest_reset,
+                                             rest_ffff);
+          REQUIRE((reset || rest_reset) == expected_reset);
+          REQUIRE((ffff || rest_ffff) == expected_ffff);
+        }
+      }
+    }
+  }
+}
+
+TEST_CASE("Wide 32-bit reset index scanning", "[primitive_processor]") {
+  std::mt19937 random(2);
+  std::vector<WideSimdLevel> levels = GetSupportedLevels();
+  ScopedNoWideSimd no_wide_simd;
+  for (WideSimdLevel level : levels) {
+    for (xenos::Endian endian :
+         {xenos::Endian::kNone, xenos::Endian::k8in16, xenos::Endian::k8in32,
+          xenos::Endian::k16in32}) {
+      uint32_t low_bits_mask =
+          xenos::GpuSwapInline(xenos::kVertexIndexMask, endian);
+      for (uint32_t count : kTestCounts) {
+        for (uint32_t offset : kTestOffsets) {
+          for (uint32_t density = 0; density < 3; ++density) {
+            uint32_t reset_index = uint32_t(random()) & low_bits_mask;
+            std::vector<uint32_t> indices = GenerateIndices<uint32_t>(
+                random, offset + count, reset_index, ~low_bits_mask);
+            if (density) {
+              // Flipping the lowest bit that is not ignored.
+              uint32_t changed_bit = low_bits_mask & (low_bits_mask - 1);
+              changed_bit ^= low_bits_mask;
+              for (uint32_t& index : indices) {
+                if ((index & low_bits_mask) == reset_index) {
+                  index ^= changed_bit;
+                }
+              }
+              if (density == 2 && count) {
+                indices[offset + random() % count] =
+                    reset_index | ~low_bits_mask;
+              }
+            }
+            const uint32_t* source = indices.data() + offset;
+            bool expected = Reference::IsResetUsed(source, count, reset_index,
+                                                   low_bits_mask);
+
+            const uint32_t* wide_source = source;
+            uint32_t wide_count = count;
+            bool result = IsResetUsed32(level, wide_source, wide_count,
+                                        reset_index, low_bits_mask);
+            if (!result) {
+              REQUIRE(wide_source + wide_count == source + count);
+              result = Reference::IsResetUsed(wide_source, wide_count,
+                                              reset_index, low_bits_mask);
+            }
+            REQUIRE(result == expected);
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST_CASE("Wide 16-bit reset index replacement", "[primitive_processor]") {
+  std::mt19937 random(3);
+  std::vector<WideSimdLevel> levels = GetSupportedLevels();
+  ScopedNoWideSimd no_wide_simd;
+  for (WideSimdLevel level : levels) {
+    for (uint32_t count : kTestCounts) {
+      for (uint32_t offset : kTestOffsets) {
+        uint16_t reset_index = uint16_t(random());
+        std::vector<uint16_t> indices =
+            GenerateIndices<uint16_t>(random, offset + count, reset_index);
+        const uint16_t* source = indices.data() + offset;
+
+        std::vector<uint16_t> expected_16(count), result_16(count);
+        Reference::ReplaceResetIndex16To16(expected_16.data(), source, count,
+                                           reset_index);
+        uint16_t* dest_16 = result_16.data();
+        const uint16_t* wide_source = source;
+        uint32_t wide_count = count;
+        ReplaceResetIndex16To16(level, dest_16, wide_source, wide_count,
+                                reset_index);
+        REQUIRE(wide_source + wide_count == source + count);
+        REQUIRE(dest_16 - result_16.data() == wide_source - source);
+        Reference::ReplaceResetIndex16To16(dest_16, wide_source, wide_count,
+                                           reset_index);
+        REQUIRE(result_16 == expected_16);
+
+        std::vector<uint32_t> expected_24(count), result_24(count);
+        Reference::ReplaceResetIndex16To24(expected_24.data(), source, count,
+                                           reset_index);
+        uint32_t* dest_24 = result_24.data();
+        wide_source = source;
+        wide_count = count;
+        ReplaceResetIndex16To24(level, dest_24, wide_source, wide_count,
+                                reset_index);
+        REQUIRE(wide_source + wide_count == source + count);
+        REQUIRE(dest_24 - result_24.data() == wide_source - source);
+        Reference::ReplaceResetIndex16To24(dest_24, wide_source, wide_count,
+                                           reset_index);
+        REQUIRE(result_24 == expected_24);
+      }
+    }
+  }
+}
+
+TEST_CASE("Wide 32-bit reset index replacement", "[primitive_processor]") {
+  std::mt19937 random(4);
+  std::vector<WideSimdLevel> levels = GetSupportedLevels();
+  ScopedNoWideSimd no_wide_simd;
+  for (WideSimdLevel level : levels) {
+    for (xenos::Endian guest_endian :
+         {xenos::Endian::kNone, xenos::Endian::k8in32}) {
+      for (xenos::Endian host_swap :
+           {xenos::Endian::kNone, xenos::Endian::k8in16, xenos::Endian::k8in32,
+            xenos::Endian::k16in32}) {
+        uint32_t low_bits_mask =
+            xenos::GpuSwapInline(xenos::kVertexIndexMask, guest_endian);
+        for (uint32_t count : kTestCounts) {
+          for (uint32_t offset : kTestOffsets) {
+            uint32_t reset_index = uint32_t(random()) & low_bits_mask;
+            std::vector<uint32_t> indices = GenerateIndices<uint32_t>(
+                random, offset + count, reset_index, ~low_bits_mask);
+            const uint32_t* source = indices.data() + offset;
+            std::vector<uint32_t> expected(count), result(count);
+            Reference::ReplaceResetIndex32To24(expected.data(), source, count,
+                                               reset_index, low_bits_mask,
+                                               host_swap);
+            uint32_t* dest = result.data();
+            const uint32_t* wide_source = source;
+            uint32_t wide_count = count;
+            ReplaceResetIndex32To24(level, dest, wide_source, wide_count,
+                                    reset_index, low_bits_mask, host_swap);
+            REQUIRE(wide_source + wide_count == source + count);
+            REQUIRE(dest - result.data() == wide_source - source);
+            Reference::ReplaceResetIndex32To24(dest, wide_source, wide_count,
+                                               reset_index, low_bits_mask,
+                                               host_swap);
+            REQUIRE(result == expected);
+          }
+        }
+      }
+    }
+  }
+}
+
+static const char* GetLevelName(WideSimdLevel level) {
+  switch (level) {
+    case WideSimdLevel::kAVX2:
+      return "AVX2";
+    case WideSimdLevel::kAVX512BW:
+      return "AVX-512";
+    default:
+      return "128-bit";
+  }
+}
+
+TEST_CASE("Wide index conversion benchmark",
+          "[primitive_processor][.][benchmark]") {
+  // A large index buffer without primitive reset, converted repeatedly, as
+  // done for every draw with the 24-bit host index conversion.
+  constexpr uint32_t kIndexCount = 1 << 20;
+  constexpr uint32_t kIterations = 64;
+  std::mt19937 random(5);
+  uint32_t reset_index = xenos::kVertexIndexMask;
+  std::vector<uint32_t> indices(kIndexCount);
+  for (uint32_t& index : indices) {
+    index = uint32_t(random()) & (xenos::kVertexIndexMask - 1);
+  }
+  std::vector<uint16_t> indices_16(kIndexCount);
+  for (uint32_t i = 0; i < kIndexCount; ++i) {
+    indices_16[i] = uint16_t(indices[i] & 0xFFFE);
+  }
+  std::vector<uint32_t> dest(kIndexCount);
+
+  std::vector<WideSimdLevel> levels = GetSupportedLevels();
+  ScopedNoWideSimd no_wide_simd;
+  for (WideSimdLevel level : levels) {
+    auto start_time = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < kIterations; ++i) {
+      uint32_t* wide_dest = dest.data();
+      const uint32_t* wide_source = indices.data();
+      uint32_t wide_count = kIndexCount;
+      ReplaceResetIndex32To24(level, wide_dest, wide_source, wide_count,
+                              reset_index, xenos::kVertexIndexMask,
+                              xenos::Endian::k8in32);
+      Reference::ReplaceResetIndex32To24(wide_dest, wide_source, wide_count,
+                                         reset_index, xenos::kVertexIndexMask,
+                                         xenos::Endian::k8in32);
+    }
+    auto elapsed_32 = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start_time);
+
+    bool is_reset_used = false;
+    start_time = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < kIterations; ++i) {
+      const uint16_t* wide_source = indices_16.data();
+      uint32_t wide_count = kIndexCount;
+      if (IsResetUsed16(level, wide_source, wide_count, 0xFFFF) ||
+          Reference::IsResetUsed(wide_source, wide_count, 0xFFFF)) {
+        is_reset_used = true;
+      }
+    }
+    auto elapsed_16 = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start_time);
+    REQUIRE(!is_reset_used);
+
+    double index_count = double(uint64_t(kIndexCount) * kIterations);
+    WARN(GetLevelName(level)
+         << ": 32-bit to 24-bit conversion "
+         << index_count / std::max(double(elapsed_32.count()), 1.0)
+         << " M indices/s, 16-bit reset scan "
+         << index_count / std::max(double(elapsed_16.count()), 1.0)
+         << " M indices/s");
+  }
+}
+
+}  // namespace test
+}  // namespace gpu
+}  // namespace xe
+
+#endif  // XE_ARCH_AMD64
@@ -0,0 +1,361 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/gpu/trace_reader.h"
+#include "xenia/gpu/trace_writer.h"
+
+#if XE_ENABLE_TRACE_WRITER_INSTRUMENTATION == 1
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+#include "third_party/catch/include/catch.hpp"
+#include "third_party/snappy/snappy.h"
+
+#include "xenia/base/byte_order.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/math.h"
+#include "xenia/base/memory.h"
+#include "xenia/gpu/trace_protocol.h"
+
+namespace xe {
+namespace gpu {
+namespace test {
+
+class TestTraceReader : public TraceReader {
+ public:
+  using TraceReader::DecodedBlobBlock;
+  using TraceReader::DecompressMemory;
+  using TraceReader::ResolveMemoryReference;
+
+  // Whether the file ends with a footer locating the frame index.
+  bool HasFooter(uint32_t frame_count) const {
+    if (trace_size_ < sizeof(TraceHeader) + sizeof(TraceFooter)) {
+      return false;
+    }
+    TraceFooter footer;
+    std::memcpy(&footer, trace_data_ + trace_size_ - sizeof(footer),
+                sizeof(footer));
+    return footer.magic == kTraceFooterMagic &&
+           footer.frame_count == frame_count;
+  }
+
+  // Size of the indices and the footer at the end of a cleanly closed file.
+  size_t GetIndicesSize() const {
+    return sizeof(uint64_t) * (frame_index_.size() + blob_block_index_.size()) +
+           sizeof(TraceFooter);
+  }
+
+  // Whether the frame is stored as multiple blocks.
+  bool IsFrameSplit(int n) const {
+    TraceBlockHeader block_header;
+    std::memcpy(&block_header, trace_data_ + frame_index_[n],
+                sizeof(block_header));
+    return block_header.continued != 0;
+  }
+};
+
+// Guest memory layout of the test trace.
+constexpr uint32_t kPacketAddress = 0x100;
+constexpr uint32_t kReadAddress = 0x1000;
+constexpr uint32_t kDuplicateReadAddress = 0x2000;
+constexpr uint32_t kSmallReadAddress = 0x3000;
+constexpr uint32_t kReadLength = 1024;
+constexpr uint32_t kSmallReadLength = 16;
+
+// Returns the commands of the given type in a decoded frame.
+static std::vector<const uint8_t*> FindCommands(const TraceReader::Frame& frame,
+                                                TraceCommandType type) {
+  std::vector<const uint8_t*> commands;
+  const uint8_t* trace_ptr = frame.start_ptr;
+  while (trace_ptr < frame.end_ptr) {
+    auto command_type =
+        static_cast<TraceCommandType>(xe::load<uint32_t>(trace_ptr));
+    if (command_type == type) {
+      commands.push_back(trace_ptr);
+    }
+    switch (command_type) {
+      case TraceCommandType::kPacketStart: {
+        auto cmd = reinterpret_cast<const PacketStartCommand*>(trace_ptr);
+        trace_ptr += sizeof(*cmd) + cmd->count * 4;
+      } break;
+      case TraceCommandType::kPacketEnd:
+        trace_ptr += sizeof(PacketEndCommand);
+        break;
+      case TraceCommandType::kMemoryRead:
+      case TraceCommandType::kMemoryWrite: {
+        auto cmd = reinterpret_cast<const MemoryCommand*>(trace_ptr);
+        trace_ptr += sizeof(*cmd) + cmd->encoded_length;
+      } break;
+      case TraceCommandType::kMemoryReadReference:
+        trace_ptr += sizeof(MemoryReferenceCommand);
+        break;
+      case TraceCommandType::kEvent:
+        trace_ptr += sizeof(EventCommand);
+        break;
+      default:
+        FAIL("Unexpected trace command type");
+        return commands;
+    }
+  }
+  return commands;
+}
+
+// Returns the data of the only memory read reference in the frame, checking
+// that the reference is valid.
+static const uint8_t* ResolveOnlyReference(
+    const TestTraceReader& reader, const TraceReader::Frame& frame,
+    const MemoryReferenceCommand*& reference,
+    std::shared_ptr<const TestTraceReader::DecodedBlobBlock>& blob_block) {
+  auto references = FindCommands(frame, TraceCommandType::kMemoryReadReference);
+  REQUIRE(references.size() == 1);
+  reference = reinterpret_cast<const MemoryReferenceCommand*>(references[0]);
+  const uint8_t* data = reader.ResolveMemoryReference(*reference, blob_block);
+  REQUIRE(data);
+  REQUIRE(blob_block);
+  return data;
+}
+
+TEST_CASE("GPU trace round trip", "[gpu_trace]") {
+  std::vector<uint8_t> memory(0x4000);
+  // A type 2 (no-op) packet.
+  xe::store_and_swap<uint32_t>(memory.data() + kPacketAddress, 0x80000000);
+  for (uint32_t i = 0; i < kReadLength; ++i) {
+    memory[kReadAddress + i] = uint8_t(i * 7 + 3);
+  }
+  std::memcpy(memory.data() + kDuplicateReadAddress,
+              memory.data() + kReadAddress, kReadLength);
+  for (uint32_t i = 0; i < kSmallReadLength; ++i) {
+    memory[kSmallReadAddress + i] = uint8_t(0xF0 | i);
+  }
+
+  std::filesystem::path path =
+      std::filesystem::temp_directory_path() / "xenia_gpu_trace_test.xtr";
+  {
+    TraceWriter writer(memory.data());
+    REQUIRE(writer.Open(path, 0x4D5307E6));
+    // Frame 0 stores the data, frame 1 references the same data.
+    writer.WritePacketStart(kPacketAddress, 1);
+    writer.WriteMemoryRead(kReadAddress, kReadLength);
+    writer.WriteEvent(EventCommand::Type::kSwap);
+    writer.WritePacketEnd();
+    writer.WritePacketStart(kPacketAddress, 1);
+    writer.WriteMemoryRead(kDuplicateReadAddress, kReadLength);
+    writer.WriteMemoryRead(kSmallReadAddress, kSmallReadLength);
+    writer.WritePacketEnd();
+    writer.Close();
+  }
+
+  // Without the indices, the blocks are located by walking the file.
+  for (bool truncate_indices : {false, true}) {
+    TestTraceReader reader;
+    REQUIRE(reader.Open(xe::path_to_utf8(path)));
+    REQUIRE(reader.header()->title_id == 0x4D5307E6);
+    REQUIRE(reader.HasFooter(2) == !truncate_indices);
+    REQUIRE(reader.frame_count() == 2);
+    REQUIRE(reader.blob_block_count() == 1);
+
+    auto frame_0 = reader.frame(0);
+    REQUIRE(frame_0);
+    // Large reads are stored in the blob blocks.
+    REQUIRE(FindCommands(*frame_0, TraceCommandType::kMemoryRead).empty());
+    const MemoryReferenceCommand* reference_0;
+    std::shared_ptr<const TestTraceReader::DecodedBlobBlock> blob_block_0;
+    const uint8_t* data_0 =
+        ResolveOnlyReference(reader, *frame_0, reference_0, blob_block_0);
+    REQUIRE(reference_0->base_ptr == kReadAddress);
+    REQUIRE(reference_0->length == kReadLength);
+    REQUIRE(!std::memcmp(data_0, memory.data() + kReadAddress, kReadLength));
+    REQUIRE(FindCommands(*frame_0, TraceCommandType::kEvent).size() == 1);
+
+    auto frame_1 = reader.frame(1);
+    REQUIRE(frame_1);
+    // The duplicate read references the data stored for frame 0.
+    const MemoryReferenceCommand* reference_1;
+    std::shared_ptr<const TestTraceReader::DecodedBlobBlock> blob_block_1;
+    const uint8_t* data_1 =
+        ResolveOnlyReference(reader, *frame_1, reference_1, blob_block_1);
+    REQUIRE(reference_1->base_ptr == kDuplicateReadAddress);
+    REQUIRE(reference_1->blob_block == reference_0->blob_block);
+    REQUIRE(reference_1->blob_offset == reference_0->blob_offset);
+    REQUIRE(!std::memcmp(data_1, memory.data() + kDuplicateReadAddress,
+                         kReadLength));
+    // Reads below the deduplication threshold are stored in the frame.
+    auto reads_1 = FindCommands(*frame_1, TraceCommandType::kMemoryRead);
+    REQUIRE(reads_1.size() == 1);
+    auto read_1 = reinterpret_cast<const MemoryCommand*>(reads_1[0]);
+    REQUIRE(read_1->base_ptr == kSmallReadAddress);
+    REQUIRE(!std::memcmp(read_1 + 1, memory.data() + kSmallReadAddress,
+                         kSmallReadLength));
+
+    size_t indices_size = reader.GetIndicesSize();
+    reader.Close();
+    if (!truncate_indices) {
+      std::filesystem::resize_file(
+          path, std::filesystem::file_size(path) - indices_size);
+    }
+  }
+
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("GPU trace deduplication across frames", "[gpu_trace]") {
+  std::vector<uint8_t> memory(0x4000);
+  xe::store_and_swap<uint32_t>(memory.data() + kPacketAddress, 0x80000000);
+  for (uint32_t i = 0; i < kReadLength; ++i) {
+    memory[kReadAddress + i] = uint8_t(i * 5 + 1);
+  }
+
+  std::filesystem::path path = std::filesystem::temp_directory_path() /
+                               "xenia_gpu_trace_deduplication_test.xtr";
+  // The same data is read in every frame, and must be stored only once
+  // regardless of how many frames ago it was stored.
+  const uint32_t frame_count = 32;
+  {
+    TraceWriter writer(memory.data());
+    REQUIRE(writer.Open(path, 0));
+    for (uint32_t i = 0; i < frame_count; ++i) {
+      writer.WritePacketStart(kPacketAddress, 1);
+      writer.WriteMemoryRead(kReadAddress, kReadLength);
+      writer.WriteEvent(EventCommand::Type::kSwap);
+      writer.WritePacketEnd();
+    }
+    writer.Close();
+  }
+
+  TestTraceReader reader;
+  REQUIRE(reader.Open(xe::path_to_utf8(path)));
+  REQUIRE(reader.frame_count() == int(frame_count));
+  REQUIRE(reader.blob_block_count() == 1);
+  // Resolving references doesn't depend on the earlier frames being decoded.
+  for (uint32_t i = frame_count; i-- > 0;) {
+    auto frame = reader.frame(int(i));
+    REQUIRE(frame);
+    REQUIRE(FindCommands(*frame, TraceCommandType::kMemoryRead).empty());
+    const MemoryReferenceCommand* reference;
+    std::shared_ptr<const TestTraceReader::DecodedBlobBlock> blob_block;
+    const uint8_t* data =
+        ResolveOnlyReference(reader, *frame, reference, blob_block);
+    REQUIRE(reference->blob_block == 0);
+    REQUIRE(reference->blob_offset == 0);
+    REQUIRE(!std::memcmp(data, memory.data() + kReadAddress, kReadLength));
+  }
+
+  reader.Close();
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("GPU trace large frame", "[gpu_trace]") {
+  std::vector<uint8_t> memory(0x4000);
+  xe::store_and_swap<uint32_t>(memory.data() + kPacketAddress, 0x80000000);
+  for (uint32_t i = 0; i < kSmallReadLength; ++i) {
+    memory[kSmallReadAddress + i] = uint8_t(0xA0 | i);
+  }
+  // More than the writer buffers for one block.
+  std::vector<uint32_t> large_data((size_t(40) << 20) / sizeof(uint32_t));
+  for (size_t i = 0; i < large_data.size(); ++i) {
+    large_data[i] = uint32_t(i * 0x9E3779B9);
+  }
+  const uint32_t large_data_size =
+      uint32_t(large_data.size() * sizeof(uint32_t));
+
+  std::filesystem::path path = std::filesystem::temp_directory_path() /
+                               "xenia_gpu_trace_large_frame_test.xtr";
+  {
+    TraceWriter writer(memory.data());
+    REQUIRE(writer.Open(path, 0));
+    // The write is stored in the frame, the read in a blob block, which is
+    // written between the blocks of the frame.
+    writer.WritePacketStart(kPacketAddress, 1);
+    writer.WriteMemoryWrite(0, large_data_size, large_data.data());
+    writer.WriteMemoryRead(0, large_data_size, large_data.data());
+    writer.WriteMemoryRead(kSmallReadAddress, kSmallReadLength);
+    writer.WriteEvent(EventCommand::Type::kSwap);
+    writer.WritePacketEnd();
+    writer.WritePacketStart(kPacketAddress, 1);
+    writer.WriteMemoryRead(kSmallReadAddress, kSmallReadLength);
+    writer.WritePacketEnd();
+    writer.Close();
+  }
+
+  TestTraceReader reader;
+  REQUIRE(reader.Open(xe::path_to_utf8(path)));
+  REQUIRE(reader.frame_count() == 2);
+  REQUIRE(reader.blob_block_count() == 1);
+  REQUIRE(reader.IsFrameSplit(0));
+  REQUIRE(!reader.IsFrameSplit(1));
+  for (int i = 0; i < 2; ++i) {
+    auto frame = reader.frame(i);
+    REQUIRE(frame);
+    if (!i) {
+      auto writes = FindCommands(*frame, TraceCommandType::kMemoryWrite);
+      REQUIRE(writes.size() == 1);
+      auto large_write = reinterpret_cast<const MemoryCommand*>(writes[0]);
+      REQUIRE(large_write->decoded_length == large_data_size);
+      REQUIRE(
+          !std::memcmp(large_write + 1, large_data.data(), large_data_size));
+      const MemoryReferenceCommand* reference;
+      std::shared_ptr<const TestTraceReader::DecodedBlobBlock> blob_block;
+      const uint8_t* data =
+          ResolveOnlyReference(reader, *frame, reference, blob_block);
+      REQUIRE(reference->length == large_data_size);
+      REQUIRE(!std::memcmp(data, large_data.data(), large_data_size));
+    }
+    auto reads = FindCommands(*frame, TraceCommandType::kMemoryRead);
+    REQUIRE(reads.size() == 1);
+    auto small_read = reinterpret_cast<const MemoryCommand*>(reads[0]);
+    REQUIRE(small_read->base_ptr == kSmallReadAddress);
+    REQUIRE(!std::memcmp(small_read + 1, memory.data() + kSmallReadAddress,
+                         kSmallReadLength));
+  }
+
+  reader.Close();
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("GPU trace decompression size checks", "[gpu_trace]") {
+  TestTraceReader reader;
+  uint8_t data[64];
+  for (size_t i = 0; i < xe::countof(data); ++i) {
+    data[i] = uint8_t(i);
+  }
+  uint8_t decoded[128];
+
+  REQUIRE(reader.DecompressMemory(MemoryEncodingFormat::kNone, data,
+                                  sizeof(data), decoded, sizeof(data)));
+  REQUIRE(!std::memcmp(decoded, data, sizeof(data)));
+  REQUIRE(!reader.DecompressMemory(MemoryEncodingFormat::kNone, data,
+                                   sizeof(data), decoded, sizeof(data) / 2));
+
+  std::vector<char> compressed(snappy::MaxCompressedLength(sizeof(data)));
+  size_t compressed_length;
+  snappy::RawCompress(reinterpret_cast<const char*>(data), sizeof(data),
+                      compressed.data(), &compressed_length);
+  REQUIRE(reader.DecompressMemory(MemoryEncodingFormat::kSnappy,
+                                  compressed.data(), compressed_length,
+                                  decoded, sizeof(data)));
+  REQUIRE(!std::memcmp(decoded, data, sizeof(data)));
+  // A destination of a different size than the stored data must be rejected
+  // instead of being overflowed or partially filled.
+  REQUIRE(!reader.DecompressMemory(MemoryEncodingFormat::kSnappy,
+                                   compressed.data(), compressed_length,
+                                   decoded, sizeof(data) / 2));
+  REQUIRE(!reader.DecompressMemory(MemoryEncodingFormat::kSnappy,
+                                   compressed.data(), compressed_length,
+                                   decoded, sizeof(decoded)));
+}
+
+}  // namespace test
+}  // namespace gpu
+}  // namespace xe
+
+#endif  // XE_ENABLE_TRACE_WRITER_INSTRUMENTATION
@@ -9,8 +9,11 @@
 
 #include "xenia/gpu/trace_player.h"
 
+#include <cstring>
 #include <memory>
 
+#include "xenia/base/clock.h"
+#include "xenia/base/logging.h"
 #include "xenia/gpu/command_processor.h"
 #include "xenia/gpu/graphics_system.h"
 #include "xenia/gpu/registers.h"
@@ -36,7 +39,7 @@ TracePlayer::TracePlayer(GraphicsSystem* graphics_system)
   assert_not_null(playback_event_);
 }
 
-const TraceReader::Frame* TracePlayer::current_frame() const {
+std::shared_ptr<const TraceReader::Frame> TracePlayer::current_frame() const {
   if (current_frame_index_ >= frame_count()) {
     return nullptr;
   }
@@ -47,8 +50,17 @@ void TracePlayer::SeekFrame(int target_frame) {
   if (current_frame_index_ == target_frame) {
     return;
   }
+  PlayFrame(target_frame);
+}
+
+void TracePlayer::PlayFrame(int target_frame) {
   current_frame_index_ = target_frame;
   auto frame = current_frame();
+  if (!frame) {
+    // Out of range or failed to decode.
+    current_command_index_ = -1;
+    return;
+  }
   current_command_index_ = int(frame->commands.size()) - 1;
 
   assert_true(frame->start_ptr <= frame->end_ptr);
@@ -89,9 +101,13 @@ void TracePlayer::PlayTrace(const uint8_t* trace_data, size_t trace_size,
                             TracePlaybackMode playback_mode,
                             bool clear_caches) {
   playing_trace_ = true;
-  graphics_system_->command_processor()->CallInThread([=]() {
-    PlayTraceOnThread(trace_data, trace_size, playback_mode, clear_caches);
-  });
+  // The trace data is in the current frame, keep it alive while playing.
+  std::shared_ptr<const DecodedFrame> playing_frame =
+      DecodeFrame(current_frame_index_);
+  graphics_system_->command_processor()->CallInThread(
+      [=, playing_frame = std::move(playing_frame)]() {
+        PlayTraceOnThread(trace_data, trace_size, playback_mode, clear_caches);
+      });
 }
 
 void TracePlayer::PlayTraceOnThread(const uint8_t* trace_data,
@@ -111,12 +127,16 @@ void TracePlayer::PlayTraceOnThread(const uint8_t* trace_data,
   playing_trace_ = true;
   auto trace_ptr = trace_data;
   bool pending_break = false;
+  bool break_playback = false;
   const PacketStartCommand* pending_packet = nullptr;
   while (trace_ptr < trace_data + trace_size) {
     playback_percent_ = uint32_t(
         (float(trace_ptr - trace_data) / float(trace_end - trace_data)) *
         10000);
 
+    const uint8_t* command_ptr = trace_ptr;
+    uint64_t command_start_ticks =
+        command_played_callback_ ? Clock::QueryHostTickCount() : 0;
     auto type = static_cast<TraceCommandType>(xe::load<uint32_t>(trace_ptr));
     switch (type) {
       case TraceCommandType::kPrimaryBufferStart: {
@@ -163,8 +183,7 @@ void TracePlayer::PlayTraceOnThread(const uint8_t* trace_data,
           pending_packet = nullptr;
         }
         if (pending_break) {
-          playing_trace_ = false;
-          return;
+          break_playback = true;
         }
         break;
       }
@@ -179,6 +198,23 @@ void TracePlayer::PlayTraceOnThread(const uint8_t* trace_data,
                                                     cmd->decoded_length);
         break;
       }
+      case TraceCommandType::kMemoryReadReference: {
+        auto cmd = reinterpret_cast<const MemoryReferenceCommand*>(trace_ptr);
+        trace_ptr += sizeof(*cmd);
+        std::shared_ptr<const DecodedBlobBlock> blob_block;
+        const uint8_t* data = ResolveMemoryReference(*cmd, blob_block);
+        if (!data) {
+          XELOGE(
+              "Invalid trace memory read reference to blob block {} offset {}",
+              cmd->blob_block, cmd->blob_offset);
+          break;
+        }
+        std::memcpy(memory->TranslatePhysical(cmd->base_ptr), data,
+                    cmd->length);
+        command_processor->TracePlaybackWroteMemory(cmd->base_ptr,
+                                                    cmd->length);
+        break;
+      }
       case TraceCommandType::kMemoryWrite: {
         auto cmd = reinterpret_cast<const MemoryCommand*>(trace_ptr);
         trace_ptr += sizeof(*cmd);
@@ -240,6 +276,14 @@ void TracePlayer::PlayTraceOnThread(const uint8_t* trace_data,
         break;
       }
     }
+
+    if (command_played_callback_) {
+      command_played_callback_(
+          type, command_ptr, Clock::QueryHostTickCount() - command_start_ticks);
+    }
+    if (break_playback) {
+      break;
+    }
   }
 
   playing_trace_ = false;
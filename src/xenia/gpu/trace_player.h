@@ -11,7 +11,10 @@
 #define XENIA_GPU_TRACE_PLAYER_H_
 
 #include <atomic>
+#include <functional>
+#include <memory>
 #include <string>
+#include <utility>
 
 #include "xenia/base/threading.h"
 #include "xenia/gpu/trace_protocol.h"
@@ -29,23 +32,36 @@ enum class TracePlaybackMode {
 
 class TracePlayer : public TraceReader {
  public:
+  // Called on the command processor thread after each trace command has been
+  // played, with the pointer to the command in the trace data and the host
+  // ticks spent playing it.
+  using CommandPlayedCallback = std::function<void(
+      TraceCommandType type, const uint8_t* command_ptr, uint64_t host_ticks)>;
+
   TracePlayer(GraphicsSystem* graphics_system);
 
   GraphicsSystem* graphics_system() const { return graphics_system_; }
   int current_frame_index() const { return current_frame_index_; }
   int current_command_index() const { return current_command_index_; }
   bool is_playing_trace() const { return playing_trace_; }
-  const Frame* current_frame() const;
+  std::shared_ptr<const Frame> current_frame() const;
 
   // Only valid if playing_trace is true.
   // Scalar from 0-10000
   uint32_t playback_percent() const { return playback_percent_; }
 
   void SeekFrame(int target_frame);
+  // Plays the frame even if it's the current one, for repeated playback.
+  void PlayFrame(int target_frame);
   void SeekCommand(int target_command);
 
   void WaitOnPlayback();
 
+  // Must not be changed while playing.
+  void set_command_played_callback(CommandPlayedCallback callback) {
+    command_played_callback_ = std::move(callback);
+  }
+
  private:
   void PlayTrace(const uint8_t* trace_data, size_t trace_size,
                  TracePlaybackMode playback_mode, bool clear_caches);
@@ -58,6 +74,7 @@ class TracePlayer : public TraceReader {
   bool playing_trace_ = false;
   std::atomic<uint32_t> playback_percent_ = {0};
   std::unique_ptr<xe::threading::Event> playback_event_;
+  CommandPlayedCallback command_played_callback_;
 };
 
 }  // namespace gpu
@@ -23,7 +23,26 @@ static const char kTraceExtension[] = "xtr";
 // Other changes besides the file format may require bumps, such as
 // anything that changes what is recorded into the files (new GPU
 // command processor commands, etc).
-constexpr uint32_t kTraceFormatVersion = 1;
+constexpr uint32_t kTraceFormatVersion = 5;
+
+// Layout of a trace file:
+// - TraceHeader.
+// - Frame blocks - TraceBlockHeader and the encoded command stream of each
+//   frame, with commands written back to back inside the decoded frame.
+//   Usually one block per frame, large frames are split into multiple blocks,
+//   which are concatenated after decoding.
+// - Blob blocks, interleaved with the frame blocks - TraceBlockHeader and the
+//   encoded data of memory reads, concatenated, referenced by the
+//   MemoryReferenceCommands of any frame. A blob block is written before the
+//   end of the first frame referencing it.
+// - Frame index: a uint64_t file offset of the first TraceBlockHeader of every
+//   frame.
+// - Blob block index: a uint64_t file offset of the TraceBlockHeader of every
+//   blob block.
+// - TraceFooter, at the very end of the file, locating the indices.
+// The indices and the footer are only written when the trace is closed
+// cleanly. Without them, the blocks can still be located by walking their
+// headers.
 
 // Trace file header identifying information about the trace.
 // This must be positioned at the start of the file and must only occur once.
@@ -55,6 +74,7 @@ enum class TraceCommandType : uint32_t {
   kEvent,
   kRegisters,
   kGammaRamp,
+  kMemoryReadReference,
 };
 
 struct PrimaryBufferStartCommand {
@@ -87,14 +107,57 @@ struct PacketEndCommand {
   TraceCommandType type;
 };
 
-// The compression format used for memory read/write buffers.
+// The compression format used for frame blocks and memory read/write buffers.
 // Note that not every memory read/write will have compressed data
-// (as it's silly to compress 4 byte buffers).
+// (as it's silly to compress 4 byte buffers, or data already inside a
+// compressed block).
 enum class MemoryEncodingFormat {
   // Data is in its raw form. encoded_length == decoded_length.
   kNone,
   // Data is compressed with third_party/snappy.
   kSnappy,
+  // Data is compressed with third_party/zstd.
+  kZstd,
+};
+
+enum class TraceBlockType : uint32_t {
+  // Commands of a frame.
+  kFrame,
+  // Data of memory reads, shared by all frames.
+  kBlob,
+};
+
+// Precedes the contents of a block in the trace file.
+struct TraceBlockHeader {
+  TraceBlockType type;
+  // Encoding format of the whole block in the trace file.
+  MemoryEncodingFormat encoding_format;
+  // Number of bytes the block occupies in the trace file after this header.
+  uint32_t encoded_length;
+  // Number of bytes the block contains after decoding.
+  uint32_t decoded_length;
+  // Nonzero if the commands of the frame continue in the next frame block.
+  // Always zero for blob blocks.
+  uint32_t continued;
+};
+
+// Must be the last 4 bytes of a cleanly closed trace file.
+constexpr uint32_t kTraceFooterMagic = 0x58545249;  // 'XTRI'
+
+// Positioned at the end of the file, after the indices.
+struct TraceFooter {
+  // File offset of the first frame index entry.
+  uint64_t frame_index_offset;
+  // File offset of the first blob block index entry.
+  uint64_t blob_block_index_offset;
+  // Number of uint64_t entries in the frame index.
+  uint32_t frame_count;
+  // Number of uint64_t entries in the blob block index.
+  uint32_t blob_block_count;
+  // Number of distinct memory reads stored in the blob blocks.
+  uint32_t blob_count;
+  // Set to kTraceFooterMagic.
+  uint32_t magic;
 };
 
 // Represents the GPU reading or writing data from or to memory.
@@ -113,6 +176,22 @@ struct MemoryCommand {
   uint32_t decoded_length;
 };
 
+// Represents the GPU reading data from memory, with the data stored in a blob
+// block. Identical data read multiple times, even from different addresses and
+// in different frames, is stored only once.
+struct MemoryReferenceCommand {
+  TraceCommandType type;
+
+  // Base physical memory pointer this read starts at.
+  uint32_t base_ptr;
+  // Number of bytes read.
+  uint32_t length;
+  // Index of the blob block containing the data in the blob block index.
+  uint32_t blob_block;
+  // Offset of the data in the decoded blob block.
+  uint32_t blob_offset;
+};
+
 // Represents a full 10 MB snapshot of EDRAM contents, for trace initialization
 // (since replaying the trace will reconstruct its state at any point later) as
 // a sequence of tiles with row-major samples (2x multisampling as 1x2 samples,
@@ -9,9 +9,12 @@
 
 #include "xenia/gpu/trace_reader.h"
 
+#include <algorithm>
 #include <cinttypes>
+#include <cstring>
 
 #include "third_party/snappy/snappy.h"
+#include "third_party/zstd/lib/zstd.h"
 #include "xenia/base/filesystem.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/mapped_memory.h"
@@ -43,6 +46,10 @@ bool TraceReader::Open(const std::string_view path) {
 
   trace_data_ = reinterpret_cast<const uint8_t*>(mmap_->data());
   trace_size_ = mmap_->size();
+  if (trace_size_ < sizeof(TraceHeader)) {
+    XELOGE("Trace file {} is too small to contain a header", path);
+    return false;
+  }
 
   // Verify version.
   auto header = reinterpret_cast<const TraceHeader*>(trace_data_);
@@ -62,34 +69,252 @@ bool TraceReader::Open(const std::string_view path) {
   XELOGI("    Commit: {}", commit_str);
   XELOGI("  Title ID: {}", header->title_id);
 
-  ParseTrace();
+  // Only the indices are read here, frames and blob blocks are decoded when
+  // they're requested.
+  LoadIndices();
+  XELOGI("    Frames: {}", frame_index_.size());
+  XELOGI("     Blobs: {} blocks", blob_block_index_.size());
 
   return true;
 }
 
 void TraceReader::Close() {
+  {
+    std::lock_guard<std::mutex> lock(decoded_frames_mutex_);
+    decoded_frames_.clear();
+  }
+  {
+    std::lock_guard<std::mutex> lock(decoded_blob_blocks_mutex_);
+    decoded_blob_blocks_.clear();
+  }
+  frame_index_.clear();
+  blob_block_index_.clear();
   mmap_.reset();
   trace_data_ = nullptr;
   trace_size_ = 0;
 }
 
-void TraceReader::ParseTrace() {
-  // Skip file header.
-  auto trace_ptr = trace_data_;
-  trace_ptr += sizeof(TraceHeader);
+void TraceReader::LoadIndices() {
+  frame_index_.clear();
+  blob_block_index_.clear();
+
+  if (trace_size_ >= sizeof(TraceHeader) + sizeof(TraceFooter)) {
+    TraceFooter footer;
+    std::memcpy(&footer, trace_data_ + trace_size_ - sizeof(footer),
+                sizeof(footer));
+    uint64_t index_end = trace_size_ - sizeof(footer);
+    auto index_in_file = [&](uint64_t offset, uint32_t count) {
+      return offset >= sizeof(TraceHeader) && offset <= index_end &&
+             (index_end - offset) / sizeof(uint64_t) >= count;
+    };
+    if (footer.magic == kTraceFooterMagic &&
+        index_in_file(footer.frame_index_offset, footer.frame_count) &&
+        index_in_file(footer.blob_block_index_offset,
+                      footer.blob_block_count)) {
+      frame_index_.resize(footer.frame_count);
+      std::memcpy(frame_index_.data(),
+                  trace_data_ + footer.frame_index_offset,
+                  sizeof(uint64_t) * footer.frame_count);
+      blob_block_index_.resize(footer.blob_block_count);
+      std::memcpy(blob_block_index_.data(),
+                  trace_data_ + footer.blob_block_index_offset,
+                  sizeof(uint64_t) * footer.blob_block_count);
+      return;
+    }
+  }
+
+  // The trace wasn't closed cleanly - locate the blocks by walking their
+  // headers without decoding them, dropping the last frame if it's truncated.
+  XELOGW("Trace has no indices, locating blocks by walking the file");
+  uint64_t block_offset = sizeof(TraceHeader);
+  uint64_t frame_offset = 0;
+  bool frame_started = false;
+  while (trace_size_ - block_offset >= sizeof(TraceBlockHeader)) {
+    TraceBlockHeader block_header;
+    std::memcpy(&block_header, trace_data_ + block_offset,
+                sizeof(block_header));
+    if (trace_size_ - block_offset - sizeof(block_header) <
+        block_header.encoded_length) {
+      break;
+    }
+    if (block_header.type == TraceBlockType::kBlob) {
+      blob_block_index_.push_back(block_offset);
+    } else {
+      // Blob blocks may be written between the blocks of a frame.
+      if (!frame_started) {
+        frame_offset = block_offset;
+        frame_started = true;
+      }
+      if (!block_header.continued) {
+        frame_index_.push_back(frame_offset);
+        frame_started = false;
+      }
+    }
+    block_offset += sizeof(block_header) + block_header.encoded_length;
+  }
+}
+
+std::shared_ptr<const TraceReader::DecodedFrame> TraceReader::DecodeFrame(
+    int n) const {
+  if (n < 0 || n >= frame_count()) {
+    return nullptr;
+  }
+
+  std::lock_guard<std::mutex> lock(decoded_frames_mutex_);
 
-  Frame current_frame;
-  current_frame.start_ptr = trace_ptr;
+  for (auto it = decoded_frames_.begin(); it != decoded_frames_.end(); ++it) {
+    if ((*it)->index == n) {
+      std::rotate(decoded_frames_.begin(), it, std::next(it));
+      return decoded_frames_.front();
+    }
+  }
+
+  // Locate all the blocks of the frame to allocate the decoded data at once.
+  uint64_t frame_offset = frame_index_[n];
+  uint64_t block_offset = frame_offset;
+  size_t decoded_length = 0;
+  for (;;) {
+    TraceBlockHeader block_header;
+    if (block_offset > trace_size_ ||
+        trace_size_ - block_offset < sizeof(block_header)) {
+      XELOGE("Trace frame {} is outside the file", n);
+      return nullptr;
+    }
+    std::memcpy(&block_header, trace_data_ + block_offset,
+                sizeof(block_header));
+    if (trace_size_ - block_offset - sizeof(block_header) <
+        block_header.encoded_length) {
+      XELOGE("Trace frame {} is truncated", n);
+      return nullptr;
+    }
+    block_offset += sizeof(block_header) + block_header.encoded_length;
+    if (block_header.type == TraceBlockType::kBlob) {
+      continue;
+    }
+    decoded_length += block_header.decoded_length;
+    if (!block_header.continued) {
+      break;
+    }
+  }
+
+  auto decoded_frame = std::make_unique<DecodedFrame>();
+  decoded_frame->index = n;
+  decoded_frame->data = std::unique_ptr<uint8_t[]>(new uint8_t[decoded_length]);
+  uint8_t* decoded_ptr = decoded_frame->data.get();
+  block_offset = frame_offset;
+  for (;;) {
+    TraceBlockHeader block_header;
+    std::memcpy(&block_header, trace_data_ + block_offset,
+                sizeof(block_header));
+    if (block_header.type == TraceBlockType::kBlob) {
+      block_offset += sizeof(block_header) + block_header.encoded_length;
+      continue;
+    }
+    if (!DecompressMemory(block_header.encoding_format,
+                          trace_data_ + block_offset + sizeof(block_header),
+                          block_header.encoded_length, decoded_ptr,
+                          block_header.decoded_length)) {
+      XELOGE("Failed to decode trace frame {}", n);
+      return nullptr;
+    }
+    decoded_ptr += block_header.decoded_length;
+    block_offset += sizeof(block_header) + block_header.encoded_length;
+    if (!block_header.continued) {
+      break;
+    }
+  }
+  ParseFrame(decoded_frame->data.get(), decoded_length, decoded_frame->frame);
+
+  if (decoded_frames_.size() >= kDecodedFrameCacheSize) {
+    decoded_frames_.pop_back();
+  }
+  decoded_frames_.insert(decoded_frames_.begin(), std::move(decoded_frame));
+  return decoded_frames_.front();
+}
+
+std::shared_ptr<const TraceReader::DecodedBlobBlock>
+TraceReader::DecodeBlobBlock(int n) const {
+  if (n < 0 || n >= blob_block_count()) {
+    return nullptr;
+  }
+
+  std::lock_guard<std::mutex> lock(decoded_blob_blocks_mutex_);
+
+  for (auto it = decoded_blob_blocks_.begin(); it != decoded_blob_blocks_.end();
+       ++it) {
+    if ((*it)->index == n) {
+      std::rotate(decoded_blob_blocks_.begin(), it, std::next(it));
+      return decoded_blob_blocks_.front();
+    }
+  }
+
+  uint64_t block_offset = blob_block_index_[n];
+  TraceBlockHeader block_header;
+  if (block_offset > trace_size_ ||
+      trace_size_ - block_offset < sizeof(block_header)) {
+    XELOGE("Trace blob block {} is outside the file", n);
+    return nullptr;
+  }
+  std::memcpy(&block_header, trace_data_ + block_offset, sizeof(block_header));
+  if (block_header.type != TraceBlockType::kBlob ||
+      trace_size_ - block_offset - sizeof(block_header) <
+          block_header.encoded_length) {
+    XELOGE("Trace blob block {} is invalid or truncated", n);
+    return nullptr;
+  }
+
+  auto decoded_blob_block = std::make_unique<DecodedBlobBlock>();
+  decoded_blob_block->index = n;
+  decoded_blob_block->data =
+      std::unique_ptr<uint8_t[]>(new uint8_t[block_header.decoded_length]);
+  decoded_blob_block->size = block_header.decoded_length;
+  if (!DecompressMemory(block_header.encoding_format,
+                        trace_data_ + block_offset + sizeof(block_header),
+                        block_header.encoded_length,
+                        decoded_blob_block->data.get(),
+                        block_header.decoded_length)) {
+    XELOGE("Failed to decode trace blob block {}", n);
+    return nullptr;
+  }
+
+  if (decoded_blob_blocks_.size() >= kDecodedBlobBlockCacheSize) {
+    decoded_blob_blocks_.pop_back();
+  }
+  decoded_blob_blocks_.insert(decoded_blob_blocks_.begin(),
+                              std::move(decoded_blob_block));
+  return decoded_blob_blocks_.front();
+}
+
+const uint8_t* TraceReader::ResolveMemoryReference(
+    const MemoryReferenceCommand& reference,
+    std::shared_ptr<const DecodedBlobBlock>& blob_block) const {
+  blob_block = DecodeBlobBlock(int(reference.blob_block));
+  if (!blob_block) {
+    return nullptr;
+  }
+  if (reference.blob_offset > blob_block->size ||
+      blob_block->size - reference.blob_offset < reference.length) {
+    return nullptr;
+  }
+  return blob_block->data.get() + reference.blob_offset;
+}
+
+void TraceReader::ParseFrame(const uint8_t* data, size_t size,
+                             Frame& frame) const {
+  auto trace_ptr = data;
+
+  frame.start_ptr = data;
+  frame.end_ptr = data + size;
+  frame.command_count = 0;
+  frame.commands.clear();
   const PacketStartCommand* packet_start = nullptr;
   const uint8_t* packet_start_ptr = nullptr;
   const uint8_t* last_ptr = trace_ptr;
-  bool pending_break = false;
   auto current_command_buffer = new CommandBuffer();
-  current_frame.command_tree =
-      std::unique_ptr<CommandBuffer>(current_command_buffer);
+  frame.command_tree = std::unique_ptr<CommandBuffer>(current_command_buffer);
 
-  while (trace_ptr < trace_data_ + trace_size_) {
-    ++current_frame.command_count;
+  while (trace_ptr < data + size) {
+    ++frame.command_count;
     auto type = static_cast<TraceCommandType>(xe::load<uint32_t>(trace_ptr));
     switch (type) {
       case TraceCommandType::kPrimaryBufferStart: {
@@ -154,10 +379,10 @@ void TraceReader::ParseTrace() {
             command.head_ptr = packet_start_ptr;
             command.start_ptr = last_ptr;
             command.end_ptr = trace_ptr;
-            current_frame.commands.push_back(std::move(command));
+            frame.commands.push_back(std::move(command));
             last_ptr = trace_ptr;
-            current_command_buffer->commands.push_back(CommandBuffer::Command(
-                uint32_t(current_frame.commands.size() - 1)));
+            current_command_buffer->commands.push_back(
+                CommandBuffer::Command(uint32_t(frame.commands.size() - 1)));
             break;
           }
           case PacketCategory::kSwap: {
@@ -166,27 +391,16 @@ void TraceReader::ParseTrace() {
             command.head_ptr = packet_start_ptr;
             command.start_ptr = last_ptr;
             command.end_ptr = trace_ptr;
-            current_frame.commands.push_back(std::move(command));
+            frame.commands.push_back(std::move(command));
             last_ptr = trace_ptr;
-            current_command_buffer->commands.push_back(CommandBuffer::Command(
-                uint32_t(current_frame.commands.size() - 1)));
+            current_command_buffer->commands.push_back(
+                CommandBuffer::Command(uint32_t(frame.commands.size() - 1)));
           } break;
           case PacketCategory::kGeneric: {
             // Ignored.
             break;
           }
         }
-        if (pending_break) {
-          current_frame.end_ptr = trace_ptr;
-          frames_.push_back(std::move(current_frame));
-          current_command_buffer = new CommandBuffer();
-          current_frame.command_tree =
-              std::unique_ptr<CommandBuffer>(current_command_buffer);
-          current_frame.start_ptr = trace_ptr;
-          current_frame.end_ptr = nullptr;
-          current_frame.command_count = 0;
-          pending_break = false;
-        }
         break;
       }
       case TraceCommandType::kMemoryRead: {
@@ -199,20 +413,20 @@ void TraceReader::ParseTrace() {
         trace_ptr += sizeof(*cmd) + cmd->encoded_length;
         break;
       }
+      case TraceCommandType::kMemoryReadReference: {
+        auto cmd = reinterpret_cast<const MemoryReferenceCommand*>(trace_ptr);
+        trace_ptr += sizeof(*cmd);
+        break;
+      }
       case TraceCommandType::kEdramSnapshot: {
         auto cmd = reinterpret_cast<const EdramSnapshotCommand*>(trace_ptr);
         trace_ptr += sizeof(*cmd) + cmd->encoded_length;
         break;
       }
       case TraceCommandType::kEvent: {
+        // Frames are split into blocks by the writer.
         auto cmd = reinterpret_cast<const EventCommand*>(trace_ptr);
         trace_ptr += sizeof(*cmd);
-        switch (cmd->event_type) {
-          case EventCommand::Type::kSwap: {
-            pending_break = true;
-            break;
-          }
-        }
         break;
       }
       case TraceCommandType::kRegisters: {
@@ -231,23 +445,33 @@ void TraceReader::ParseTrace() {
         break;
     }
   }
-  if (pending_break || current_frame.command_count) {
-    current_frame.end_ptr = trace_ptr;
-    frames_.push_back(std::move(current_frame));
-  }
 }
 
 bool TraceReader::DecompressMemory(MemoryEncodingFormat encoding_format,
                                    const void* src, size_t src_size, void* dest,
-                                   size_t dest_size) {
+                                   size_t dest_size) const {
   switch (encoding_format) {
     case MemoryEncodingFormat::kNone:
-      assert_true(src_size == dest_size);
+      if (src_size != dest_size) {
+        return false;
+      }
       std::memcpy(dest, src, src_size);
       return true;
-    case MemoryEncodingFormat::kSnappy:
+    case MemoryEncodingFormat::kSnappy: {
+      // RawUncompress writes as many bytes as stored in the compressed data.
+      size_t decoded_size;
+      if (!snappy::GetUncompressedLength(reinterpret_cast<const char*>(src),
+                                         src_size, &decoded_size) ||
+          decoded_size != dest_size) {
+        return false;
+      }
       return snappy::RawUncompress(reinterpret_cast<const char*>(src), src_size,
                                    reinterpret_cast<char*>(dest));
+    }
+    case MemoryEncodingFormat::kZstd: {
+      size_t decoded_size = ZSTD_decompress(dest, dest_size, src, src_size);
+      return !ZSTD_isError(decoded_size) && decoded_size == dest_size;
+    }
     default:
       assert_unhandled_case(encoding_format);
       return false;
@@ -10,6 +10,8 @@
 #ifndef XENIA_GPU_TRACE_READER_H_
 #define XENIA_GPU_TRACE_READER_H_
 
+#include <memory>
+#include <mutex>
 #include <string_view>
 #include <vector>
 
@@ -96,22 +98,68 @@ class TraceReader {
     return reinterpret_cast<const TraceHeader*>(trace_data_);
   }
 
-  const Frame* frame(int n) const { return &frames_[n]; }
-  int frame_count() const { return int(frames_.size()); }
+  // Frames are decoded on demand. The returned reference keeps the frame and
+  // the command data it points to alive even if it's evicted from the cache.
+  std::shared_ptr<const Frame> frame(int n) const {
+    auto decoded_frame = DecodeFrame(n);
+    if (!decoded_frame) {
+      return nullptr;
+    }
+    return std::shared_ptr<const Frame>(decoded_frame, &decoded_frame->frame);
+  }
+  int frame_count() const { return int(frame_index_.size()); }
+  int blob_block_count() const { return int(blob_block_index_.size()); }
 
   bool Open(const std::string_view path);
 
   void Close();
 
  protected:
-  void ParseTrace();
+  static constexpr size_t kDecodedFrameCacheSize = 4;
+  static constexpr size_t kDecodedBlobBlockCacheSize = 4;
+
+  struct DecodedFrame {
+    int index;
+    std::unique_ptr<uint8_t[]> data;
+    Frame frame;
+  };
+
+  struct DecodedBlobBlock {
+    int index;
+    std::unique_ptr<uint8_t[]> data;
+    size_t size;
+  };
+
+  void LoadIndices();
+  // The returned reference keeps the frame data alive even if it's evicted
+  // from the cache.
+  std::shared_ptr<const DecodedFrame> DecodeFrame(int n) const;
+  std::shared_ptr<const DecodedBlobBlock> DecodeBlobBlock(int n) const;
+  void ParseFrame(const uint8_t* data, size_t size, Frame& frame) const;
+  // Returns the data of the memory read, or nullptr if the reference is
+  // invalid. blob_block keeps the data alive.
+  const uint8_t* ResolveMemoryReference(
+      const MemoryReferenceCommand& reference,
+      std::shared_ptr<const DecodedBlobBlock>& blob_block) const;
   bool DecompressMemory(MemoryEncodingFormat encoding_format, const void* src,
-                        size_t src_size, void* dest, size_t dest_size);
+                        size_t src_size, void* dest, size_t dest_size) const;
 
   std::unique_ptr<MappedMemory> mmap_;
   const uint8_t* trace_data_ = nullptr;
   size_t trace_size_ = 0;
-  std::vector<Frame> frames_;
+  // File offsets of the first TraceBlockHeader of every frame.
+  std::vector<uint64_t> frame_index_;
+  // File offsets of the TraceBlockHeader of every blob block.
+  std::vector<uint64_t> blob_block_index_;
+
+  // Most recently used first.
+  mutable std::mutex decoded_frames_mutex_;
+  mutable std::vector<std::shared_ptr<const DecodedFrame>> decoded_frames_;
+  // Separate from the frames, so playing a frame doesn't evict the data it
+  // references. Most recently used first.
+  mutable std::mutex decoded_blob_blocks_mutex_;
+  mutable std::vector<std::shared_ptr<const DecodedBlobBlock>>
+      decoded_blob_blocks_;
 };
 
 }  // namespace gpu
@@ -390,6 +390,12 @@ void TraceViewer::DrawPacketDisassemblerUI() {
         // ImGui::BulletText("MemoryRead");
         break;
       }
+      case TraceCommandType::kMemoryReadReference: {
+        auto cmd = reinterpret_cast<const MemoryReferenceCommand*>(trace_ptr);
+        trace_ptr += sizeof(*cmd);
+        // ImGui::BulletText("MemoryReadReference");
+        break;
+      }
       case TraceCommandType::kMemoryWrite: {
         auto cmd = reinterpret_cast<const MemoryCommand*>(trace_ptr);
         trace_ptr += sizeof(*cmd) + cmd->encoded_length;
@@ -500,16 +506,16 @@ void TraceViewer::DrawCommandListUI() {
     return;
   }
 
-  static const TracePlayer::Frame* previous_frame = nullptr;
+  static int previous_frame_index = -1;
   auto frame = player_->current_frame();
   if (!frame) {
     ImGui::End();
     return;
   }
   bool did_seek = false;
-  if (previous_frame != frame) {
+  if (previous_frame_index != player_->current_frame_index()) {
     did_seek = true;
-    previous_frame = frame;
+    previous_frame_index = player_->current_frame_index();
   }
   int command_count = int(frame->commands.size());
   int target_command = player_->current_command_index();
@@ -576,7 +582,8 @@ void TraceViewer::DrawCommandListUI() {
     ImGui::SetScrollHereY(0.5f);
   }
 
-  auto id = RecursiveDrawCommandBufferUI(frame, frame->command_tree.get());
+  auto id =
+      RecursiveDrawCommandBufferUI(frame.get(), frame->command_tree.get());
   if (id != -1 && id != player_->current_command_index() &&
       !player_->is_playing_trace()) {
     player_->SeekCommand(id);
@@ -9,17 +9,21 @@
 
 #include "xenia/gpu/trace_writer.h"
 
+#include <algorithm>
 #include <cstring>
 #include <memory>
 
-#include "third_party/snappy/snappy-sinksource.h"
 #include "third_party/snappy/snappy.h"
+#include "third_party/zstd/lib/zstd.h"
 
 #include "build/version.h"
 #include "xenia/base/assert.h"
+#include "xenia/base/clock.h"
 #include "xenia/base/filesystem.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/string.h"
+#include "xenia/base/xxhash.h"
+#include "xenia/gpu/gpu_flags.h"
 #include "xenia/gpu/registers.h"
 #include "xenia/gpu/xenos.h"
 
@@ -29,7 +33,7 @@ namespace gpu {
 TraceWriter::TraceWriter(uint8_t* membase)
     : membase_(membase), file_(nullptr) {}
 
-TraceWriter::~TraceWriter() = default;
+TraceWriter::~TraceWriter() { Close(); }
 
 bool TraceWriter::Open(const std::filesystem::path& path, uint32_t title_id) {
   Close();
@@ -44,6 +48,7 @@ bool TraceWriter::Open(const std::filesystem::path& path, uint32_t title_id) {
   if (!file_) {
     return false;
   }
+  file_offset_ = 0;
 
   // Write header first. Must be at the top of the file.
   TraceHeader header;
@@ -51,21 +56,108 @@ bool TraceWriter::Open(const std::filesystem::path& path, uint32_t title_id) {
   std::memcpy(header.build_commit_sha, XE_BUILD_COMMIT,
               sizeof(header.build_commit_sha));
   header.title_id = title_id;
-  fwrite(&header, sizeof(header), 1, file_);
+  WriteFile(&header, sizeof(header));
 
   cached_memory_reads_.clear();
+  memory_read_blobs_.clear();
+  block_size_ = 0;
+  block_count_ = 0;
+  block_end_pending_ = false;
+  blob_buffer_.clear();
+  blob_block_count_ = 0;
+  pending_blob_blocks_.clear();
+  pending_blob_block_bytes_ = 0;
+  block_buffer_.clear();
+  block_continued_ = false;
+  frame_index_.clear();
+  blob_block_index_.clear();
+
+  appended_bytes_ = 0;
+  blob_bytes_ = 0;
+  deduplicated_bytes_ = 0;
+  peak_ring_usage_ = 0;
+  stall_count_ = 0;
+  stall_ticks_ = 0;
+  encode_ticks_ = 0;
+  write_ticks_ = 0;
+
+  ring_size_ = size_t(std::max(cvars::trace_gpu_buffer_size, uint32_t(1)))
+               << 20;
+  ring_ = std::unique_ptr<uint8_t[]>(new uint8_t[ring_size_]);
+  ring_write_position_.store(0, std::memory_order_relaxed);
+  ring_read_position_.store(0, std::memory_order_relaxed);
+  block_end_write_index_.store(0, std::memory_order_relaxed);
+  block_end_read_index_.store(0, std::memory_order_relaxed);
+  flush_requested_.store(false, std::memory_order_relaxed);
+  writer_exit_requested_.store(false, std::memory_order_relaxed);
+  data_available_event_ = xe::threading::Event::CreateAutoResetEvent(false);
+  space_available_event_ = xe::threading::Event::CreateAutoResetEvent(false);
+  writer_thread_ =
+      xe::threading::Thread::Create({}, [this]() { WriterThreadMain(); });
+  writer_thread_->set_name("GPU Trace Writer");
   return true;
 }
 
 void TraceWriter::Flush() {
+  // Only whole frames are written, the block of the current frame stays
+  // buffered until the frame ends.
   if (file_) {
-    fflush(file_);
+    flush_requested_.store(true, std::memory_order_relaxed);
+    data_available_event_->Set();
   }
 }
 
 void TraceWriter::Close() {
   if (file_) {
+    EndBlock();
+
+    // Let the writer thread write everything remaining in the ring.
+    writer_exit_requested_.store(true, std::memory_order_release);
+    data_available_event_->Set();
+    xe::threading::Wait(writer_thread_.get(), false);
+    writer_thread_.reset();
+    data_available_event_.reset();
+    space_available_event_.reset();
+
+    // Write the indices and the footer locating them.
+    TraceFooter footer;
+    footer.frame_index_offset = file_offset_;
+    footer.frame_count = uint32_t(frame_index_.size());
+    WriteFile(frame_index_.data(), sizeof(uint64_t) * frame_index_.size());
+    footer.blob_block_index_offset = file_offset_;
+    footer.blob_block_count = uint32_t(blob_block_index_.size());
+    WriteFile(blob_block_index_.data(),
+              sizeof(uint64_t) * blob_block_index_.size());
+    footer.blob_count = uint32_t(memory_read_blobs_.size());
+    footer.magic = kTraceFooterMagic;
+    WriteFile(&footer, sizeof(footer));
+
+    double ticks_to_ms = 1000.0 / double(Clock::QueryHostTickFrequency());
+    XELOGI(
+        "GPU trace closed: {} frames, {} bytes of commands, {} bytes of memory "
+        "reads in {} blob blocks ({} bytes deduplicated), {} bytes written",
+        frame_index_.size(), appended_bytes_, blob_bytes_,
+        blob_block_index_.size(), deduplicated_bytes_, file_offset_);
+    XELOGI(
+        "GPU trace capture overhead: command processor stalled {} times for "
+        "{:.3f} ms on a full buffer (peak usage {} of {} bytes), writer thread "
+        "spent {:.3f} ms encoding and {:.3f} ms writing",
+        stall_count_, stall_ticks_ * ticks_to_ms, peak_ring_usage_,
+        ring_size_, encode_ticks_ * ticks_to_ms, write_ticks_ * ticks_to_ms);
+
+    ring_.reset();
+    ring_size_ = 0;
+
     cached_memory_reads_.clear();
+    memory_read_blobs_.clear();
+    blob_buffer_.clear();
+    blob_buffer_.shrink_to_fit();
+    block_buffer_.clear();
+    block_buffer_.shrink_to_fit();
+    encoded_block_buffer_.clear();
+    encoded_block_buffer_.shrink_to_fit();
+    frame_index_.clear();
+    blob_block_index_.clear();
 
     fflush(file_);
     fclose(file_);
@@ -73,6 +165,265 @@ void TraceWriter::Close() {
   }
 }
 
+void TraceWriter::Append(const void* data, size_t length) {
+  auto data_bytes = reinterpret_cast<const uint8_t*>(data);
+  appended_bytes_ += length;
+  block_size_ += uint32_t(length);
+
+  uint64_t write_position =
+      ring_write_position_.load(std::memory_order_relaxed);
+  while (length) {
+    uint64_t read_position =
+        ring_read_position_.load(std::memory_order_acquire);
+    size_t ring_free = ring_size_ - size_t(write_position - read_position);
+    if (!ring_free) {
+      WaitForRingSpace();
+      continue;
+    }
+    // Large data, such as the EDRAM snapshot, may be copied in parts.
+    size_t copy_length = std::min(length, ring_free);
+    size_t ring_offset = size_t(write_position % ring_size_);
+    size_t copy_length_until_wrap =
+        std::min(copy_length, ring_size_ - ring_offset);
+    std::memcpy(ring_.get() + ring_offset, data_bytes, copy_length_until_wrap);
+    std::memcpy(ring_.get(), data_bytes + copy_length_until_wrap,
+                copy_length - copy_length_until_wrap);
+    data_bytes += copy_length;
+    length -= copy_length;
+    write_position += copy_length;
+    ring_write_position_.store(write_position, std::memory_order_release);
+    peak_ring_usage_ =
+        std::max(peak_ring_usage_, write_position - read_position);
+  }
+}
+
+void TraceWriter::EndBlock() {
+  block_end_pending_ = false;
+  if (!block_size_) {
+    return;
+  }
+  // Let the writer thread write the data referenced by the frame before the
+  // end of the frame, so the frame can be played even if the trace isn't
+  // closed cleanly.
+  EndBlobBlock();
+  uint32_t block_end_write_index =
+      block_end_write_index_.load(std::memory_order_relaxed);
+  while (block_end_write_index -
+             block_end_read_index_.load(std::memory_order_acquire) >=
+         kBlockEndRingSize) {
+    WaitForRingSpace();
+  }
+  block_end_ring_[block_end_write_index % kBlockEndRingSize] =
+      ring_write_position_.load(std::memory_order_relaxed);
+  block_end_write_index_.store(block_end_write_index + 1,
+                               std::memory_order_release);
+  data_available_event_->Set();
+  block_size_ = 0;
+  ++block_count_;
+}
+
+void TraceWriter::EndBlobBlock() {
+  if (blob_buffer_.empty()) {
+    return;
+  }
+  // Limit the amount of data waiting for the writer thread to the size of the
+  // ring, but always accept a single blob block larger than that.
+  while (true) {
+    {
+      std::lock_guard<std::mutex> lock(blob_blocks_mutex_);
+      if (pending_blob_blocks_.empty() ||
+          pending_blob_block_bytes_ + blob_buffer_.size() <= ring_size_) {
+        pending_blob_block_bytes_ += blob_buffer_.size();
+        pending_blob_blocks_.push_back(std::move(blob_buffer_));
+        break;
+      }
+    }
+    WaitForRingSpace();
+  }
+  blob_buffer_.clear();
+  ++blob_block_count_;
+  data_available_event_->Set();
+}
+
+void TraceWriter::WaitForRingSpace() {
+  // Backpressure - the writer thread can't keep up with the command processor.
+  ++stall_count_;
+  uint64_t stall_start_ticks = Clock::QueryHostTickCount();
+  xe::threading::SignalAndWait(data_available_event_.get(),
+                               space_available_event_.get(), false);
+  stall_ticks_ += Clock::QueryHostTickCount() - stall_start_ticks;
+}
+
+void TraceWriter::WriterThreadMain() {
+  while (true) {
+    // Everything appended before the exit request must still be written.
+    bool exit_requested =
+        writer_exit_requested_.load(std::memory_order_acquire);
+    // Block ends are published after the data preceding them, and before the
+    // data following them - load the write position first so the data can't
+    // be consumed past a block end that isn't visible yet.
+    uint64_t write_position =
+        ring_write_position_.load(std::memory_order_acquire);
+    uint32_t block_end_read_index =
+        block_end_read_index_.load(std::memory_order_relaxed);
+    bool block_end_available =
+        block_end_read_index !=
+        block_end_write_index_.load(std::memory_order_acquire);
+    uint64_t read_position =
+        ring_read_position_.load(std::memory_order_relaxed);
+    uint64_t consume_end = write_position;
+    if (block_end_available) {
+      consume_end = std::min(
+          consume_end,
+          block_end_ring_[block_end_read_index % kBlockEndRingSize]);
+    }
+
+    // Blob blocks are ended before the ends of the frames referencing them are
+    // published, write them before the frames.
+    bool did_work = WriteBlobBlocks();
+    if (block_buffer_.size() >= kMaxBlockBufferSize &&
+        read_position < consume_end) {
+      // More data of the current frame is pending, but the buffer is full -
+      // write a part of the frame.
+      WriteBlock(true);
+      did_work = true;
+    }
+    if (read_position < consume_end) {
+      // Gather the data of the current frame, even if the frame hasn't ended
+      // yet, so the command processor can keep appending.
+      size_t consume_length =
+          std::min(size_t(consume_end - read_position),
+                   kMaxBlockBufferSize - block_buffer_.size());
+      size_t ring_offset = size_t(read_position % ring_size_);
+      size_t consume_length_until_wrap =
+          std::min(consume_length, ring_size_ - ring_offset);
+      block_buffer_.insert(block_buffer_.end(), ring_.get() + ring_offset,
+                           ring_.get() + ring_offset +
+                               consume_length_until_wrap);
+      block_buffer_.insert(
+          block_buffer_.end(), ring_.get(),
+          ring_.get() + (consume_length - consume_length_until_wrap));
+      read_position += consume_length;
+      ring_read_position_.store(read_position, std::memory_order_release);
+      space_available_event_->Set();
+      did_work = true;
+    }
+    if (block_end_available &&
+        read_position ==
+            block_end_ring_[block_end_read_index % kBlockEndRingSize]) {
+      WriteBlock(false);
+      block_end_read_index_.store(block_end_read_index + 1,
+                                  std::memory_order_release);
+      space_available_event_->Set();
+      did_work = true;
+    }
+    if (did_work) {
+      continue;
+    }
+
+    if (flush_requested_.exchange(false, std::memory_order_relaxed)) {
+      fflush(file_);
+    }
+    if (exit_requested) {
+      break;
+    }
+    xe::threading::Wait(data_available_event_.get(), false);
+  }
+}
+
+void TraceWriter::WriteFile(const void* data, size_t length) {
+  fwrite(data, 1, length, file_);
+  file_offset_ += length;
+}
+
+void TraceWriter::WriteBlock(bool continued) {
+  // A continued block is only written when more data of the frame is pending,
+  // so the last block of a frame is never empty.
+  if (block_buffer_.empty()) {
+    return;
+  }
+  if (!block_continued_) {
+    frame_index_.push_back(file_offset_);
+  }
+  block_continued_ = continued;
+  WriteEncodedBlock(TraceBlockType::kFrame, block_buffer_, continued);
+  // Keep the allocation for the next block.
+  block_buffer_.clear();
+}
+
+bool TraceWriter::WriteBlobBlocks() {
+  bool blob_blocks_written = false;
+  while (true) {
+    std::vector<uint8_t> blob_block;
+    {
+      std::lock_guard<std::mutex> lock(blob_blocks_mutex_);
+      if (pending_blob_blocks_.empty()) {
+        break;
+      }
+      blob_block = std::move(pending_blob_blocks_.front());
+      pending_blob_blocks_.pop_front();
+    }
+    blob_block_index_.push_back(file_offset_);
+    WriteEncodedBlock(TraceBlockType::kBlob, blob_block, false);
+    {
+      std::lock_guard<std::mutex> lock(blob_blocks_mutex_);
+      pending_blob_block_bytes_ -= blob_block.size();
+    }
+    space_available_event_->Set();
+    blob_blocks_written = true;
+  }
+  return blob_blocks_written;
+}
+
+void TraceWriter::WriteEncodedBlock(TraceBlockType type,
+                                    const std::vector<uint8_t>& data,
+                                    bool continued) {
+  uint64_t encode_start_ticks = Clock::QueryHostTickCount();
+  TraceBlockHeader block_header = {};
+  block_header.type = type;
+  block_header.encoding_format = MemoryEncodingFormat::kNone;
+  block_header.encoded_length = uint32_t(data.size());
+  block_header.decoded_length = uint32_t(data.size());
+  block_header.continued = continued ? 1 : 0;
+  const void* encoded_data = data.data();
+  switch (block_encoding_format_) {
+    case MemoryEncodingFormat::kSnappy: {
+      encoded_block_buffer_.resize(snappy::MaxCompressedLength(data.size()));
+      size_t encoded_length;
+      snappy::RawCompress(reinterpret_cast<const char*>(data.data()),
+                          data.size(),
+                          reinterpret_cast<char*>(encoded_block_buffer_.data()),
+                          &encoded_length);
+      block_header.encoding_format = MemoryEncodingFormat::kSnappy;
+      block_header.encoded_length = uint32_t(encoded_length);
+      encoded_data = encoded_block_buffer_.data();
+    } break;
+    case MemoryEncodingFormat::kZstd: {
+      encoded_block_buffer_.resize(ZSTD_compressBound(data.size()));
+      size_t encoded_length = ZSTD_compress(
+          encoded_block_buffer_.data(), encoded_block_buffer_.size(),
+          data.data(), data.size(), zstd_compression_level_);
+      if (ZSTD_isError(encoded_length)) {
+        // Store the block uncompressed rather than losing the data.
+        XELOGE("Failed to compress a GPU trace block with zstd: {}",
+               ZSTD_getErrorName(encoded_length));
+        break;
+      }
+      block_header.encoding_format = MemoryEncodingFormat::kZstd;
+      block_header.encoded_length = uint32_t(encoded_length);
+      encoded_data = encoded_block_buffer_.data();
+    } break;
+    default:
+      break;
+  }
+  uint64_t write_start_ticks = Clock::QueryHostTickCount();
+  encode_ticks_ += write_start_ticks - encode_start_ticks;
+
+  WriteFile(&block_header, sizeof(block_header));
+  WriteFile(encoded_data, block_header.encoded_length);
+  write_ticks_ += Clock::QueryHostTickCount() - write_start_ticks;
+}
+
 void TraceWriter::WritePrimaryBufferStart(uint32_t base_ptr, uint32_t count) {
   if (!file_) {
     return;
@@ -82,7 +433,7 @@ void TraceWriter::WritePrimaryBufferStart(uint32_t base_ptr, uint32_t count) {
       base_ptr,
       0,
   };
-  fwrite(&cmd, 1, sizeof(cmd), file_);
+  Append(&cmd, sizeof(cmd));
 }
 
 void TraceWriter::WritePrimaryBufferEnd() {
@@ -92,7 +443,7 @@ void TraceWriter::WritePrimaryBufferEnd() {
   PrimaryBufferEndCommand cmd = {
       TraceCommandType::kPrimaryBufferEnd,
   };
-  fwrite(&cmd, 1, sizeof(cmd), file_);
+  Append(&cmd, sizeof(cmd));
 }
 
 void TraceWriter::WriteIndirectBufferStart(uint32_t base_ptr, uint32_t count) {
@@ -104,7 +455,7 @@ void TraceWriter::WriteIndirectBufferStart(uint32_t base_ptr, uint32_t count) {
       base_ptr,
       0,
   };
-  fwrite(&cmd, 1, sizeof(cmd), file_);
+  Append(&cmd, sizeof(cmd));
 }
 
 void TraceWriter::WriteIndirectBufferEnd() {
@@ -114,7 +465,7 @@ void TraceWriter::WriteIndirectBufferEnd() {
   IndirectBufferEndCommand cmd = {
       TraceCommandType::kIndirectBufferEnd,
   };
-  fwrite(&cmd, 1, sizeof(cmd), file_);
+  Append(&cmd, sizeof(cmd));
 }
 
 void TraceWriter::WritePacketStart(uint32_t base_ptr, uint32_t count) {
@@ -126,8 +477,8 @@ void TraceWriter::WritePacketStart(uint32_t base_ptr, uint32_t count) {
       base_ptr,
       count,
   };
-  fwrite(&cmd, 1, sizeof(cmd), file_);
-  fwrite(membase_ + base_ptr, 4, count, file_);
+  Append(&cmd, sizeof(cmd));
+  Append(membase_ + base_ptr, sizeof(uint32_t) * count);
 }
 
 void TraceWriter::WritePacketEnd() {
@@ -137,7 +488,11 @@ void TraceWriter::WritePacketEnd() {
   PacketEndCommand cmd = {
       TraceCommandType::kPacketEnd,
   };
-  fwrite(&cmd, 1, sizeof(cmd), file_);
+  Append(&cmd, sizeof(cmd));
+  // The swap packet is complete, end the frame.
+  if (block_end_pending_) {
+    EndBlock();
+  }
 }
 
 void TraceWriter::WriteMemoryRead(uint32_t base_ptr, size_t length,
@@ -182,20 +537,9 @@ void TraceWriter::WriteMemoryWrite(uint32_t base_ptr, size_t length,
                      host_ptr);
 }
 
-class SnappySink : public snappy::Sink {
- public:
-  SnappySink(FILE* file) : file_(file) {}
-
-  void Append(const char* bytes, size_t n) override {
-    fwrite(bytes, 1, n, file_);
-  }
-
- private:
-  FILE* file_ = nullptr;
-};
-
 void TraceWriter::WriteMemoryCommand(TraceCommandType type, uint32_t base_ptr,
                                      size_t length, const void* host_ptr) {
+  // The data is compressed along with the rest of the block.
   MemoryCommand cmd = {};
   cmd.type = type;
   cmd.base_ptr = base_ptr;
@@ -206,62 +550,49 @@ void TraceWriter::WriteMemoryCommand(TraceCommandType type, uint32_t base_ptr,
     host_ptr = membase_ + cmd.base_ptr;
   }
 
-  bool compress = compress_output_ && length > compression_threshold_;
-  if (compress) {
-    // Write the header now so we reserve space in the buffer.
-    long header_position = std::ftell(file_);
-    cmd.encoding_format = MemoryEncodingFormat::kSnappy;
-    fwrite(&cmd, 1, sizeof(cmd), file_);
-
-    // Stream the content right to the buffer.
-    snappy::ByteArraySource snappy_source(
-        reinterpret_cast<const char*>(host_ptr), cmd.decoded_length);
-    SnappySink snappy_sink(file_);
-    cmd.encoded_length =
-        static_cast<uint32_t>(snappy::Compress(&snappy_source, &snappy_sink));
-
-    // Seek back and overwrite the header with our final size.
-    std::fseek(file_, header_position, SEEK_SET);
-    fwrite(&cmd, 1, sizeof(cmd), file_);
-    std::fseek(file_, header_position + sizeof(cmd) + cmd.encoded_length,
-               SEEK_SET);
-  } else {
-    // Uncompressed - write buffer directly to the file.
-    cmd.encoding_format = MemoryEncodingFormat::kNone;
-    fwrite(&cmd, 1, sizeof(cmd), file_);
-    fwrite(host_ptr, 1, cmd.decoded_length, file_);
+  // Store the data of identical reads, even from different addresses and in
+  // different frames, once in the blob blocks.
+  if (type == TraceCommandType::kMemoryRead &&
+      length >= deduplication_threshold_) {
+    XXH128_hash_t hash = XXH3_128bits(host_ptr, length);
+    MemoryReadBlob& blob = memory_read_blobs_[hash.low64];
+    if (blob.hash_high == hash.high64 && blob.length == length) {
+      deduplicated_bytes_ += length;
+    } else {
+      // New data (or a collision of the low 64 bits of the hash) - the data
+      // stored now is referenced by the following reads.
+      auto host_bytes = reinterpret_cast<const uint8_t*>(host_ptr);
+      blob.hash_high = hash.high64;
+      blob.length = cmd.decoded_length;
+      blob.blob_block = blob_block_count_;
+      blob.blob_offset = uint32_t(blob_buffer_.size());
+      blob_buffer_.insert(blob_buffer_.end(), host_bytes, host_bytes + length);
+      blob_bytes_ += length;
+    }
+    MemoryReferenceCommand reference_cmd = {};
+    reference_cmd.type = TraceCommandType::kMemoryReadReference;
+    reference_cmd.base_ptr = base_ptr;
+    reference_cmd.length = blob.length;
+    reference_cmd.blob_block = blob.blob_block;
+    reference_cmd.blob_offset = blob.blob_offset;
+    Append(&reference_cmd, sizeof(reference_cmd));
+    if (blob_buffer_.size() >= kMaxBlobBlockSize) {
+      EndBlobBlock();
+    }
+    return;
   }
+
+  Append(&cmd, sizeof(cmd));
+  Append(host_ptr, cmd.decoded_length);
 }
 
 void TraceWriter::WriteEdramSnapshot(const void* snapshot) {
   EdramSnapshotCommand cmd = {};
   cmd.type = TraceCommandType::kEdramSnapshot;
-
-  if (compress_output_) {
-    // Write the header now so we reserve space in the buffer.
-    long header_position = std::ftell(file_);
-    cmd.encoding_format = MemoryEncodingFormat::kSnappy;
-    fwrite(&cmd, 1, sizeof(cmd), file_);
-
-    // Stream the content right to the buffer.
-    snappy::ByteArraySource snappy_source(
-        reinterpret_cast<const char*>(snapshot), xenos::kEdramSizeBytes);
-    SnappySink snappy_sink(file_);
-    cmd.encoded_length =
-        static_cast<uint32_t>(snappy::Compress(&snappy_source, &snappy_sink));
-
-    // Seek back and overwrite the header with our final size.
-    std::fseek(file_, header_position, SEEK_SET);
-    fwrite(&cmd, 1, sizeof(cmd), file_);
-    std::fseek(file_, header_position + sizeof(cmd) + cmd.encoded_length,
-               SEEK_SET);
-  } else {
-    // Uncompressed - write buffer directly to the file.
-    cmd.encoding_format = MemoryEncodingFormat::kNone;
-    cmd.encoded_length = xenos::kEdramSizeBytes;
-    fwrite(&cmd, 1, sizeof(cmd), file_);
-    fwrite(snapshot, 1, xenos::kEdramSizeBytes, file_);
-  }
+  cmd.encoding_format = MemoryEncodingFormat::kNone;
+  cmd.encoded_length = xenos::kEdramSizeBytes;
+  Append(&cmd, sizeof(cmd));
+  Append(snapshot, xenos::kEdramSizeBytes);
 }
 
 void TraceWriter::WriteEvent(EventCommand::Type event_type) {
@@ -272,7 +603,10 @@ void TraceWriter::WriteEvent(EventCommand::Type event_type) {
       TraceCommandType::kEvent,
       event_type,
   };
-  fwrite(&cmd, 1, sizeof(cmd), file_);
+  Append(&cmd, sizeof(cmd));
+  if (event_type == EventCommand::Type::kSwap) {
+    block_end_pending_ = true;
+  }
 }
 
 void TraceWriter::WriteRegisters(uint32_t first_register,
@@ -284,33 +618,10 @@ void TraceWriter::WriteRegisters(uint32_t first_register,
   cmd.first_register = first_register;
   cmd.register_count = register_count;
   cmd.execute_callbacks = execute_callbacks_on_play;
-
-  uint32_t uncompressed_length = uint32_t(sizeof(uint32_t) * register_count);
-  if (compress_output_) {
-    // Write the header now so we reserve space in the buffer.
-    long header_position = std::ftell(file_);
-    cmd.encoding_format = MemoryEncodingFormat::kSnappy;
-    fwrite(&cmd, 1, sizeof(cmd), file_);
-
-    // Stream the content right to the buffer.
-    snappy::ByteArraySource snappy_source(
-        reinterpret_cast<const char*>(register_values), uncompressed_length);
-    SnappySink snappy_sink(file_);
-    cmd.encoded_length =
-        static_cast<uint32_t>(snappy::Compress(&snappy_source, &snappy_sink));
-
-    // Seek back and overwrite the header with our final size.
-    std::fseek(file_, header_position, SEEK_SET);
-    fwrite(&cmd, 1, sizeof(cmd), file_);
-    std::fseek(file_, header_position + sizeof(cmd) + cmd.encoded_length,
-               SEEK_SET);
-  } else {
-    // Uncompressed - write the values directly to the file.
-    cmd.encoding_format = MemoryEncodingFormat::kNone;
-    cmd.encoded_length = uncompressed_length;
-    fwrite(&cmd, 1, sizeof(cmd), file_);
-    fwrite(register_values, 1, uncompressed_length, file_);
-  }
+  cmd.encoding_format = MemoryEncodingFormat::kNone;
+  cmd.encoded_length = uint32_t(sizeof(uint32_t) * register_count);
+  Append(&cmd, sizeof(cmd));
+  Append(register_values, cmd.encoded_length);
 }
 
 void TraceWriter::WriteGammaRamp(
@@ -325,42 +636,12 @@ void TraceWriter::WriteGammaRamp(
       sizeof(reg::DC_LUT_30_COLOR) * 256;
   constexpr uint32_t kPWLUncompressedLength =
       sizeof(reg::DC_LUT_PWL_DATA) * 3 * 128;
-  constexpr uint32_t kUncompressedLength =
+  cmd.encoding_format = MemoryEncodingFormat::kNone;
+  cmd.encoded_length =
       k256EntryTableUncompressedLength + kPWLUncompressedLength;
-  if (compress_output_) {
-    // Write the header now so we reserve space in the buffer.
-    long header_position = std::ftell(file_);
-    cmd.encoding_format = MemoryEncodingFormat::kSnappy;
-    fwrite(&cmd, 1, sizeof(cmd), file_);
-
-    // Stream the content right to the buffer.
-    {
-      std::unique_ptr<char[]> gamma_ramps(new char[kUncompressedLength]);
-      std::memcpy(gamma_ramps.get(), gamma_ramp_256_entry_table,
-                  k256EntryTableUncompressedLength);
-      std::memcpy(gamma_ramps.get() + k256EntryTableUncompressedLength,
-                  gamma_ramp_pwl_rgb, kPWLUncompressedLength);
-      snappy::ByteArraySource snappy_source(gamma_ramps.get(),
-                                            kUncompressedLength);
-      SnappySink snappy_sink(file_);
-      cmd.encoded_length =
-          static_cast<uint32_t>(snappy::Compress(&snappy_source, &snappy_sink));
-    }
-
-    // Seek back and overwrite the header with our final size.
-    std::fseek(file_, header_position, SEEK_SET);
-    fwrite(&cmd, 1, sizeof(cmd), file_);
-    std::fseek(file_, header_position + sizeof(cmd) + cmd.encoded_length,
-               SEEK_SET);
-  } else {
-    // Uncompressed - write the values directly to the file.
-    cmd.encoding_format = MemoryEncodingFormat::kNone;
-    cmd.encoded_length = kUncompressedLength;
-    fwrite(&cmd, 1, sizeof(cmd), file_);
-    fwrite(gamma_ramp_256_entry_table, 1, k256EntryTableUncompressedLength,
-           file_);
-    fwrite(gamma_ramp_pwl_rgb, 1, kPWLUncompressedLength, file_);
-  }
+  Append(&cmd, sizeof(cmd));
+  Append(gamma_ramp_256_entry_table, k256EntryTableUncompressedLength);
+  Append(gamma_ramp_pwl_rgb, kPWLUncompressedLength);
 }
 #endif
 }  //  namespace gpu
@@ -10,10 +10,17 @@
 #ifndef XENIA_GPU_TRACE_WRITER_H_
 #define XENIA_GPU_TRACE_WRITER_H_
 
+#include <atomic>
+#include <deque>
 #include <filesystem>
+#include <memory>
+#include <mutex>
 #include <set>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
+#include "xenia/base/threading.h"
 #include "xenia/gpu/registers.h"
 #include "xenia/gpu/trace_protocol.h"
 
@@ -66,12 +73,123 @@ class TraceWriter {
   void WriteMemoryCommand(TraceCommandType type, uint32_t base_ptr,
                           size_t length, const void* host_ptr = nullptr);
 
+  // Command processor thread side.
+  // Copies command data to the ring buffer, waiting for the writer thread to
+  // free space if it's full.
+  void Append(const void* data, size_t length);
+  // Ends the block of the current frame after the data appended so far.
+  void EndBlock();
+  // Passes the memory read data stored so far to the writer thread as a blob
+  // block.
+  void EndBlobBlock();
+  // Wakes up the writer thread and waits for it to free space in the ring.
+  void WaitForRingSpace();
+
+  // Writer thread side.
+  void WriterThreadMain();
+  // Encodes the buffered commands of the current frame and writes them to the
+  // file as a block, which is the last one of the frame unless continued.
+  void WriteBlock(bool continued);
+  // Writes the blob blocks ended so far to the file, returns whether there
+  // were any.
+  bool WriteBlobBlocks();
+  void WriteEncodedBlock(TraceBlockType type, const std::vector<uint8_t>& data,
+                         bool continued);
+  void WriteFile(const void* data, size_t length);
+
+  // Location of the data of a memory read already stored in the trace.
+  struct MemoryReadBlob {
+    // The low 64 bits are the key in memory_read_blobs_.
+    uint64_t hash_high;
+    uint32_t length;
+    uint32_t blob_block;
+    uint32_t blob_offset;
+  };
+
   std::set<uint64_t> cached_memory_reads_;
+  // Memory reads stored in the trace by the XXH3-128 hash of their data, for
+  // the whole trace, as the blob blocks don't belong to any frame.
+  std::unordered_map<uint64_t, MemoryReadBlob> memory_read_blobs_;
   uint8_t* membase_;
   FILE* file_;
 
-  bool compress_output_ = true;
-  size_t compression_threshold_ = 1024;  // Min. number of bytes to compress.
+  // Number of bytes appended to the block of the current frame.
+  uint32_t block_size_ = 0;
+  // Number of blocks ended so far, the index of the current frame.
+  uint32_t block_count_ = 0;
+  // Whether a swap event has been written, so the block must be ended after
+  // the current packet.
+  bool block_end_pending_ = false;
+  // Memory read data of the blob block being filled.
+  std::vector<uint8_t> blob_buffer_;
+  // Number of blob blocks ended so far, the index of the one being filled.
+  uint32_t blob_block_count_ = 0;
+  // Max. number of bytes of memory read data buffered for a blob block. A
+  // single larger read is stored as one blob block.
+  static constexpr size_t kMaxBlobBlockSize = size_t(16) << 20;
+
+  // Single-producer single-consumer ring buffer passing the command data from
+  // the command processor thread to the writer thread. Positions are the total
+  // numbers of bytes appended and consumed, the ring offset is modulo the size.
+  std::unique_ptr<uint8_t[]> ring_;
+  size_t ring_size_ = 0;
+  std::atomic<uint64_t> ring_write_position_{0};
+  std::atomic<uint64_t> ring_read_position_{0};
+  // Ring positions where the blocks of the frames end.
+  static constexpr uint32_t kBlockEndRingSize = 64;
+  uint64_t block_end_ring_[kBlockEndRingSize];
+  std::atomic<uint32_t> block_end_write_index_{0};
+  std::atomic<uint32_t> block_end_read_index_{0};
+  // Blob blocks ended, but not written yet, oldest first. Blob blocks don't
+  // need to be ordered relatively to the commands, so they're passed outside
+  // the ring.
+  std::mutex blob_blocks_mutex_;
+  std::deque<std::vector<uint8_t>> pending_blob_blocks_;
+  size_t pending_blob_block_bytes_ = 0;
+  std::atomic<bool> flush_requested_{false};
+  std::atomic<bool> writer_exit_requested_{false};
+  // Only signaled when the writer thread has something to do, not for every
+  // command, as the commands are tiny.
+  std::unique_ptr<xe::threading::Event> data_available_event_;
+  std::unique_ptr<xe::threading::Event> space_available_event_;
+  std::unique_ptr<xe::threading::Thread> writer_thread_;
+
+  // Owned by the writer thread while it's running.
+  // Not using ftell as long is 32-bit on Windows.
+  uint64_t file_offset_ = 0;
+  // Max. number of bytes of commands buffered for a block. Larger frames are
+  // written as multiple blocks, so the buffer size doesn't depend on the
+  // amount of data the game uploads in a frame.
+  static constexpr size_t kMaxBlockBufferSize = size_t(16) << 20;
+  // Commands of the current frame not written yet, encoded as a whole when the
+  // frame ends or the buffer is full.
+  std::vector<uint8_t> block_buffer_;
+  // Whether the last block written was continued, so the current frame already
+  // has an entry in the frame index.
+  bool block_continued_ = false;
+  std::vector<uint8_t> encoded_block_buffer_;
+  // File offsets of the headers of the first blocks of the frames written so
+  // far.
+  std::vector<uint64_t> frame_index_;
+  // File offsets of the headers of the blob blocks written so far.
+  std::vector<uint64_t> blob_block_index_;
+
+  // Capture overhead statistics, reported when the trace is closed.
+  // Command processor thread.
+  uint64_t appended_bytes_ = 0;
+  uint64_t blob_bytes_ = 0;
+  uint64_t deduplicated_bytes_ = 0;
+  uint64_t peak_ring_usage_ = 0;
+  uint64_t stall_count_ = 0;
+  uint64_t stall_ticks_ = 0;
+  // Writer thread.
+  uint64_t encode_ticks_ = 0;
+  uint64_t write_ticks_ = 0;
+
+  // Min. number of bytes to deduplicate.
+  size_t deduplication_threshold_ = 256;
+  MemoryEncodingFormat block_encoding_format_ = MemoryEncodingFormat::kZstd;
+  int zstd_compression_level_ = 3;
 
 #else
   // this could be annoying to maintain if new methods are added or the
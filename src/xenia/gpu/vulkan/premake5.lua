@@ -23,6 +23,8 @@ project("xenia-gpu-vulkan")
     "../shaders/bytecode/vulkan_spirv/*.h",
   })
 
+include("testing")
+
 group("src")
 project("xenia-gpu-vulkan-trace-viewer")
   uuid("86a1dddc-a26a-4885-8c55-cf745225d93e")
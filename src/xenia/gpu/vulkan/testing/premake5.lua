@@ -0,0 +1,18 @@
+project_root = "../../../../.."
+include(project_root.."/tools/build")
+
+test_suite("xenia-gpu-vulkan-tests", project_root, ".", {
+  includedirs = {
+    project_root.."/third_party/Vulkan-Headers/include",
+  },
+  links = {
+    "fmt",
+    "glslang-spirv",
+    "xenia-base",
+    "xenia-gpu",
+    "xenia-gpu-vulkan",
+    "xenia-ui",
+    "xenia-ui-vulkan",
+    "xxhash",
+  },
+})
@@ -0,0 +1,234 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/gpu/vulkan/vulkan_pipeline_cache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "third_party/catch/include/catch.hpp"
+
+#include "xenia/base/byte_order.h"
+#include "xenia/base/xxhash.h"
+#include "xenia/gpu/spirv_shader.h"
+#include "xenia/gpu/spirv_shader_translator.h"
+#include "xenia/gpu/xenos.h"
+
+namespace xe {
+namespace gpu {
+namespace vulkan {
+namespace test {
+
+using PipelineStoredDescription =
+    VulkanPipelineCache::PipelineStoredDescription;
+
+// A control flow pair with an exec_end of no instructions and a nop, stored
+// with the guest endianness like in the storage file.
+static std::vector<uint32_t> MakeEmptyShaderUcode(uint32_t variant) {
+  // The exec address is 1 - right after the control flow, and the unused bits
+  // of the nop make the ucode, and thus the hash, unique.
+  std::vector<uint32_t> ucode = {0x00000001, 0x00002000, variant << 16};
+  for (uint32_t& dword : ucode) {
+    dword = xe::byte_swap(dword);
+  }
+  return ucode;
+}
+
+static std::unique_ptr<SpirvShader> MakeShader(
+    xenos::ShaderType type, const std::vector<uint32_t>& ucode) {
+  return std::make_unique<SpirvShader>(
+      type, XXH3_64bits(ucode.data(), ucode.size() * sizeof(uint32_t)),
+      ucode.data(), ucode.size());
+}
+
+static PipelineStoredDescription MakeStoredDescription(
+    uint64_t vertex_shader_hash, uint64_t vertex_shader_modification,
+    uint64_t pixel_shader_hash, uint64_t pixel_shader_modification) {
+  // The description constructor clears the padding for a stable hash.
+  PipelineStoredDescription stored_description;
+  stored_description.description.vertex_shader_hash = vertex_shader_hash;
+  stored_description.description.vertex_shader_modification =
+      vertex_shader_modification;
+  stored_description.description.pixel_shader_hash = pixel_shader_hash;
+  stored_description.description.pixel_shader_modification =
+      pixel_shader_modification;
+  stored_description.description_hash =
+      stored_description.description.GetHash();
+  return stored_description;
+}
+
+TEST_CASE("Vulkan pipeline storage round trip", "[vulkan]") {
+  const bool edram_fragment_shader_interlock = false;
+  const SpirvShaderTranslator::Features translator_features(true);
+  SpirvShaderTranslator modification_translator(
+      translator_features, true, true, edram_fragment_shader_interlock);
+
+  std::vector<uint32_t> vertex_ucode = MakeEmptyShaderUcode(1);
+  std::vector<uint32_t> pixel_ucode = MakeEmptyShaderUcode(2);
+  std::vector<uint32_t> unused_ucode = MakeEmptyShaderUcode(3);
+  std::unique_ptr<SpirvShader> vertex_shader =
+      MakeShader(xenos::ShaderType::kVertex, vertex_ucode);
+  std::unique_ptr<SpirvShader> pixel_shader =
+      MakeShader(xenos::ShaderType::kPixel, pixel_ucode);
+  std::unique_ptr<SpirvShader> unused_shader =
+      MakeShader(xenos::ShaderType::kPixel, unused_ucode);
+
+  uint64_t vertex_modification =
+      modification_translator.GetDefaultVertexShaderModification(0);
+  uint64_t vertex_modification_point_size;
+  {
+    SpirvShaderTranslator::Modification modification(vertex_modification);
+    modification.vertex.output_point_parameters = 1;
+    vertex_modification_point_size = modification.value;
+  }
+  uint64_t pixel_modification =
+      modification_translator.GetDefaultPixelShaderModification(0);
+
+  // Two pipelines, one of them without a pixel shader, sharing the vertex
+  // shader with different modifications.
+  std::vector<PipelineStoredDescription> written_descriptions;
+  written_descriptions.push_back(MakeStoredDescription(
+      vertex_shader->ucode_data_hash(), vertex_modification,
+      pixel_shader->ucode_data_hash(), pixel_modification));
+  written_descriptions.push_back(
+      MakeStoredDescription(vertex_shader->ucode_data_hash(),
+                            vertex_modification_point_size, 0, 0));
+
+  FILE* pipeline_file = std::tmpfile();
+  REQUIRE(pipeline_file);
+  VulkanPipelineCache::WritePipelineStorageHeader(
+      pipeline_file, edram_fragment_shader_interlock);
+  for (const PipelineStoredDescription& description : written_descriptions) {
+    fwrite(&description, sizeof(description), 1, pipeline_file);
+  }
+  long pipeline_file_valid_size = std::ftell(pipeline_file);
+  // A corrupted description in the end must be dropped.
+  PipelineStoredDescription corrupted_description = written_descriptions[0];
+  corrupted_description.description_hash ^= 1;
+  fwrite(&corrupted_description, sizeof(corrupted_description), 1,
+         pipeline_file);
+
+  FILE* shader_file = std::tmpfile();
+  REQUIRE(shader_file);
+  VulkanPipelineCache::WriteShaderStorageHeader(shader_file);
+  VulkanPipelineCache::WriteStoredShader(shader_file, *vertex_shader);
+  VulkanPipelineCache::WriteStoredShader(shader_file, *pixel_shader);
+  VulkanPipelineCache::WriteStoredShader(shader_file, *unused_shader);
+  long shader_file_valid_size = std::ftell(shader_file);
+  // A shader with corrupted ucode in the end must be dropped.
+  VulkanPipelineCache::WriteStoredShader(shader_file, *unused_shader);
+  uint32_t corrupted_ucode_dword = 0;
+  std::fseek(shader_file, -long(sizeof(corrupted_ucode_dword)), SEEK_END);
+  std::fwrite(&corrupted_ucode_dword, sizeof(corrupted_ucode_dword), 1,
+              shader_file);
+
+  std::rewind(pipeline_file);
+  std::vector<PipelineStoredDescription> read_descriptions;
+  std::set<std::pair<uint64_t, uint64_t>> shader_translations_needed;
+  uint64_t pipeline_valid_bytes = VulkanPipelineCache::ReadPipelineStorage(
+      pipeline_file, edram_fragment_shader_interlock, read_descriptions,
+      shader_translations_needed);
+  REQUIRE(pipeline_valid_bytes == uint64_t(pipeline_file_valid_size));
+  REQUIRE(read_descriptions.size() == written_descriptions.size());
+  for (size_t i = 0; i < written_descriptions.size(); ++i) {
+    REQUIRE(!std::memcmp(&read_descriptions[i], &written_descriptions[i],
+                         sizeof(PipelineStoredDescription)));
+  }
+  REQUIRE(shader_translations_needed ==
+          std::set<std::pair<uint64_t, uint64_t>>{
+              {vertex_shader->ucode_data_hash(), vertex_modification},
+              {vertex_shader->ucode_data_hash(),
+               vertex_modification_point_size},
+              {pixel_shader->ucode_data_hash(), pixel_modification},
+          });
+
+  // The other render target path must not accept the file.
+  {
+    std::rewind(pipeline_file);
+    std::vector<PipelineStoredDescription> other_path_descriptions;
+    std::set<std::pair<uint64_t, uint64_t>> other_path_translations_needed;
+    REQUIRE(!VulkanPipelineCache::ReadPipelineStorage(
+        pipeline_file, !edram_fragment_shader_interlock,
+        other_path_descriptions, other_path_translations_needed));
+    REQUIRE(other_path_descriptions.empty());
+    REQUIRE(other_path_translations_needed.empty());
+  }
+
+  // A file written with a different shader modification version must not be
+  // accepted either - the header ends with it, after the description version.
+  {
+    uint32_t modification_version_swapped =
+        xe::byte_swap(SpirvShaderTranslator::Modification::kVersion + 1);
+    std::fseek(pipeline_file, 3 * sizeof(uint32_t), SEEK_SET);
+    std::fwrite(&modification_version_swapped,
+                sizeof(modification_version_swapped), 1, pipeline_file);
+    std::rewind(pipeline_file);
+    std::vector<PipelineStoredDescription> old_version_descriptions;
+    std::set<std::pair<uint64_t, uint64_t>> old_version_translations_needed;
+    REQUIRE(!VulkanPipelineCache::ReadPipelineStorage(
+        pipeline_file, edram_fragment_shader_interlock,
+        old_version_descriptions, old_version_translations_needed));
+    REQUIRE(old_version_descriptions.empty());
+  }
+  std::fclose(pipeline_file);
+
+  std::rewind(shader_file);
+  std::vector<std::unique_ptr<SpirvShader>> loaded_shaders;
+  std::vector<SpirvShader::SpirvTranslation*> failed_translations;
+  uint64_t shader_valid_bytes = VulkanPipelineCache::ReadShaderStorage(
+      shader_file, shader_translations_needed, translator_features, true, true,
+      edram_fragment_shader_interlock, 2,
+      [&](xenos::ShaderType shader_type, const uint32_t* ucode_dwords,
+          uint32_t ucode_dword_count, uint64_t ucode_data_hash) {
+        return loaded_shaders
+            .emplace_back(std::make_unique<SpirvShader>(
+                shader_type, ucode_data_hash, ucode_dwords,
+                ucode_dword_count))
+            .get();
+      },
+      [](SpirvShaderTranslator& translator,
+         SpirvShader::SpirvTranslation& translation) {
+        return translator.TranslateAnalyzedShader(translation);
+      },
+      failed_translations);
+  std::fclose(shader_file);
+  REQUIRE(shader_valid_bytes == uint64_t(shader_file_valid_size));
+  REQUIRE(failed_translations.empty());
+
+  REQUIRE(loaded_shaders.size() == 3);
+  REQUIRE(loaded_shaders[0]->type() == xenos::ShaderType::kVertex);
+  REQUIRE(loaded_shaders[0]->ucode_data_hash() ==
+          vertex_shader->ucode_data_hash());
+  REQUIRE(loaded_shaders[1]->type() == xenos::ShaderType::kPixel);
+  REQUIRE(loaded_shaders[1]->ucode_data_hash() ==
+          pixel_shader->ucode_data_hash());
+  REQUIRE(loaded_shaders[2]->ucode_data_hash() ==
+          unused_shader->ucode_data_hash());
+  size_t translated_count = 0;
+  for (const std::unique_ptr<SpirvShader>& shader : loaded_shaders) {
+    for (const auto& translation : shader->translations()) {
+      if (translation.second->is_translated() &&
+          translation.second->is_valid()) {
+        ++translated_count;
+      }
+    }
+  }
+  // Only the modifications used by the pipelines are translated.
+  REQUIRE(translated_count == shader_translations_needed.size());
+  REQUIRE(loaded_shaders[2]->translations().empty());
+}
+
+}  // namespace test
+}  // namespace vulkan
+}  // namespace gpu
+}  // namespace xe
@@ -11,6 +11,7 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <cstdint>
 #include <cstring>
 #include <memory>
@@ -19,8 +20,13 @@
 
 #include "third_party/fmt/include/fmt/format.h"
 #include "xenia/base/assert.h"
+#include "xenia/base/byte_order.h"
+#include "xenia/base/clock.h"
+#include "xenia/base/cvar.h"
+#include "xenia/base/filesystem.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
+#include "xenia/base/memory.h"
 #include "xenia/base/profiling.h"
 #include "xenia/base/xxhash.h"
 #include "xenia/gpu/draw_util.h"
@@ -34,6 +40,15 @@
 #include "xenia/gpu/xenos.h"
 #include "xenia/ui/vulkan/vulkan_util.h"
 
+DEFINE_bool(vulkan_optimize_spirv, false,
+            "Run the SPIRV-Tools optimizer (dead code elimination, constant "
+            "folding, local variable promotion) on the translated shaders. "
+            "Requires SPIRV-Tools from the Vulkan SDK ($VULKAN_SDK) and a "
+            "shared SPIRV-Tools-opt library in the Vulkan SDK or in the "
+            "library search path. Slows down shader translation, but may "
+            "reduce the time the host driver spends compiling pipelines.",
+            "Vulkan");
+
 namespace xe {
 namespace gpu {
 namespace vulkan {
@@ -58,8 +73,9 @@ bool VulkanPipelineCache::Initialize() {
       render_target_cache_.GetPath() ==
       RenderTargetCache::Path::kPixelShaderInterlock;
 
+  SpirvShaderTranslator::Features translator_features(provider.device_info());
   shader_translator_ = std::make_unique<SpirvShaderTranslator>(
-      SpirvShaderTranslator::Features(provider.device_info()),
+      translator_features,
       render_target_cache_.msaa_2x_attachments_supported(),
       render_target_cache_.msaa_2x_no_attachments_supported(),
       edram_fragment_shader_interlock);
@@ -81,6 +97,16 @@ bool VulkanPipelineCache::Initialize() {
     }
   }
 
+  if (cvars::vulkan_optimize_spirv) {
+    if (!spirv_tools_context_.Initialize(translator_features.spirv_version) ||
+        !spirv_tools_context_.IsOptimizerAvailable()) {
+      XELOGW(
+          "VulkanPipelineCache: SPIR-V optimizer is unavailable, shaders will "
+          "not be optimized");
+      spirv_tools_context_.Shutdown();
+    }
+  }
+
   return true;
 }
 
@@ -90,6 +116,9 @@ void VulkanPipelineCache::Shutdown() {
   const ui::vulkan::VulkanProvider::DeviceFunctions& dfn = provider.dfn();
   VkDevice device = provider.device();
 
+  // Shut down the persistent shader / pipeline storage.
+  ShutdownShaderStorage();
+
   // Destroy all pipelines.
   last_pipeline_ = nullptr;
   for (const auto& pipeline_pair : pipelines_) {
@@ -119,14 +148,367 @@ void VulkanPipelineCache::Shutdown() {
 
   // Shut down shader translation.
   shader_translator_.reset();
+  spirv_tools_context_.Shutdown();
+}
+
+void VulkanPipelineCache::InitializeShaderStorage(
+    const std::filesystem::path& cache_root, uint32_t title_id, bool blocking) {
+  ShutdownShaderStorage();
+
+  auto shader_storage_root = cache_root / "shaders";
+  // For files that can be moved between different hosts.
+  auto shader_storage_shareable_root = shader_storage_root / "shareable";
+  if (!std::filesystem::exists(shader_storage_shareable_root)) {
+    if (!std::filesystem::create_directories(shader_storage_shareable_root)) {
+      XELOGE(
+          "Failed to create the shareable shader storage directory, persistent "
+          "shader storage will be disabled: {}",
+          shader_storage_shareable_root);
+      return;
+    }
+  }
+
+  bool edram_fragment_shader_interlock =
+      render_target_cache_.GetPath() ==
+      RenderTargetCache::Path::kPixelShaderInterlock;
+
+  // Initialize the pipeline storage stream - read pipeline descriptions and
+  // collect used shader modifications to translate.
+  std::vector<PipelineStoredDescription> pipeline_stored_descriptions;
+  // <Shader hash, modification bits>.
+  std::set<std::pair<uint64_t, uint64_t>> shader_translations_needed;
+  auto pipeline_storage_file_path =
+      shader_storage_shareable_root /
+      fmt::format("{:08X}.{}.vulkan.xpso", title_id,
+                  edram_fragment_shader_interlock ? "fsi" : "rtv");
+  pipeline_storage_file_ =
+      xe::filesystem::OpenFile(pipeline_storage_file_path, "a+b");
+  if (!pipeline_storage_file_) {
+    XELOGE(
+        "Failed to open the Vulkan pipeline description storage file for "
+        "writing, persistent shader storage will be disabled: {}",
+        pipeline_storage_file_path);
+    return;
+  }
+  pipeline_storage_file_flush_needed_ = false;
+  uint64_t pipeline_storage_valid_bytes = ReadPipelineStorage(
+      pipeline_storage_file_, edram_fragment_shader_interlock,
+      pipeline_stored_descriptions, shader_translations_needed);
+
+  size_t logical_processor_count = xe::threading::logical_processor_count();
+  if (!logical_processor_count) {
+    // Pick some reasonable amount if couldn't determine the number of cores.
+    logical_processor_count = 6;
+  }
+
+  // Initialize the Xenos shader storage stream.
+  uint64_t shader_storage_initialization_start =
+      xe::Clock::QueryHostTickCount();
+  auto shader_storage_file_path =
+      shader_storage_shareable_root / fmt::format("{:08X}.xsh", title_id);
+  shader_storage_file_ =
+      xe::filesystem::OpenFile(shader_storage_file_path, "a+b");
+  if (!shader_storage_file_) {
+    XELOGE(
+        "Failed to open the guest shader storage file for writing, persistent "
+        "shader storage will be disabled: {}",
+        shader_storage_file_path);
+    fclose(pipeline_storage_file_);
+    pipeline_storage_file_ = nullptr;
+    return;
+  }
+  ++shader_storage_index_;
+  shader_storage_file_flush_needed_ = false;
+  // Load the shaders on this thread, and translate them on other threads while
+  // the file is being read. Translation to SPIR-V itself only needs the device
+  // features, not the device.
+  size_t shaders_translated = 0;
+  std::vector<SpirvShader::SpirvTranslation*> shaders_failed_to_translate;
+  uint64_t shader_storage_valid_bytes = ReadShaderStorage(
+      shader_storage_file_, shader_translations_needed,
+      SpirvShaderTranslator::Features(
+          command_processor_.GetVulkanProvider().device_info()),
+      render_target_cache_.msaa_2x_attachments_supported(),
+      render_target_cache_.msaa_2x_no_attachments_supported(),
+      edram_fragment_shader_interlock, logical_processor_count - 1,
+      [&](xenos::ShaderType shader_type, const uint32_t* ucode_dwords,
+          uint32_t ucode_dword_count,
+          uint64_t ucode_data_hash) -> SpirvShader* {
+        VulkanShader* shader = LoadShader(shader_type, ucode_dwords,
+                                          ucode_dword_count, ucode_data_hash);
+        if (shader->ucode_storage_index() == shader_storage_index_) {
+          // Appeared twice in this file for some reason - skip, otherwise race
+          // condition will be caused by translating twice in parallel.
+          return nullptr;
+        }
+        // Loaded from the current storage - don't write again.
+        shader->set_ucode_storage_index(shader_storage_index_);
+        ++shaders_translated;
+        return shader;
+      },
+      [this](SpirvShaderTranslator& translator,
+             SpirvShader::SpirvTranslation& translation) {
+        return TranslateAnalyzedShader(
+            translator,
+            static_cast<VulkanShader::VulkanTranslation&>(translation));
+      },
+      shaders_failed_to_translate);
+  if (shader_storage_valid_bytes) {
+    for (SpirvShader::SpirvTranslation* translation :
+         shaders_failed_to_translate) {
+      VulkanShader* shader = static_cast<VulkanShader*>(&translation->shader());
+      shader->DestroyTranslation(translation->modification());
+      if (shader->translations().empty()) {
+        shaders_.erase(shader->ucode_data_hash());
+        delete shader;
+      }
+    }
+    XELOGGPU("Translated {} shaders from the storage in {} milliseconds",
+             shaders_translated,
+             (xe::Clock::QueryHostTickCount() -
+              shader_storage_initialization_start) *
+                 1000 / xe::Clock::QueryHostTickFrequency());
+    xe::filesystem::TruncateStdioFile(shader_storage_file_,
+                                      shader_storage_valid_bytes);
+  } else {
+    xe::filesystem::TruncateStdioFile(shader_storage_file_, 0);
+    WriteShaderStorageHeader(shader_storage_file_);
+  }
+
+  // Create the pipelines.
+  if (!pipeline_stored_descriptions.empty()) {
+    uint64_t pipeline_creation_start = xe::Clock::QueryHostTickCount();
+
+    // Look up everything the pipelines need from the caches on this thread, so
+    // only the Vulkan pipeline objects themselves are created in parallel.
+    std::vector<PipelineCreationArguments> pipelines_to_create;
+    pipelines_to_create.reserve(pipeline_stored_descriptions.size());
+    for (const PipelineStoredDescription& pipeline_stored_description :
+         pipeline_stored_descriptions) {
+      const PipelineDescription& pipeline_description =
+          pipeline_stored_description.description;
+      // Skip pipelines requiring unsupported device features to keep the
+      // storage files shareable across devices.
+      if (!ArePipelineRequirementsMet(pipeline_description)) {
+        continue;
+      }
+      // Skip already known pipelines.
+      if (pipelines_.find(pipeline_description) != pipelines_.end()) {
+        continue;
+      }
+
+      auto vertex_shader_it =
+          shaders_.find(pipeline_description.vertex_shader_hash);
+      if (vertex_shader_it == shaders_.end()) {
+        continue;
+      }
+      VulkanShader* vertex_shader = vertex_shader_it->second;
+      auto vertex_shader_translation =
+          static_cast<VulkanShader::VulkanTranslation*>(
+              vertex_shader->GetTranslation(
+                  pipeline_description.vertex_shader_modification));
+      if (!vertex_shader_translation ||
+          !vertex_shader_translation->is_translated() ||
+          !vertex_shader_translation->is_valid()) {
+        continue;
+      }
+      VulkanShader* pixel_shader = nullptr;
+      VulkanShader::VulkanTranslation* pixel_shader_translation = nullptr;
+      if (pipeline_description.pixel_shader_hash) {
+        auto pixel_shader_it =
+            shaders_.find(pipeline_description.pixel_shader_hash);
+        if (pixel_shader_it == shaders_.end()) {
+          continue;
+        }
+        pixel_shader = pixel_shader_it->second;
+        pixel_shader_translation =
+            static_cast<VulkanShader::VulkanTranslation*>(
+                pixel_shader->GetTranslation(
+                    pipeline_description.pixel_shader_modification));
+        if (!pixel_shader_translation ||
+            !pixel_shader_translation->is_translated() ||
+            !pixel_shader_translation->is_valid()) {
+          continue;
+        }
+      }
+
+      const PipelineLayoutProvider* pipeline_layout =
+          command_processor_.GetPipelineLayout(
+              pixel_shader
+                  ? pixel_shader->GetTextureBindingsAfterTranslation().size()
+                  : 0,
+              pixel_shader
+                  ? pixel_shader->GetSamplerBindingsAfterTranslation().size()
+                  : 0,
+              vertex_shader->GetTextureBindingsAfterTranslation().size(),
+              vertex_shader->GetSamplerBindingsAfterTranslation().size());
+      if (!pipeline_layout) {
+        continue;
+      }
+      VkShaderModule geometry_shader = VK_NULL_HANDLE;
+      GeometryShaderKey geometry_shader_key;
+      if (GetGeometryShaderKey(
+              pipeline_description.geometry_shader,
+              SpirvShaderTranslator::Modification(
+                  pipeline_description.vertex_shader_modification),
+              SpirvShaderTranslator::Modification(
+                  pipeline_description.pixel_shader_modification),
+              geometry_shader_key)) {
+        geometry_shader = GetGeometryShader(geometry_shader_key);
+        if (geometry_shader == VK_NULL_HANDLE) {
+          continue;
+        }
+      }
+      VkRenderPass render_pass =
+          edram_fragment_shader_interlock
+              ? render_target_cache_.GetFragmentShaderInterlockRenderPass()
+              : render_target_cache_.GetHostRenderTargetsRenderPass(
+                    pipeline_description.render_pass_key);
+      if (render_pass == VK_NULL_HANDLE) {
+        continue;
+      }
+
+      PipelineCreationArguments& creation_arguments =
+          pipelines_to_create.emplace_back();
+      creation_arguments.pipeline =
+          &*pipelines_
+                .emplace(pipeline_description, Pipeline(pipeline_layout))
+                .first;
+      creation_arguments.vertex_shader = vertex_shader_translation;
+      creation_arguments.pixel_shader = pixel_shader_translation;
+      creation_arguments.geometry_shader = geometry_shader;
+      creation_arguments.render_pass = render_pass;
+    }
+
+    // Create the pipelines on all cores, including this thread, so minus 1.
+    std::atomic<size_t> pipeline_creation_next_index(0);
+    auto pipeline_creation_thread_function = [&]() {
+      for (;;) {
+        size_t pipeline_index = pipeline_creation_next_index.fetch_add(
+            1, std::memory_order_relaxed);
+        if (pipeline_index >= pipelines_to_create.size()) {
+          return;
+        }
+        EnsurePipelineCreated(pipelines_to_create[pipeline_index]);
+      }
+    };
+    std::vector<std::unique_ptr<xe::threading::Thread>>
+        pipeline_creation_threads;
+    size_t pipeline_creation_thread_count =
+        std::min(pipelines_to_create.size(), logical_processor_count);
+    while (pipeline_creation_threads.size() + 1 <
+           pipeline_creation_thread_count) {
+      auto thread = xe::threading::Thread::Create(
+          {}, pipeline_creation_thread_function);
+      assert_not_null(thread);
+      thread->set_name("Vulkan Pipelines");
+      pipeline_creation_threads.push_back(std::move(thread));
+    }
+    pipeline_creation_thread_function();
+    for (auto& pipeline_creation_thread : pipeline_creation_threads) {
+      xe::threading::Wait(pipeline_creation_thread.get(), false);
+    }
+    pipeline_creation_threads.clear();
+
+    size_t pipelines_created = 0;
+    for (const PipelineCreationArguments& creation_arguments :
+         pipelines_to_create) {
+      if (creation_arguments.pipeline->second.pipeline != VK_NULL_HANDLE) {
+        ++pipelines_created;
+      } else {
+        // Let the pipeline be created again if it's actually used.
+        pipelines_.erase(creation_arguments.pipeline->first);
+      }
+    }
+
+    XELOGGPU(
+        "Created {} graphics pipelines (not including reading the "
+        "descriptions) from the storage in {} milliseconds",
+        pipelines_created,
+        (xe::Clock::QueryHostTickCount() - pipeline_creation_start) * 1000 /
+            xe::Clock::QueryHostTickFrequency());
+    // If any pipeline descriptions were corrupted (or the whole file has excess
+    // bytes in the end), truncate to the last valid pipeline description.
+    xe::filesystem::TruncateStdioFile(pipeline_storage_file_,
+                                      pipeline_storage_valid_bytes);
+  } else {
+    xe::filesystem::TruncateStdioFile(pipeline_storage_file_, 0);
+    WritePipelineStorageHeader(pipeline_storage_file_,
+                               edram_fragment_shader_interlock);
+  }
+
+  shader_storage_cache_root_ = cache_root;
+  shader_storage_title_id_ = title_id;
+
+  // Start the storage writing thread.
+  storage_write_flush_shaders_ = false;
+  storage_write_flush_pipelines_ = false;
+  storage_write_thread_shutdown_ = false;
+  storage_write_thread_ =
+      xe::threading::Thread::Create({}, [this]() { StorageWriteThread(); });
+  assert_not_null(storage_write_thread_);
+  storage_write_thread_->set_name("Vulkan Storage writer");
+}
+
+void VulkanPipelineCache::ShutdownShaderStorage() {
+  if (storage_write_thread_) {
+    {
+      std::lock_guard<std::mutex> lock(storage_write_request_lock_);
+      storage_write_thread_shutdown_ = true;
+    }
+    storage_write_request_cond_.notify_all();
+    xe::threading::Wait(storage_write_thread_.get(), false);
+    storage_write_thread_.reset();
+  }
+  storage_write_shader_queue_.clear();
+  storage_write_pipeline_queue_.clear();
+
+  if (pipeline_storage_file_) {
+    fclose(pipeline_storage_file_);
+    pipeline_storage_file_ = nullptr;
+    pipeline_storage_file_flush_needed_ = false;
+  }
+
+  if (shader_storage_file_) {
+    fclose(shader_storage_file_);
+    shader_storage_file_ = nullptr;
+    shader_storage_file_flush_needed_ = false;
+  }
+
+  shader_storage_cache_root_.clear();
+  shader_storage_title_id_ = 0;
+}
+
+void VulkanPipelineCache::EndSubmission() {
+  if (shader_storage_file_flush_needed_ ||
+      pipeline_storage_file_flush_needed_) {
+    {
+      std::lock_guard<std::mutex> lock(storage_write_request_lock_);
+      if (shader_storage_file_flush_needed_) {
+        storage_write_flush_shaders_ = true;
+      }
+      if (pipeline_storage_file_flush_needed_) {
+        storage_write_flush_pipelines_ = true;
+      }
+    }
+    storage_write_request_cond_.notify_one();
+    shader_storage_file_flush_needed_ = false;
+    pipeline_storage_file_flush_needed_ = false;
+  }
 }
 
 VulkanShader* VulkanPipelineCache::LoadShader(xenos::ShaderType shader_type,
                                               const uint32_t* host_address,
                                               uint32_t dword_count) {
   // Hash the input memory and lookup the shader.
-  uint64_t data_hash =
-      XXH3_64bits(host_address, dword_count * sizeof(uint32_t));
+  return LoadShader(shader_type, host_address, dword_count,
+                    XXH3_64bits(host_address, dword_count * sizeof(uint32_t)));
+}
+
+VulkanShader* VulkanPipelineCache::LoadShader(xenos::ShaderType shader_type,
+                                              const uint32_t* host_address,
+                                              uint32_t dword_count,
+                                              uint64_t data_hash) {
   auto it = shaders_.find(data_hash);
   if (it != shaders_.end()) {
     // Shader has been previously loaded.
@@ -238,6 +620,17 @@ bool VulkanPipelineCache::EnsureShadersTranslated(
       XELOGE("Failed to translate the vertex shader!");
       return false;
     }
+    if (shader_storage_file_ && vertex_shader->shader().ucode_storage_index() !=
+                                    shader_storage_index_) {
+      vertex_shader->shader().set_ucode_storage_index(shader_storage_index_);
+      assert_not_null(storage_write_thread_);
+      shader_storage_file_flush_needed_ = true;
+      {
+        std::lock_guard<std::mutex> lock(storage_write_request_lock_);
+        storage_write_shader_queue_.push_back(&vertex_shader->shader());
+      }
+      storage_write_request_cond_.notify_all();
+    }
   }
   if (!vertex_shader->is_valid()) {
     // Translation attempted previously, but not valid.
@@ -250,6 +643,18 @@ bool VulkanPipelineCache::EnsureShadersTranslated(
         XELOGE("Failed to translate the pixel shader!");
         return false;
       }
+      if (shader_storage_file_ &&
+          pixel_shader->shader().ucode_storage_index() !=
+              shader_storage_index_) {
+        pixel_shader->shader().set_ucode_storage_index(shader_storage_index_);
+        assert_not_null(storage_write_thread_);
+        shader_storage_file_flush_needed_ = true;
+        {
+          std::lock_guard<std::mutex> lock(storage_write_request_lock_);
+          storage_write_shader_queue_.push_back(&pixel_shader->shader());
+        }
+        storage_write_request_cond_.notify_all();
+      }
     }
     if (!pixel_shader->is_valid()) {
       // Translation attempted previously, but not valid.
@@ -352,6 +757,22 @@ bool VulkanPipelineCache::ConfigurePipeline(
   if (!EnsurePipelineCreated(creation_arguments)) {
     return false;
   }
+
+  if (pipeline_storage_file_) {
+    assert_not_null(storage_write_thread_);
+    pipeline_storage_file_flush_needed_ = true;
+    {
+      std::lock_guard<std::mutex> lock(storage_write_request_lock_);
+      storage_write_pipeline_queue_.emplace_back();
+      PipelineStoredDescription& stored_description =
+          storage_write_pipeline_queue_.back();
+      stored_description.description_hash = description.GetHash();
+      std::memcpy(&stored_description.description, &description,
+                  sizeof(description));
+    }
+    storage_write_request_cond_.notify_all();
+  }
+
   pipeline_out = pipeline.second.pipeline;
   pipeline_layout_out = pipeline_layout;
   return true;
@@ -369,6 +790,11 @@ bool VulkanPipelineCache::TranslateAnalyzedShader(
            shader.ucode_data_hash());
     return false;
   }
+  // The optimized SPIR-V replaces the translated one, so it's kept with the
+  // translation and not optimized again.
+  if (spirv_tools_context_.IsOptimizerAvailable()) {
+    translation.OptimizeTranslatedBinary(spirv_tools_context_);
+  }
   if (translation.GetOrCreateShaderModule() == VK_NULL_HANDLE) {
     return false;
   }
@@ -385,6 +811,8 @@ bool VulkanPipelineCache::TranslateAnalyzedShader(
         shader.GetTextureBindingsAfterTranslation();
     size_t texture_binding_count = texture_bindings.size();
     if (texture_binding_count) {
+      // Shaders from the storage are translated on multiple threads.
+      std::lock_guard<std::mutex> layouts_lock(layouts_mutex_);
       size_t texture_binding_layout_bytes =
           texture_binding_count * sizeof(*texture_bindings.data());
       uint64_t texture_binding_layout_hash =
@@ -2298,6 +2726,66 @@ bool VulkanPipelineCache::EnsurePipelineCreated(
   return true;
 }
 
+void VulkanPipelineCache::StorageWriteThread() {
+  bool flush_shaders = false;
+  bool flush_pipelines = false;
+
+  while (true) {
+    if (flush_shaders) {
+      flush_shaders = false;
+      assert_not_null(shader_storage_file_);
+      fflush(shader_storage_file_);
+    }
+    if (flush_pipelines) {
+      flush_pipelines = false;
+      assert_not_null(pipeline_storage_file_);
+      fflush(pipeline_storage_file_);
+    }
+
+    const Shader* shader = nullptr;
+    PipelineStoredDescription pipeline_description;
+    bool write_pipeline = false;
+    {
+      std::unique_lock<std::mutex> lock(storage_write_request_lock_);
+      if (storage_write_thread_shutdown_) {
+        return;
+      }
+      if (!storage_write_shader_queue_.empty()) {
+        shader = storage_write_shader_queue_.front();
+        storage_write_shader_queue_.pop_front();
+      } else if (storage_write_flush_shaders_) {
+        storage_write_flush_shaders_ = false;
+        flush_shaders = true;
+      }
+      if (!storage_write_pipeline_queue_.empty()) {
+        std::memcpy(&pipeline_description,
+                    &storage_write_pipeline_queue_.front(),
+                    sizeof(pipeline_description));
+        storage_write_pipeline_queue_.pop_front();
+        write_pipeline = true;
+      } else if (storage_write_flush_pipelines_) {
+        storage_write_flush_pipelines_ = false;
+        flush_pipelines = true;
+      }
+      if (!shader && !write_pipeline) {
+        storage_write_request_cond_.wait(lock);
+        continue;
+      }
+    }
+
+    if (shader) {
+      assert_not_null(shader_storage_file_);
+      WriteStoredShader(shader_storage_file_, *shader);
+    }
+
+    if (write_pipeline) {
+      assert_not_null(pipeline_storage_file_);
+      fwrite(&pipeline_description, sizeof(pipeline_description), 1,
+             pipeline_storage_file_);
+    }
+  }
+}
+
 }  // namespace vulkan
 }  // namespace gpu
 }  // namespace xe
@@ -10,23 +10,33 @@
 #ifndef XENIA_GPU_VULKAN_VULKAN_PIPELINE_STATE_CACHE_H_
 #define XENIA_GPU_VULKAN_VULKAN_PIPELINE_STATE_CACHE_H_
 
+#include <condition_variable>
 #include <cstddef>
+#include <cstdio>
 #include <cstring>
+#include <deque>
+#include <filesystem>
 #include <functional>
 #include <memory>
+#include <mutex>
+#include <set>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 #include "xenia/base/hash.h"
 #include "xenia/base/platform.h"
+#include "xenia/base/threading.h"
 #include "xenia/base/xxhash.h"
 #include "xenia/gpu/primitive_processor.h"
 #include "xenia/gpu/register_file.h"
 #include "xenia/gpu/registers.h"
+#include "xenia/gpu/spirv_shader.h"
 #include "xenia/gpu/spirv_shader_translator.h"
 #include "xenia/gpu/vulkan/vulkan_render_target_cache.h"
 #include "xenia/gpu/vulkan/vulkan_shader.h"
 #include "xenia/gpu/xenos.h"
+#include "xenia/ui/vulkan/spirv_tools_context.h"
 #include "xenia/ui/vulkan/vulkan_provider.h"
 
 namespace xe {
@@ -59,6 +69,12 @@ class VulkanPipelineCache {
   bool Initialize();
   void Shutdown();
 
+  void InitializeShaderStorage(const std::filesystem::path& cache_root,
+                               uint32_t title_id, bool blocking);
+  void ShutdownShaderStorage();
+
+  void EndSubmission();
+
   VulkanShader* LoadShader(xenos::ShaderType shader_type,
                            const uint32_t* host_address, uint32_t dword_count);
   // Analyze shader microcode on the translator thread.
@@ -90,6 +106,9 @@ class VulkanPipelineCache {
       const PipelineLayoutProvider*& pipeline_layout_out);
 
  private:
+  // Update PipelineDescription::kVersion if any of the Pipeline* enums are
+  // changed!
+
   enum class PipelineGeometryShader : uint32_t {
     kNone,
     kPointList,
@@ -179,6 +198,8 @@ class VulkanPipelineCache {
     // Filled only for the attachments present in the render pass object.
     PipelineRenderTarget render_targets[xenos::kMaxColorRenderTargets];
 
+    static constexpr uint32_t kVersion = 0x20241016;
+
     // Including all the padding, for a stable hash.
     PipelineDescription() { Reset(); }
     PipelineDescription(const PipelineDescription& description) {
@@ -200,6 +221,56 @@ class VulkanPipelineCache {
     };
   });
 
+ public:
+  XEPACKEDSTRUCT(PipelineStoredDescription, {
+    uint64_t description_hash;
+    PipelineDescription description;
+  });
+
+  // Reading and writing of the storage files. They don't depend on the device
+  // (shader translation only needs its features), so they're implemented in
+  // vulkan_pipeline_storage.cc, which can be linked without the rest of the
+  // Vulkan backend.
+
+  // Reads the pipeline storage file header and the pipeline descriptions
+  // following it until the end or the first corrupted one, and gathers the
+  // <shader hash, modification bits> pairs that need to be translated for
+  // them. Returns the number of valid bytes in the file, or 0 if the header is
+  // missing or is for a different API or version.
+  static uint64_t ReadPipelineStorage(
+      FILE* file, bool edram_fragment_shader_interlock,
+      std::vector<PipelineStoredDescription>& descriptions_out,
+      std::set<std::pair<uint64_t, uint64_t>>& shader_translations_needed_out);
+  static void WritePipelineStorageHeader(FILE* file,
+                                         bool edram_fragment_shader_interlock);
+
+  // Reads the shader storage file header and the guest shaders following it
+  // until the end or the first corrupted one. load_shader is called on this
+  // thread for every shader, and may return nullptr to skip it. The
+  // modifications in shader_translations_needed of the returned shaders are
+  // analyzed and translated with translate_shader on up to
+  // max_translation_threads threads while the file is still being read, and
+  // the translations that have failed are appended to
+  // failed_translations_out. Returns the number of valid bytes in the file,
+  // or 0 if the header is missing or is for a different version.
+  static uint64_t ReadShaderStorage(
+      FILE* file,
+      const std::set<std::pair<uint64_t, uint64_t>>& shader_translations_needed,
+      const SpirvShaderTranslator::Features& translator_features,
+      bool native_2x_msaa_with_attachments, bool native_2x_msaa_no_attachments,
+      bool edram_fragment_shader_interlock, size_t max_translation_threads,
+      const std::function<SpirvShader*(xenos::ShaderType shader_type,
+                                       const uint32_t* ucode_dwords,
+                                       uint32_t ucode_dword_count,
+                                       uint64_t ucode_data_hash)>& load_shader,
+      const std::function<bool(SpirvShaderTranslator& translator,
+                               SpirvShader::SpirvTranslation& translation)>&
+          translate_shader,
+      std::vector<SpirvShader::SpirvTranslation*>& failed_translations_out);
+  static void WriteShaderStorageHeader(FILE* file);
+  static void WriteStoredShader(FILE* file, const Shader& shader);
+
+ private:
   struct Pipeline {
     VkPipeline pipeline = VK_NULL_HANDLE;
     // The layouts are owned by the VulkanCommandProcessor, and must not be
@@ -246,6 +317,10 @@ class VulkanPipelineCache {
     }
   };
 
+  VulkanShader* LoadShader(xenos::ShaderType shader_type,
+                           const uint32_t* host_address, uint32_t dword_count,
+                           uint64_t data_hash);
+
   // Can be called from multiple threads.
   bool TranslateAnalyzedShader(SpirvShaderTranslator& translator,
                                VulkanShader::VulkanTranslation& translation);
@@ -287,6 +362,8 @@ class VulkanPipelineCache {
   StringBuffer ucode_disasm_buffer_;
   // Reusable shader translator on the command processor thread.
   std::unique_ptr<SpirvShaderTranslator> shader_translator_;
+  // Initialized only if the translated SPIR-V needs to be optimized.
+  ui::vulkan::SpirvToolsContext spirv_tools_context_;
 
   struct LayoutUID {
     size_t uid;
@@ -324,6 +401,34 @@ class VulkanPipelineCache {
   // Previously used pipeline, to avoid lookups if the state wasn't changed.
   const std::pair<const PipelineDescription, Pipeline>* last_pipeline_ =
       nullptr;
+
+  // Currently open shader storage path.
+  std::filesystem::path shader_storage_cache_root_;
+  uint32_t shader_storage_title_id_ = 0;
+
+  // Shader storage output stream, for preload in the next emulator runs.
+  FILE* shader_storage_file_ = nullptr;
+  // For only writing shaders to the currently open storage once, incremented
+  // when switching the storage.
+  uint32_t shader_storage_index_ = 0;
+  bool shader_storage_file_flush_needed_ = false;
+
+  // Pipeline storage output stream, for preload in the next emulator runs.
+  FILE* pipeline_storage_file_ = nullptr;
+  bool pipeline_storage_file_flush_needed_ = false;
+
+  // Thread for asynchronous writing to the storage streams.
+  void StorageWriteThread();
+  std::mutex storage_write_request_lock_;
+  std::condition_variable storage_write_request_cond_;
+  // Storage thread input is protected with storage_write_request_lock_, and the
+  // thread is notified about its change via storage_write_request_cond_.
+  std::deque<const Shader*> storage_write_shader_queue_;
+  std::deque<PipelineStoredDescription> storage_write_pipeline_queue_;
+  bool storage_write_flush_shaders_ = false;
+  bool storage_write_flush_pipelines_ = false;
+  bool storage_write_thread_shutdown_ = false;
+  std::unique_ptr<xe::threading::Thread> storage_write_thread_;
 };
 
 }  // namespace vulkan
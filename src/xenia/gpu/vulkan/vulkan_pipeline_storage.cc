@@ -0,0 +1,317 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2024 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/gpu/vulkan/vulkan_pipeline_cache.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "xenia/base/assert.h"
+#include "xenia/base/byte_order.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/memory.h"
+#include "xenia/base/string_buffer.h"
+#include "xenia/base/threading.h"
+#include "xenia/base/xxhash.h"
+#include "xenia/gpu/shader_storage.h"
+
+namespace xe {
+namespace gpu {
+namespace vulkan {
+
+namespace {
+
+// 'XEPS'.
+constexpr uint32_t kPipelineStorageMagic = 0x53504558;
+// 'VKFS'.
+constexpr uint32_t kPipelineStorageMagicApiFragmentShaderInterlock = 0x53464B56;
+// 'VKRT'.
+constexpr uint32_t kPipelineStorageMagicApiHostRenderTargets = 0x54524B56;
+
+// The pipeline descriptions contain both the description fields and the
+// shader modification bits, so the file is invalidated when either of their
+// layouts changes. The two versions are stored separately, as they're not
+// comparable - one is a date, the other is a counter.
+struct PipelineStorageFileHeader {
+  uint32_t magic;
+  uint32_t magic_api;
+  uint32_t description_version_swapped;
+  uint32_t modification_version_swapped;
+};
+
+PipelineStorageFileHeader GetPipelineStorageFileHeader(
+    bool edram_fragment_shader_interlock, uint32_t description_version,
+    uint32_t modification_version) {
+  PipelineStorageFileHeader header;
+  header.magic = kPipelineStorageMagic;
+  header.magic_api = edram_fragment_shader_interlock
+                         ? kPipelineStorageMagicApiFragmentShaderInterlock
+                         : kPipelineStorageMagicApiHostRenderTargets;
+  header.description_version_swapped = xe::byte_swap(description_version);
+  header.modification_version_swapped = xe::byte_swap(modification_version);
+  return header;
+}
+
+}  // namespace
+
+uint64_t VulkanPipelineCache::ReadPipelineStorage(
+    FILE* file, bool edram_fragment_shader_interlock,
+    std::vector<PipelineStoredDescription>& descriptions_out,
+    std::set<std::pair<uint64_t, uint64_t>>& shader_translations_needed_out) {
+  descriptions_out.clear();
+
+  const PipelineStorageFileHeader expected_header =
+      GetPipelineStorageFileHeader(
+          edram_fragment_shader_interlock, PipelineDescription::kVersion,
+          SpirvShaderTranslator::Modification::kVersion);
+  PipelineStorageFileHeader header;
+  if (!fread(&header, sizeof(header), 1, file) ||
+      header.magic != expected_header.magic ||
+      header.magic_api != expected_header.magic_api ||
+      header.description_version_swapped !=
+          expected_header.description_version_swapped ||
+      header.modification_version_swapped !=
+          expected_header.modification_version_swapped) {
+    return 0;
+  }
+
+  xe::filesystem::Seek(file, 0, SEEK_END);
+  int64_t told_end = xe::filesystem::Tell(file);
+  size_t told_count =
+      size_t(told_end >= int64_t(sizeof(header))
+                 ? (uint64_t(told_end) - sizeof(header)) /
+                       sizeof(PipelineStoredDescription)
+                 : 0);
+  if (told_count &&
+      xe::filesystem::Seek(file, int64_t(sizeof(header)), SEEK_SET)) {
+    descriptions_out.resize(told_count);
+    descriptions_out.resize(fread(descriptions_out.data(),
+                                  sizeof(PipelineStoredDescription),
+                                  told_count, file));
+  }
+  size_t description_read_count = descriptions_out.size();
+  for (size_t i = 0; i < description_read_count; ++i) {
+    const PipelineStoredDescription& stored_description = descriptions_out[i];
+    // Validate file integrity, stop and truncate the stream if data is
+    // corrupted.
+    if (stored_description.description.GetHash() !=
+        stored_description.description_hash) {
+      descriptions_out.resize(i);
+      break;
+    }
+    // Mark the shader modifications as needed for translation.
+    shader_translations_needed_out.emplace(
+        stored_description.description.vertex_shader_hash,
+        stored_description.description.vertex_shader_modification);
+    if (stored_description.description.pixel_shader_hash) {
+      shader_translations_needed_out.emplace(
+          stored_description.description.pixel_shader_hash,
+          stored_description.description.pixel_shader_modification);
+    }
+  }
+  return sizeof(header) +
+         sizeof(PipelineStoredDescription) * descriptions_out.size();
+}
+
+void VulkanPipelineCache::WritePipelineStorageHeader(
+    FILE* file, bool edram_fragment_shader_interlock) {
+  const PipelineStorageFileHeader header = GetPipelineStorageFileHeader(
+      edram_fragment_shader_interlock, PipelineDescription::kVersion,
+      SpirvShaderTranslator::Modification::kVersion);
+  fwrite(&header, sizeof(header), 1, file);
+}
+
+uint64_t VulkanPipelineCache::ReadShaderStorage(
+    FILE* file,
+    const std::set<std::pair<uint64_t, uint64_t>>& shader_translations_needed,
+    const SpirvShaderTranslator::Features& translator_features,
+    bool native_2x_msaa_with_attachments, bool native_2x_msaa_no_attachments,
+    bool edram_fragment_shader_interlock, size_t max_translation_threads,
+    const std::function<SpirvShader*(xenos::ShaderType shader_type,
+                                     const uint32_t* ucode_dwords,
+                                     uint32_t ucode_dword_count,
+                                     uint64_t ucode_data_hash)>& load_shader,
+    const std::function<bool(SpirvShaderTranslator& translator,
+                             SpirvShader::SpirvTranslation& translation)>&
+        translate_shader,
+    std::vector<SpirvShader::SpirvTranslation*>& failed_translations_out) {
+  ShaderStorageFileHeader file_header;
+  if (!fread(&file_header, sizeof(file_header), 1, file) ||
+      file_header.magic != kShaderStorageMagic ||
+      xe::byte_swap(file_header.version_swapped) !=
+          ShaderStoredHeader::kVersion) {
+    return 0;
+  }
+  uint64_t valid_bytes = sizeof(file_header);
+  // Load and translate shaders written by previous Xenia executions until the
+  // end of the file or until a corrupted one is detected.
+  ShaderStoredHeader shader_header;
+  std::vector<uint32_t> ucode_dwords;
+  ucode_dwords.reserve(0xFFFF);
+
+  // Threads overlapping file reading.
+  std::mutex translation_thread_mutex;
+  std::condition_variable translation_thread_cond;
+  std::deque<SpirvShader*> shaders_to_translate;
+  size_t translation_threads_busy = 0;
+  bool translation_threads_shutdown = false;
+  std::mutex failed_translations_mutex;
+  auto translation_thread_function = [&]() {
+    StringBuffer ucode_disasm_buffer;
+    SpirvShaderTranslator translator(
+        translator_features, native_2x_msaa_with_attachments,
+        native_2x_msaa_no_attachments, edram_fragment_shader_interlock);
+    for (;;) {
+      SpirvShader* shader_to_translate;
+      for (;;) {
+        std::unique_lock<std::mutex> lock(translation_thread_mutex);
+        if (shaders_to_translate.empty()) {
+          if (translation_threads_shutdown) {
+            return;
+          }
+          translation_thread_cond.wait(lock);
+          continue;
+        }
+        shader_to_translate = shaders_to_translate.front();
+        shaders_to_translate.pop_front();
+        ++translation_threads_busy;
+        break;
+      }
+      if (!shader_to_translate->is_ucode_analyzed()) {
+        shader_to_translate->AnalyzeUcode(ucode_disasm_buffer);
+      }
+      // Translate each needed modification on this thread after performing
+      // modification-independent analysis of the whole shader.
+      uint64_t ucode_data_hash = shader_to_translate->ucode_data_hash();
+      for (auto modification_it = shader_translations_needed.lower_bound(
+               std::make_pair(ucode_data_hash, uint64_t(0)));
+           modification_it != shader_translations_needed.end() &&
+           modification_it->first == ucode_data_hash;
+           ++modification_it) {
+        auto translation = static_cast<SpirvShader::SpirvTranslation*>(
+            shader_to_translate->GetOrCreateTranslation(
+                modification_it->second));
+        // Only try (and report the failure) if it's a new translation. If
+        // it's a shader previously encountered in the game, translation of
+        // which has failed, and the shader storage is loaded later, keep it
+        // this way not to try to translate it again.
+        if (!translation->is_translated() &&
+            !translate_shader(translator, *translation)) {
+          std::lock_guard<std::mutex> lock(failed_translations_mutex);
+          failed_translations_out.push_back(translation);
+        }
+      }
+      {
+        std::lock_guard<std::mutex> lock(translation_thread_mutex);
+        --translation_threads_busy;
+      }
+    }
+  };
+  std::vector<std::unique_ptr<xe::threading::Thread>> translation_threads;
+  // At least one thread is needed for the translation to be done at all.
+  max_translation_threads = std::max(max_translation_threads, size_t(1));
+
+  while (true) {
+    if (!fread(&shader_header, sizeof(shader_header), 1, file)) {
+      break;
+    }
+    size_t ucode_byte_count =
+        shader_header.ucode_dword_count * sizeof(uint32_t);
+    ucode_dwords.resize(shader_header.ucode_dword_count);
+    if (shader_header.ucode_dword_count &&
+        !fread(ucode_dwords.data(), ucode_byte_count, 1, file)) {
+      break;
+    }
+    uint64_t ucode_data_hash =
+        XXH3_64bits(ucode_dwords.data(), ucode_byte_count);
+    if (shader_header.ucode_data_hash != ucode_data_hash) {
+      // Validation failed.
+      break;
+    }
+    valid_bytes += sizeof(shader_header) + ucode_byte_count;
+    SpirvShader* shader =
+        load_shader(shader_header.type, ucode_dwords.data(),
+                    shader_header.ucode_dword_count, ucode_data_hash);
+    if (!shader) {
+      continue;
+    }
+    // Create new threads if the currently existing threads can't keep up with
+    // file reading, but not more than the maximum.
+    size_t translation_threads_needed;
+    {
+      std::lock_guard<std::mutex> lock(translation_thread_mutex);
+      translation_threads_needed =
+          std::min(translation_threads_busy + shaders_to_translate.size() +
+                       size_t(1),
+                   max_translation_threads);
+    }
+    while (translation_threads.size() < translation_threads_needed) {
+      auto thread =
+          xe::threading::Thread::Create({}, translation_thread_function);
+      assert_not_null(thread);
+      thread->set_name("Shader Translation");
+      translation_threads.push_back(std::move(thread));
+    }
+    // Request ucode information gathering and translation of all the needed
+    // shaders.
+    {
+      std::lock_guard<std::mutex> lock(translation_thread_mutex);
+      shaders_to_translate.push_back(shader);
+    }
+    translation_thread_cond.notify_one();
+  }
+  if (!translation_threads.empty()) {
+    {
+      std::lock_guard<std::mutex> lock(translation_thread_mutex);
+      translation_threads_shutdown = true;
+    }
+    translation_thread_cond.notify_all();
+    for (auto& translation_thread : translation_threads) {
+      xe::threading::Wait(translation_thread.get(), false);
+    }
+    translation_threads.clear();
+  }
+  return valid_bytes;
+}
+
+void VulkanPipelineCache::WriteShaderStorageHeader(FILE* file) {
+  ShaderStorageFileHeader header;
+  header.magic = kShaderStorageMagic;
+  header.version_swapped = xe::byte_swap(ShaderStoredHeader::kVersion);
+  fwrite(&header, sizeof(header), 1, file);
+}
+
+void VulkanPipelineCache::WriteStoredShader(FILE* file, const Shader& shader) {
+  ShaderStoredHeader shader_header;
+  // Don't leak anything in unused bits.
+  std::memset(&shader_header, 0, sizeof(shader_header));
+  shader_header.ucode_data_hash = shader.ucode_data_hash();
+  shader_header.ucode_dword_count = shader.ucode_dword_count();
+  shader_header.type = shader.type();
+  fwrite(&shader_header, sizeof(shader_header), 1, file);
+  if (shader_header.ucode_dword_count) {
+    // Need to swap because the hash is calculated for the shader with guest
+    // endianness.
+    std::vector<uint32_t> ucode_guest_endian(shader_header.ucode_dword_count);
+    xe::copy_and_swap(ucode_guest_endian.data(), shader.ucode_dwords(),
+                      shader_header.ucode_dword_count);
+    fwrite(ucode_guest_endian.data(),
+           shader_header.ucode_dword_count * sizeof(uint32_t), 1, file);
+  }
+}
+
+}  // namespace vulkan
+}  // namespace gpu
+}  // namespace xe
@@ -14,6 +14,7 @@
 
 #include "xenia/gpu/spirv_shader.h"
 #include "xenia/gpu/xenos.h"
+#include "xenia/ui/vulkan/spirv_tools_context.h"
 #include "xenia/ui/vulkan/vulkan_provider.h"
 
 namespace xe {
@@ -28,6 +29,12 @@ class VulkanShader : public SpirvShader {
         : SpirvTranslation(shader, modification) {}
     ~VulkanTranslation() override;
 
+    // Replaces the translated SPIR-V with the optimized one. Must be called
+    // before the shader module is created. If optimization fails, the
+    // unoptimized SPIR-V is kept.
+    bool OptimizeTranslatedBinary(
+        const ui::vulkan::SpirvToolsContext& spirv_tools_context);
+
     VkShaderModule GetOrCreateShaderModule();
     VkShaderModule shader_module() const { return shader_module_; }
 
@@ -10,10 +10,18 @@
 #include "xenia/memory.h"
 
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
 #include <utility>
+#include <vector>
 
 #include "third_party/fmt/include/fmt/format.h"
+#include "third_party/snappy/snappy.h"
 #include "xenia/base/assert.h"
 #include "xenia/base/byte_stream.h"
 #include "xenia/base/clock.h"
@@ -21,6 +29,7 @@
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 #include "xenia/base/threading.h"
+#include "xenia/base/xxhash.h"
 
 #include "xenia/cpu/mmio_handler.h"
 
@@ -35,6 +44,117 @@ DEFINE_bool(scribble_heap, false,
             "Scribble 0xCD into all allocated heap memory.", "Memory");
 
 namespace xe {
+constexpr fourcc_t kMemorySaveSignature = make_fourcc("XMEM");
+
+class MemorySaveWorkers {
+ public:
+  MemorySaveWorkers() {
+    uint32_t thread_count =
+        std::max(xe::threading::logical_processor_count(), uint32_t(1)) - 1;
+    for (uint32_t i = 0; i < thread_count; ++i) {
+      auto thread =
+          xe::threading::Thread::Create({}, [this]() { WorkerThreadMain(); });
+      if (thread) {
+        threads_.push_back(std::move(thread));
+      }
+    }
+  }
+  ~MemorySaveWorkers() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      shutdown_ = true;
+    }
+    work_cond_.notify_all();
+    for (auto& thread : threads_) {
+      xe::threading::Wait(thread.get(), false);
+    }
+  }
+
+  // Calls function for every index in [0, count) on the worker threads and
+  // the calling thread, returns when all are done.
+  void ParallelFor(uint32_t count,
+                   const std::function<void(uint32_t index)>& function) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      function_ = &function;
+      count_ = count;
+      next_index_.store(0, std::memory_order_relaxed);
+      busy_thread_count_ = uint32_t(threads_.size());
+      ++generation_;
+    }
+    work_cond_.notify_all();
+    RunIndices(function, count);
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_cond_.wait(lock, [this]() { return !busy_thread_count_; });
+    function_ = nullptr;
+  }
+
+ private:
+  void RunIndices(const std::function<void(uint32_t index)>& function,
+                  uint32_t count) {
+    for (uint32_t index = next_index_.fetch_add(1, std::memory_order_relaxed);
+         index < count;
+         index = next_index_.fetch_add(1, std::memory_order_relaxed)) {
+      function(index);
+    }
+  }
+
+  void WorkerThreadMain() {
+    uint64_t done_generation = 0;
+    for (;;) {
+      const std::function<void(uint32_t index)>* function;
+      uint32_t count;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        work_cond_.wait(lock, [this, done_generation]() {
+          return shutdown_ || generation_ != done_generation;
+        });
+        if (shutdown_) {
+          return;
+        }
+        done_generation = generation_;
+        function = function_;
+        count = count_;
+      }
+      RunIndices(*function, count);
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!--busy_thread_count_) {
+        done_cond_.notify_one();
+      }
+    }
+  }
+
+  std::vector<std::unique_ptr<xe::threading::Thread>> threads_;
+  std::mutex mutex_;
+  std::condition_variable work_cond_;
+  std::condition_variable done_cond_;
+  const std::function<void(uint32_t index)>* function_ = nullptr;
+  uint32_t count_ = 0;
+  std::atomic<uint32_t> next_index_{0};
+  uint32_t busy_thread_count_ = 0;
+  uint64_t generation_ = 0;
+  bool shutdown_ = false;
+};
+
+// Identifies a memory snapshot, so incremental snapshots, which may be
+// restored in a later run, can verify the snapshot they're based on.
+static uint64_t GenerateSnapshotId() {
+  std::random_device random_device;
+  uint64_t id = (uint64_t(random_device()) << 32) ^ random_device() ^
+                Clock::QueryHostTickCount();
+  return id ? id : 1;
+}
+
+// Reads a value from a save state, which may be truncated.
+template <typename T>
+static bool ReadChecked(ByteStream* stream, T& value_out) {
+  if (stream->data_length() - stream->offset() < sizeof(T)) {
+    return false;
+  }
+  value_out = stream->Read<T>();
+  return true;
+}
+
 uint32_t get_page_count(uint32_t value, uint32_t page_size) {
   return xe::round_up(value, page_size) / page_size;
 }
@@ -672,25 +792,84 @@ void Memory::DumpMap() {
   XELOGE("");
 }
 
-bool Memory::Save(ByteStream* stream) {
+bool Memory::Save(ByteStream* stream, bool incremental) {
+  if (incremental && !saved_snapshot_id_) {
+    XELOGE("No memory snapshot to base an incremental one on");
+    return false;
+  }
   XELOGD("Serializing memory...");
-  heaps_.v00000000.Save(stream);
-  heaps_.v40000000.Save(stream);
-  heaps_.v80000000.Save(stream);
-  heaps_.v90000000.Save(stream);
-  heaps_.physical.Save(stream);
+  uint64_t snapshot_id = GenerateSnapshotId();
+  stream->Write(kMemorySaveSignature);
+  stream->Write(incremental);
+  stream->Write(snapshot_id);
+  if (incremental) {
+    stream->Write(saved_snapshot_id_);
+  }
+  // The workers are shared by all heaps, created once for the whole save.
+  MemorySaveWorkers workers;
+  heaps_.v00000000.Save(stream, incremental, false, &workers);
+  heaps_.v40000000.Save(stream, incremental, false, &workers);
+  heaps_.v80000000.Save(stream, incremental, false, &workers);
+  heaps_.v90000000.Save(stream, incremental, false, &workers);
+  heaps_.physical.Save(stream, incremental, false, &workers);
+  saved_snapshot_id_ = snapshot_id;
 
   return true;
 }
 
-bool Memory::Restore(ByteStream* stream) {
-  XELOGD("Restoring memory...");
-  heaps_.v00000000.Restore(stream);
-  heaps_.v40000000.Restore(stream);
-  heaps_.v80000000.Restore(stream);
-  heaps_.v90000000.Restore(stream);
-  heaps_.physical.Restore(stream);
+bool Memory::SaveFromForkedProcess(ByteStream* stream) {
+  stream->Write(kMemorySaveSignature);
+  stream->Write(false);
+  stream->Write(GenerateSnapshotId());
+  heaps_.v00000000.Save(stream, false, true);
+  heaps_.v40000000.Save(stream, false, true);
+  heaps_.v80000000.Save(stream, false, true);
+  heaps_.v90000000.Save(stream, false, true);
+  heaps_.physical.Save(stream, false, true);
+
+  return true;
+}
 
+bool Memory::Restore(ByteStream* stream, uint64_t current_snapshot_id,
+                     uint64_t* restored_snapshot_id) {
+  XELOGD("Restoring memory...");
+  uint32_t signature;
+  if (!ReadChecked(stream, signature) || signature != kMemorySaveSignature) {
+    XELOGE("Invalid memory snapshot signature");
+    return false;
+  }
+  bool incremental;
+  uint64_t snapshot_id;
+  if (!ReadChecked(stream, incremental) || !ReadChecked(stream, snapshot_id)) {
+    XELOGE("Truncated memory snapshot header");
+    return false;
+  }
+  if (incremental) {
+    uint64_t base_snapshot_id;
+    if (!ReadChecked(stream, base_snapshot_id)) {
+      XELOGE("Truncated memory snapshot header");
+      return false;
+    }
+    if (!current_snapshot_id || base_snapshot_id != current_snapshot_id) {
+      XELOGE(
+          "Memory snapshot {:016X} is incremental over {:016X}, which is not "
+          "the current memory state",
+          snapshot_id, base_snapshot_id);
+      return false;
+    }
+  }
+  // The hashes of the last Save are dropped by the heaps, so the next
+  // snapshot must be a full one.
+  saved_snapshot_id_ = 0;
+  if (!heaps_.v00000000.Restore(stream) ||
+      !heaps_.v40000000.Restore(stream) ||
+      !heaps_.v80000000.Restore(stream) ||
+      !heaps_.v90000000.Restore(stream) || !heaps_.physical.Restore(stream)) {
+    return false;
+  }
+  if (restored_snapshot_id) {
+    *restored_snapshot_id = snapshot_id;
+  }
   return true;
 }
 
@@ -800,75 +979,384 @@ void BaseHeap::DumpMap() {
   }
 }
 
-bool BaseHeap::Save(ByteStream* stream) {
-  XELOGD("Heap {:08X}-{:08X}", heap_base_, heap_base_ + (heap_size_ - 1));
+namespace {
 
-  for (size_t i = 0; i < page_table_.size(); i++) {
-    auto& page = page_table_[i];
-    stream->Write(page.qword);
-    if (!page.state) {
-      // Unallocated.
-      continue;
+// Pages are saved in chunks of 64, described by two page bit masks.
+constexpr uint32_t kSaveChunkPageCount = 64;
+// Chunks are compressed in parallel in batches, each batch written before the
+// next one is processed to bound the memory used by compressed data.
+constexpr uint32_t kSaveChunkBatchSize = 256;
+constexpr uint32_t kSaveChunkListEnd = UINT32_MAX;
+// Hash of pages containing only zeros, which aren't hashed or stored.
+constexpr uint64_t kZeroPageHash = 1;
+
+bool IsZeroPage(const void* data, size_t length) {
+  auto qwords = reinterpret_cast<const uint64_t*>(data);
+  for (size_t i = 0; i < length / sizeof(uint64_t); i += 32) {
+    uint64_t bits = 0;
+    for (size_t j = 0; j < 32; ++j) {
+      bits |= qwords[i + j];
     }
+    if (bits) {
+      return false;
+    }
+  }
+  return true;
+}
 
-    // TODO(DrChat): write compressed with snappy.
-    if (page.state & kMemoryAllocationCommit) {
-      void* addr = TranslateRelative(i * page_size_);
+void WriteCompressed(ByteStream* stream, const void* data, size_t length) {
+  std::vector<char> compressed(snappy::MaxCompressedLength(length));
+  size_t compressed_length;
+  snappy::RawCompress(reinterpret_cast<const char*>(data), length,
+                      compressed.data(), &compressed_length);
+  stream->Write(uint32_t(compressed_length));
+  stream->Write(compressed.data(), compressed_length);
+}
 
-      memory::PageAccess old_access;
-      memory::Protect(addr, page_size_, memory::PageAccess::kReadWrite,
-                      &old_access);
+bool ReadCompressed(ByteStream* stream, void* data, size_t length) {
+  uint32_t compressed_length;
+  if (!ReadChecked(stream, compressed_length) ||
+      compressed_length > stream->data_length() - stream->offset()) {
+    return false;
+  }
+  auto compressed =
+      reinterpret_cast<const char*>(stream->data() + stream->offset());
+  if (!length) {
+    return !compressed_length;
+  }
+  size_t uncompressed_length;
+  if (!snappy::GetUncompressedLength(compressed, compressed_length,
+                                     &uncompressed_length) ||
+      uncompressed_length != length ||
+      !snappy::RawUncompress(compressed, compressed_length,
+                             reinterpret_cast<char*>(data))) {
+    return false;
+  }
+  stream->Advance(compressed_length);
+  return true;
+}
+
+// Checks that data written by WriteCompressed decompresses to length bytes
+// without decompressing it, and skips it.
+bool SkipCompressed(ByteStream* stream, size_t length) {
+  uint32_t compressed_length;
+  if (!ReadChecked(stream, compressed_length) ||
+      compressed_length > stream->data_length() - stream->offset()) {
+    return false;
+  }
+  auto compressed =
+      reinterpret_cast<const char*>(stream->data() + stream->offset());
+  if (!length) {
+    return !compressed_length;
+  }
+  size_t uncompressed_length;
+  if (!snappy::GetUncompressedLength(compressed, compressed_length,
+                                     &uncompressed_length) ||
+      uncompressed_length != length ||
+      !snappy::IsValidCompressedBuffer(compressed, compressed_length)) {
+    return false;
+  }
+  stream->Advance(compressed_length);
+  return true;
+}
 
-      stream->Write(addr, page_size_);
+}  // namespace
 
-      memory::Protect(addr, page_size_, old_access, nullptr);
+bool BaseHeap::Save(ByteStream* stream, bool incremental, bool forked_process,
+                    MemorySaveWorkers* workers) {
+  if (!forked_process) {
+    XELOGD("Heap {:08X}-{:08X}", heap_base_, heap_base_ + (heap_size_ - 1));
+  }
+
+  uint32_t page_count = uint32_t(page_table_.size());
+  if (saved_page_hashes_.size() != page_count) {
+    saved_page_hashes_.clear();
+    saved_page_hashes_.resize(page_count, 0);
+  }
+
+  stream->Write(page_count);
+  WriteCompressed(stream, page_table_.data(), page_count * sizeof(PageEntry));
+
+  // Make the pages without read access temporarily readable, one range of
+  // pages with the same protection at a time rather than toggling the
+  // protection of every page.
+  auto is_unreadable = [this](uint32_t page_number) {
+    const PageEntry& page = page_table_[page_number];
+    return (page.state & kMemoryAllocationCommit) &&
+           !(page.current_protect & kMemoryProtectRead);
+  };
+  std::vector<std::pair<uint32_t, uint32_t>> unreadable_ranges;
+  for (uint32_t i = 0; i < page_count; ++i) {
+    if (!is_unreadable(i)) {
+      continue;
+    }
+    uint32_t range_end = i + 1;
+    while (range_end < page_count && is_unreadable(range_end) &&
+           page_table_[range_end].current_protect ==
+               page_table_[i].current_protect) {
+      ++range_end;
+    }
+    xe::memory::Protect(TranslateRelative(i * page_size_),
+                        (range_end - i) * page_size_,
+                        xe::memory::PageAccess::kReadOnly, nullptr);
+    unreadable_ranges.emplace_back(i, range_end - i);
+    i = range_end - 1;
+  }
+
+  std::vector<uint32_t> committed_chunks;
+  for (uint32_t i = 0; i < page_count; i += kSaveChunkPageCount) {
+    uint32_t chunk_end = std::min(i + kSaveChunkPageCount, page_count);
+    for (uint32_t j = i; j < chunk_end; ++j) {
+      if (page_table_[j].state & kMemoryAllocationCommit) {
+        committed_chunks.push_back(i / kSaveChunkPageCount);
+        break;
+      }
+      saved_page_hashes_[j] = 0;
+    }
+  }
+
+  struct SavedChunk {
+    uint64_t stored_mask;
+    uint64_t zero_mask;
+    std::vector<char> data;
+  };
+  std::vector<SavedChunk> saved_chunks(
+      std::min(uint32_t(committed_chunks.size()), kSaveChunkBatchSize));
+  std::atomic<uint32_t> stored_page_count(0), zero_page_count(0);
+  for (size_t batch_start = 0; batch_start < committed_chunks.size();
+       batch_start += kSaveChunkBatchSize) {
+    uint32_t batch_size =
+        std::min(uint32_t(committed_chunks.size() - batch_start),
+                 kSaveChunkBatchSize);
+    auto save_chunk = [&](uint32_t index) {
+      SavedChunk& saved_chunk = saved_chunks[index];
+      saved_chunk.stored_mask = 0;
+      saved_chunk.zero_mask = 0;
+      saved_chunk.data.clear();
+      uint32_t first_page =
+          committed_chunks[batch_start + index] * kSaveChunkPageCount;
+      uint32_t chunk_page_count =
+          std::min(kSaveChunkPageCount, page_count - first_page);
+      for (uint32_t i = 0; i < chunk_page_count; ++i) {
+        uint32_t page_number = first_page + i;
+        if (!(page_table_[page_number].state & kMemoryAllocationCommit)) {
+          saved_page_hashes_[page_number] = 0;
+          continue;
+        }
+        auto page_data = TranslateRelative(page_number * page_size_);
+        uint64_t hash = IsZeroPage(page_data, page_size_)
+                            ? kZeroPageHash
+                            : XXH3_64bits(page_data, page_size_);
+        if (incremental && saved_page_hashes_[page_number] == hash) {
+          continue;
+        }
+        saved_page_hashes_[page_number] = hash;
+        if (hash == kZeroPageHash) {
+          saved_chunk.zero_mask |= uint64_t(1) << i;
+        } else {
+          saved_chunk.stored_mask |= uint64_t(1) << i;
+        }
+      }
+      uint32_t chunk_stored_page_count = xe::bit_count(saved_chunk.stored_mask);
+      stored_page_count += chunk_stored_page_count;
+      zero_page_count += xe::bit_count(saved_chunk.zero_mask);
+      if (!chunk_stored_page_count) {
+        return;
+      }
+      // Gather the stored pages and compress them as a single block.
+      std::vector<uint8_t> uncompressed(chunk_stored_page_count * page_size_);
+      uint8_t* uncompressed_ptr = uncompressed.data();
+      uint64_t stored_mask = saved_chunk.stored_mask;
+      uint32_t i;
+      while (xe::bit_scan_forward(stored_mask, &i)) {
+        stored_mask &= stored_mask - 1;
+        std::memcpy(uncompressed_ptr,
+                    TranslateRelative((first_page + i) * page_size_),
+                    page_size_);
+        uncompressed_ptr += page_size_;
+      }
+      saved_chunk.data.resize(snappy::MaxCompressedLength(uncompressed.size()));
+      size_t compressed_length;
+      snappy::RawCompress(reinterpret_cast<const char*>(uncompressed.data()),
+                          uncompressed.size(), saved_chunk.data.data(),
+                          &compressed_length);
+      saved_chunk.data.resize(compressed_length);
+    };
+    if (workers) {
+      workers->ParallelFor(batch_size, save_chunk);
+    } else {
+      for (uint32_t i = 0; i < batch_size; ++i) {
+        save_chunk(i);
+      }
+    }
+    for (uint32_t i = 0; i < batch_size; ++i) {
+      const SavedChunk& saved_chunk = saved_chunks[i];
+      if (!saved_chunk.stored_mask && !saved_chunk.zero_mask) {
+        continue;
+      }
+      stream->Write(committed_chunks[batch_start + i] * kSaveChunkPageCount);
+      stream->Write(saved_chunk.stored_mask);
+      stream->Write(saved_chunk.zero_mask);
+      stream->Write(uint32_t(saved_chunk.data.size()));
+      stream->Write(saved_chunk.data.data(), saved_chunk.data.size());
     }
   }
+  stream->Write(kSaveChunkListEnd);
 
+  // Restore the protection the unreadable pages had before saving.
+  for (auto& range : unreadable_ranges) {
+    xe::memory::Protect(
+        TranslateRelative(range.first * page_size_), range.second * page_size_,
+        ToPageAccess(page_table_[range.first].current_protect), nullptr);
+  }
+
+  if (!forked_process) {
+    XELOGD("{} pages stored, {} zero pages", stored_page_count.load(),
+           zero_page_count.load());
+  }
   return true;
 }
 
 bool BaseHeap::Restore(ByteStream* stream) {
   XELOGD("Heap {:08X}-{:08X}", heap_base_, heap_base_ + (heap_size_ - 1));
 
-  for (size_t i = 0; i < page_table_.size(); i++) {
-    auto& page = page_table_[i];
-    page.qword = stream->Read<uint64_t>();
+  // Nothing is modified until the whole heap snapshot has been validated, so
+  // a truncated or corrupted one leaves the heap in a consistent state.
+  uint32_t page_count = uint32_t(page_table_.size());
+  uint32_t stored_page_count;
+  std::vector<PageEntry> page_table(page_count);
+  if (!ReadChecked(stream, stored_page_count) ||
+      stored_page_count != page_count ||
+      !ReadCompressed(stream, page_table.data(),
+                      page_count * sizeof(PageEntry))) {
+    XELOGE("Heap {:08X}-{:08X}: invalid page table", heap_base_,
+           heap_base_ + (heap_size_ - 1));
+    return false;
+  }
+  for (uint32_t i = 0; i < page_count; ++i) {
+    const PageEntry& page = page_table[i];
     if (!page.state) {
-      // Unallocated.
       continue;
     }
-
-    memory::PageAccess page_access = memory::PageAccess::kNoAccess;
-    if ((page.current_protect & kMemoryProtectRead) &&
-        (page.current_protect & kMemoryProtectWrite)) {
-      page_access = memory::PageAccess::kReadWrite;
-    } else if (page.current_protect & kMemoryProtectRead) {
-      page_access = memory::PageAccess::kReadOnly;
+    if (!(page.state & kMemoryAllocationReserve) || page.base_address > i ||
+        page.base_address + page.region_page_count <= i ||
+        page.base_address + page.region_page_count > page_count) {
+      XELOGE("Heap {:08X}-{:08X}: invalid page table entry for page {}",
+             heap_base_, heap_base_ + (heap_size_ - 1), i);
+      return false;
     }
+  }
 
-    // Commit the memory if it isn't already. We do not need to reserve any
-    // memory, as the mapping has already taken care of that.
-    if (page.state & kMemoryAllocationCommit) {
-      xe::memory::AllocFixed(TranslateRelative(i * page_size_), page_size_,
-                             memory::AllocationType::kCommit,
-                             memory::PageAccess::kReadWrite);
+  // Pages not in either mask of a chunk are left unchanged, as they're
+  // unmodified since the snapshot an incremental one is based on. Only
+  // committed pages may be written.
+  size_t chunks_offset = stream->offset();
+  for (;;) {
+    uint32_t first_page;
+    if (!ReadChecked(stream, first_page)) {
+      XELOGE("Heap {:08X}-{:08X}: truncated chunk list", heap_base_,
+             heap_base_ + (heap_size_ - 1));
+      return false;
+    }
+    if (first_page == kSaveChunkListEnd) {
+      break;
+    }
+    uint64_t stored_mask, zero_mask;
+    bool chunk_valid = ReadChecked(stream, stored_mask) &&
+                       ReadChecked(stream, zero_mask) &&
+                       !(first_page % kSaveChunkPageCount) &&
+                       first_page < page_count;
+    if (chunk_valid) {
+      uint32_t chunk_page_count =
+          std::min(kSaveChunkPageCount, page_count - first_page);
+      uint64_t committed_mask = 0;
+      for (uint32_t i = 0; i < chunk_page_count; ++i) {
+        if (page_table[first_page + i].state & kMemoryAllocationCommit) {
+          committed_mask |= uint64_t(1) << i;
+        }
+      }
+      size_t stored_length = size_t(xe::bit_count(stored_mask)) * page_size_;
+      chunk_valid = !((stored_mask | zero_mask) & ~committed_mask) &&
+                    SkipCompressed(stream, stored_length);
+    }
+    if (!chunk_valid) {
+      XELOGE("Heap {:08X}-{:08X}: invalid chunk at page {}", heap_base_,
+             heap_base_ + (heap_size_ - 1), first_page);
+      return false;
     }
+  }
 
-    // Now read into memory. We'll set R/W protection first, then set the
-    // protection back to its previous state.
-    // TODO(DrChat): read compressed with snappy.
-    if (page.state & kMemoryAllocationCommit) {
-      void* addr = TranslateRelative(i * page_size_);
-      xe::memory::Protect(addr, page_size_, memory::PageAccess::kReadWrite,
-                          nullptr);
+  std::memcpy(page_table_.data(), page_table.data(),
+              page_count * sizeof(PageEntry));
 
-      stream->Read(addr, page_size_);
+  // Commit the memory if it isn't already and make it writable for reading
+  // into it. We do not need to reserve any memory, as the mapping has already
+  // taken care of that.
+  for (uint32_t i = 0; i < page_count; ++i) {
+    if (!(page_table_[i].state & kMemoryAllocationCommit)) {
+      continue;
+    }
+    uint32_t range_end = i + 1;
+    while (range_end < page_count &&
+           (page_table_[range_end].state & kMemoryAllocationCommit)) {
+      ++range_end;
+    }
+    void* addr = TranslateRelative(i * page_size_);
+    size_t length = (range_end - i) * page_size_;
+    xe::memory::AllocFixed(addr, length, memory::AllocationType::kCommit,
+                           memory::PageAccess::kReadWrite);
+    xe::memory::Protect(addr, length, memory::PageAccess::kReadWrite, nullptr);
+    i = range_end;
+  }
+
+  // The chunks have been validated, so this doesn't fail.
+  stream->set_offset(chunks_offset);
+  std::vector<uint8_t> chunk_data;
+  for (;;) {
+    auto first_page = stream->Read<uint32_t>();
+    if (first_page == kSaveChunkListEnd) {
+      break;
+    }
+    auto stored_mask = stream->Read<uint64_t>();
+    auto zero_mask = stream->Read<uint64_t>();
+    chunk_data.resize(xe::bit_count(stored_mask) * page_size_);
+    ReadCompressed(stream, chunk_data.data(), chunk_data.size());
+    const uint8_t* chunk_data_ptr = chunk_data.data();
+    uint32_t i;
+    while (xe::bit_scan_forward(stored_mask, &i)) {
+      stored_mask &= stored_mask - 1;
+      std::memcpy(TranslateRelative((first_page + i) * page_size_),
+                  chunk_data_ptr, page_size_);
+      chunk_data_ptr += page_size_;
+    }
+    while (xe::bit_scan_forward(zero_mask, &i)) {
+      zero_mask &= zero_mask - 1;
+      std::memset(TranslateRelative((first_page + i) * page_size_), 0,
+                  page_size_);
+    }
+  }
 
-      xe::memory::Protect(addr, page_size_, page_access, nullptr);
+  // Set the protection back to the one in the page table.
+  for (uint32_t i = 0; i < page_count; ++i) {
+    const PageEntry& page = page_table_[i];
+    if (!(page.state & kMemoryAllocationCommit)) {
+      continue;
     }
+    uint32_t range_end = i + 1;
+    while (range_end < page_count &&
+           (page_table_[range_end].state & kMemoryAllocationCommit) &&
+           page_table_[range_end].current_protect == page.current_protect) {
+      ++range_end;
+    }
+    xe::memory::Protect(TranslateRelative(i * page_size_),
+                        (range_end - i) * page_size_,
+                        ToPageAccess(page.current_protect), nullptr);
+    i = range_end - 1;
   }
 
+  // The memory contents don't necessarily match the last Save anymore.
+  saved_page_hashes_.clear();
+
   return true;
 }
 
@@ -28,6 +28,8 @@ class ByteStream;
 namespace xe {
 
 class Memory;
+// Threads compressing the guest memory pages during Memory::Save.
+class MemorySaveWorkers;
 
 enum SystemHeapFlag : uint32_t {
   kSystemHeapVirtual = 1 << 0,
@@ -198,7 +200,14 @@ class BaseHeap {
   xe::memory::PageAccess QueryRangeAccess(uint32_t low_address,
                                           uint32_t high_address);
 
-  bool Save(ByteStream* stream);
+  // Writes the page table and the contents of the committed pages in chunks
+  // of 64 pages, compressed on the workers if provided, or on the calling
+  // thread otherwise. Zero pages aren't stored. If incremental, only pages
+  // modified since the previous Save are written, and the result must be
+  // restored on top of the previous snapshot. Nothing is logged in a forked
+  // process.
+  bool Save(ByteStream* stream, bool incremental = false,
+            bool forked_process = false, MemorySaveWorkers* workers = nullptr);
   bool Restore(ByteStream* stream);
 
   void Reset();
@@ -221,6 +230,9 @@ class BaseHeap {
   uint32_t unreserved_page_count_;
   xe::global_critical_region global_critical_region_;
   std::vector<PageEntry> page_table_;
+  // Hashes of the page contents as of the last Save, for incremental
+  // snapshots. 0 if not known.
+  std::vector<uint64_t> saved_page_hashes_;
 };
 
 // Normal heap allowing allocations from guest virtual address ranges.
@@ -536,8 +548,26 @@ class Memory {
   // Dumps a map of all allocated memory to the log.
   void DumpMap();
 
-  bool Save(ByteStream* stream);
-  bool Restore(ByteStream* stream);
+  // Saves the contents of all heaps. Every snapshot has a unique ID.
+  // Incremental snapshots only contain the pages modified since the previous
+  // Save (see BaseHeap::Save), and store the ID of that snapshot as their
+  // base. They can only be taken if saved_snapshot_id() is not 0.
+  bool Save(ByteStream* stream, bool incremental = false);
+  // Saves all heaps from a process forked from the emulator. Only the forking
+  // thread exists in it, and locks held by other threads at the time of the
+  // fork are never released, so this neither logs nor creates threads. The
+  // snapshot is always full, and it can't be the base of incremental ones, as
+  // the state needed for them stays in the forked process.
+  bool SaveFromForkedProcess(ByteStream* stream);
+  // Restores a snapshot. An incremental snapshot is only accepted if
+  // current_snapshot_id is its base, that is, if the memory contents are
+  // exactly the ones of the snapshot with that ID, as restored right before.
+  // The ID of the restored snapshot is returned in restored_snapshot_id.
+  bool Restore(ByteStream* stream, uint64_t current_snapshot_id = 0,
+               uint64_t* restored_snapshot_id = nullptr);
+  // ID of the snapshot written by the last Save, or 0 if the memory has been
+  // restored since then or nothing has been saved.
+  uint64_t saved_snapshot_id() const { return saved_snapshot_id_; }
 
   void SetMMIOExceptionRecordingCallback(cpu::MmioAccessRecordCallback callback,
                                          void* context);
@@ -599,6 +629,8 @@ class Memory {
   xe::global_critical_region global_critical_region_;
   std::vector<std::pair<PhysicalMemoryInvalidationCallback, void*>*>
       physical_memory_invalidation_callbacks_;
+
+  uint64_t saved_snapshot_id_ = 0;
 };
 
 }  // namespace xe
@@ -12,7 +12,9 @@
 #include <cstdlib>
 #include <filesystem>
 #include <string>
+#include <vector>
 
+#include "xenia/base/filesystem.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/platform.h"
 
@@ -26,6 +28,53 @@ namespace xe {
 namespace ui {
 namespace vulkan {
 
+SpirvToolsContext::Library SpirvToolsContext::OpenLibrary(
+    const std::filesystem::path& path) {
+#if XE_PLATFORM_LINUX
+  return dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+#elif XE_PLATFORM_WIN32
+  return LoadLibraryW(path.wstring().c_str());
+#else
+#error No SPIRV-Tools library loading provided for the target platform.
+#endif
+}
+
+void SpirvToolsContext::CloseLibrary(Library library) {
+#if XE_PLATFORM_LINUX
+  dlclose(library);
+#elif XE_PLATFORM_WIN32
+  FreeLibrary(library);
+#endif
+}
+
+bool SpirvToolsContext::LoadOptimizerFunctions(Library library) {
+  if (!LoadLibraryFunction(library, fn_spvOptimizerCreate_,
+                           "spvOptimizerCreate") ||
+      !LoadLibraryFunction(library, fn_spvOptimizerDestroy_,
+                           "spvOptimizerDestroy") ||
+      !LoadLibraryFunction(library, fn_spvOptimizerRegisterPassFromFlag_,
+                           "spvOptimizerRegisterPassFromFlag") ||
+      !LoadLibraryFunction(library, fn_spvOptimizerRun_, "spvOptimizerRun") ||
+      !LoadLibraryFunction(library, fn_spvOptimizerOptionsCreate_,
+                           "spvOptimizerOptionsCreate") ||
+      !LoadLibraryFunction(library, fn_spvOptimizerOptionsDestroy_,
+                           "spvOptimizerOptionsDestroy") ||
+      !LoadLibraryFunction(library, fn_spvOptimizerOptionsSetRunValidator_,
+                           "spvOptimizerOptionsSetRunValidator")) {
+    fn_spvOptimizerRun_ = nullptr;
+    return false;
+  }
+  // spvBinaryDestroy is in the core library, which SPIRV-Tools-opt depends on,
+  // but GetProcAddress doesn't look into the dependencies.
+  if (!LoadLibraryFunction(library, fn_spvBinaryDestroy_, "spvBinaryDestroy") &&
+      !LoadLibraryFunction(library_, fn_spvBinaryDestroy_,
+                           "spvBinaryDestroy")) {
+    fn_spvOptimizerRun_ = nullptr;
+    return false;
+  }
+  return true;
+}
+
 bool SpirvToolsContext::Initialize(unsigned int spirv_version) {
   const char* vulkan_sdk_env = std::getenv("VULKAN_SDK");
   if (!vulkan_sdk_env) {
@@ -35,8 +84,7 @@ bool SpirvToolsContext::Initialize(unsigned int spirv_version) {
   }
   std::filesystem::path vulkan_sdk_path(vulkan_sdk_env);
 #if XE_PLATFORM_LINUX
-  library_ = dlopen((vulkan_sdk_path / "bin/libSPIRV-Tools-shared.so").c_str(),
-                    RTLD_NOW | RTLD_LOCAL);
+  library_ = OpenLibrary(vulkan_sdk_path / "bin/libSPIRV-Tools-shared.so");
   if (!library_) {
     XELOGE(
         "SPIRV-Tools: Failed to load $VULKAN_SDK/bin/libSPIRV-Tools-shared.so");
@@ -44,8 +92,7 @@ bool SpirvToolsContext::Initialize(unsigned int spirv_version) {
     return false;
   }
 #elif XE_PLATFORM_WIN32
-  library_ = LoadLibraryW(
-      (vulkan_sdk_path / "Bin/SPIRV-Tools-shared.dll").wstring().c_str());
+  library_ = OpenLibrary(vulkan_sdk_path / "Bin/SPIRV-Tools-shared.dll");
   if (!library_) {
     XELOGE(
         "SPIRV-Tools: Failed to load %VULKAN_SDK%/Bin/SPIRV-Tools-shared.dll");
@@ -55,25 +102,64 @@ bool SpirvToolsContext::Initialize(unsigned int spirv_version) {
 #else
 #error No SPIRV-Tools library loading provided for the target platform.
 #endif
-  if (!LoadLibraryFunction(fn_spvContextCreate_, "spvContextCreate") ||
-      !LoadLibraryFunction(fn_spvContextDestroy_, "spvContextDestroy") ||
-      !LoadLibraryFunction(fn_spvValidateBinary_, "spvValidateBinary") ||
-      !LoadLibraryFunction(fn_spvDiagnosticDestroy_, "spvDiagnosticDestroy")) {
+  if (!LoadLibraryFunction(library_, fn_spvContextCreate_,
+                           "spvContextCreate") ||
+      !LoadLibraryFunction(library_, fn_spvContextDestroy_,
+                           "spvContextDestroy") ||
+      !LoadLibraryFunction(library_, fn_spvValidateBinary_,
+                           "spvValidateBinary") ||
+      !LoadLibraryFunction(library_, fn_spvDiagnosticDestroy_,
+                           "spvDiagnosticDestroy")) {
     XELOGE("SPIRV-Tools: Failed to get library function pointers");
     Shutdown();
     return false;
   }
-  spv_target_env target_env;
+  // The optimizer C API is implemented in SPIRV-Tools-opt, not in
+  // SPIRV-Tools-shared, and the Vulkan SDK only ships SPIRV-Tools-opt as a
+  // static library. Use a shared SPIRV-Tools-opt, such as the one from the
+  // SPIRV-Tools package of a Linux distribution, placed in the SDK or in the
+  // library search path, unless the loaded library includes the optimizer.
+  if (!LoadOptimizerFunctions(library_)) {
+#if XE_PLATFORM_LINUX
+    const std::filesystem::path optimizer_library_paths[] = {
+        vulkan_sdk_path / "lib/libSPIRV-Tools-opt.so",
+        "libSPIRV-Tools-opt.so",
+    };
+#elif XE_PLATFORM_WIN32
+    const std::filesystem::path optimizer_library_paths[] = {
+        vulkan_sdk_path / "Bin/SPIRV-Tools-opt.dll",
+        "SPIRV-Tools-opt.dll",
+    };
+#endif
+    for (const std::filesystem::path& path : optimizer_library_paths) {
+      optimizer_library_ = OpenLibrary(path);
+      if (!optimizer_library_) {
+        continue;
+      }
+      if (LoadOptimizerFunctions(optimizer_library_)) {
+        XELOGI("SPIRV-Tools: Using the optimizer from {}",
+               xe::path_to_utf8(path));
+        break;
+      }
+      CloseLibrary(optimizer_library_);
+      optimizer_library_ = nullptr;
+    }
+    if (!optimizer_library_) {
+      XELOGW(
+          "SPIRV-Tools: The SPIRV-Tools-opt shared library is unavailable, "
+          "SPIR-V optimization will be unavailable");
+    }
+  }
   if (spirv_version >= 0x10500) {
-    target_env = SPV_ENV_VULKAN_1_2;
+    target_env_ = SPV_ENV_VULKAN_1_2;
   } else if (spirv_version >= 0x10400) {
-    target_env = SPV_ENV_VULKAN_1_1_SPIRV_1_4;
+    target_env_ = SPV_ENV_VULKAN_1_1_SPIRV_1_4;
   } else if (spirv_version >= 0x10300) {
-    target_env = SPV_ENV_VULKAN_1_1;
+    target_env_ = SPV_ENV_VULKAN_1_1;
   } else {
-    target_env = SPV_ENV_VULKAN_1_0;
+    target_env_ = SPV_ENV_VULKAN_1_0;
   }
-  context_ = fn_spvContextCreate_(target_env);
+  context_ = fn_spvContextCreate_(target_env_);
   if (!context_) {
     XELOGE("SPIRV-Tools: Failed to create a Vulkan 1.0 context");
     Shutdown();
@@ -87,12 +173,13 @@ void SpirvToolsContext::Shutdown() {
     fn_spvContextDestroy_(context_);
     context_ = nullptr;
   }
+  fn_spvOptimizerRun_ = nullptr;
+  if (optimizer_library_) {
+    CloseLibrary(optimizer_library_);
+    optimizer_library_ = nullptr;
+  }
   if (library_) {
-#if XE_PLATFORM_LINUX
-    dlclose(library_);
-#elif XE_PLATFORM_WIN32
-    FreeLibrary(library_);
-#endif
+    CloseLibrary(library_);
     library_ = nullptr;
   }
 }
@@ -118,6 +205,57 @@ spv_result_t SpirvToolsContext::Validate(const uint32_t* words,
   return result;
 }
 
+spv_result_t SpirvToolsContext::Optimize(
+    const uint32_t* words, size_t num_words,
+    std::vector<uint32_t>& optimized_out) const {
+  optimized_out.clear();
+  if (!context_ || !IsOptimizerAvailable()) {
+    return SPV_UNSUPPORTED;
+  }
+  // Passes keep state while running, so an optimizer is created for every
+  // invocation to allow calling this from multiple threads.
+  static const char* const kPasses[] = {
+      // Promote function-local variables to SSA values.
+      "--eliminate-local-single-block",
+      "--eliminate-local-single-store",
+      "--ssa-rewrite",
+      "--eliminate-dead-code-aggressive",
+      // Fold and propagate constants, and remove the branches they make dead.
+      "--ccp",
+      "--simplify-instructions",
+      "--eliminate-dead-branches",
+      "--merge-blocks",
+      "--eliminate-dead-code-aggressive",
+  };
+  spv_optimizer_t* optimizer = fn_spvOptimizerCreate_(target_env_);
+  if (!optimizer) {
+    return SPV_ERROR_OUT_OF_MEMORY;
+  }
+  for (const char* pass : kPasses) {
+    if (!fn_spvOptimizerRegisterPassFromFlag_(optimizer, pass)) {
+      fn_spvOptimizerDestroy_(optimizer);
+      return SPV_ERROR_INVALID_LOOKUP;
+    }
+  }
+  spv_optimizer_options options = fn_spvOptimizerOptionsCreate_();
+  // The translator output is validated separately if needed.
+  fn_spvOptimizerOptionsSetRunValidator_(options, false);
+  spv_binary optimized_binary = nullptr;
+  spv_result_t result = fn_spvOptimizerRun_(optimizer, words, num_words,
+                                            &optimized_binary, options);
+  fn_spvOptimizerOptionsDestroy_(options);
+  fn_spvOptimizerDestroy_(optimizer);
+  if (optimized_binary) {
+    if (result == SPV_SUCCESS) {
+      optimized_out.assign(
+          optimized_binary->code,
+          optimized_binary->code + optimized_binary->wordCount);
+    }
+    fn_spvBinaryDestroy_(optimized_binary);
+  }
+  return result;
+}
+
 }  // namespace vulkan
 }  // namespace ui
 }  // namespace xe
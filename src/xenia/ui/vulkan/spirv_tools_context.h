@@ -11,7 +11,9 @@
 #define XENIA_UI_VULKAN_SPIRV_TOOLS_CONTEXT_H_
 
 #include <cstdint>
+#include <filesystem>
 #include <string>
+#include <vector>
 
 #include "third_party/SPIRV-Tools/include/spirv-tools/libspirv.h"
 #include "xenia/base/platform.h"
@@ -38,20 +40,38 @@ class SpirvToolsContext {
   spv_result_t Validate(const uint32_t* words, size_t num_words,
                         std::string* error) const;
 
+  // The optimizer is in a separate library, SPIRV-Tools-opt, which may be
+  // unavailable as a shared library.
+  bool IsOptimizerAvailable() const { return fn_spvOptimizerRun_ != nullptr; }
+  // Eliminates dead code, folds constants and promotes function-local
+  // variables to SSA values. Can be called from multiple threads.
+  spv_result_t Optimize(const uint32_t* words, size_t num_words,
+                        std::vector<uint32_t>& optimized_out) const;
+
  private:
 #if XE_PLATFORM_LINUX
-  void* library_ = nullptr;
+  using Library = void*;
 #elif XE_PLATFORM_WIN32
-  HMODULE library_ = nullptr;
+  using Library = HMODULE;
 #endif
+  static Library OpenLibrary(const std::filesystem::path& path);
+  static void CloseLibrary(Library library);
+
+  // Loads the optimizer functions from the library, or clears them and returns
+  // false if any is missing.
+  bool LoadOptimizerFunctions(Library library);
+
+  Library library_ = nullptr;
+  // SPIRV-Tools-opt if the optimizer is not in library_.
+  Library optimizer_library_ = nullptr;
 
   template <typename FunctionPointer>
-  bool LoadLibraryFunction(FunctionPointer& function, const char* name) {
+  static bool LoadLibraryFunction(Library library, FunctionPointer& function,
+                                  const char* name) {
 #if XE_PLATFORM_LINUX
-    function = reinterpret_cast<FunctionPointer>(dlsym(library_, name));
+    function = reinterpret_cast<FunctionPointer>(dlsym(library, name));
 #elif XE_PLATFORM_WIN32
-    function =
-        reinterpret_cast<FunctionPointer>(GetProcAddress(library_, name));
+    function = reinterpret_cast<FunctionPointer>(GetProcAddress(library, name));
 #else
 #error No SPIRV-Tools LoadLibraryFunction provided for the target platform.
 #endif
@@ -61,7 +81,19 @@ class SpirvToolsContext {
   decltype(&spvContextDestroy) fn_spvContextDestroy_ = nullptr;
   decltype(&spvValidateBinary) fn_spvValidateBinary_ = nullptr;
   decltype(&spvDiagnosticDestroy) fn_spvDiagnosticDestroy_ = nullptr;
+  decltype(&spvOptimizerCreate) fn_spvOptimizerCreate_ = nullptr;
+  decltype(&spvOptimizerDestroy) fn_spvOptimizerDestroy_ = nullptr;
+  decltype(&spvOptimizerRegisterPassFromFlag)
+      fn_spvOptimizerRegisterPassFromFlag_ = nullptr;
+  decltype(&spvOptimizerRun) fn_spvOptimizerRun_ = nullptr;
+  decltype(&spvOptimizerOptionsCreate) fn_spvOptimizerOptionsCreate_ = nullptr;
+  decltype(&spvOptimizerOptionsDestroy) fn_spvOptimizerOptionsDestroy_ =
+      nullptr;
+  decltype(&spvOptimizerOptionsSetRunValidator)
+      fn_spvOptimizerOptionsSetRunValidator_ = nullptr;
+  decltype(&spvBinaryDestroy) fn_spvBinaryDestroy_ = nullptr;
 
+  spv_target_env target_env_ = SPV_ENV_VULKAN_1_0;
   spv_context context_ = nullptr;
 };
 